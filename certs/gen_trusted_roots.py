@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020, Nuvoton Technology Corporation
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Generate trusted_roots.c, holding only the root CA certificates needed to reach DPS and IoT Hub.
+
+Certificates are picked by subject common name out of PEM bundles, e.g. the host's CA bundle:
+
+    $ python3 certs/gen_trusted_roots.py /etc/ssl/certs/ca-certificates.crt
+
+Expired certificates are refused. Requires the openssl command line tool.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+# Roots of the TLS server certificates of Azure IoT Hub and DPS, see:
+# https://learn.microsoft.com/azure/iot/iot-hub-tls-support
+DEFAULT_COMMON_NAMES = [
+    "DigiCert Global Root G2",
+    "Microsoft RSA Root Certificate Authority 2017",
+]
+
+PEM_RE = re.compile(r"-----BEGIN CERTIFICATE-----\s+.*?-----END CERTIFICATE-----", re.DOTALL)
+
+HEADER = """/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// GENERATED by certs/gen_trusted_roots.py.  Do not edit.
+
+#include "trusted_roots.h"
+
+const char trusted_roots[] =
+"""
+
+
+def openssl_x509(pem, *args):
+    return subprocess.run(["openssl", "x509", "-noout"] + list(args), input=pem.encode(),
+                          stdout=subprocess.PIPE, stderr=subprocess.PIPE, check=False)
+
+
+def common_name(pem):
+    out = openssl_x509(pem, "-subject", "-nameopt", "multiline").stdout.decode()
+    match = re.search(r"^\s*commonName\s*=\s*(.+?)\s*$", out, re.MULTILINE)
+    return match.group(1) if match else None
+
+
+def is_expired(pem):
+    return openssl_x509(pem, "-checkend", "0").returncode != 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("bundles", nargs="+", help="PEM files to pick certificates from")
+    parser.add_argument("--cn", action="append", dest="common_names",
+                        help="subject common name of a certificate to keep (repeatable; default: %s)" % DEFAULT_COMMON_NAMES)
+    parser.add_argument("-o", "--output", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "trusted_roots.c"))
+    args = parser.parse_args()
+
+    common_names = args.common_names or DEFAULT_COMMON_NAMES
+    found = {}
+    for bundle in args.bundles:
+        with open(bundle) as f:
+            for pem in PEM_RE.findall(f.read()):
+                name = common_name(pem)
+                if name in common_names and name not in found:
+                    found[name] = pem
+
+    missing = [name for name in common_names if name not in found]
+    if missing:
+        sys.exit("Certificates not found: %s" % ", ".join(missing))
+    expired = [name for name in common_names if is_expired(found[name])]
+    if expired:
+        sys.exit("Certificates expired: %s" % ", ".join(expired))
+
+    with open(args.output, "w", newline="\n") as out:
+        out.write(HEADER)
+        for name in common_names:
+            out.write("/* %s */\n" % name)
+            for line in found[name].splitlines():
+                out.write("\"%s\\r\\n\"\n" % line.strip())
+        out.write(";\n")
+
+    print("Wrote %d certificates to %s" % (len(common_names), args.output))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header provides the root CA certificates trusted for TLS with DPS and IoT Hub.
+//
+// Unlike "certificates" of the Azure IoT C SDK, which bundles every root Azure has used, this only holds the roots
+// currently needed, so that mbedTLS has less PEM to copy and parse into X.509 structures on every connection.
+// It is generated by gen_trusted_roots.py.
+
+#ifndef TRUSTED_ROOTS_H
+#define TRUSTED_ROOTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// trusted_roots is a NULL-terminated string of PEM certificates, to pass as OPTION_TRUSTED_CERT.
+//
+extern const char trusted_roots[];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRUSTED_ROOTS_H */
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include "mbed.h"
+#include "I2CBus.h"
+
+I2CBus *I2CBus::_first_bus = NULL;
+
+I2CBus::I2CBus(PinName p_sda, PinName p_scl) :
+    _i2c_p(new I2C(p_sda, p_scl)), _i2c(*_i2c_p)
+{
+    initialize();
+}
+
+I2CBus::I2CBus(I2C &p_i2c) :
+    _i2c_p(NULL), _i2c(p_i2c)
+{
+    initialize();
+}
+
+I2CBus::~I2CBus()
+{
+    {
+        CriticalSectionLock lock;
+        I2CBus **link = &_first_bus;
+
+        while (*link != this) {
+            link = &(*link)->_next_bus;
+        }
+        *link = _next_bus;
+    }
+
+    delete _i2c_p;
+}
+
+void I2CBus::initialize(void)
+{
+    for (int i = 0; i < I2CBUS_NUM_PRIORITIES; i++) {
+        _head[i] = NULL;
+        _tail[i] = NULL;
+    }
+    _active = NULL;
+    memset(_stats, 0, sizeof(_stats));
+    _num_devices = 0;
+#if DEVICE_I2C_ASYNCH
+    // Built here, in thread context, as building it starts its thread
+    _dispatch_queue = mbed_highprio_event_queue();
+#endif
+
+    CriticalSectionLock lock;
+    _next_bus = _first_bus;
+    _first_bus = this;
+}
+
+/////////////// Devices ///////////////////////////////////
+int I2CBus::attach(const char *name)
+{
+    CriticalSectionLock lock;
+
+    if (_num_devices >= I2CBUS_MAX_DEVICES) {
+        return -1;
+    }
+
+    _stats[_num_devices].name = name;
+    _attached_ms[_num_devices] = Kernel::Clock::now().time_since_epoch().count();
+
+    return _num_devices++;
+}
+
+/////////////// Transactions //////////////////////////////
+int I2CBus::transfer(int device, int address, const char *tx, int tx_length, char *rx, int rx_length, I2CBus_Priority priority)
+{
+    Transaction t;
+
+    if ((device < 0) || (device >= _num_devices) || (priority >= I2CBUS_NUM_PRIORITIES)) {
+        return -1;
+    }
+
+    t.device = device;
+    t.address = address;
+    t.tx = tx;
+    t.tx_length = tx_length;
+    t.tx_pairs = 0;
+    t.rx = rx;
+    t.rx_length = rx_length;
+
+    return run(&t, priority);
+}
+
+int I2CBus::write_regs(int device, int address, const uint8_t *pairs, int num_regs, I2CBus_Priority priority)
+{
+    Transaction t;
+
+    if ((device < 0) || (device >= _num_devices) || (priority >= I2CBUS_NUM_PRIORITIES) || (num_regs <= 0)) {
+        return -1;
+    }
+
+    t.device = device;
+    t.address = address;
+    t.tx = (const char *)pairs;
+    t.tx_length = num_regs * 2;
+    t.tx_pairs = num_regs;
+    t.rx = NULL;
+    t.rx_length = 0;
+
+    return run(&t, priority);
+}
+
+int I2CBus::run(Transaction *t, I2CBus_Priority priority)
+{
+    t->result = -1;
+
+    enqueue(t, priority);
+    dispatch();
+
+    t->done.acquire();
+
+    // In case the end of an asynchronous transfer could not defer dispatch, the event queue being full
+    dispatch();
+
+    return t->result;
+}
+
+int I2CBus::write_reg(int device, int address, uint8_t reg, uint8_t data, I2CBus_Priority priority)
+{
+    char dt[2];
+
+    dt[0] = reg;
+    dt[1] = data;
+
+    return transfer(device, address, dt, 2, NULL, 0, priority);
+}
+
+int I2CBus::read_regs(int device, int address, uint8_t reg, char *data, int length, I2CBus_Priority priority)
+{
+    char dt = reg;
+
+    return transfer(device, address, &dt, 1, data, length, priority);
+}
+
+void I2CBus::enqueue(Transaction *t, I2CBus_Priority priority)
+{
+    CriticalSectionLock lock;
+
+    t->next = NULL;
+    t->queued_us = ticker_read_us(get_us_ticker_data());
+    if (_tail[priority] != NULL) {
+        _tail[priority]->next = t;
+    } else {
+        _head[priority] = t;
+    }
+    _tail[priority] = t;
+}
+
+I2CBus::Transaction *I2CBus::take_next(void)
+{
+    CriticalSectionLock lock;
+
+    if (_active != NULL) {
+        return NULL;
+    }
+
+    for (int i = 0; i < I2CBUS_NUM_PRIORITIES; i++) {
+        Transaction *t = _head[i];
+
+        if (t != NULL) {
+            _head[i] = t->next;
+            if (_head[i] == NULL) {
+                _tail[i] = NULL;
+            }
+            _active = t;
+            return t;
+        }
+    }
+
+    return NULL;
+}
+
+void I2CBus::dispatch(void)
+{
+    Transaction *t;
+
+    // Blocking transfers run here, one after another.  An asynchronous one leaves the bus busy, which ends the loop.
+    while ((t = take_next()) != NULL) {
+        start(t);
+    }
+}
+
+void I2CBus::start(Transaction *t)
+{
+    t->started_us = ticker_read_us(get_us_ticker_data());
+
+    if (t->tx_pairs > 0) {
+        // Blocking even with asynchronous transfers, as configuration is short and not time-critical
+        int result = 0;
+
+        for (int i = 0; (i < t->tx_pairs) && (result == 0); i++) {
+            result = _i2c.write(t->address, &t->tx[i * 2], 2, false);
+        }
+        finish(t, result);
+        return;
+    }
+
+#if DEVICE_I2C_ASYNCH
+    // A repeated start separates writing from reading
+    if (_i2c.transfer(t->address, t->tx, t->tx_length, t->rx, t->rx_length,
+                      callback(this, &I2CBus::on_transfer_done), I2C_EVENT_ALL, false) != 0) {
+        finish(t, -1);
+    }
+#else
+    int result = 0;
+
+    if (t->tx_length > 0) {
+        result = _i2c.write(t->address, t->tx, t->tx_length, t->rx_length > 0);
+    }
+    if ((result == 0) && (t->rx_length > 0)) {
+        result = _i2c.read(t->address, t->rx, t->rx_length, false);
+    }
+    finish(t, result);
+#endif
+}
+
+#if DEVICE_I2C_ASYNCH
+void I2CBus::on_transfer_done(int event)
+{
+    finish(_active, (event & I2C_EVENT_TRANSFER_COMPLETE) ? 0 : -1);
+
+    // Start the next one at high priority, rather than leave it to the woken owner, which may be a low-priority thread
+    // preempted by the very threads whose transactions are queued.  Should posting fail, the owner dispatches.
+    _dispatch_queue->call(this, &I2CBus::dispatch);
+}
+#endif
+
+void I2CBus::finish(Transaction *t, int result)
+{
+    // The 64-bit ticker, in microseconds, as the raw one wraps in seconds on some targets
+    uint64_t now_us = ticker_read_us(get_us_ticker_data());
+    uint32_t wait_us = (uint32_t)(t->started_us - t->queued_us);
+
+    {
+        CriticalSectionLock lock;
+        I2CBus_DeviceStats *stats = &_stats[t->device];
+
+        stats->transactions++;
+        if (result != 0) {
+            stats->errors++;
+        }
+        stats->bytes += t->tx_length + t->rx_length;
+        stats->busy_us += now_us - t->started_us;
+        stats->wait_us += wait_us;
+        if (wait_us > stats->max_wait_us) {
+            stats->max_wait_us = wait_us;
+        }
+
+        _active = NULL;
+    }
+
+    t->result = result;
+    t->done.release();
+}
+
+/////////////// I2C Freq. /////////////////////////////////
+void I2CBus::frequency(int hz)
+{
+    _i2c.frequency(hz);
+}
+
+/////////////// Statistics ////////////////////////////////
+size_t I2CBus::get_stats_each(I2CBus_DeviceStats *stats, size_t count)
+{
+    uint64_t now_ms = Kernel::Clock::now().time_since_epoch().count();
+    size_t filled = 0;
+
+    CriticalSectionLock lock;
+
+    for (I2CBus *bus = _first_bus; bus != NULL; bus = bus->_next_bus) {
+        for (int i = 0; (i < bus->_num_devices) && (filled < count); i++) {
+            stats[filled] = bus->_stats[i];
+            stats[filled].elapsed_us = (now_ms - bus->_attached_ms[i]) * 1000;
+            filled++;
+        }
+    }
+
+    return filled;
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Shared I2C bus manager.  Drivers of the devices on one bus submit their transactions to one I2CBus, rather than each
+// driving an I2C object of its own.  Transactions are queued by priority, then in order of submission, and run back-to-back:
+// whichever thread finds the bus free starts the next one queued.
+// The calling thread blocks until its transaction is over, so drivers keep their simple read-then-use style, but no
+// buffer of theirs is touched by another thread.
+//
+// With DEVICE_I2C_ASYNCH, transfers use the asynchronous API of I2C, and the CPU may sleep for their duration.  When one
+// ends, the next queued is started from the shared high-priority event queue, not by the thread whose transfer ended,
+// which only dispatches should that fail.
+// Otherwise, they are blocking transfers, run by the thread that takes the bus.
+//
+// Bus time and queueing delay are accounted per attached device; see I2CBus::get_stats_each.
+
+#ifndef I2CBUS_H
+#define I2CBUS_H
+
+#include "mbed.h"
+
+// Maximum number of devices attached to one bus
+#define I2CBUS_MAX_DEVICES 8
+
+////////////// DATA TYPE DEFINITION ///////////////////////
+typedef enum {
+    I2CBUS_PRIORITY_HIGH = 0,   // Time-critical, e.g. samples on data-ready
+    I2CBUS_PRIORITY_NORMAL,     // Periodic reads
+    I2CBUS_PRIORITY_LOW,        // Configuration
+    I2CBUS_NUM_PRIORITIES
+} I2CBus_Priority;
+
+typedef struct {
+    const char *name;           // Name the device was attached with
+    uint32_t transactions;      // Transactions run
+    uint32_t errors;            // Transactions NACKed or failed
+    uint32_t bytes;             // Bytes written and read
+    uint64_t busy_us;           // Bus time of its transactions
+    uint64_t wait_us;           // Total time its transactions were queued behind others
+    uint32_t max_wait_us;       // Longest time one of them was queued
+    uint64_t elapsed_us;        // Time since the device was attached, to relate busy_us to
+} I2CBus_DeviceStats;
+
+/** Shared I2C bus with transaction scheduling
+ * @code
+ * I2CBus bus(I2C_SDA, I2C_SCL);
+ * int acc = bus.attach("acc");
+ *
+ * char reg = 0x02;
+ * char data[6];
+ * bus.transfer(acc, 0x18 << 1, &reg, 1, data, 6);
+ * @endcode
+ */
+class I2CBus
+{
+public:
+    /** Create a bus on pins
+      * @param SDA and SCL pins
+      */
+    I2CBus(PinName p_sda, PinName p_scl);
+
+    /** Create a bus on an existing I2C object, which must not be used otherwise
+      * @param I2C previous definition
+      */
+    I2CBus(I2C &p_i2c);
+
+    ~I2CBus();
+
+    /** Attach a device, for accounting
+      * @param name of the device, which must outlive the bus
+      * @return device handle, or -1 if I2CBUS_MAX_DEVICES are attached already
+      */
+    int attach(const char *name);
+
+    /** Write tx_length bytes then, with a repeated start, read rx_length bytes.  Either may be 0.  Blocks until done.
+      * @param device handle from attach()
+      * @param 8-bit I2C address
+      * @param data to write, and its length
+      * @param buffer to read into, and its length
+      * @param priority of the transaction
+      * @return 0 on success (ACK), nonzero on failure
+      */
+    int transfer(int device, int address, const char *tx, int tx_length, char *rx, int rx_length,
+                 I2CBus_Priority priority = I2CBUS_PRIORITY_NORMAL);
+
+    /** Write one register
+      * @return 0 on success (ACK), nonzero on failure
+      */
+    int write_reg(int device, int address, uint8_t reg, uint8_t data, I2CBus_Priority priority = I2CBUS_PRIORITY_LOW);
+
+    /** Write registers given as num_regs (register, data) pairs, back to back in one turn on the bus
+      * Each pair is an I2C write of its own, so this suits chips without multi-byte writes.  Nothing else gets in between.
+      * @return 0 on success (ACK), nonzero on the first failure
+      */
+    int write_regs(int device, int address, const uint8_t *pairs, int num_regs, I2CBus_Priority priority = I2CBUS_PRIORITY_LOW);
+
+    /** Read length registers from reg on, in one transaction
+      * @return 0 on success (ACK), nonzero on failure
+      */
+    int read_regs(int device, int address, uint8_t reg, char *data, int length, I2CBus_Priority priority = I2CBUS_PRIORITY_NORMAL);
+
+    /** Set I2C clock frequency
+      * @param freq.
+      */
+    void frequency(int hz);
+
+    /** Get statistics of every device attached to every bus, like mbed_stats_stack_get_each
+      * @param array to fill, and its size
+      * @return number of entries filled
+      */
+    static size_t get_stats_each(I2CBus_DeviceStats *stats, size_t count);
+
+private:
+    struct Transaction {
+        Transaction *next;
+        int device;
+        int address;
+        const char *tx;
+        int tx_length;
+        int tx_pairs;       // tx is this many (register, data) pairs to write one by one, if nonzero
+        char *rx;
+        int rx_length;
+        uint64_t queued_us;
+        uint64_t started_us;
+        volatile int result;
+        Semaphore done;
+
+        Transaction() : done(0) {}
+    };
+
+    void initialize(void);
+    int run(Transaction *t, I2CBus_Priority priority);
+    void enqueue(Transaction *t, I2CBus_Priority priority);
+    Transaction *take_next(void);
+    void dispatch(void);
+    void start(Transaction *t);
+    void finish(Transaction *t, int result);
+#if DEVICE_I2C_ASYNCH
+    void on_transfer_done(int event);
+#endif
+
+    I2C *_i2c_p;
+    I2C &_i2c;
+
+    // Queued transactions, by priority.  Guarded by a critical section, as transfers end in interrupt context.
+    Transaction *_head[I2CBUS_NUM_PRIORITIES];
+    Transaction *_tail[I2CBUS_NUM_PRIORITIES];
+    // Transaction on the bus, or NULL if the bus is free
+    Transaction *_active;
+#if DEVICE_I2C_ASYNCH
+    // Shared high-priority event queue, which the end of a transfer defers dispatch to
+    EventQueue *_dispatch_queue;
+#endif
+
+    // Accounting, per device
+    I2CBus_DeviceStats _stats[I2CBUS_MAX_DEVICES];
+    uint64_t _attached_ms[I2CBUS_MAX_DEVICES];
+    int _num_devices;
+
+    // All buses, for get_stats_each
+    I2CBus *_next_bus;
+    static I2CBus *_first_bus;
+};
+
+#endif      // I2CBUS_H
@@ -15,6 +15,11 @@
 
 #define DEBUG 0
 
+// MAG compensation results and raw data telling overflow
+#define BMX055_MAG_OVERFLOW         (-32768)
+#define BMX055_MAG_XY_OVERFLOW_ADC  (-4096)
+#define BMX055_MAG_Z_OVERFLOW_ADC   (-16384)
+
 #if MBED_MAJOR_VERSION == 2
 #define WAIT_MS(x)       wait_ms(x)
 #elif  MBED_MAJOR_VERSION == 5
@@ -25,16 +30,36 @@
 #error "Running on Unknown OS"
 #endif
 
-BMX055::BMX055 (PinName p_sda, PinName p_scl):
-    _i2c_p(new I2C(p_sda, p_scl)), _i2c(*_i2c_p)
+BMX055::BMX055 (PinName p_sda, PinName p_scl, const BMX055_ADDR_INF_TypeDef *p_addr_hint):
+    _bus_p(new I2CBus(p_sda, p_scl)), _bus(*_bus_p),
+    _acc_int(NULL), _gyr_int(NULL)
 {
     bmx055_parameters = bmx055_std_paramtr;
+    bmx055_int = bmx055_no_int;
+    bmx055_engine = bmx055_no_engine;
+    set_addr_hint(p_addr_hint);
     initialize ();
 }
 
-BMX055::BMX055 (I2C& p_i2c) :
-    _i2c(p_i2c)
+BMX055::BMX055 (I2C& p_i2c, const BMX055_ADDR_INF_TypeDef *p_addr_hint) :
+    _bus_p(new I2CBus(p_i2c)), _bus(*_bus_p),
+    _acc_int(NULL), _gyr_int(NULL)
 {
+    bmx055_parameters = bmx055_std_paramtr;
+    bmx055_int = bmx055_no_int;
+    bmx055_engine = bmx055_no_engine;
+    set_addr_hint(p_addr_hint);
+    initialize ();
+}
+
+BMX055::BMX055 (I2CBus& p_bus, const BMX055_ADDR_INF_TypeDef *p_addr_hint) :
+    _bus_p(NULL), _bus(p_bus),
+    _acc_int(NULL), _gyr_int(NULL)
+{
+    bmx055_parameters = bmx055_std_paramtr;
+    bmx055_int = bmx055_no_int;
+    bmx055_engine = bmx055_no_engine;
+    set_addr_hint(p_addr_hint);
     initialize ();
 }
 
@@ -49,13 +74,9 @@ void BMX055::set_parameter(const BMX055_TypeDef *bmx055_parameter)
 /////////////// Read data & normalize /////////////////////
 void BMX055::get_accel(BMX055_ACCEL_TypeDef *acc)
 {
-    int16_t x,y,z;
-    float factor = 2.0f;
+    char dt[6] = {0};
 
-    chip_addr = inf_addr.acc_addr;
-    dt[0] = 0x02;
-    _i2c.write(chip_addr, dt, 1, true);
-    _i2c.read(chip_addr, dt, 6, false);
+    _bus.read_regs(_acc_dev, inf_addr.acc_addr, 0x02, dt, 6);
 #if DEBUG
     printf("Read ACC data-> ");
     for (uint32_t i = 0; i < 6; i++){
@@ -63,26 +84,34 @@ void BMX055::get_accel(BMX055_ACCEL_TypeDef *acc)
     }
     printf(", all\r\n");
 #endif
-    x = dt[1] << 8 | (dt[0] & 0xf0);
-    y = dt[3] << 8 | (dt[2] & 0xf0);
-    z = dt[5] << 8 | (dt[4] & 0xf0);
+    convert_accel(dt, acc);
+}
+
+float BMX055::acc_range_g(void)
+{
     switch(bmx055_parameters.acc_fs){
         case ACC_2G:
-            factor = 2.0f;
-            break;
+            return 2.0f;
         case ACC_4G:
-            factor = 4.0f;
-            break;
+            return 4.0f;
         case ACC_8G:
-            factor = 8.0f;
-            break;
+            return 8.0f;
         case ACC_16G:
-            factor = 16.0f;
-            break;
+            return 16.0f;
         default:
-            factor = 0;
-            break;
+            return 0;
     }
+}
+
+void BMX055::convert_accel(const char *dt, BMX055_ACCEL_TypeDef *acc)
+{
+    int16_t x,y,z;
+    float factor = 2.0f;
+
+    x = dt[1] << 8 | (dt[0] & 0xf0);
+    y = dt[3] << 8 | (dt[2] & 0xf0);
+    z = dt[5] << 8 | (dt[4] & 0xf0);
+    factor = acc_range_g();
     acc->x = (double)x * factor / 2048.0f / 16.0f;
     acc->y = (double)y * factor / 2048.0f / 16.0f;
     acc->z = (double)z * factor / 2048.0f / 16.0f;
@@ -90,13 +119,9 @@ void BMX055::get_accel(BMX055_ACCEL_TypeDef *acc)
 
 void BMX055::get_gyro(BMX055_GYRO_TypeDef *gyr)
 {
-    int16_t x,y,z;
-    float factor = 2.0f;
+    char dt[6] = {0};
 
-    chip_addr = inf_addr.gyr_addr;
-    dt[0] = 0x02;
-    _i2c.write(chip_addr, dt, 1, true);
-    _i2c.read(chip_addr, dt, 6, false);
+    _bus.read_regs(_gyr_dev, inf_addr.gyr_addr, 0x02, dt, 6);
 #if DEBUG
     printf("Read MAG data-> ");
     for (uint32_t i = 0; i < 6; i++){
@@ -104,97 +129,179 @@ void BMX055::get_gyro(BMX055_GYRO_TypeDef *gyr)
     }
     printf(", all\r\n");
 #endif
-    x = dt[1] << 8 | dt[0];
-    y = dt[3] << 8 | dt[2];
-    z = dt[5] << 8 | dt[4];
-#if 0
-    switch(bmx055_parameters.gyr_fs){
-        case GYR_2000DPS:
-            factor = 1998.0f;
-            break;
-        case GYR_1000DPS:
-            factor = 999.0f;
-            break;
-        case GYR_500DPS:
-            factor = 499.5f;
-            break;
-        case GYR_250DPS:
-            factor = 249.75f;
-            break;
-        case GYR_125DPS:
-            factor = 124.87f;
-            break;
-        default:
-            factor = 0;
-            break;
-    }
-    gyr->x = (double)x * factor / 32768.0f / 16.0f;
-    gyr->y = (double)y * factor / 32768.0f / 16.0f;
-    gyr->z = (double)z * factor / 32768.0f / 16.0f;
-#else
+    convert_gyro(dt, gyr);
+}
+
+float BMX055::gyr_range_dps(void)
+{
     switch(bmx055_parameters.gyr_fs){
         case GYR_2000DPS:
-            factor = 61.0f;
-            break;
+            return 2000.0f;
         case GYR_1000DPS:
-            factor = 30.5f;
-            break;
+            return 1000.0f;
         case GYR_500DPS:
-            factor = 15.3;
-            break;
+            return 500.0f;
         case GYR_250DPS:
-            factor = 7.6f;
-            break;
+            return 250.0f;
         case GYR_125DPS:
-            factor = 3.8f;
-            break;
+            return 125.0f;
         default:
-            factor = 0;
-            break;
+            return 0;
     }
-    gyr->x = (double)x * factor / 1000.0f;
-    gyr->y = (double)y * factor / 1000.0f;
-    gyr->z = (double)z * factor / 1000.0f;
-#endif
 }
 
-void BMX055::get_magnet(BMX055_MAGNET_TypeDef *mag)
+void BMX055::convert_gyro(const char *dt, BMX055_GYRO_TypeDef *gyr)
 {
     int16_t x,y,z;
+    float factor;
+
+    x = dt[1] << 8 | dt[0];
+    y = dt[3] << 8 | dt[2];
+    z = dt[5] << 8 | dt[4];
+    // Full scale over 16bit, e.g. 61.035 mDeg/sec/LSB at 2000 Deg/s rather than the rounded 61.0 of the data sheet
+    factor = gyr_range_dps();
+    gyr->x = (float)x * factor / 32768.0f;
+    gyr->y = (float)y * factor / 32768.0f;
+    gyr->z = (float)z * factor / 32768.0f;
+}
 
-    chip_addr = inf_addr.gyr_addr;
-    dt[0] = 0x42;
-    _i2c.write(chip_addr, dt, 1, true);
-    _i2c.read(chip_addr, dt, 6, false);
+bool BMX055::get_magnet(BMX055_MAGNET_TypeDef *mag)
+{
+    int16_t x,y,z;
+    uint16_t rhall;
+    char dt[8] = {0};
+
+    _bus.read_regs(_mag_dev, inf_addr.mag_addr, 0x42, dt, 8);
 #if DEBUG
-    printf("Read GYR data-> ");
-    for (uint32_t i = 0; i < 6; i++){
+    printf("Read MAG data-> ");
+    for (uint32_t i = 0; i < 8; i++){
         printf("i=%d,dt=0x%02x, ", i, dt[i]);
     }
     printf(", all\r\n");
 #endif
-    x = (dt[1] << 5 | (dt[0] & 0x1f)) << 3;    // 13bit
-    y = (dt[3] << 5 | (dt[2] & 0x1f)) << 3;    // 13bit
-    z = (dt[5] << 7 | (dt[4] & 0x7f)) << 1;    // 15bit
-    mag->x = (double)x;
-    mag->y = (double)y;
-    mag->z = (double)z;
+    x = (int16_t)(dt[1] << 8 | (dt[0] & 0xf8)) >> 3;   // 13bit
+    y = (int16_t)(dt[3] << 8 | (dt[2] & 0xf8)) >> 3;   // 13bit
+    z = (int16_t)(dt[5] << 8 | (dt[4] & 0xfe)) >> 1;   // 15bit
+    rhall = (uint16_t)(dt[7] << 8 | (dt[6] & 0xfc)) >> 2;  // 14bit, resistance of the hall plates
+    // Compensated data are in 1/16 uT
+    x = compensate_mag_xy(x, rhall, mag_trim.dig_x1, mag_trim.dig_x2);
+    y = compensate_mag_xy(y, rhall, mag_trim.dig_y1, mag_trim.dig_y2);
+    z = compensate_mag_z(z, rhall);
+    if ((x == BMX055_MAG_OVERFLOW) || (y == BMX055_MAG_OVERFLOW) || (z == BMX055_MAG_OVERFLOW)) {
+        return false;
+    }
+    mag->x = (float)x / 16.0f;
+    mag->y = (float)y / 16.0f;
+    mag->z = (float)z / 16.0f;
+    return true;
+}
+
+////// Compensate MAG data with the trim registers ////////
+// Fixed point formulas of the BMM050 API, integer only so as to be exact on any FPU
+int16_t BMX055::compensate_mag_xy(int16_t raw, uint16_t rhall, int8_t dig_1, int8_t dig_2)
+{
+    int32_t r;
+
+    if ((raw == BMX055_MAG_XY_OVERFLOW_ADC) || (rhall == 0) || (mag_trim.dig_xyz1 == 0)) {
+        return BMX055_MAG_OVERFLOW;
+    }
+    r = (int16_t)((uint16_t)(((int32_t)mag_trim.dig_xyz1 << 14) / rhall) - 0x4000);
+    r = ((int32_t)mag_trim.dig_xy2 * ((r * r) >> 7) + r * ((int32_t)mag_trim.dig_xy1 << 7)) >> 9;
+    r = (((r + 0x100000) * ((int32_t)dig_2 + 0xa0)) >> 12);
+    r = ((int32_t)raw * r) >> 13;
+    return (int16_t)(r + ((int32_t)dig_1 << 3));
+}
+
+int16_t BMX055::compensate_mag_z(int16_t raw, uint16_t rhall)
+{
+    int32_t r;
+
+    if ((raw == BMX055_MAG_Z_OVERFLOW_ADC) || (rhall == 0) || (mag_trim.dig_z1 == 0) || (mag_trim.dig_z2 == 0) ||
+        (mag_trim.dig_xyz1 == 0)) {
+        return BMX055_MAG_OVERFLOW;
+    }
+    r = (((int32_t)(raw - mag_trim.dig_z4) << 15) -
+         (((int32_t)mag_trim.dig_z3 * ((int32_t)rhall - (int32_t)mag_trim.dig_xyz1)) >> 2)) /
+        (mag_trim.dig_z2 + (int16_t)(((int32_t)mag_trim.dig_z1 * ((int32_t)rhall << 1) + (1 << 15)) >> 16));
+    // Saturate to +/-2 mT
+    if (r > 32767) {
+        r = 32767;
+    } else if (r < -32767) {
+        r = -32767;
+    }
+    return (int16_t)r;
+}
+
+/////////////// Read data collected in FIFO ////////////////
+// Frames are read in bursts from FIFO_DATA, at high priority on the bus, since they are read on the interrupt or poll
+int BMX055::get_accel_fifo(BMX055_ACCEL_TypeDef *acc, int max_frames)
+{
+    char dt[6 * 16];
+    int frames;
+
+    _bus.read_regs(_acc_dev, inf_addr.acc_addr, 0x0e, dt, 1, I2CBUS_PRIORITY_HIGH);  // FIFO_STATUS
+    frames = dt[0] & 0x7f;
+    if (frames > max_frames) {
+        frames = max_frames;
+    }
+    for (int i = 0; i < frames; i += 16) {
+        int n = (frames - i < 16) ? frames - i : 16;
+        _bus.read_regs(_acc_dev, inf_addr.acc_addr, 0x3f, dt, n * 6, I2CBUS_PRIORITY_HIGH);
+        for (int j = 0; j < n; j++) {
+            convert_accel(&dt[j * 6], &acc[i + j]);
+        }
+    }
+    return frames;
+}
+
+int BMX055::get_gyro_fifo(BMX055_GYRO_TypeDef *gyr, int max_frames)
+{
+    char dt[6 * 16];
+    int frames;
+
+    _bus.read_regs(_gyr_dev, inf_addr.gyr_addr, 0x0e, dt, 1, I2CBUS_PRIORITY_HIGH);  // FIFO_STATUS
+    frames = dt[0] & 0x7f;
+    if (frames > max_frames) {
+        frames = max_frames;
+    }
+    for (int i = 0; i < frames; i += 16) {
+        int n = (frames - i < 16) ? frames - i : 16;
+        _bus.read_regs(_gyr_dev, inf_addr.gyr_addr, 0x3f, dt, n * 6, I2CBUS_PRIORITY_HIGH);
+        for (int j = 0; j < n; j++) {
+            convert_gyro(&dt[j * 6], &gyr[i + j]);
+        }
+    }
+    return frames;
 }
 
 float BMX055::get_chip_temperature()
 {
-    chip_addr = inf_addr.acc_addr;
-    dt[0] = 0x08;   // chip tempareture reg addr
-    _i2c.write(chip_addr, dt, 1, true);
-    _i2c.read(chip_addr, dt, 1, false);
+    char dt[1] = {0};
+
+    _bus.read_regs(_acc_dev, inf_addr.acc_addr, 0x08, dt, 1);   // chip tempareture reg addr
     //printf("Temp reg = 0x%02x\r\n", dt[0]);
     return (float)((int8_t)dt[0]) * 0.5f + 23.0f;
 }
 
 /////////////// Initialize ////////////////////////////////
+void BMX055::set_addr_hint(const BMX055_ADDR_INF_TypeDef *p_addr_hint)
+{
+    if (p_addr_hint != NULL) {
+        addr_hint = *p_addr_hint;
+    } else {
+        addr_hint.acc_addr = 0;
+        addr_hint.mag_addr = 0;
+        addr_hint.gyr_addr = 0;
+    }
+}
+
 void BMX055::initialize (void)
 {
-    _i2c.frequency(100000);
+    _acc_dev = _bus.attach("bmx055.acc");
+    _gyr_dev = _bus.attach("bmx055.gyr");
+    _mag_dev = _bus.attach("bmx055.mag");
+    // All three support Fast-mode
+    _bus.frequency(400000);
     // Check Acc & Mag & Gyro are available of not
     check_id();
     if (ready_flag == 0x07){
@@ -202,220 +309,338 @@ void BMX055::initialize (void)
         printf("ACC+GYR+MAG are ready!\r\n");
 #endif
     }
+    // MAG soft reset, which keeps the power control bit.  It goes to Sleep mode 1 ms later (BMM050 API).
+    _bus.write_reg(_mag_dev, inf_addr.mag_addr, 0x4b, 0x83);
+    WAIT_MS(1);
+    // MAG trim registers are readable in Sleep mode, and never change
+    read_mag_trim();
     // Set initial data
     set_parameters_to_regs();
 }
 
+void BMX055::read_mag_trim(void)
+{
+    char dt[0x72 - 0x5d] = {0};
+
+    // dig_x1 (0x5D) to dig_xy1 (0x71) in one burst
+    _bus.read_regs(_mag_dev, inf_addr.mag_addr, 0x5d, dt, sizeof(dt));
+#define MAG_TRIM(reg)       ((uint8_t)dt[(reg) - 0x5d])
+#define MAG_TRIM16(reg)     ((uint16_t)(MAG_TRIM((reg) + 1) << 8 | MAG_TRIM(reg)))
+    mag_trim.dig_x1 = (int8_t)MAG_TRIM(0x5d);
+    mag_trim.dig_y1 = (int8_t)MAG_TRIM(0x5e);
+    mag_trim.dig_z4 = (int16_t)MAG_TRIM16(0x62);
+    mag_trim.dig_x2 = (int8_t)MAG_TRIM(0x64);
+    mag_trim.dig_y2 = (int8_t)MAG_TRIM(0x65);
+    mag_trim.dig_z2 = (int16_t)MAG_TRIM16(0x68);
+    mag_trim.dig_z1 = MAG_TRIM16(0x6a);
+    mag_trim.dig_xyz1 = MAG_TRIM16(0x6c) & 0x7fff;
+    mag_trim.dig_z3 = (int16_t)MAG_TRIM16(0x6e);
+    mag_trim.dig_xy2 = (int8_t)MAG_TRIM(0x70);
+    mag_trim.dig_xy1 = MAG_TRIM(0x71);
+#undef MAG_TRIM16
+#undef MAG_TRIM
+}
+
 ////// Set initialize data to related registers ///////////
+// ACC and GYR are in Normal mode from power-on, where registers take writes back to back with no wait.
 void BMX055::set_parameters_to_regs(void)
 {
     // ACC
-    chip_addr = inf_addr.acc_addr;
-    dt[0] = 0x0f;   // Select PMU_Range register
-    dt[1] = bmx055_parameters.acc_fs;
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-    dt[0] = 0x10;   // Select PMU_BW register
-    dt[1] = bmx055_parameters.acc_bw;
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-    dt[0] = 0x11;   // Select PMU_LPW register
-    dt[1] = 0x00;   // Normal mode, Sleep duration = 0.5ms
-    _i2c.write(chip_addr, dt, 2, false);
+    const uint8_t acc[] = {
+        0x0f, bmx055_parameters.acc_fs,     // Select PMU_Range register
+        0x10, bmx055_parameters.acc_bw,     // Select PMU_BW register
+        0x11, 0x00                          // Select PMU_LPW register, Normal mode, Sleep duration = 0.5ms
+    };
+    _bus.write_regs(_acc_dev, inf_addr.acc_addr, acc, sizeof(acc) / 2);
     // GYR
-    chip_addr = inf_addr.gyr_addr;
-    dt[0] = 0x0f;   // Select Range register
-    dt[1] = bmx055_parameters.gyr_fs;
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-    dt[0] = 0x10;   // Select Bandwidth register
-    dt[1] = bmx055_parameters.gyr_bw;
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-    dt[0] = 0x11;   // Select LPM1 register
-    dt[1] = 0x00;   // Normal mode, Sleep duration = 2ms
-    _i2c.write(chip_addr, dt, 2, false);
+    const uint8_t gyr[] = {
+        0x0f, bmx055_parameters.gyr_fs,     // Select Range register
+        0x10, bmx055_parameters.gyr_bw,     // Select Bandwidth register
+        0x11, 0x00                          // Select LPM1 register, Normal mode, Sleep duration = 2ms
+    };
+    _bus.write_regs(_gyr_dev, inf_addr.gyr_addr, gyr, sizeof(gyr) / 2);
     // MAG
-    chip_addr = inf_addr.mag_addr;
-    dt[0] = 0x4b;   // Select Mag register
-    dt[1] = 0x83;   // Soft reset
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(10);
-    dt[0] = 0x4b;   // Select Mag register
-    dt[1] = 0x01;   // Soft reset
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(10);
-    dt[0] = 0x4c;   // Select Mag register
-    dt[1] = bmx055_parameters.mag_odr;
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-    dt[0] = 0x4e;   // Select Mag register
-    dt[1] = 0x84;   // X, Y, Z-Axis enabled
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-    dt[0] = 0x51;   // Select Mag register
-    dt[1] = 0x04;   // No. of Repetitions for X-Y Axis = 9
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-    dt[0] = 0x52;   // Select Mag register
-    dt[1] = 0x16;   // No. of Repetitions for Z-Axis = 15
-    _i2c.write(chip_addr, dt, 2, false);
-#if 0
+    const uint8_t mag[] = {
+        0x4c, (uint8_t)((bmx055_parameters.mag_odr & 0x07) << 3),  // Data rate, Normal mode
+        0x4e, 0x84,                         // X, Y, Z-Axis enabled
+        0x51, 0x04,                         // No. of Repetitions for X-Y Axis = 9
+        0x52, 0x16                          // No. of Repetitions for Z-Axis = 15
+    };
+    _bus.write_regs(_mag_dev, inf_addr.mag_addr, mag, sizeof(mag) / 2);
+    // Interrupts
+    set_interrupt_to_regs();
+}
+
+////// Set interrupt data to related registers ////////////
+// Interrupts are non-latched and active high, so that each new data or watermark gives a rising edge.
+// FIFOs run in stream mode whether or not interrupt pins are wired, so polling loses no sample as long as it drains them
+// before they fill.  Stream mode keeps the latest frames on overflow.  Writing FIFO_CONFIG_1 clears FIFO.
+#define ADD_REG(pairs, n, reg, data)    do { (pairs)[(n)++] = (reg); (pairs)[(n)++] = (data); } while (0)
+
+void BMX055::set_interrupt_to_regs(void)
+{
+    uint8_t acc[2 * 12];
+    uint8_t gyr[2 * 8];
+    int n;
+
+    // ACC engines.  Their events are latched until get_events(), data-ready and FIFO interrupts never are.
+    // Threshold LSBs scale with the range: slope 3.91 mg, high-g 7.81 mg and tap 62.5 mg at 2 g.
+    uint8_t en_0 = 0x00;
+    uint8_t en_1 = 0x00;
+    uint8_t map_0 = 0x00;
+    float range_scale = acc_range_g() / 2.0f;
+    n = 0;
+    if (bmx055_engine.motion_th > 0.0f) {
+        ADD_REG(acc, n, 0x27, 0x01);    // INT_5, slope_dur = 2 samples
+        ADD_REG(acc, n, 0x28, threshold_to_reg(bmx055_engine.motion_th, 0.00391f * range_scale, 0xff));  // INT_6, slope_th
+        en_0 |= 0x07;   // slope_en_x/y/z
+        map_0 |= 0x04;  // int1_slope
+    }
+    if (bmx055_engine.tap_th > 0.0f) {
+        ADD_REG(acc, n, 0x2b, threshold_to_reg(bmx055_engine.tap_th, 0.0625f * range_scale, 0x1f));     // INT_9, tap_th, 2 samples
+        en_0 |= 0x20;   // s_tap_en
+        map_0 |= 0x20;  // int1_s_tap
+    }
+    if (bmx055_engine.high_g_th > 0.0f) {
+        ADD_REG(acc, n, 0x26, threshold_to_reg(bmx055_engine.high_g_th, 0.00781f * range_scale, 0xff));  // INT_4, high_th
+        en_1 |= 0x07;   // high_en_x/y/z
+        map_0 |= 0x02;  // int1_high
+    }
+    ADD_REG(acc, n, 0x21, engine_enabled() ? 0x8f : 0x80);     // INT_RST_LATCH, reset, latched or not
+    ADD_REG(acc, n, 0x16, en_0);                                // INT_EN_0
     // ACC
-    chip_addr = inf_addr.acc_addr;
-    dt[0] = 0x0f;   // Select PMU_Range register
-    dt[1] = 0x03;   // Range = +/- 2g
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-    dt[0] = 0x10;   // Select PMU_BW register
-    dt[1] = 0x08;   // Bandwidth = 7.81 Hz
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-    dt[0] = 0x11;   // Select PMU_LPW register
-    dt[1] = 0x00;   // Normal mode, Sleep duration = 0.5ms
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
+    ADD_REG(acc, n, 0x3e, 0x80);            // FIFO_CONFIG_1, stream mode, X+Y+Z
+    if (bmx055_int.acc_int1 != NC) {
+        ADD_REG(acc, n, 0x20, 0x05);        // INT_OUT_CTRL, INT1/2 push-pull active high
+        ADD_REG(acc, n, 0x19, map_0);       // INT_MAP_0, engines to INT1
+        if (bmx055_int.fifo_wm != 0) {
+            ADD_REG(acc, n, 0x30, bmx055_int.fifo_wm & 0x3f);  // FIFO_CONFIG_0, watermark
+            ADD_REG(acc, n, 0x1a, 0x02);    // INT_MAP_1, FIFO watermark to INT1
+            ADD_REG(acc, n, 0x17, en_1 | 0x20);     // INT_EN_1, FIFO watermark
+        } else {
+            ADD_REG(acc, n, 0x1a, 0x01);    // INT_MAP_1, new data to INT1
+            ADD_REG(acc, n, 0x17, en_1 | 0x10);     // INT_EN_1, new data
+        }
+    } else {
+        ADD_REG(acc, n, 0x17, en_1);        // INT_EN_1, engines only
+        ADD_REG(acc, n, 0x19, 0x00);        // INT_MAP_0, none
+        ADD_REG(acc, n, 0x1a, 0x00);        // INT_MAP_1, none
+    }
+    _bus.write_regs(_acc_dev, inf_addr.acc_addr, acc, n / 2);
     // GYR
-    chip_addr = inf_addr.gyr_addr;
-    dt[0] = 0x0f;   // Select Range register
-    dt[1] = 0x04;   // Full scale = +/- 125 degree/s
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-    dt[0] = 0x10;   // Select Bandwidth register
-    dt[1] = 0x07;   // ODR = 100 Hz
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-    dt[0] = 0x11;   // Select LPM1 register
-    dt[1] = 0x00;   // Normal mode, Sleep duration = 2ms
-    _i2c.write(chip_addr, dt, 2, false);
-    // MAG
-    chip_addr = inf_addr.mag_addr;
-    dt[0] = 0x4b;   // Select Mag register
-    dt[1] = 0x83;   // Soft reset
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(10);
-    dt[0] = 0x4b;   // Select Mag register
-    dt[1] = 0x01;   // Soft reset
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(10);
-    dt[0] = 0x4c;   // Select Mag register
-    dt[1] = 0x00;   // Normal Mode, ODR = 10 Hz
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-    dt[0] = 0x4e;   // Select Mag register
-    dt[1] = 0x84;   // X, Y, Z-Axis enabled
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-    dt[0] = 0x51;   // Select Mag register
-    dt[1] = 0x04;   // No. of Repetitions for X-Y Axis = 9
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-    dt[0] = 0x52;   // Select Mag register
-    dt[1] = 0x16;   // No. of Repetitions for Z-Axis = 15
-    _i2c.write(chip_addr, dt, 2, false);
-    WAIT_MS(1);
-#endif
+    n = 0;
+    ADD_REG(gyr, n, 0x3e, 0x80);            // FIFO_CONFIG_1, stream mode, X+Y+Z
+    if (bmx055_int.gyr_int3 != NC) {
+        ADD_REG(gyr, n, 0x16, 0x05);        // INT_EN_1, INT3/4 push-pull active high
+        ADD_REG(gyr, n, 0x21, 0x80);        // INT_RST_LATCH, reset, non-latched
+        if (bmx055_int.fifo_wm != 0) {
+            ADD_REG(gyr, n, 0x3d, bmx055_int.fifo_wm & 0x7f);  // FIFO_CONFIG_0, watermark
+            ADD_REG(gyr, n, 0x1e, 0x80);    // FIFO_WM_EN, watermark interrupt
+            ADD_REG(gyr, n, 0x18, 0x04);    // INT_MAP_1, FIFO to INT3
+            ADD_REG(gyr, n, 0x15, 0x40);    // INT_EN_0, FIFO
+        } else {
+            ADD_REG(gyr, n, 0x1e, 0x00);    // FIFO_WM_EN, none
+            ADD_REG(gyr, n, 0x18, 0x01);    // INT_MAP_1, new data to INT3
+            ADD_REG(gyr, n, 0x15, 0x80);    // INT_EN_0, new data
+        }
+    } else {
+        ADD_REG(gyr, n, 0x15, 0x00);        // INT_EN_0, none
+        ADD_REG(gyr, n, 0x18, 0x00);        // INT_MAP_1, none
+        ADD_REG(gyr, n, 0x1e, 0x00);        // FIFO_WM_EN, none
+    }
+    _bus.write_regs(_gyr_dev, inf_addr.gyr_addr, gyr, n / 2);
+}
+
+/////////////// Interrupts ////////////////////////////////
+void BMX055::set_interrupt(const BMX055_INT_TypeDef *bmx055_int_parameter)
+{
+    bmx055_int = *bmx055_int_parameter;
+    if ((bmx055_int.acc_int1 != NC) && (_acc_int == NULL)) {
+        _acc_int = new InterruptIn(bmx055_int.acc_int1);
+        _acc_int->rise(callback(this, &BMX055::on_acc_int));
+    }
+    if ((bmx055_int.gyr_int3 != NC) && (_gyr_int == NULL)) {
+        _gyr_int = new InterruptIn(bmx055_int.gyr_int3);
+        _gyr_int->rise(callback(this, &BMX055::on_gyr_int));
+    }
+    set_interrupt_to_regs();
+}
+
+/////////////// Motion, tap and high-g engines //////////
+void BMX055::set_engine(const BMX055_ENGINE_TypeDef *bmx055_engine_parameter)
+{
+    bmx055_engine = *bmx055_engine_parameter;
+    set_interrupt_to_regs();
+}
+
+bool BMX055::engine_enabled(void)
+{
+    return (bmx055_engine.motion_th > 0.0f) || (bmx055_engine.tap_th > 0.0f) || (bmx055_engine.high_g_th > 0.0f);
+}
+
+uint8_t BMX055::get_events(BMX055_EVENT_TypeDef *evt)
+{
+    static const char axes[] = {'x', 'y', 'z'};
+    char dt[4] = {0};
+
+    // INT_STATUS_0 to INT_STATUS_3
+    _bus.read_regs(_acc_dev, inf_addr.acc_addr, 0x09, dt, 4, I2CBUS_PRIORITY_HIGH);
+    evt->events = 0;
+    if (dt[0] & 0x04) {
+        evt->events |= BMX055_EVT_MOTION;
+    }
+    if (dt[0] & 0x20) {
+        evt->events |= BMX055_EVT_TAP;
+    }
+    if (dt[0] & 0x02) {
+        evt->events |= BMX055_EVT_HIGH_G;
+    }
+    // First axis bits are one-hot: X, Y and Z from the lowest
+    evt->motion_axis = axes[(dt[2] & 0x02) ? 1 : ((dt[2] & 0x04) ? 2 : 0)];
+    evt->motion_sign = (dt[2] & 0x08) ? -1 : 1;
+    evt->tap_axis = axes[(dt[2] & 0x20) ? 1 : ((dt[2] & 0x40) ? 2 : 0)];
+    evt->tap_sign = (dt[2] & 0x80) ? -1 : 1;
+    evt->high_g_axis = axes[(dt[3] & 0x02) ? 1 : ((dt[3] & 0x04) ? 2 : 0)];
+    evt->high_g_sign = (dt[3] & 0x08) ? -1 : 1;
+    if (evt->events != 0) {
+        _bus.write_reg(_acc_dev, inf_addr.acc_addr, 0x21, 0x8f, I2CBUS_PRIORITY_HIGH);   // INT_RST_LATCH, reset, latched
+    }
+    return evt->events;
+}
+
+uint8_t BMX055::threshold_to_reg(float th, float lsb, uint8_t max)
+{
+    float n = th / lsb + 0.5f;
+
+    if (n < 1.0f) {
+        return 1;
+    }
+    if (n > (float)max) {
+        return max;
+    }
+    return (uint8_t)n;
+}
+
+uint32_t BMX055::wait_for_data(uint32_t timeout_ms)
+{
+    uint32_t flags;
+
+    flags = _int_flags.wait_any_for(BMX055_INT_ACC | BMX055_INT_GYR, std::chrono::milliseconds(timeout_ms));
+    if (flags & osFlagsError) {
+        return 0;   // Timeout
+    }
+    return flags & (BMX055_INT_ACC | BMX055_INT_GYR);
+}
+
+// Interrupt context
+void BMX055::on_acc_int(void)
+{
+    _int_flags.set(BMX055_INT_ACC);
+}
+
+void BMX055::on_gyr_int(void)
+{
+    _int_flags.set(BMX055_INT_GYR);
+}
+
+/////////////// Offset compensation /////////////////////
+bool BMX055::fast_offset_compensation(const uint8_t acc_target[3])
+{
+    // ACC: one axis at a time, each done when cal_rdy is set again
+    _bus.write_reg(_acc_dev, inf_addr.acc_addr, 0x37,       // Select OFC_SETTING register
+                   (uint8_t)(((acc_target[2] & 0x03) << 5) | ((acc_target[1] & 0x03) << 3) | ((acc_target[0] & 0x03) << 1)));
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        _bus.write_reg(_acc_dev, inf_addr.acc_addr, 0x36, (uint8_t)((axis + 1) << 5));   // cal_trigger
+        if (!wait_reg(_acc_dev, inf_addr.acc_addr, 0x36, 0x10, 0x10, 100)) {
+            return false;
+        }
+    }
+    // GYR: all axes at once, done when fast_offset_en is cleared
+    _bus.write_reg(_gyr_dev, inf_addr.gyr_addr, 0x32, 0x1f);   // 64 samples, fast_offset_en, X/Y/Z
+    return wait_reg(_gyr_dev, inf_addr.gyr_addr, 0x32, 0x08, 0x00, 1000);
+}
+
+// GYR offsets are 12bit, split over OFC1 (MSBs), OFC2..4 and trim_gp0 (LSBs)
+void BMX055::get_offset(BMX055_OFFSET_TypeDef *ofs)
+{
+    char dt[5] = {0};
+    uint16_t x,y,z;
+
+    _bus.read_regs(_acc_dev, inf_addr.acc_addr, 0x38, dt, 3);
+    for (uint32_t i = 0; i < 3; i++) {
+        ofs->acc[i] = (int8_t)dt[i];
+    }
+    _bus.read_regs(_gyr_dev, inf_addr.gyr_addr, 0x36, dt, 5);
+    x = ((dt[0] >> 6) & 0x03) << 10 | (uint8_t)dt[1] << 2 | ((dt[4] >> 2) & 0x03);
+    y = ((dt[0] >> 3) & 0x07) << 9 | (uint8_t)dt[2] << 1 | ((dt[4] >> 1) & 0x01);
+    z = (dt[0] & 0x07) << 9 | (uint8_t)dt[3] << 1 | (dt[4] & 0x01);
+    ofs->gyr[0] = (int16_t)(x << 4) >> 4;
+    ofs->gyr[1] = (int16_t)(y << 4) >> 4;
+    ofs->gyr[2] = (int16_t)(z << 4) >> 4;
+}
+
+void BMX055::set_offset(const BMX055_OFFSET_TypeDef *ofs)
+{
+    char dt[1] = {0};
+    uint16_t x = (uint16_t)ofs->gyr[0];
+    uint16_t y = (uint16_t)ofs->gyr[1];
+    uint16_t z = (uint16_t)ofs->gyr[2];
+
+    const uint8_t acc[] = {
+        0x38, (uint8_t)ofs->acc[0],
+        0x39, (uint8_t)ofs->acc[1],
+        0x3a, (uint8_t)ofs->acc[2]
+    };
+    _bus.write_regs(_acc_dev, inf_addr.acc_addr, acc, sizeof(acc) / 2);
+    // Bits 7:4 of trim_gp0 are general purpose NVM, kept as they are
+    _bus.read_regs(_gyr_dev, inf_addr.gyr_addr, 0x3a, dt, 1);
+    const uint8_t gyr[] = {
+        0x36, (uint8_t)(((x >> 10) & 0x03) << 6 | ((y >> 9) & 0x07) << 3 | ((z >> 9) & 0x07)),
+        0x37, (uint8_t)(x >> 2),
+        0x38, (uint8_t)(y >> 1),
+        0x39, (uint8_t)(z >> 1),
+        0x3a, (uint8_t)((dt[0] & 0xf0) | (x & 0x03) << 2 | (y & 0x01) << 1 | (z & 0x01))
+    };
+    _bus.write_regs(_gyr_dev, inf_addr.gyr_addr, gyr, sizeof(gyr) / 2);
+}
+
+// Poll reg until the bits of mask read value
+bool BMX055::wait_reg(int dev, uint8_t chip, uint8_t reg, uint8_t mask, uint8_t value, uint32_t timeout_ms)
+{
+    for (uint32_t i = 0; i < timeout_ms; i++) {
+        WAIT_MS(1);
+        if ((read_id(dev, chip, reg) & mask) == value) {
+            return true;
+        }
+    }
+    return false;
 }
 
 /////////////// Check Who am I? ///////////////////////////
 void BMX055::check_id(void)
 {
+    // Addresses selectable by SDO/CSB pins
+    static const uint8_t acc_addrs[] = {BMX055_ACC_CHIP_ADDR, (0x19 << 1)};
+    static const uint8_t gyr_addrs[] = {BMX055_GYR_CHIP_ADDR, (0x69 << 1)};
+    static const uint8_t mag_addrs[] = {BMX055_MAG_CHIP_ADDR, (0x11 << 1), (0x12 << 1), (0x13 << 1)};
+
     ready_flag = 0;
     // ID ACC
-    inf_addr.acc_addr = BMX055_ACC_CHIP_ADDR;
-    chip_addr = inf_addr.acc_addr;
-    dt[0] = 0x00;   // chip ID reg addr
-    _i2c.write(chip_addr, dt, 1, true);
-    _i2c.read(chip_addr, dt, 1, false);
-    inf_id.acc_id = dt[0];
-    if (inf_id.acc_id == I_AM_BMX055_ACC) {
+    if (probe(_acc_dev, acc_addrs, sizeof(acc_addrs), addr_hint.acc_addr, 0x00, I_AM_BMX055_ACC,
+              &inf_addr.acc_addr, &inf_id.acc_id)) {
         ready_flag |= 0x01;
-    } else {
-        inf_addr.acc_addr = (0x18 << 1);
-        chip_addr = inf_addr.acc_addr;
-        dt[0] = 0x00;   // chip ID reg addr
-        _i2c.write(chip_addr, dt, 1, true);
-        _i2c.read(chip_addr, dt, 1, false);
-        inf_id.acc_id = dt[0];
-        if (inf_id.acc_id == I_AM_BMX055_ACC) {
-            ready_flag |= 0x01;
-        }
     }
     // ID GYRO
-    inf_addr.gyr_addr = BMX055_GYR_CHIP_ADDR;
-    chip_addr = inf_addr.gyr_addr;
-    dt[0] = 0x00;   // chip ID reg addr
-    _i2c.write(chip_addr, dt, 1, true);
-    _i2c.read(chip_addr, dt, 1, false);
-    inf_id.gyr_id = dt[0];
-    if (inf_id.gyr_id == I_AM_BMX055_GYR) {
+    if (probe(_gyr_dev, gyr_addrs, sizeof(gyr_addrs), addr_hint.gyr_addr, 0x00, I_AM_BMX055_GYR,
+              &inf_addr.gyr_addr, &inf_id.gyr_id)) {
         ready_flag |= 0x02;
-    } else {
-        inf_addr.gyr_addr = (0x68 << 1);
-        chip_addr = inf_addr.gyr_addr;
-        dt[0] = 0x00;   // chip ID reg addr
-        _i2c.write(chip_addr, dt, 1, true);
-        _i2c.read(chip_addr, dt, 1, false);
-        inf_id.gyr_id = dt[0];
-        if (inf_id.gyr_id == I_AM_BMX055_GYR) {
-            ready_flag |= 0x02;
-        }
     }
     // ID Mag
-    inf_addr.mag_addr = BMX055_MAG_CHIP_ADDR;
-    chip_addr = inf_addr.mag_addr;
-    dt[0] = 0x4b;   // reg addr
-    dt[1] = 0x01;   // control power bit set 1
-    _i2c.write(chip_addr, dt, 2, false);
-    dt[0] = 0x40;   // chip ID reg addr
-    _i2c.write(chip_addr, dt, 1, true);
-    _i2c.read(chip_addr, dt, 1, false);
-    inf_id.mag_id = dt[0];
-    if (inf_id.mag_id == I_AM_BMX055_MAG) {
+    if (probe(_mag_dev, mag_addrs, sizeof(mag_addrs), addr_hint.mag_addr, 0x40, I_AM_BMX055_MAG,
+              &inf_addr.mag_addr, &inf_id.mag_id)) {
         ready_flag |= 0x04;
-    } else {
-        inf_addr.mag_addr = (0x12 << 1);
-        chip_addr = inf_addr.mag_addr;
-        // control power bit set 1
-        dt[0] = 0x4b;
-        dt[1] = 0x01;
-        _i2c.write(chip_addr, dt, 2, false);
-        dt[0] = 0x40;
-        _i2c.write(chip_addr, dt, 1, true);
-        _i2c.read(chip_addr, dt, 1, false);
-        inf_id.mag_id = dt[0];
-        if (inf_id.mag_id == I_AM_BMX055_MAG) {
-            ready_flag |= 0x04;
-        } else {
-            inf_addr.mag_addr = (0x11 << 1);
-            chip_addr = inf_addr.mag_addr;
-            // control power bit set 1
-            dt[0] = 0x4b;
-            dt[1] = 0x01;
-            _i2c.write(chip_addr, dt, 2, false);
-            dt[0] = 0x40;
-            _i2c.write(chip_addr, dt, 1, true);
-            _i2c.read(chip_addr, dt, 1, false);
-            inf_id.mag_id = dt[0];
-            if (inf_id.mag_id == I_AM_BMX055_MAG) {
-                ready_flag |= 0x04;
-            } else {
-                inf_addr.mag_addr = (0x10 << 1);
-                chip_addr = inf_addr.mag_addr;
-                // control power bit set 1
-                dt[0] = 0x4b;
-                dt[1] = 0x01;
-                _i2c.write(chip_addr, dt, 2, false);
-                dt[0] = 0x40;
-                _i2c.write(chip_addr, dt, 1, true);
-                _i2c.read(chip_addr, dt, 1, false);
-                inf_id.mag_id = dt[0];
-                if (inf_id.mag_id == I_AM_BMX055_MAG) {
-                    ready_flag |= 0x04;
-                }
-            }
-        }
     }
+    chip_addr = inf_addr.mag_addr;
 #if DEBUG
     printf("ACC addr=0x%02x, id=0x%02x\r\n", inf_addr.acc_addr, inf_id.acc_id); 
     printf("GYR addr=0x%02x, id=0x%02x\r\n", inf_addr.gyr_addr, inf_id.gyr_id); 
@@ -424,6 +649,32 @@ void BMX055::check_id(void)
 #endif
 }
 
+// Try the address found last time first, which saves walking the others
+bool BMX055::probe(int dev, const uint8_t *addrs, uint32_t num_addrs, uint8_t hint, uint8_t id_reg, uint8_t id,
+                   uint8_t *addr, uint8_t *found_id)
+{
+    for (int32_t i = (hint != 0) ? -1 : 0; i < (int32_t)num_addrs; i++) {
+        if ((i >= 0) && (addrs[i] == hint)) {
+            continue;
+        }
+        *addr = (i < 0) ? hint : addrs[i];
+        if (dev == _mag_dev) {
+            // control power bit set 1
+            _bus.write_reg(dev, *addr, 0x4b, 0x01);
+        }
+        *found_id = read_id(dev, *addr, id_reg);
+        if (*found_id == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BMX055::read_addr_inf(BMX055_ADDR_INF_TypeDef *addr)
+{
+    *addr = inf_addr;
+}
+
 void BMX055::read_id_inf(BMX055_ID_INF_TypeDef *id)
 {
     id->acc_id = acc_id;
@@ -443,25 +694,25 @@ bool BMX055::chip_ready(void)
 /////////////// I2C Freq. /////////////////////////////////
 void BMX055::frequency(int hz)
 {
-    _i2c.frequency(hz);
+    _bus.frequency(hz);
 }
 
 /////////////// Read/Write specific register //////////////
-uint8_t BMX055::read_reg(uint8_t addr)
+uint8_t BMX055::read_id(int dev, uint8_t chip, uint8_t addr)
 {
-    dt[0] = addr;
-    _i2c.write(chip_addr, dt, 1, true);
-    _i2c.read(chip_addr, dt, 1, false);
+    char dt[1] = {0};
+
+    _bus.read_regs(dev, chip, addr, dt, 1);
     return (uint8_t)dt[0];
 }
 
-uint8_t BMX055::write_reg(uint8_t addr, uint8_t data)
+uint8_t BMX055::read_reg(uint8_t addr)
 {
-    uint8_t d;
+    return read_id(_mag_dev, chip_addr, addr);
+}
 
-    dt[0] = addr;
-    dt[1] = data;
-    _i2c.write(chip_addr, dt, 2, false);
-    d = dt[0];
-    return d;
+uint8_t BMX055::write_reg(uint8_t addr, uint8_t data)
+{
+    _bus.write_reg(_mag_dev, chip_addr, addr, data);
+    return addr;
 }
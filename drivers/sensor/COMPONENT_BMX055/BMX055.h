@@ -24,13 +24,17 @@
  *          http://akizukidenshi.com/catalog/g/gK-13010/
  */
 
-// NO Interrupt functions are supported due to no pin on AE-BMX055 Module
+// Interrupts: ACC data-ready or FIFO watermark on INT1 and GYR data-ready or FIFO watermark on INT3,
+// for boards where they are wired (no pin on AE-BMX055 Module).  See set_interrupt().
+// ACC and GYR FIFOs always run, in stream mode, so that boards without the pins poll them without losing samples.
+// ACC any-motion (slope), single tap and high-g engines, also on INT1.  See set_engine().
 // Only supprt normal mode (No sleep and/or standby mode)
 
 #ifndef BMX055_H
 #define BMX055_H
 
 #include "mbed.h"
+#include "I2CBus.h"
 
 #define AKIZUKI_BOARD
 
@@ -44,7 +48,7 @@
 //  ID's
 #define I_AM_BMX055_ACC         0xFA    // ACC ID
 #define I_AM_BMX055_GYR         0x0F    // GYR ID
-#define I_AM_BMX055_MAG         0x40    // MAG ID
+#define I_AM_BMX055_MAG         0x32    // MAG ID
 
 
 ////////////// PARAMETER DEFINITION ///////////////////////
@@ -66,11 +70,11 @@
 #define ACC_BW1kHz      15  // 0.5 ms
 
 // Gyro Sampling (Data per Second)
-#define GYR_2000DPS     0   //  full scal +/- 2000 Deg/s(61.0 mDeg/sec/LSB)
-#define GYR_1000DPS     1   //  +/- 1000 Deg/s(30.5 mDeg/sec/LSB)
-#define GYR_500DPS      2   //  +/- 500 Deg/s(15.3 mDeg/sec/LSB)
-#define GYR_250DPS      3   //  +/- 250 Deg/s(7.6 mDeg/sec/LSB)
-#define GYR_125DPS      4   //  +/- 125 Deg/s(3.8 mDeg/sec/LSB)
+#define GYR_2000DPS     0   //  full scal +/- 2000 Deg/s(61.035 mDeg/sec/LSB)
+#define GYR_1000DPS     1   //  +/- 1000 Deg/s(30.518 mDeg/sec/LSB)
+#define GYR_500DPS      2   //  +/- 500 Deg/s(15.259 mDeg/sec/LSB)
+#define GYR_250DPS      3   //  +/- 250 Deg/s(7.629 mDeg/sec/LSB)
+#define GYR_125DPS      4   //  +/- 125 Deg/s(3.815 mDeg/sec/LSB)
 
 // Gyro Bandwidth
 #define GYR_2000Hz523Hz 0   // 2000 Hz ODR and unfiltered (BW(bandwidth) 523Hz)
@@ -92,6 +96,24 @@
 #define MAG_ODR25Hz     6   // 25 Hz ODR
 #define MAG_ODR30Hz     7   // 30 Hz ODR
 
+// Interrupt sources returned by wait_for_data()
+#define BMX055_INT_ACC  0x01    // ACC new data or FIFO watermark (INT1)
+#define BMX055_INT_GYR  0x02    // GYR new data or FIFO watermark (INT3)
+
+// Events of the ACC engines returned by get_events()
+#define BMX055_EVT_MOTION   0x01    // Any-motion (slope)
+#define BMX055_EVT_TAP      0x02    // Single tap
+#define BMX055_EVT_HIGH_G   0x04    // High-g
+
+// Targets of the ACC fast offset compensation, what each axis reads when the board lies still
+#define BMX055_FOC_0G       0
+#define BMX055_FOC_PLUS_1G  1
+#define BMX055_FOC_MINUS_1G 2
+
+// FIFO depth (frames of X, Y and Z)
+#define BMX055_ACC_FIFO_FRAMES  32
+#define BMX055_GYR_FIFO_FRAMES  100
+
 ////////////// DATA TYPE DEFINITION ///////////////////////
 typedef struct {
     // ACC
@@ -117,6 +139,32 @@ const BMX055_TypeDef bmx055_std_paramtr = {
     MAG_ODR10Hz
 };
 
+typedef struct {
+    PinName acc_int1;   // Pin ACC INT1 is wired to, NC if none
+    PinName gyr_int3;   // Pin GYR INT3 is wired to, NC if none
+    uint8_t fifo_wm;    // FIFO watermark in frames, 0 = data-ready interrupt
+} BMX055_INT_TypeDef;
+
+// No interrupt pins, sampled by polling
+const BMX055_INT_TypeDef bmx055_no_int = {
+    NC,
+    NC,
+    0
+};
+
+typedef struct {
+    float motion_th;    // Any-motion slope threshold in g, 0 = disabled
+    float tap_th;       // Single tap threshold in g, 0 = disabled
+    float high_g_th;    // High-g threshold in g, 0 = disabled
+} BMX055_ENGINE_TypeDef;
+
+// All engines disabled
+const BMX055_ENGINE_TypeDef bmx055_no_engine = {
+    0.0f,
+    0.0f,
+    0.0f
+};
+
 ////////////// DATA TYPE DEFINITION ///////////////////////
 typedef struct {
     uint8_t  acc_addr;
@@ -136,6 +184,17 @@ typedef struct {
     float z;
 } BMX055_ACCEL_TypeDef;
 
+typedef struct {
+    uint8_t events;         // BMX055_EVT_*
+    // Axis ('x', 'y' or 'z') which triggered each event first, and its sign (+1 or -1)
+    char    motion_axis;
+    int8_t  motion_sign;
+    char    tap_axis;
+    int8_t  tap_sign;
+    char    high_g_axis;
+    int8_t  high_g_sign;
+} BMX055_EVENT_TypeDef;
+
 typedef struct {
     float x;
     float y;
@@ -154,6 +213,27 @@ typedef struct {
     float z;
 } BMX055_MAGNET_TypeDef;
 
+// Offset compensation registers, which both the fast offset compensation and set_offset() write.  They are volatile.
+typedef struct {
+    int8_t   acc[3];    // ACC X, Y, Z (0x38..0x3A), 7.8 mg/LSB
+    int16_t  gyr[3];    // GYR X, Y, Z (0x36..0x3A), 12bit
+} BMX055_OFFSET_TypeDef;
+
+// MAG trim registers (0x5D..0x71), programmed into NVM per chip at the factory
+typedef struct {
+    int8_t   dig_x1;
+    int8_t   dig_y1;
+    int8_t   dig_x2;
+    int8_t   dig_y2;
+    uint16_t dig_z1;
+    int16_t  dig_z2;
+    int16_t  dig_z3;
+    int16_t  dig_z4;
+    uint8_t  dig_xy1;
+    int8_t   dig_xy2;
+    uint16_t dig_xyz1;
+} BMX055_MAG_TRIM_TypeDef;
+
 /** BMX055 Small, versatile 9-axis sensor module by Bosch Sensortec
  * @code
  * #include    "mbed.h"
@@ -204,15 +284,24 @@ class BMX055
 public:
     /** Configure data pin
       * @param data SDA and SCL pins
+      * @param addresses found last time (read_addr_inf()) to probe first, or NULL
       * @param Other parameters are set automatically
       */
-    BMX055(PinName p_sda, PinName p_scl);
+    BMX055(PinName p_sda, PinName p_scl, const BMX055_ADDR_INF_TypeDef *p_addr_hint = NULL);
 
     /** Configure data pin (with other devices on I2C line)
       * @param I2C previous definition
+      * @param addresses found last time (read_addr_inf()) to probe first, or NULL
+      * @param Other parameters are set automatically
+      */
+    BMX055(I2C& p_i2c, const BMX055_ADDR_INF_TypeDef *p_addr_hint = NULL);
+
+    /** Configure data pin (with other devices on a shared I2C bus)
+      * @param I2C bus manager the other devices are on
+      * @param addresses found last time (read_addr_inf()) to probe first, or NULL
       * @param Other parameters are set automatically
       */
-    BMX055(I2C& p_i2c);
+    BMX055(I2CBus& p_bus, const BMX055_ADDR_INF_TypeDef *p_addr_hint = NULL);
 
     /** Get accel data
      * @param float type of 3D data address
@@ -224,10 +313,25 @@ public:
      */
     void get_gyro(BMX055_GYRO_TypeDef *gyr);
 
-    /** Get magnet data
+    /** Get magnet data in uT, temperature compensated with the trim registers
      * @param float type of 3D data address
+     * @return OK = true, NG (overflow) = false and data left unchanged
+     */
+    bool get_magnet(BMX055_MAGNET_TypeDef *mag);
+
+    /** Get accel data collected in FIFO, oldest first
+     * @param float type of 3D data array
+     * @param size of the array in frames
+     * @return number of frames read
      */
-    void get_magnet(BMX055_MAGNET_TypeDef *mag);
+    int get_accel_fifo(BMX055_ACCEL_TypeDef *acc, int max_frames);
+
+    /** Get gyroscope data collected in FIFO, oldest first
+     * @param float type of 3D data array
+     * @param size of the array in frames
+     * @return number of frames read
+     */
+    int get_gyro_fifo(BMX055_GYRO_TypeDef *gyr, int max_frames);
 
     /** Get Chip temperature data both Acc & Gyro
      * @param none
@@ -241,6 +345,12 @@ public:
       */
     void read_id_inf(BMX055_ID_INF_TypeDef *id);
 
+    /** Read addresses the chips were found at, to probe them first next time
+      * @param address information address
+      * @return none
+      */
+    void read_addr_inf(BMX055_ADDR_INF_TypeDef *addr);
+
     /** Check chip is avairable or not
       * @param none
       * @return OK = true, NG = false;
@@ -253,19 +363,69 @@ public:
       */
     void set_parameter(const BMX055_TypeDef *bmx055_parameter);
 
+    /** Enable data-ready or FIFO watermark interrupts on the pins wired
+      * @param interrupt pins and FIFO watermark
+      * @return none
+      */
+    void set_interrupt(const BMX055_INT_TypeDef *bmx055_int);
+
+    /** Wait for an interrupt of new data
+      * @param timeout in milliseconds
+      * @return BMX055_INT_ACC and/or BMX055_INT_GYR, 0 on timeout
+      */
+    uint32_t wait_for_data(uint32_t timeout_ms);
+
+    /** Configure the ACC any-motion, tap and high-g engines
+      * Events are latched until get_events() reads them, and raise INT1 if it is wired.
+      * @param thresholds of the engines
+      * @return none
+      */
+    void set_engine(const BMX055_ENGINE_TypeDef *bmx055_engine_parameter);
+
+    /** Read and clear events of the ACC engines
+      * @param event information address
+      * @return BMX055_EVT_* of the events happened, 0 if none
+      */
+    uint8_t get_events(BMX055_EVENT_TypeDef *evt);
+
+    /** Check whether any ACC engine is enabled
+      * @param none
+      * @return enabled = true
+      */
+    bool engine_enabled(void);
+
+    /** Run the fast offset compensation of ACC and GYR.  The board must lie still meanwhile.
+      * GYR is compensated to read zero, and ACC to read the targets given, e.g. +1 g on Z lying flat.
+      * @param BMX055_FOC_* target of ACC X, Y and Z
+      * @return OK = true, NG (timeout) = false
+      */
+    bool fast_offset_compensation(const uint8_t acc_target[3]);
+
+    /** Read offset compensation registers
+      * @param offset information address
+      * @return none
+      */
+    void get_offset(BMX055_OFFSET_TypeDef *ofs);
+
+    /** Write offset compensation registers, e.g. to restore ones of an earlier compensation
+      * @param offset information address
+      * @return none
+      */
+    void set_offset(const BMX055_OFFSET_TypeDef *ofs);
+
     /** Set I2C clock frequency
       * @param freq.
       * @return none
       */
     void frequency(int hz);
 
-    /** Read register
+    /** Read register of the chip probed last (MAG)
       * @param register's address
       * @return register data
       */
     uint8_t read_reg(uint8_t addr);
 
-    /** Write register
+    /** Write register of the chip probed last (MAG)
       * @param register's address
       * @param data
       * @return register data
@@ -275,15 +435,37 @@ public:
 protected:
     void initialize(void);
     void check_id(void);
+    void set_addr_hint(const BMX055_ADDR_INF_TypeDef *p_addr_hint);
+    bool probe(int dev, const uint8_t *addrs, uint32_t num_addrs, uint8_t hint, uint8_t id_reg, uint8_t id,
+               uint8_t *addr, uint8_t *found_id);
     void set_parameters_to_regs(void);
-
-    I2C *_i2c_p;
-    I2C &_i2c;
+    void read_mag_trim(void);
+    int16_t compensate_mag_xy(int16_t raw, uint16_t rhall, int8_t dig_1, int8_t dig_2);
+    int16_t compensate_mag_z(int16_t raw, uint16_t rhall);
+    uint8_t read_id(int dev, uint8_t chip, uint8_t addr);
+    void set_interrupt_to_regs(void);
+    float acc_range_g(void);
+    float gyr_range_dps(void);
+    bool wait_reg(int dev, uint8_t chip, uint8_t reg, uint8_t mask, uint8_t value, uint32_t timeout_ms);
+    uint8_t threshold_to_reg(float th, float lsb, uint8_t max);
+    void convert_accel(const char *dt, BMX055_ACCEL_TypeDef *acc);
+    void convert_gyro(const char *dt, BMX055_GYRO_TypeDef *gyr);
+    void on_acc_int(void);
+    void on_gyr_int(void);
+
+    I2CBus *_bus_p;
+    I2CBus &_bus;
+    int _acc_dev;
+    int _gyr_dev;
+    int _mag_dev;
+    InterruptIn *_acc_int;
+    InterruptIn *_gyr_int;
+    EventFlags _int_flags;
 
 private:
-    char     dt[16];      // working buffer
     uint8_t  chip_addr;
     BMX055_ADDR_INF_TypeDef inf_addr;
+    BMX055_ADDR_INF_TypeDef addr_hint;
     BMX055_ID_INF_TypeDef inf_id;
 
     uint8_t  ready_flag;
@@ -291,6 +473,9 @@ private:
     
     
     BMX055_TypeDef bmx055_parameters;
+    BMX055_INT_TypeDef bmx055_int;
+    BMX055_ENGINE_TypeDef bmx055_engine;
+    BMX055_MAG_TRIM_TypeDef mag_trim;
     uint8_t  acc_id;
     uint8_t  mag_id;
     uint8_t  gyr_id;
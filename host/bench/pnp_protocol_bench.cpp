@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Microbenchmarks of pnp_protocol.c, the serialization and parsing every device runs for each property, command and
+// telemetry message.  Each benchmark reports ns/op, allocations/op and bytes allocated/op, and may be checked against a
+// baseline file:
+//
+//     $ pnp-protocol-bench --write-baseline baseline.json      Record a baseline
+//     $ pnp-protocol-bench --baseline baseline.json            Fail if a benchmark regressed against it
+//
+// Allocation counts are exact and portable across machines.  Times are only comparable on the machine the baseline was
+// recorded on.
+
+#include <getopt.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "iothub_message.h"
+#include "azure_c_shared_utility/strings.h"
+#include "parson.h"
+
+#include "pnp_protocol.h"
+#include "pnp_arena.h"
+#include "pnp_mempool.h"
+
+//
+// Allocation accounting.  malloc and friends are replaced with counting wrappers of the C library's own allocator, so
+// that allocations of the SDK and parson count too.  Address sanitizer replaces them itself, so nothing is counted then.
+//
+static bool g_countAllocations = false;
+static uint64_t g_allocations = 0;
+static uint64_t g_allocatedBytes = 0;
+
+#if !defined(__SANITIZE_ADDRESS__)
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size)
+{
+    if (g_countAllocations)
+    {
+        g_allocations++;
+        g_allocatedBytes += size;
+    }
+
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    if (g_countAllocations)
+    {
+        g_allocations++;
+        g_allocatedBytes += count * size;
+    }
+
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    if (g_countAllocations)
+    {
+        g_allocations++;
+        g_allocatedBytes += size;
+    }
+
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+
+}
+
+#endif /* !defined(__SANITIZE_ADDRESS__) */
+
+static const char g_componentName[] = "motionSensorBMX055";
+static const char* g_componentsInModel[] = {"motionSensorBMX055", "deviceInformation", "diagnostics"};
+static const size_t g_numComponentsInModel = sizeof(g_componentsInModel) / sizeof(g_componentsInModel[0]);
+
+//
+// BENCHMARK_RESULT is the cost of one operation of a benchmark
+//
+typedef struct BENCHMARK_RESULT_TAG
+{
+    std::string name;
+    double nsPerOp;
+    double allocsPerOp;
+    double bytesPerOp;
+}
+BENCHMARK_RESULT;
+
+// Properties the twin benchmarks visit, so that the callback is not optimized away
+static volatile int g_propertiesVisited = 0;
+
+static void Bench_PropertyCallback(const char* componentName, const char* propertyName, JSON_Value* propertyValue, int version, void* userContextCallback)
+{
+    (void)componentName;
+    (void)propertyName;
+    (void)propertyValue;
+    (void)version;
+    (void)userContextCallback;
+
+    g_propertiesVisited++;
+}
+
+//
+// MakeFullTwin returns a full twin of about targetSize bytes, with desired properties spread over the components of the model
+// and as many again reported
+//
+static std::string MakeFullTwin(size_t targetSize)
+{
+    std::string desired = "{\"$version\":7";
+    std::string reported = "{\"$version\":9";
+    char property[96];
+
+    for (int i = 0; (desired.size() + reported.size()) < targetSize; i++)
+    {
+        snprintf(property, sizeof(property), ",\"%s\":{\"__t\":\"c\",\"property%d\":%d.5}", g_componentsInModel[i % g_numComponentsInModel], i, i);
+        desired += property;
+        snprintf(property, sizeof(property), ",\"property%d\":{\"value\":%d.5,\"ac\":200,\"ad\":\"success\",\"av\":7}", i, i);
+        reported += property;
+    }
+
+    return "{\"desired\":" + desired + "},\"reported\":" + reported + "}}";
+}
+
+//
+// RunBenchmark times operation, repeated until it has run for at least minTimeMs
+//
+template <typename Operation>
+static BENCHMARK_RESULT RunBenchmark(const std::string& name, unsigned int minTimeMs, Operation operation)
+{
+    typedef std::chrono::steady_clock Clock;
+    BENCHMARK_RESULT result;
+    uint64_t iterations = 1;
+    double elapsedNs;
+
+    // Warm up caches and the allocator
+    operation();
+
+    // Grow the iterations until a run is long enough to time reliably
+    while (true)
+    {
+        Clock::time_point start = Clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            operation();
+        }
+        elapsedNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+
+        if ((elapsedNs >= minTimeMs * 1e6) || (iterations >= (1ULL << 40)))
+        {
+            break;
+        }
+        iterations = (elapsedNs < minTimeMs * 1e5) ? (iterations * 10) : (uint64_t)(iterations * (minTimeMs * 1.2e6 / elapsedNs)) + 1;
+    }
+
+    // Count allocations over a separate, shorter run, so that the counting does not skew the time
+    uint64_t countIterations = (iterations < 1000) ? iterations : 1000;
+    g_allocations = 0;
+    g_allocatedBytes = 0;
+    g_countAllocations = true;
+    for (uint64_t i = 0; i < countIterations; i++)
+    {
+        operation();
+    }
+    g_countAllocations = false;
+
+    result.name = name;
+    result.nsPerOp = elapsedNs / iterations;
+    result.allocsPerOp = (double)g_allocations / countIterations;
+    result.bytesPerOp = (double)g_allocatedBytes / countIterations;
+
+    printf("%-48s %12.1f ns/op %8.1f allocs/op %10.1f B/op\r\n", result.name.c_str(), result.nsPerOp, result.allocsPerOp, result.bytesPerOp);
+    fflush(stdout);
+
+    return result;
+}
+
+static std::vector<BENCHMARK_RESULT> RunAllBenchmarks(unsigned int minTimeMs, const char* filter)
+{
+    std::vector<BENCHMARK_RESULT> results;
+
+#define BENCHMARK(name, body) \
+    if ((filter == NULL) || (strstr(name, filter) != NULL)) { results.push_back(RunBenchmark(name, minTimeMs, [&]() body)); }
+
+    BENCHMARK("CreateReportedProperty/root", {
+        STRING_delete(PnP_CreateReportedProperty(NULL, "serialNumber", "\"NUMAKER-0001\""));
+    });
+    BENCHMARK("CreateReportedProperty/component", {
+        STRING_delete(PnP_CreateReportedProperty(g_componentName, "accelRange", "4"));
+    });
+    BENCHMARK("CreateReportedPropertyWithStatus/root", {
+        STRING_delete(PnP_CreateReportedPropertyWithStatus(NULL, "led", "true", PNP_STATUS_SUCCESS, "success", 3));
+    });
+    BENCHMARK("CreateReportedPropertyWithStatus/component", {
+        STRING_delete(PnP_CreateReportedPropertyWithStatus(g_componentName, "accelRange", "4", PNP_STATUS_SUCCESS, "success", 3));
+    });
+    BENCHMARK("FormatReportedProperty/component", {
+        PnP_MemPool_Free(PnP_FormatReportedProperty(g_componentName, "accelRange", "4"));
+    });
+    BENCHMARK("FormatReportedPropertyWithStatus/component", {
+        PnP_MemPool_Free(PnP_FormatReportedPropertyWithStatus(g_componentName, "accelRange", "4", PNP_STATUS_SUCCESS, "success", 3));
+    });
+    BENCHMARK("CreateTelemetryMessageHandle/root", {
+        IoTHubMessage_Destroy(PnP_CreateTelemetryMessageHandle(NULL, "{\"button1\":true}"));
+    });
+    BENCHMARK("CreateTelemetryMessageHandle/component", {
+        IoTHubMessage_Destroy(PnP_CreateTelemetryMessageHandle(g_componentName, "{\"accelX\":0.98}"));
+    });
+
+    unsigned const char* componentName;
+    size_t componentNameSize;
+    const char* pnpCommandName;
+
+    BENCHMARK("ParseCommandName/root", {
+        PnP_ParseCommandName("reboot", &componentName, &componentNameSize, &pnpCommandName);
+    });
+    BENCHMARK("ParseCommandName/component", {
+        PnP_ParseCommandName("diagnostics*dumpStats", &componentName, &componentNameSize, &pnpCommandName);
+    });
+
+    static const char tinyPatch[] = "{\"led\":true,\"$version\":3}";
+    static const char componentPatch[] = "{\"motionSensorBMX055\":{\"__t\":\"c\",\"accelRange\":4,\"gyroRange\":500},\"$version\":4}";
+
+    BENCHMARK("ProcessTwinData/patch/tiny", {
+        PnP_ProcessTwinData(DEVICE_TWIN_UPDATE_PARTIAL, (const unsigned char*)tinyPatch, sizeof(tinyPatch) - 1,
+                            g_componentsInModel, g_numComponentsInModel, Bench_PropertyCallback, NULL);
+    });
+    BENCHMARK("ProcessTwinData/patch/component", {
+        PnP_ProcessTwinData(DEVICE_TWIN_UPDATE_PARTIAL, (const unsigned char*)componentPatch, sizeof(componentPatch) - 1,
+                            g_componentsInModel, g_numComponentsInModel, Bench_PropertyCallback, NULL);
+    });
+
+    static const size_t twinSizes[] = {512, 2048, 8192};
+    for (size_t i = 0; i < sizeof(twinSizes) / sizeof(twinSizes[0]); i++)
+    {
+        std::string twin = MakeFullTwin(twinSizes[i]);
+        std::string name = "ProcessTwinData/full/" + std::to_string(twinSizes[i]);
+
+        BENCHMARK(name.c_str(), {
+            PnP_ProcessTwinData(DEVICE_TWIN_UPDATE_COMPLETE, (const unsigned char*)twin.data(), twin.size(),
+                                g_componentsInModel, g_numComponentsInModel, Bench_PropertyCallback, NULL);
+        });
+    }
+
+#undef BENCHMARK
+
+    return results;
+}
+
+static bool WriteBaseline(const char* path, const std::vector<BENCHMARK_RESULT>& results)
+{
+    JSON_Value* rootValue = json_value_init_object();
+    JSON_Object* rootObject = json_value_get_object(rootValue);
+    bool result;
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        JSON_Value* benchmarkValue = json_value_init_object();
+        JSON_Object* benchmarkObject = json_value_get_object(benchmarkValue);
+
+        json_object_set_number(benchmarkObject, "nsPerOp", results[i].nsPerOp);
+        json_object_set_number(benchmarkObject, "allocsPerOp", results[i].allocsPerOp);
+        json_object_set_number(benchmarkObject, "bytesPerOp", results[i].bytesPerOp);
+        // Names hold '/', so they are set without dot notation
+        json_object_set_value(rootObject, results[i].name.c_str(), benchmarkValue);
+    }
+
+    if ((result = (json_serialize_to_file_pretty(rootValue, path) == JSONSuccess)) == false)
+    {
+        printf("Cannot write baseline %s\r\n", path);
+    }
+
+    json_value_free(rootValue);
+
+    return result;
+}
+
+//
+// CheckBaseline compares results with the baseline at path, and returns whether none regressed: allocations must not grow,
+// and time must not grow by more than timeTolerance.  Benchmarks missing from the baseline are skipped.
+//
+static bool CheckBaseline(const char* path, const std::vector<BENCHMARK_RESULT>& results, double timeTolerance)
+{
+    JSON_Value* rootValue;
+    JSON_Object* rootObject;
+    bool result = true;
+
+    if (((rootValue = json_parse_file(path)) == NULL) || ((rootObject = json_value_get_object(rootValue)) == NULL))
+    {
+        printf("Cannot read baseline %s\r\n", path);
+        json_value_free(rootValue);
+        return false;
+    }
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        JSON_Object* baseline = json_object_get_object(rootObject, results[i].name.c_str());
+
+        if (baseline == NULL)
+        {
+            printf("%-48s not in baseline\r\n", results[i].name.c_str());
+            continue;
+        }
+
+        double nsPerOp = json_object_get_number(baseline, "nsPerOp");
+        double allocsPerOp = json_object_get_number(baseline, "allocsPerOp");
+        double bytesPerOp = json_object_get_number(baseline, "bytesPerOp");
+
+        if (results[i].allocsPerOp > allocsPerOp + 0.01)
+        {
+            printf("%-48s REGRESSED allocs/op %.1f -> %.1f\r\n", results[i].name.c_str(), allocsPerOp, results[i].allocsPerOp);
+            result = false;
+        }
+        if (results[i].bytesPerOp > bytesPerOp + 0.5)
+        {
+            printf("%-48s REGRESSED B/op %.1f -> %.1f\r\n", results[i].name.c_str(), bytesPerOp, results[i].bytesPerOp);
+            result = false;
+        }
+        if (results[i].nsPerOp > nsPerOp * (1 + timeTolerance))
+        {
+            printf("%-48s REGRESSED ns/op %.1f -> %.1f\r\n", results[i].name.c_str(), nsPerOp, results[i].nsPerOp);
+            result = false;
+        }
+    }
+
+    json_value_free(rootValue);
+
+    return result;
+}
+
+static void PrintUsage(const char* program)
+{
+    printf("Usage: %s [options]\r\n"
+           "  -f, --filter TEXT           only run benchmarks whose names contain TEXT\r\n"
+           "  -m, --min-time-ms MS        time each benchmark for at least MS (default: 500)\r\n"
+           "  -b, --baseline FILE         fail if a benchmark regressed against FILE\r\n"
+           "  -t, --tolerance FRACTION    ns/op regression tolerated against the baseline (default: 0.25)\r\n"
+           "  -w, --write-baseline FILE   write the results to FILE as the new baseline\r\n", program);
+}
+
+int main(int argc, char* argv[])
+{
+    static const struct option longOptions[] =
+    {
+        {"filter", required_argument, NULL, 'f'},
+        {"min-time-ms", required_argument, NULL, 'm'},
+        {"baseline", required_argument, NULL, 'b'},
+        {"tolerance", required_argument, NULL, 't'},
+        {"write-baseline", required_argument, NULL, 'w'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    const char* filter = NULL;
+    const char* baselinePath = NULL;
+    const char* writeBaselinePath = NULL;
+    unsigned int minTimeMs = 500;
+    double timeTolerance = 0.25;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "f:m:b:t:w:h", longOptions, NULL)) != -1)
+    {
+        switch (option)
+        {
+            case 'f': filter = optarg; break;
+            case 'm': minTimeMs = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'b': baselinePath = optarg; break;
+            case 't': timeTolerance = strtod(optarg, NULL); break;
+            case 'w': writeBaselinePath = optarg; break;
+            default: PrintUsage(argv[0]); return (option == 'h') ? 0 : 1;
+        }
+    }
+
+    // As on the device, parson allocates through the arena
+    PnP_Arena_Init();
+
+    std::vector<BENCHMARK_RESULT> results = RunAllBenchmarks(minTimeMs, filter);
+    int exitCode = 0;
+
+    if ((writeBaselinePath != NULL) && (WriteBaseline(writeBaselinePath, results) == false))
+    {
+        exitCode = 1;
+    }
+    if ((baselinePath != NULL) && (CheckBaseline(baselinePath, results, timeTolerance) == false))
+    {
+        exitCode = 1;
+    }
+
+    return exitCode;
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmark of the TLS handshakes of pnp/common/pnp_tlsio.c against host/hub_standin: full handshakes, with the cached
+// session dropped before each, and handshakes resuming the session of the one before.  Each is timed from the start of
+// the TCP connection to the handshake done, and the bytes it cost on the wire are counted.
+//
+//     $ python3 host/hub_standin/hub_standin.py serve --certs standin-certs &
+//     $ PNP_TRUSTED_CERT_FILE=standin-certs/ca.pem pnp-tls-bench --rounds 20
+//
+// Bytes are what the device sends and receives too.  Times on the host are a small fraction of the device's, where the
+// public key operations of a full handshake take most of it.
+
+#include <getopt.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "mbed_config.h"
+#include "azure_c_shared_utility/platform.h"
+#include "azure_c_shared_utility/shared_util_options.h"
+#include "azure_c_shared_utility/tlsio.h"
+#include "azure_c_shared_utility/xio.h"
+
+#include "pnp_tlsio.h"
+#include "trusted_roots.h"
+
+// Longest a handshake, or the close after it, may take
+static const double g_handshakeTimeoutMs = 10000;
+
+//
+// HANDSHAKE_RESULT is the cost of one handshake
+//
+typedef struct HANDSHAKE_RESULT_TAG
+{
+    double ms;
+    uint32_t bytesSent;
+    uint32_t bytesReceived;
+    bool resumed;
+}
+HANDSHAKE_RESULT;
+
+//
+// CONNECTION_STATE tracks the open and close of one connection
+//
+typedef struct CONNECTION_STATE_TAG
+{
+    bool openDone;
+    IO_OPEN_RESULT openResult;
+    bool closeDone;
+}
+CONNECTION_STATE;
+
+static void Bench_OnOpenComplete(void* context, IO_OPEN_RESULT openResult)
+{
+    CONNECTION_STATE* state = (CONNECTION_STATE*)context;
+
+    state->openDone = true;
+    state->openResult = openResult;
+}
+
+static void Bench_OnBytesReceived(void* context, const unsigned char* buffer, size_t size)
+{
+    (void)context;
+    (void)buffer;
+    (void)size;
+}
+
+static void Bench_OnIoError(void* context)
+{
+    // Errors while opening are reported as a failed open
+    (void)context;
+}
+
+static void Bench_OnCloseComplete(void* context)
+{
+    CONNECTION_STATE* state = (CONNECTION_STATE*)context;
+
+    state->closeDone = true;
+}
+
+static double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//
+// Handshake connects with host, takes the TLS handshake and closes again, and returns its cost in result
+//
+static bool Handshake(const char* host, int port, const char* trustedCertificates, HANDSHAKE_RESULT* result)
+{
+    TLSIO_CONFIG tlsioConfig = {host, port, NULL, NULL};
+    CONNECTION_STATE state = {false, IO_OPEN_ERROR, false};
+    PNP_TLSIO_STATS stats;
+    XIO_HANDLE tlsIo;
+    bool succeeded = false;
+
+    if ((tlsIo = xio_create(PnP_TlsIo_GetInterfaceDescription(), &tlsioConfig)) == NULL)
+    {
+        printf("Cannot create TLS I/O\r\n");
+        return false;
+    }
+
+    if (xio_setoption(tlsIo, OPTION_TRUSTED_CERT, trustedCertificates) != 0)
+    {
+        printf("Cannot set trusted certificates\r\n");
+    }
+    else
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        if (xio_open(tlsIo, Bench_OnOpenComplete, &state, Bench_OnBytesReceived, NULL, Bench_OnIoError, &state) != 0)
+        {
+            printf("Cannot open TLS I/O\r\n");
+        }
+        else
+        {
+            while ((state.openDone == false) && (ElapsedMs(start) < g_handshakeTimeoutMs))
+            {
+                xio_dowork(tlsIo);
+                sched_yield();
+            }
+            result->ms = ElapsedMs(start);
+
+            if (state.openDone == false)
+            {
+                printf("TLS handshake with %s:%d timed out\r\n", host, port);
+            }
+            else if (state.openResult != IO_OPEN_OK)
+            {
+                printf("TLS handshake with %s:%d failed\r\n", host, port);
+            }
+            else
+            {
+                PnP_TlsIo_GetStats(&stats);
+                result->bytesSent = stats.lastHandshakeBytesSent;
+                result->bytesReceived = stats.lastHandshakeBytesReceived;
+                result->resumed = stats.lastHandshakeResumed;
+                succeeded = true;
+            }
+
+            // Close cleanly, so that the stand-in keeps the session
+            start = std::chrono::steady_clock::now();
+            if (xio_close(tlsIo, Bench_OnCloseComplete, &state) == 0)
+            {
+                while ((state.closeDone == false) && (ElapsedMs(start) < g_handshakeTimeoutMs))
+                {
+                    xio_dowork(tlsIo);
+                    sched_yield();
+                }
+            }
+        }
+    }
+
+    xio_destroy(tlsIo);
+
+    return succeeded;
+}
+
+//
+// RunHandshakes takes rounds handshakes, dropping the cached session before each if full is set, and prints their cost
+//
+static bool RunHandshakes(const char* name, bool full, unsigned int rounds, const char* host, int port, const char* trustedCertificates)
+{
+    std::vector<HANDSHAKE_RESULT> results;
+    double totalMs = 0;
+    double totalSent = 0;
+    double totalReceived = 0;
+    unsigned int resumed = 0;
+
+    for (unsigned int i = 0; i < rounds; i++)
+    {
+        HANDSHAKE_RESULT result;
+
+        if (full == true)
+        {
+            PnP_TlsIo_ForgetSession();
+        }
+
+        if (Handshake(host, port, trustedCertificates, &result) == false)
+        {
+            return false;
+        }
+
+        results.push_back(result);
+        totalMs += result.ms;
+        totalSent += result.bytesSent;
+        totalReceived += result.bytesReceived;
+        resumed += (result.resumed == true) ? 1 : 0;
+    }
+
+    std::sort(results.begin(), results.end(), [](const HANDSHAKE_RESULT& a, const HANDSHAKE_RESULT& b) { return a.ms < b.ms; });
+
+    printf("%-8s %8.2f ms mean %8.2f ms median %8.2f ms max %8.1f B sent %8.1f B received %3u/%u resumed\r\n",
+           name, totalMs / rounds, results[rounds / 2].ms, results[rounds - 1].ms, totalSent / rounds, totalReceived / rounds, resumed, rounds);
+    fflush(stdout);
+
+    return true;
+}
+
+static void PrintUsage(const char* program)
+{
+    printf("Usage: %s [options]\r\n"
+           "  -H, --host HOST       host of the stand-in (default: localhost)\r\n"
+           "  -p, --port PORT       port of the stand-in (default: 8883)\r\n"
+           "  -r, --rounds N        handshakes of each kind (default: 20)\r\n"
+           "Trusted certificates are read from PNP_TRUSTED_CERT_FILE, e.g. the stand-in's test CA.\r\n", program);
+}
+
+int main(int argc, char* argv[])
+{
+    static const struct option longOptions[] =
+    {
+        {"host", required_argument, NULL, 'H'},
+        {"port", required_argument, NULL, 'p'},
+        {"rounds", required_argument, NULL, 'r'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    const char* host = "localhost";
+    int port = 8883;
+    unsigned int rounds = 20;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "H:p:r:h", longOptions, NULL)) != -1)
+    {
+        switch (option)
+        {
+            case 'H': host = optarg; break;
+            case 'p': port = (int)strtol(optarg, NULL, 0); break;
+            case 'r': rounds = (unsigned int)strtoul(optarg, NULL, 0); break;
+            default: PrintUsage(argv[0]); return (option == 'h') ? 0 : 1;
+        }
+    }
+
+    if (rounds == 0)
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    const char* trustedCertificates = HostConfig_GetTrustedCertificates(trusted_roots);
+    bool succeeded;
+
+    if (platform_init() != 0)
+    {
+        printf("platform_init failed\r\n");
+        return 1;
+    }
+
+    // The resumed handshakes start from the session of the last full one
+    succeeded = RunHandshakes("full", true, rounds, host, port, trustedCertificates) &&
+                RunHandshakes("resumed", false, rounds, host, port, trustedCertificates);
+
+    platform_deinit();
+
+    return succeeded ? 0 : 1;
+}
@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Simulated-fleet load generator of the host build.  It runs many virtual NuMaker IoT M487 devices in one process, each
+// with its own IoT Hub client and components, against IoT Hub or the local stand-in in host/hub_standin.  All devices are
+// served by one event loop, like the single thread each board polls its client from, and share the simulated BMX055.
+//
+// It reports aggregate telemetry messages/sec, CPU time/message and heap/device, i.e. the per-device cost of the
+// protocol layer and components.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <map>
+#include <vector>
+
+#include "mbed.h"
+#include "mbed_stats.h"
+
+#include "iothub.h"
+#include "iothub_device_client_ll.h"
+#include "iothub_client_options.h"
+#include "azure_c_shared_utility/strings.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "pnp_device_client_ll.h"
+#include "pnp_protocol.h"
+#include "pnp_arena.h"
+#include "pnp_mempool.h"
+#include "latency_probe.h"
+#include "trusted_roots.h"
+
+#include "pnp_component_registry.h"
+#include "pnp_motion_sensor_bmx055_component.h"
+#include "pnp_deviceinfo_component.h"
+#include "pnp_diagnostics_component.h"
+
+static const char g_NuMakerIoTM487DevModelId[] = "dtmi:nuvoton:numaker_iot_m487_dev;1";
+
+// Components of each device.  Telemetry of the motion sensor is due on every telemetry interval of the device.  Diagnostics are
+// of the whole process, so devices send none.
+static const PNP_COMPONENT_REGISTRATION g_componentRegistrations[] =
+{
+    {"motionSensorBMX055", 1, &g_motionSensorBMX055ComponentInterface},
+    {"deviceInformation", 0, &g_deviceInfoComponentInterface},
+    {"diagnostics", 0, &g_diagnosticsComponentInterface}
+};
+static const size_t g_numComponentRegistrations = sizeof(g_componentRegistrations) / sizeof(g_componentRegistrations[0]);
+
+static const char g_ledPropertyName[] = "led";
+
+//
+// FLEET_OPTIONS are the command line options
+//
+typedef struct FLEET_OPTIONS_TAG
+{
+    unsigned int numDevices;
+    // printf format of the connection strings, given the device index
+    const char* connectionStringFormat;
+    unsigned int telemetryIntervalMs;
+    unsigned int pollIntervalMs;
+    unsigned int reportIntervalSecs;
+    unsigned int durationSecs;
+}
+FLEET_OPTIONS;
+
+//
+// VIRTUAL_DEVICE is one device of the fleet
+//
+typedef struct VIRTUAL_DEVICE_TAG
+{
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClient;
+    PNP_COMPONENT_REGISTRY componentRegistry;
+    char connectionString[256];
+    uint64_t nextTelemetryMs;
+    unsigned int telemetryCount;
+    bool connected;
+}
+VIRTUAL_DEVICE;
+
+static std::vector<VIRTUAL_DEVICE> g_devices;
+
+// Devices by IoT Hub client, for the twin callbacks
+static std::map<IOTHUB_DEVICE_CLIENT_LL_HANDLE, VIRTUAL_DEVICE*> g_devicesByClient;
+
+static unsigned int g_connectedDevices = 0;
+
+//
+// NowMs returns milliseconds of the monotonic clock
+//
+static uint64_t NowMs(void)
+{
+    return (uint64_t)(Kernel::Clock::now().time_since_epoch().count());
+}
+
+//
+// ProcessCpuUs returns the CPU time of the process, in microseconds
+//
+static uint64_t ProcessCpuUs(void)
+{
+    struct timespec cpuTime;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuTime);
+
+    return (uint64_t)cpuTime.tv_sec * 1000000 + cpuTime.tv_nsec / 1000;
+}
+
+//
+// HeapInUse returns the heap allocated, in bytes
+//
+static uint32_t HeapInUse(void)
+{
+    mbed_stats_heap_t heapStats;
+
+    mbed_stats_heap_get(&heapStats);
+
+    return heapStats.current_size;
+}
+
+//
+// Fleet_ReportProperty_Led acknowledges a led property update
+//
+static void Fleet_ReportProperty_Led(IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClient, bool ledState, int version)
+{
+    char* jsonToSend;
+
+    if ((jsonToSend = PnP_FormatReportedPropertyWithStatus(NULL, g_ledPropertyName, ledState ? "true" : "false", PNP_STATUS_SUCCESS, "success", version)) == NULL)
+    {
+        LogError("Unable to build %s property", g_ledPropertyName);
+    }
+    else
+    {
+        if (IoTHubDeviceClient_LL_SendReportedState(deviceClient, (const unsigned char*)jsonToSend, strlen(jsonToSend), NULL, NULL) != IOTHUB_CLIENT_OK)
+        {
+            LogError("Unable to send reported state for %s property", g_ledPropertyName);
+        }
+
+        PnP_MemPool_Free(jsonToSend);
+    }
+}
+
+//
+// Fleet_PropertyCallback is invoked when PnP_ProcessTwinData() visits each property
+//
+static void Fleet_PropertyCallback(const char* componentName, const char* propertyName, JSON_Value* propertyValue, int version, void* userContextCallback)
+{
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClient = (IOTHUB_DEVICE_CLIENT_LL_HANDLE)userContextCallback;
+
+    if (componentName == NULL)
+    {
+        if ((strcmp(propertyName, g_ledPropertyName) == 0) && (json_value_get_type(propertyValue) == JSONBoolean))
+        {
+            Fleet_ReportProperty_Led(deviceClient, json_value_get_boolean(propertyValue) != 0, version);
+        }
+    }
+    else
+    {
+        (void)PnP_ComponentRegistry_ProcessPropertyUpdate(&g_devicesByClient[deviceClient]->componentRegistry, deviceClient, componentName, propertyName, propertyValue, version);
+    }
+}
+
+//
+// Fleet_DeviceTwinCallback is invoked by IoT SDK when a twin - either full twin or a PATCH update - arrives
+//
+static void Fleet_DeviceTwinCallback(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned char* payload, size_t size, void* userContextCallback)
+{
+    PNP_COMPONENT_REGISTRY* componentRegistry = &g_devicesByClient[(IOTHUB_DEVICE_CLIENT_LL_HANDLE)userContextCallback]->componentRegistry;
+
+    if (PnP_ProcessTwinData(updateState, payload, size, componentRegistry->componentNames, componentRegistry->numComponents, Fleet_PropertyCallback, userContextCallback) == false)
+    {
+        LogError("Unable to process twin json");
+    }
+}
+
+//
+// Fleet_DeviceMethodCallback is invoked by IoT SDK when a device method arrives
+//
+static int Fleet_DeviceMethodCallback(const char* methodName, const unsigned char* payload, size_t size, unsigned char** response, size_t* responseSize, void* userContextCallback)
+{
+    VIRTUAL_DEVICE* device = (VIRTUAL_DEVICE*)userContextCallback;
+    static const char emptyResponse[] = "{}";
+    char* jsonStr = NULL;
+    JSON_Value* rootValue = NULL;
+    unsigned const char* componentName;
+    size_t componentNameSize;
+    const char* pnpCommandName;
+    int result = PNP_STATUS_NOT_FOUND;
+
+    *response = NULL;
+    *responseSize = 0;
+
+    PnP_Arena_Begin();
+
+    PnP_ParseCommandName(methodName, &componentName, &componentNameSize, &pnpCommandName);
+
+    if (((jsonStr = PnP_CopyPayloadToString(payload, size)) == NULL) || ((rootValue = json_parse_string(jsonStr)) == NULL))
+    {
+        result = PNP_STATUS_BAD_FORMAT;
+    }
+    else if (componentName == NULL)
+    {
+        // No reboot on the fleet
+        result = PNP_STATUS_NOT_FOUND;
+    }
+    else
+    {
+        result = PnP_ComponentRegistry_ProcessCommand(&device->componentRegistry, (const char*)componentName, componentNameSize, pnpCommandName, rootValue, response, responseSize);
+    }
+
+    if ((*response == NULL) && ((*response = (unsigned char*)malloc(sizeof(emptyResponse) - 1)) != NULL))
+    {
+        memcpy(*response, emptyResponse, sizeof(emptyResponse) - 1);
+        *responseSize = sizeof(emptyResponse) - 1;
+    }
+
+    json_value_free(rootValue);
+    PnP_Arena_Free(jsonStr);
+
+    PnP_Arena_End();
+
+    return result;
+}
+
+//
+// Fleet_ConnectionStatusCallback is invoked by IoT SDK when the connection status of a device changes
+//
+static void Fleet_ConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void* userContextCallback)
+{
+    VIRTUAL_DEVICE* device = (VIRTUAL_DEVICE*)userContextCallback;
+    bool connected = (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED);
+
+    (void)reason;
+
+    if (connected != device->connected)
+    {
+        device->connected = connected;
+        connected ? g_connectedDevices++ : g_connectedDevices--;
+    }
+}
+
+//
+// Fleet_CreateDevice creates the IoT Hub client and components of device index
+//
+static bool Fleet_CreateDevice(const FLEET_OPTIONS* options, unsigned int index)
+{
+    VIRTUAL_DEVICE* device = &g_devices[index];
+    PNP_DEVICE_CONFIGURATION pnpDeviceConfiguration;
+
+    memset(&pnpDeviceConfiguration, 0, sizeof(pnpDeviceConfiguration));
+    snprintf(device->connectionString, sizeof(device->connectionString), options->connectionStringFormat, index);
+
+    pnpDeviceConfiguration.securityType = PNP_CONNECTION_SECURITY_TYPE_CONNECTION_STRING;
+    pnpDeviceConfiguration.u.connectionString = device->connectionString;
+    pnpDeviceConfiguration.modelId = g_NuMakerIoTM487DevModelId;
+    pnpDeviceConfiguration.deviceTwinCallback = Fleet_DeviceTwinCallback;
+    pnpDeviceConfiguration.setRetryPolicy = true;
+    pnpDeviceConfiguration.retryPolicy = IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER;
+    pnpDeviceConfiguration.trustedCertificates = HostConfig_GetTrustedCertificates(trusted_roots);
+
+    if ((device->deviceClient = PnP_CreateDeviceClientLLHandle(&pnpDeviceConfiguration)) == NULL)
+    {
+        LogError("Failure creating IotHub device client of device %u", index);
+        return false;
+    }
+    // The connection status and device method callbacks are set here, as PnP_CreateDeviceClientLLHandle gives them no context
+    else if (IoTHubDeviceClient_LL_SetConnectionStatusCallback(device->deviceClient, Fleet_ConnectionStatusCallback, device) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Unable to set connection status callback of device %u", index);
+        return false;
+    }
+    else if (IoTHubDeviceClient_LL_SetDeviceMethodCallback(device->deviceClient, Fleet_DeviceMethodCallback, device) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Unable to set device method callback of device %u", index);
+        return false;
+    }
+    else if (PnP_ComponentRegistry_Create(&device->componentRegistry, g_componentRegistrations, g_numComponentRegistrations) == false)
+    {
+        LogError("Unable to create components of device %u", index);
+        return false;
+    }
+
+    g_devicesByClient[device->deviceClient] = device;
+
+    // Spread telemetry of the devices evenly over the interval
+    device->nextTelemetryMs = NowMs() + ((uint64_t)options->telemetryIntervalMs * index) / options->numDevices;
+
+    PnP_ComponentRegistry_ReportProperties(&device->componentRegistry, device->deviceClient);
+    Fleet_ReportProperty_Led(device->deviceClient, false, 1);
+
+    return true;
+}
+
+//
+// Fleet_PrintReport prints the rates over the interval since the previous report
+//
+static void Fleet_PrintReport(uint64_t intervalMs, uint32_t delivered, uint32_t failed, uint64_t cpuUs, uint32_t heapPerDevice)
+{
+    double seconds = (double)intervalMs / 1000;
+
+    printf("devices=%u connected=%u msgs/s=%.1f failed=%lu cpuUs/msg=%.1f cpu=%.1f%% heapBytes/device=%lu\r\n",
+           (unsigned int)g_devices.size(), g_connectedDevices, delivered / seconds, (unsigned long)failed,
+           (delivered > 0) ? (double)cpuUs / delivered : 0.0, (double)cpuUs / (intervalMs * 10), (unsigned long)heapPerDevice);
+    fflush(stdout);
+}
+
+static void PrintUsage(const char* program)
+{
+    printf("Usage: %s [options]\r\n"
+           "  -n, --devices N             virtual devices (default: 100)\r\n"
+           "  -c, --connection-string F   printf format of connection strings, given the device index\r\n"
+           "                              (default: HostName=localhost;DeviceId=fleet%%u;SharedAccessKey=AAAA)\r\n"
+           "  -t, --telemetry-ms MS       motion sensor telemetry interval of each device (default: 10000)\r\n"
+           "  -p, --poll-ms MS            interval of the event loop (default: 10)\r\n"
+           "  -r, --report-secs S         interval of reports (default: 10)\r\n"
+           "  -d, --duration-secs S       seconds to run, or 0 until interrupted (default: 0)\r\n"
+           "PNP_TRUSTED_CERT_FILE trusts another CA, e.g. the test CA of host/hub_standin.\r\n", program);
+}
+
+int main(int argc, char* argv[])
+{
+    static const struct option longOptions[] =
+    {
+        {"devices", required_argument, NULL, 'n'},
+        {"connection-string", required_argument, NULL, 'c'},
+        {"telemetry-ms", required_argument, NULL, 't'},
+        {"poll-ms", required_argument, NULL, 'p'},
+        {"report-secs", required_argument, NULL, 'r'},
+        {"duration-secs", required_argument, NULL, 'd'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    FLEET_OPTIONS options = {100, "HostName=localhost;DeviceId=fleet%u;SharedAccessKey=AAAA", 10000, 10, 10, 0};
+    int option;
+
+    while ((option = getopt_long(argc, argv, "n:c:t:p:r:d:h", longOptions, NULL)) != -1)
+    {
+        switch (option)
+        {
+            case 'n': options.numDevices = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'c': options.connectionStringFormat = optarg; break;
+            case 't': options.telemetryIntervalMs = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'p': options.pollIntervalMs = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'r': options.reportIntervalSecs = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'd': options.durationSecs = (unsigned int)strtoul(optarg, NULL, 0); break;
+            default: PrintUsage(argv[0]); return (option == 'h') ? 0 : 1;
+        }
+    }
+
+    if ((options.numDevices == 0) || (options.pollIntervalMs == 0) || (options.reportIntervalSecs == 0))
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    PnP_Arena_Init();
+    LatencyProbe_Init();
+
+    if (PnP_ComponentRegistry_Initialize(g_componentRegistrations, g_numComponentRegistrations) == false)
+    {
+        LogError("Simulated sensors are NOT available!!");
+        return -1;
+    }
+
+    // Heap per device is what creating the clients and components, and connecting them, adds
+    uint32_t heapBaseline = HeapInUse();
+
+    g_devices.resize(options.numDevices);
+    for (unsigned int i = 0; i < options.numDevices; i++)
+    {
+        memset(&g_devices[i], 0, sizeof(g_devices[i]));
+        if (Fleet_CreateDevice(&options, i) == false)
+        {
+            return -1;
+        }
+    }
+    LogInfo("Created %u virtual devices", options.numDevices);
+
+    uint64_t startMs = NowMs();
+    uint64_t reportMs = startMs;
+    uint64_t reportCpuUs = ProcessCpuUs();
+    uint32_t reportDelivered = 0;
+    uint32_t reportFailed = 0;
+    uint32_t totalDelivered;
+    uint32_t totalFailed;
+
+    while ((options.durationSecs == 0) || ((NowMs() - startMs) < (uint64_t)options.durationSecs * 1000))
+    {
+        uint64_t nowMs = NowMs();
+
+        for (size_t i = 0; i < g_devices.size(); i++)
+        {
+            VIRTUAL_DEVICE* device = &g_devices[i];
+
+            if (device->connected && (nowMs >= device->nextTelemetryMs))
+            {
+                PnP_ComponentRegistry_SendTelemetry(&device->componentRegistry, device->deviceClient, device->telemetryCount++);
+                device->nextTelemetryMs += options.telemetryIntervalMs;
+            }
+
+            IoTHubDeviceClient_LL_DoWork(device->deviceClient);
+        }
+
+        if ((nowMs - reportMs) >= (uint64_t)options.reportIntervalSecs * 1000)
+        {
+            uint64_t cpuUs = ProcessCpuUs();
+            uint32_t heapInUse = HeapInUse();
+
+            PnP_DiagnosticsComponent_GetSendCounts(&totalDelivered, &totalFailed);
+            Fleet_PrintReport(nowMs - reportMs, totalDelivered - reportDelivered, totalFailed - reportFailed, cpuUs - reportCpuUs,
+                              (heapInUse > heapBaseline) ? (heapInUse - heapBaseline) / options.numDevices : 0);
+
+            reportMs = nowMs;
+            reportCpuUs = cpuUs;
+            reportDelivered = totalDelivered;
+            reportFailed = totalFailed;
+        }
+
+        ThisThread::sleep_for(std::chrono::milliseconds(options.pollIntervalMs));
+    }
+
+    PnP_DiagnosticsComponent_GetSendCounts(&totalDelivered, &totalFailed);
+    LogInfo("Delivered %lu messages, %lu failed, in %lu s", (unsigned long)totalDelivered, (unsigned long)totalFailed, (unsigned long)((NowMs() - startMs) / 1000));
+
+    for (size_t i = 0; i < g_devices.size(); i++)
+    {
+        IoTHubDeviceClient_LL_Destroy(g_devices[i].deviceClient);
+        PnP_ComponentRegistry_Destroy(&g_devices[i].componentRegistry);
+    }
+
+    // The platform and TLS layer go last, once no client is left using them
+    IoTHub_Deinit();
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Fuzz target of command handling: PnP_ParseCommandName on the method name, and the components' command processing on the
+// payload, dispatched through the component registry like the application's device method callback.  The input is the method name, a NUL, then the payload.
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "azure_c_shared_utility/xlogging.h"
+#include "parson.h"
+
+#include "pnp_protocol.h"
+#include "pnp_arena.h"
+#include "pnp_component_registry.h"
+#include "pnp_motion_sensor_bmx055_component.h"
+#include "pnp_deviceinfo_component.h"
+#include "pnp_diagnostics_component.h"
+
+static const PNP_COMPONENT_REGISTRATION g_componentRegistrations[] =
+{
+    {"motionSensorBMX055", 0, &g_motionSensorBMX055ComponentInterface},
+    {"deviceInformation", 0, &g_deviceInfoComponentInterface},
+    {"diagnostics", 0, &g_diagnosticsComponentInterface}
+};
+
+static PNP_COMPONENT_REGISTRY g_componentRegistry;
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    xlogging_set_log_function(NULL);
+
+    PnP_Arena_Init();
+    (void)PnP_ComponentRegistry_Create(&g_componentRegistry, g_componentRegistrations, sizeof(g_componentRegistrations) / sizeof(g_componentRegistrations[0]));
+
+    return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    const uint8_t* separator = (const uint8_t*)memchr(data, '\0', size);
+    size_t methodNameSize = (separator != NULL) ? (size_t)(separator - data) : size;
+    std::string methodName((const char*)data, methodNameSize);
+    const unsigned char* payload = (separator != NULL) ? (separator + 1) : (data + size);
+    size_t payloadSize = size - (size_t)(payload - data);
+
+    unsigned const char* componentName;
+    size_t componentNameSize;
+    const char* pnpCommandName;
+
+    PnP_ParseCommandName(methodName.c_str(), &componentName, &componentNameSize, &pnpCommandName);
+
+    // The component name and command name must lie within the method name
+    const char* begin = methodName.c_str();
+    const char* end = begin + methodName.size();
+    assert((pnpCommandName >= begin) && (pnpCommandName <= end));
+    assert((componentName == NULL) || (((const char*)componentName >= begin) && ((const char*)componentName + componentNameSize < end)));
+
+    PnP_Arena_Begin();
+
+    char* jsonStr = PnP_CopyPayloadToString(payload, payloadSize);
+    JSON_Value* rootValue = (jsonStr != NULL) ? json_parse_string(jsonStr) : NULL;
+    unsigned char* response = NULL;
+    size_t responseSize = 0;
+
+    if ((rootValue != NULL) && (componentName != NULL))
+    {
+        (void)PnP_ComponentRegistry_ProcessCommand(&g_componentRegistry, (const char*)componentName, componentNameSize, pnpCommandName, rootValue, &response, &responseSize);
+    }
+
+    // The SDK frees responses with free(), so they must not come from the arena
+    free(response);
+
+    json_value_free(rootValue);
+    PnP_Arena_Free(jsonStr);
+
+    PnP_Arena_End();
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Corpus-driven throughput mode of the fuzz targets, for builds without libFuzzer.  It feeds every file of the given corpus
+// directories to LLVMFuzzerTestOneInput for a number of rounds, and reports the parse rate in MB/s:
+//
+//     $ pnp-fuzz-twin-throughput --rounds 200 host/fuzz/corpus/twin
+//
+// Any change to the parsers can so be checked for speed on the same inputs the fuzzers checked it for correctness.
+
+#include <dirent.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv);
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+//
+// ReadFile appends the contents of path to inputs
+//
+static void ReadFile(const std::string& path, std::vector<std::string>* inputs)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    std::string input;
+    char buffer[4096];
+    size_t length;
+
+    if (file == NULL)
+    {
+        return;
+    }
+
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        input.append(buffer, length);
+    }
+    fclose(file);
+
+    inputs->push_back(input);
+}
+
+//
+// ReadCorpus reads every file of a corpus directory, or the path itself if it is a file
+//
+static void ReadCorpus(const char* path, std::vector<std::string>* inputs)
+{
+    DIR* directory = opendir(path);
+    struct dirent* entry;
+
+    if (directory == NULL)
+    {
+        ReadFile(path, inputs);
+        return;
+    }
+
+    while ((entry = readdir(directory)) != NULL)
+    {
+        if (entry->d_name[0] != '.')
+        {
+            ReadFile(std::string(path) + "/" + entry->d_name, inputs);
+        }
+    }
+    closedir(directory);
+}
+
+int main(int argc, char* argv[])
+{
+    static const struct option longOptions[] =
+    {
+        {"rounds", required_argument, NULL, 'r'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    unsigned int rounds = 100;
+    int option;
+
+    while ((option = getopt_long(argc, argv, "r:h", longOptions, NULL)) != -1)
+    {
+        if (option == 'r')
+        {
+            rounds = (unsigned int)strtoul(optarg, NULL, 0);
+        }
+        else
+        {
+            printf("Usage: %s [--rounds N] CORPUS_DIR_OR_FILE...\r\n", argv[0]);
+            return (option == 'h') ? 0 : 1;
+        }
+    }
+
+    std::vector<std::string> inputs;
+    size_t totalBytes = 0;
+
+    for (int i = optind; i < argc; i++)
+    {
+        ReadCorpus(argv[i], &inputs);
+    }
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        totalBytes += inputs[i].size();
+    }
+
+    if (inputs.empty() || (rounds == 0))
+    {
+        printf("No inputs\r\n");
+        return 1;
+    }
+
+    LLVMFuzzerInitialize(&argc, &argv);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int round = 0; round < rounds; round++)
+    {
+        for (size_t i = 0; i < inputs.size(); i++)
+        {
+            LLVMFuzzerTestOneInput((const uint8_t*)inputs[i].data(), inputs[i].size());
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("inputs=%lu bytes=%lu rounds=%u seconds=%.3f MB/s=%.2f inputs/s=%.0f\r\n",
+           (unsigned long)inputs.size(), (unsigned long)totalBytes, rounds, seconds,
+           (double)totalBytes * rounds / seconds / 1e6, (double)inputs.size() * rounds / seconds);
+
+    return 0;
+}
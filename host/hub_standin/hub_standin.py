@@ -0,0 +1,416 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020, Nuvoton Technology Corporation
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Local stand-in of Azure IoT Hub, for end-to-end throughput benchmarks of the host build.
+
+It speaks just enough of the IoT Hub MQTT topic scheme for this application: telemetry on
+devices/{id}/messages/events, the device twin on $iothub/twin/* and direct methods on $iothub/methods/*.
+Any device and SAS token are accepted. Twin patches and method calls are injected at configurable rates,
+and their round-trip latencies and the telemetry rate are reported.
+
+    $ python3 host/hub_standin/hub_standin.py gen-certs standin-certs
+    $ python3 host/hub_standin/hub_standin.py serve --certs standin-certs --method-rate 2 --patch-rate 1 --duration 60 --output report.json
+
+Then run the host build against it:
+
+    $ PNP_TRUSTED_CERT_FILE=standin-certs/ca.pem \\
+      IOTHUB_CONNECTION_STRING="HostName=localhost;DeviceId=dev0;SharedAccessKey=AAAA" \\
+      ./build-host/host/NuMaker-mbed-Azure-IoT-CSDK-PnP-example-host
+
+Requires Python 3.7, and the openssl command line tool for gen-certs.
+"""
+
+import argparse
+import asyncio
+import json
+import os
+import signal
+import ssl
+import struct
+import subprocess
+import sys
+import time
+from urllib.parse import parse_qs
+
+# MQTT 3.1.1 control packet types
+CONNECT = 1
+CONNACK = 2
+PUBLISH = 3
+PUBACK = 4
+SUBSCRIBE = 8
+SUBACK = 9
+UNSUBSCRIBE = 10
+UNSUBACK = 11
+PINGREQ = 12
+PINGRESP = 13
+DISCONNECT = 14
+
+TWIN_RES_PREFIX = "$iothub/twin/res/"
+TWIN_GET_PREFIX = "$iothub/twin/GET/"
+TWIN_REPORTED_PREFIX = "$iothub/twin/PATCH/properties/reported/"
+TWIN_DESIRED_PREFIX = "$iothub/twin/PATCH/properties/desired/"
+METHODS_POST_PREFIX = "$iothub/methods/POST/"
+METHODS_RES_PREFIX = "$iothub/methods/res/"
+
+
+def encode_length(length):
+    encoded = bytearray()
+    while True:
+        byte = length % 128
+        length //= 128
+        encoded.append(byte | 0x80 if length > 0 else byte)
+        if length == 0:
+            return bytes(encoded)
+
+
+def encode_string(text):
+    data = text.encode("utf-8")
+    return struct.pack("!H", len(data)) + data
+
+
+def packet(packet_type, flags, body):
+    return bytes([(packet_type << 4) | flags]) + encode_length(len(body)) + body
+
+
+def percentile(values, fraction):
+    if not values:
+        return None
+    ordered = sorted(values)
+    return round(ordered[min(len(ordered) - 1, int(fraction * len(ordered)))], 3)
+
+
+class LatencySeries:
+    """Round-trip latencies in milliseconds, with the count of requests that were never answered."""
+
+    def __init__(self):
+        self.sent = 0
+        self.latencies = []
+        self.timeouts = 0
+
+    def summary(self):
+        return {
+            "sent": self.sent,
+            "answered": len(self.latencies),
+            "timeouts": self.timeouts,
+            "p50Ms": percentile(self.latencies, 0.50),
+            "p90Ms": percentile(self.latencies, 0.90),
+            "p99Ms": percentile(self.latencies, 0.99),
+            "maxMs": round(max(self.latencies), 3) if self.latencies else None,
+        }
+
+
+class Stats:
+    def __init__(self):
+        self.start = time.monotonic()
+        self.connects = 0
+        self.telemetry_messages = 0
+        self.telemetry_bytes = 0
+        self.reported_patches = 0
+        self.methods = LatencySeries()
+        self.patches = LatencySeries()
+        self.interval_start = self.start
+        self.interval_messages = 0
+
+    def take_interval_rate(self):
+        now = time.monotonic()
+        rate = self.interval_messages / max(now - self.interval_start, 1e-6)
+        self.interval_start = now
+        self.interval_messages = 0
+        return rate
+
+    def report(self):
+        elapsed = time.monotonic() - self.start
+        return {
+            "elapsedSecs": round(elapsed, 3),
+            "connects": self.connects,
+            "telemetryMessages": self.telemetry_messages,
+            "telemetryBytes": self.telemetry_bytes,
+            "telemetryPerSec": round(self.telemetry_messages / max(elapsed, 1e-6), 3),
+            "reportedPatches": self.reported_patches,
+            "methods": self.methods.summary(),
+            "desiredPatches": self.patches.summary(),
+        }
+
+
+class DeviceSession:
+    """One MQTT connection from a device, with its twin and the requests injected into it."""
+
+    def __init__(self, hub, reader, writer):
+        self.hub = hub
+        self.reader = reader
+        self.writer = writer
+        self.device_id = None
+        self.subscriptions = set()
+        self.desired = {"$version": 1}
+        self.reported = {"$version": 1}
+        self.pending_methods = {}
+        self.pending_patches = {}
+        self.next_rid = 1
+        self.led = False
+        self.tasks = []
+
+    async def read_packet(self):
+        header = await self.reader.readexactly(1)
+        length = 0
+        multiplier = 1
+        while True:
+            byte = (await self.reader.readexactly(1))[0]
+            length += (byte & 0x7F) * multiplier
+            if (byte & 0x80) == 0:
+                break
+            multiplier *= 128
+        body = await self.reader.readexactly(length) if length > 0 else b""
+        return header[0] >> 4, header[0] & 0x0F, body
+
+    def send(self, data):
+        self.writer.write(data)
+
+    def publish(self, topic, payload):
+        # QoS 0, like IoT Hub for twin responses, desired property patches and method requests
+        self.send(packet(PUBLISH, 0, encode_string(topic) + payload))
+
+    async def run(self):
+        try:
+            while True:
+                packet_type, flags, body = await self.read_packet()
+                if packet_type == CONNECT:
+                    self.on_connect(body)
+                elif packet_type == PUBLISH:
+                    self.on_publish(flags, body)
+                elif packet_type == SUBSCRIBE:
+                    self.on_subscribe(body)
+                elif packet_type == UNSUBSCRIBE:
+                    self.send(packet(UNSUBACK, 0, body[0:2]))
+                elif packet_type == PINGREQ:
+                    self.send(packet(PINGRESP, 0, b""))
+                elif packet_type == DISCONNECT:
+                    break
+                await self.writer.drain()
+        except (asyncio.IncompleteReadError, ConnectionError, ssl.SSLError):
+            pass
+        finally:
+            for task in self.tasks:
+                task.cancel()
+            # Requests outstanding at disconnect are never answered
+            self.hub.stats.methods.timeouts += len(self.pending_methods)
+            self.hub.stats.patches.timeouts += len(self.pending_patches)
+            self.writer.close()
+            if self.device_id is not None:
+                print("Device {} disconnected".format(self.device_id))
+
+    def on_connect(self, body):
+        offset = 2 + struct.unpack_from("!H", body, 0)[0]
+        offset += 4  # Protocol level, connect flags and keep alive
+        client_id_length = struct.unpack_from("!H", body, offset)[0]
+        self.device_id = body[offset + 2:offset + 2 + client_id_length].decode("utf-8")
+        self.hub.stats.connects += 1
+        print("Device {} connected".format(self.device_id))
+        self.send(packet(CONNACK, 0, b"\x00\x00"))
+
+    def on_subscribe(self, body):
+        packet_id = body[0:2]
+        offset = 2
+        granted = bytearray()
+        while offset < len(body):
+            length = struct.unpack_from("!H", body, offset)[0]
+            topic = body[offset + 2:offset + 2 + length].decode("utf-8")
+            qos = body[offset + 2 + length]
+            offset += 3 + length
+            self.subscriptions.add(topic)
+            granted.append(min(qos, 1))
+            if topic.startswith(METHODS_POST_PREFIX) and self.hub.args.method_rate > 0:
+                self.tasks.append(asyncio.ensure_future(self.inject(self.hub.args.method_rate, self.invoke_method)))
+            elif topic.startswith(TWIN_DESIRED_PREFIX) and self.hub.args.patch_rate > 0:
+                self.tasks.append(asyncio.ensure_future(self.inject(self.hub.args.patch_rate, self.patch_desired)))
+        self.send(packet(SUBACK, 0, packet_id + bytes(granted)))
+
+    def on_publish(self, flags, body):
+        qos = (flags >> 1) & 0x03
+        length = struct.unpack_from("!H", body, 0)[0]
+        topic = body[2:2 + length].decode("utf-8")
+        offset = 2 + length
+        if qos > 0:
+            self.send(packet(PUBACK, 0, body[offset:offset + 2]))
+            offset += 2
+        payload = body[offset:]
+
+        path, _, query = topic.partition("?")
+        params = {key: values[0] for key, values in parse_qs(query).items()}
+
+        if topic.startswith("devices/{}/messages/events".format(self.device_id)):
+            self.hub.stats.telemetry_messages += 1
+            self.hub.stats.interval_messages += 1
+            self.hub.stats.telemetry_bytes += len(payload)
+        elif path.startswith(TWIN_GET_PREFIX):
+            twin = {"desired": self.desired, "reported": self.reported}
+            self.publish("{}200/?$rid={}".format(TWIN_RES_PREFIX, params.get("$rid", "")), json.dumps(twin).encode("utf-8"))
+        elif path.startswith(TWIN_REPORTED_PREFIX):
+            self.on_reported_patch(params.get("$rid", ""), payload)
+        elif path.startswith(METHODS_RES_PREFIX):
+            sent = self.pending_methods.pop(params.get("$rid", ""), None)
+            if sent is not None:
+                self.hub.stats.methods.latencies.append((time.monotonic() - sent) * 1000)
+
+    def on_reported_patch(self, rid, payload):
+        try:
+            patch = json.loads(payload.decode("utf-8"))
+        except ValueError:
+            self.publish("{}400/?$rid={}".format(TWIN_RES_PREFIX, rid), b"")
+            return
+
+        self.reported["$version"] += 1
+        self.hub.stats.reported_patches += 1
+        for name, value in patch.items():
+            if value is None:
+                self.reported.pop(name, None)
+            else:
+                self.reported[name] = value
+            # Writable properties are acknowledged with the desired version they apply
+            version = value.get("av") if isinstance(value, dict) else None
+            sent = self.pending_patches.pop(version, None)
+            if sent is not None:
+                self.hub.stats.patches.latencies.append((time.monotonic() - sent) * 1000)
+        self.publish("{}204/?$rid={}&$version={}".format(TWIN_RES_PREFIX, rid, self.reported["$version"]), b"")
+
+    async def inject(self, rate, request):
+        interval = 1.0 / rate
+        timeout = self.hub.args.timeout
+        while True:
+            await asyncio.sleep(interval)
+            request()
+            await self.writer.drain()
+            now = time.monotonic()
+            for pending, series in ((self.pending_methods, self.hub.stats.methods), (self.pending_patches, self.hub.stats.patches)):
+                for key in [key for key, sent in pending.items() if now - sent > timeout]:
+                    del pending[key]
+                    series.timeouts += 1
+
+    def invoke_method(self):
+        rid = "{:x}".format(self.next_rid)
+        self.next_rid += 1
+        self.pending_methods[rid] = time.monotonic()
+        self.hub.stats.methods.sent += 1
+        self.publish("{}{}/?$rid={}".format(METHODS_POST_PREFIX, self.hub.args.method, rid), self.hub.args.method_payload.encode("utf-8"))
+
+    def patch_desired(self):
+        self.led = not self.led
+        self.desired["$version"] += 1
+        self.desired[self.hub.args.patch_property] = self.led
+        version = self.desired["$version"]
+        self.pending_patches[version] = time.monotonic()
+        self.hub.stats.patches.sent += 1
+        patch = {self.hub.args.patch_property: self.led, "$version": version}
+        self.publish("{}?$version={}".format(TWIN_DESIRED_PREFIX, version), json.dumps(patch).encode("utf-8"))
+
+
+class Hub:
+    def __init__(self, args):
+        self.args = args
+        self.stats = Stats()
+
+    async def on_client(self, reader, writer):
+        await DeviceSession(self, reader, writer).run()
+
+    async def print_progress(self):
+        while True:
+            await asyncio.sleep(self.args.report_interval)
+            methods = self.stats.methods.summary()
+            patches = self.stats.patches.summary()
+            print("telemetry={:.1f}/s methods={}/{} p99={}ms patches={}/{} p99={}ms".format(
+                self.stats.take_interval_rate(),
+                methods["answered"], methods["sent"], methods["p99Ms"],
+                patches["answered"], patches["sent"], patches["p99Ms"]))
+
+    async def serve(self):
+        context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        context.load_cert_chain(os.path.join(self.args.certs, "server.pem"), os.path.join(self.args.certs, "server.key"))
+
+        server = await asyncio.start_server(self.on_client, self.args.host, self.args.port, ssl=context)
+        print("IoT Hub stand-in listening on {}:{}".format(self.args.host, self.args.port))
+
+        stop = asyncio.get_event_loop().create_future()
+        for signum in (signal.SIGINT, signal.SIGTERM):
+            asyncio.get_event_loop().add_signal_handler(signum, lambda: stop.done() or stop.set_result(None))
+        if self.args.duration > 0:
+            asyncio.get_event_loop().call_later(self.args.duration, lambda: stop.done() or stop.set_result(None))
+
+        progress = asyncio.ensure_future(self.print_progress())
+        await stop
+        progress.cancel()
+        server.close()
+
+        report = self.stats.report()
+        print(json.dumps(report, indent=4))
+        if self.args.output:
+            with open(self.args.output, "w") as output:
+                json.dump(report, output, indent=4)
+
+
+def openssl(*args):
+    subprocess.run(["openssl"] + list(args), check=True, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+def gen_certs(directory):
+    """Generate a test CA, and a server certificate for localhost signed by it."""
+    os.makedirs(directory, exist_ok=True)
+    path = lambda name: os.path.join(directory, name)
+
+    openssl("req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "3650", "-subj", "/CN=PnP Hub Stand-in Test CA",
+            "-keyout", path("ca.key"), "-out", path("ca.pem"))
+    openssl("req", "-newkey", "rsa:2048", "-nodes", "-subj", "/CN=localhost", "-keyout", path("server.key"), "-out", path("server.csr"))
+    with open(path("server.ext"), "w") as ext:
+        ext.write("subjectAltName=DNS:localhost,IP:127.0.0.1\n")
+    openssl("x509", "-req", "-days", "825", "-in", path("server.csr"), "-CA", path("ca.pem"), "-CAkey", path("ca.key"),
+            "-CAcreateserial", "-extfile", path("server.ext"), "-out", path("server.pem"))
+    print("Test CA: {}".format(path("ca.pem")))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command")
+
+    gen = commands.add_parser("gen-certs", help="generate a test CA and server certificate")
+    gen.add_argument("directory")
+
+    serve = commands.add_parser("serve", help="run the stand-in")
+    serve.add_argument("--certs", required=True, help="directory with server.pem and server.key from gen-certs")
+    serve.add_argument("--host", default="127.0.0.1")
+    serve.add_argument("--port", type=int, default=8883, help="port, 8883 as the device connects to (default: %(default)s)")
+    serve.add_argument("--method-rate", type=float, default=0, help="method calls per second per device")
+    serve.add_argument("--method", default="diagnostics*dumpStats", help="method to call (default: %(default)s)")
+    serve.add_argument("--method-payload", default="null", help="JSON payload of method calls (default: %(default)s)")
+    serve.add_argument("--patch-rate", type=float, default=0, help="desired property patches per second per device")
+    serve.add_argument("--patch-property", default="led", help="boolean writable property to toggle (default: %(default)s)")
+    serve.add_argument("--timeout", type=float, default=30, help="seconds before a request counts as unanswered")
+    serve.add_argument("--report-interval", type=float, default=10, help="seconds between progress lines")
+    serve.add_argument("--duration", type=float, default=0, help="seconds to run, or 0 until interrupted")
+    serve.add_argument("--output", help="file to write the final JSON report to")
+
+    args = parser.parse_args()
+    if args.command == "gen-certs":
+        gen_certs(args.directory)
+    elif args.command == "serve":
+        asyncio.get_event_loop().run_until_complete(Hub(args).serve())
+    else:
+        parser.print_help()
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header stands in for the NTP client library in the host build.  The host clock is kept in sync by the OS already,
+// so it is returned as the NTP time.
+
+#ifndef MBED_HOST_NTP_CLIENT_H
+#define MBED_HOST_NTP_CLIENT_H
+
+#include <time.h>
+
+#include "mbed.h"
+
+class NTPClient
+{
+public:
+    NTPClient(NetworkInterface* iface) { (void)iface; }
+    void set_server(const char* server, int port) { (void)server; (void)port; }
+    time_t get_timestamp(int timeout = 15000) { (void)timeout; return time(NULL); }
+};
+
+#endif /* MBED_HOST_NTP_CLIENT_H */
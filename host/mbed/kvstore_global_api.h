@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header stands in for the Mbed OS KVStore global API in the host build.  Each key is a file in the directory named by
+// the PNP_HOST_KV_DIR environment variable, "kvstore" by default.
+
+#ifndef MBED_HOST_KVSTORE_GLOBAL_API_H
+#define MBED_HOST_KVSTORE_GLOBAL_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "platform/mbed_error.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t kv_info_flags;
+
+int kv_set(const char* full_name_key, const void* buffer, size_t size, uint32_t create_flags);
+int kv_get(const char* full_name_key, void* buffer, size_t buffer_size, size_t* actual_size);
+int kv_remove(const char* full_name_key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBED_HOST_KVSTORE_GLOBAL_API_H */
@@ -0,0 +1,350 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header stands in for Mbed OS in the host (Linux) build.  It provides the subset of the Mbed OS API the application
+// uses, on top of the C++ standard library and POSIX.  Peripherals are simulated, see host/sim.
+
+#ifndef MBED_HOST_H
+#define MBED_HOST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "mbed_config.h"
+
+#define MBED_MAJOR_VERSION 6
+
+//
+// Pins the application refers to.  On the host they only identify simulated peripherals.
+//
+typedef enum
+{
+    PD_0,
+    PD_1,
+    PH_8,
+    PH_9,
+    LED3,
+    LED_RED,
+    SW2,
+    SW3,
+    NC = -1
+} PinName;
+
+//
+// CMSIS-RTOS2 subset
+//
+typedef enum
+{
+    osPriorityLow = 8,
+    osPriorityBelowNormal = 16,
+    osPriorityNormal = 24,
+    osPriorityAboveNormal = 32,
+    osPriorityHigh = 40
+} osPriority_t;
+
+typedef enum
+{
+    osOK = 0,
+    osError = -1
+} osStatus;
+
+typedef void* osThreadId_t;
+
+#define osFlagsError        0x80000000U
+#define osFlagsErrorTimeout 0xFFFFFFFEU
+
+const char* osThreadGetName(osThreadId_t threadId);
+
+//
+// Cortex-M intrinsics and HAL
+//
+#define __CLZ(value) ((uint8_t)(((value) == 0) ? 32 : __builtin_clz(value)))
+
+// Restarting the device ends the host process.  A supervisor, if any, starts it again.
+void NVIC_SystemReset(void);
+
+uint32_t us_ticker_read(void);
+
+// The microsecond ticker, read as 64-bit microseconds since start, which never wraps
+typedef uint64_t us_timestamp_t;
+typedef struct ticker_data_s ticker_data_t;
+
+const ticker_data_t* get_us_ticker_data(void);
+us_timestamp_t ticker_read_us(const ticker_data_t* const ticker);
+
+void rtc_init(void);
+time_t rtc_read(void);
+void rtc_write(time_t t);
+
+#define DEVICE_RESET_REASON 1
+
+typedef enum
+{
+    RESET_REASON_POWER_ON,
+    RESET_REASON_PIN_RESET,
+    RESET_REASON_BROWN_OUT,
+    RESET_REASON_SOFTWARE,
+    RESET_REASON_WATCHDOG,
+    RESET_REASON_UNKNOWN
+} reset_reason_t;
+
+uint32_t core_util_atomic_incr_u32(volatile uint32_t* valuePtr, uint32_t delta);
+
+namespace mbed {
+
+//
+// Callback wraps any callable, like mbed::Callback
+//
+template <typename F>
+class Callback;
+
+template <typename R, typename... ArgTs>
+class Callback<R(ArgTs...)> : public std::function<R(ArgTs...)>
+{
+public:
+    using std::function<R(ArgTs...)>::function;
+};
+
+template <typename R, typename... ArgTs>
+Callback<R(ArgTs...)> callback(R (*func)(ArgTs...))
+{
+    return Callback<R(ArgTs...)>(func);
+}
+
+template <typename R, typename T, typename U>
+Callback<R()> callback(R (*func)(T), U arg)
+{
+    return Callback<R()>([func, arg]() { return func(arg); });
+}
+
+template <typename R, typename T>
+Callback<R()> callback(T* obj, R (T::*method)())
+{
+    return Callback<R()>([obj, method]() { return (obj->*method)(); });
+}
+
+//
+// CriticalSectionLock serializes against all other critical sections, as interrupts are not masked on the host
+//
+class CriticalSectionLock
+{
+public:
+    CriticalSectionLock();
+    ~CriticalSectionLock();
+};
+
+//
+// DigitalOut simulates an output pin, which only keeps its level
+//
+class DigitalOut
+{
+public:
+    DigitalOut(PinName pin, int value = 0) : _pin(pin), _value(value) {}
+    void write(int value) { _value = value; }
+    int read() { return _value; }
+    DigitalOut& operator=(int value) { write(value); return *this; }
+    operator int() { return read(); }
+
+private:
+    PinName _pin;
+    int _value;
+};
+
+//
+// InterruptIn simulates an input pin of a button, which is never pressed (reads high)
+//
+class InterruptIn
+{
+public:
+    InterruptIn(PinName pin) : _pin(pin) {}
+    int read() { return 1; }
+    operator int() { return read(); }
+    void rise(Callback<void()> func) { (void)func; }
+    void fall(Callback<void()> func) { (void)func; }
+
+private:
+    PinName _pin;
+};
+
+//
+// I2C routes transfers to the devices simulated on the host I2C bus, see host/sim/sim_i2c.h.
+// Addresses are 8-bit, as in Mbed OS.  Transfers return 0 on ACK and nonzero on NACK.
+//
+class I2C
+{
+public:
+    I2C(PinName sda, PinName scl) : _sda(sda), _scl(scl) {}
+    void frequency(int hz) { (void)hz; }
+    int read(int address, char* data, int length, bool repeated = false);
+    int write(int address, const char* data, int length, bool repeated = false);
+
+private:
+    PinName _sda;
+    PinName _scl;
+};
+
+//
+// EventQueue runs deferred calls on a thread of their own
+//
+class EventQueue
+{
+public:
+    template <typename Rep, typename Period>
+    int call_in(std::chrono::duration<Rep, Period> delay, void (*func)(void))
+    {
+        std::thread([delay, func]() { std::this_thread::sleep_for(delay); func(); }).detach();
+        return 1;
+    }
+};
+
+EventQueue* mbed_event_queue(void);
+
+//
+// ResetReason reports how the simulated device was last reset
+//
+class ResetReason
+{
+public:
+    static reset_reason_t get();
+};
+
+} // namespace mbed
+
+namespace rtos {
+
+//
+// Kernel::Clock counts milliseconds since the process started
+//
+namespace Kernel {
+
+struct Clock
+{
+    using duration = std::chrono::milliseconds;
+    using rep = duration::rep;
+    using period = duration::period;
+    using duration_u32 = std::chrono::duration<uint32_t, std::milli>;
+    using time_point = std::chrono::time_point<Clock>;
+    static const bool is_steady = true;
+    static time_point now();
+};
+
+} // namespace Kernel
+
+namespace ThisThread {
+
+template <typename Rep, typename Period>
+void sleep_for(std::chrono::duration<Rep, Period> delay)
+{
+    std::this_thread::sleep_for(delay);
+}
+
+} // namespace ThisThread
+
+//
+// Mutex is recursive, as in Mbed OS
+//
+class Mutex
+{
+public:
+    void lock() { _mutex.lock(); }
+    bool trylock() { return _mutex.try_lock(); }
+    void unlock() { _mutex.unlock(); }
+
+private:
+    std::recursive_mutex _mutex;
+};
+
+//
+// Semaphore counts on a condition variable
+//
+class Semaphore
+{
+public:
+    Semaphore(int32_t count = 0) : _count(count) {}
+
+    void acquire()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cond.wait(lock, [this]() { return _count > 0; });
+        _count--;
+    }
+
+    osStatus release()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _count++;
+        _cond.notify_one();
+        return osOK;
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    int32_t _count;
+};
+
+class EventFlags
+{
+public:
+    uint32_t set(uint32_t flags);
+    uint32_t clear(uint32_t flags = 0x7fffffff);
+    uint32_t get() const;
+    uint32_t wait_any(uint32_t flags, bool clear = true);
+    // Returns osFlagsErrorTimeout if none of flags is set within relTime
+    uint32_t wait_any_for(uint32_t flags, Kernel::Clock::duration_u32 relTime, bool clear = true);
+
+private:
+    mutable std::mutex _mutex;
+    std::condition_variable _cond;
+    uint32_t _flags = 0;
+};
+
+//
+// Thread runs on a std::thread.  Priority and stack size are ignored.
+//
+class Thread
+{
+public:
+    Thread(osPriority_t priority = osPriorityNormal, uint32_t stackSize = 0, unsigned char* stackMem = nullptr, const char* name = nullptr);
+    ~Thread();
+    osStatus start(mbed::Callback<void()> task);
+    osStatus join();
+    const char* get_name() const { return _name; }
+    osThreadId_t get_id() const { return (osThreadId_t)this; }
+
+private:
+    const char* _name;
+    std::thread _thread;
+};
+
+} // namespace rtos
+
+#include "netsocket/NetworkInterface.h"
+
+using namespace mbed;
+using namespace rtos;
+using namespace std::chrono_literals;
+
+#endif /* MBED_HOST_H */
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header stands in for the configuration Mbed OS generates from mbed_app.json, in the host build.
+// Defaults follow mbed_app.json.  Connection settings are read from environment variables of the same names at run time,
+// e.g. IOTHUB_CONNECTION_STRING, so that one host binary serves any device.
+
+#ifndef MBED_HOST_MBED_CONFIG_H
+#define MBED_HOST_MBED_CONFIG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// HostConfig_GetString returns the environment variable name, or defaultValue if it is not set.
+//
+const char* HostConfig_GetString(const char* name, const char* defaultValue);
+
+//
+// HostConfig_GetTrustedCertificates returns the PEM certificates in the file PNP_TRUSTED_CERT_FILE, or defaultCertificates if it is not set.
+//
+const char* HostConfig_GetTrustedCertificates(const char* defaultCertificates);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define MBED_CONF_APP_PROVISION_REGISTRATION_ID     HostConfig_GetString("PROVISION_REGISTRATION_ID", "REGISTRATION_ID")
+#define MBED_CONF_APP_PROVISION_SYMMETRIC_KEY       HostConfig_GetString("PROVISION_SYMMETRIC_KEY", "SYMMETRIC_KEY")
+#define MBED_CONF_APP_PROVISION_ENDPOINT            HostConfig_GetString("PROVISION_ENDPOINT", "global.azure-devices-provisioning.net")
+#define MBED_CONF_APP_PROVISION_ID_SCOPE            HostConfig_GetString("PROVISION_ID_SCOPE", "ID_SCOPE")
+#define MBED_CONF_APP_IOTHUB_CONNECTION_STRING      HostConfig_GetString("IOTHUB_CONNECTION_STRING", "IOTHUB_CONNECTION_STRING")
+
+#ifndef MBED_CONF_APP_IOTHUB_RETRY_TIMEOUT
+#define MBED_CONF_APP_IOTHUB_RETRY_TIMEOUT          0
+#endif
+#ifndef MBED_CONF_APP_NETWORK_RECONNECT_MAX_BACKOFF
+#define MBED_CONF_APP_NETWORK_RECONNECT_MAX_BACKOFF 60
+#endif
+#ifndef MBED_CONF_APP_MOTION_TELEMETRY_INTERVAL
+#define MBED_CONF_APP_MOTION_TELEMETRY_INTERVAL     2
+#endif
+#ifndef MBED_CONF_APP_MOTION_ANOMALY_THRESHOLD
+#define MBED_CONF_APP_MOTION_ANOMALY_THRESHOLD      6.0
+#endif
+#ifndef MBED_CONF_APP_DIAGNOSTICS_TELEMETRY_INTERVAL
+#define MBED_CONF_APP_DIAGNOSTICS_TELEMETRY_INTERVAL 60
+#endif
+#ifndef MBED_CONF_APP_BMX055_INT1_PIN
+#define MBED_CONF_APP_BMX055_INT1_PIN               NC
+#endif
+#ifndef MBED_CONF_APP_BMX055_INT3_PIN
+#define MBED_CONF_APP_BMX055_INT3_PIN               NC
+#endif
+#ifndef MBED_CONF_APP_BMX055_FIFO_WATERMARK
+#define MBED_CONF_APP_BMX055_FIFO_WATERMARK         16
+#endif
+#ifndef MBED_CONF_APP_BMX055_POLL_PERIOD
+#define MBED_CONF_APP_BMX055_POLL_PERIOD            20
+#endif
+#ifndef MBED_CONF_APP_IOTHUB_CLIENT_TRACE
+#define MBED_CONF_APP_IOTHUB_CLIENT_TRACE           false
+#endif
+
+#endif /* MBED_HOST_MBED_CONFIG_H */
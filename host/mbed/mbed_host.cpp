@@ -0,0 +1,479 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Implementation of the Mbed OS stand-in of the host build
+
+#include <errno.h>
+#include <malloc.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+
+#include <map>
+#include <string>
+
+#include "mbed.h"
+#include "mbed_stats.h"
+#include "kvstore_global_api.h"
+#include "platform/mbed_critical.h"
+
+//
+// Process start, the epoch of Kernel::Clock and the microsecond ticker
+//
+static const std::chrono::steady_clock::time_point g_hostStartTime = std::chrono::steady_clock::now();
+
+const char* HostConfig_GetString(const char* name, const char* defaultValue)
+{
+    const char* value = getenv(name);
+
+    return (value != NULL) ? value : defaultValue;
+}
+
+const char* HostConfig_GetTrustedCertificates(const char* defaultCertificates)
+{
+    static std::string certificates;
+    const char* path = getenv("PNP_TRUSTED_CERT_FILE");
+    FILE* file;
+
+    if (path == NULL)
+    {
+        return defaultCertificates;
+    }
+    else if ((file = fopen(path, "r")) == NULL)
+    {
+        printf("Cannot open PNP_TRUSTED_CERT_FILE %s, error=%d\r\n", path, errno);
+        return defaultCertificates;
+    }
+
+    char buffer[256];
+    size_t length;
+
+    certificates.clear();
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        certificates.append(buffer, length);
+    }
+    fclose(file);
+
+    return certificates.c_str();
+}
+
+//
+// Names of running threads, by thread id
+//
+static std::mutex g_threadNamesMutex;
+static std::map<osThreadId_t, const char*> g_threadNames;
+
+const char* osThreadGetName(osThreadId_t threadId)
+{
+    std::lock_guard<std::mutex> lock(g_threadNamesMutex);
+    std::map<osThreadId_t, const char*>::iterator it = g_threadNames.find(threadId);
+
+    return (it != g_threadNames.end()) ? it->second : NULL;
+}
+
+void NVIC_SystemReset(void)
+{
+    printf("System reset requested.  Exiting host process\r\n");
+    fflush(stdout);
+    exit(0);
+}
+
+uint32_t us_ticker_read(void)
+{
+    return (uint32_t)ticker_read_us(get_us_ticker_data());
+}
+
+// There is one ticker, so its data is only a handle
+struct ticker_data_s
+{
+    int unused;
+};
+
+const ticker_data_t* get_us_ticker_data(void)
+{
+    static const ticker_data_t usTicker = { 0 };
+
+    return &usTicker;
+}
+
+us_timestamp_t ticker_read_us(const ticker_data_t* const ticker)
+{
+    (void)ticker;
+
+    return (us_timestamp_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - g_hostStartTime).count();
+}
+
+// The RTC is the host clock plus whatever offset rtc_write sets; the host clock itself is left alone.
+static time_t g_rtcOffset = 0;
+
+void rtc_init(void)
+{
+}
+
+time_t rtc_read(void)
+{
+    return time(NULL) + g_rtcOffset;
+}
+
+void rtc_write(time_t t)
+{
+    g_rtcOffset = t - time(NULL);
+}
+
+uint32_t core_util_atomic_incr_u32(volatile uint32_t* valuePtr, uint32_t delta)
+{
+    return __atomic_add_fetch(valuePtr, delta, __ATOMIC_SEQ_CST);
+}
+
+namespace mbed {
+
+static std::recursive_mutex g_criticalSectionMutex;
+
+CriticalSectionLock::CriticalSectionLock()
+{
+    g_criticalSectionMutex.lock();
+}
+
+CriticalSectionLock::~CriticalSectionLock()
+{
+    g_criticalSectionMutex.unlock();
+}
+
+EventQueue* mbed_event_queue(void)
+{
+    static EventQueue eventQueue;
+
+    return &eventQueue;
+}
+
+reset_reason_t ResetReason::get()
+{
+    // The host clock keeps running between runs, like the RTC across a warm reset.
+    return RESET_REASON_SOFTWARE;
+}
+
+} // namespace mbed
+
+void core_util_critical_section_enter(void)
+{
+    mbed::g_criticalSectionMutex.lock();
+}
+
+void core_util_critical_section_exit(void)
+{
+    mbed::g_criticalSectionMutex.unlock();
+}
+
+namespace rtos {
+
+Kernel::Clock::time_point Kernel::Clock::now()
+{
+    return time_point(std::chrono::duration_cast<duration>(std::chrono::steady_clock::now() - g_hostStartTime));
+}
+
+uint32_t EventFlags::set(uint32_t flags)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _flags |= flags;
+    _cond.notify_all();
+
+    return _flags;
+}
+
+uint32_t EventFlags::clear(uint32_t flags)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t previous = _flags;
+
+    _flags &= ~flags;
+
+    return previous;
+}
+
+uint32_t EventFlags::get() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    return _flags;
+}
+
+uint32_t EventFlags::wait_any(uint32_t flags, bool clear)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    _cond.wait(lock, [this, flags]() { return (_flags & flags) != 0; });
+
+    uint32_t result = _flags;
+    if (clear)
+    {
+        _flags &= ~flags;
+    }
+
+    return result;
+}
+
+uint32_t EventFlags::wait_any_for(uint32_t flags, Kernel::Clock::duration_u32 relTime, bool clear)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    if (_cond.wait_for(lock, relTime, [this, flags]() { return (_flags & flags) != 0; }) == false)
+    {
+        return osFlagsErrorTimeout;
+    }
+
+    uint32_t result = _flags;
+    if (clear)
+    {
+        _flags &= ~flags;
+    }
+
+    return result;
+}
+
+Thread::Thread(osPriority_t priority, uint32_t stackSize, unsigned char* stackMem, const char* name) : _name(name)
+{
+    (void)priority;
+    (void)stackSize;
+    (void)stackMem;
+}
+
+Thread::~Thread()
+{
+    // Threads of the application run for ever or are joined.  Do not take the process down with one left running.
+    if (_thread.joinable())
+    {
+        _thread.detach();
+    }
+
+    std::lock_guard<std::mutex> lock(g_threadNamesMutex);
+    g_threadNames.erase(get_id());
+}
+
+osStatus Thread::start(mbed::Callback<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(g_threadNamesMutex);
+        g_threadNames[get_id()] = _name;
+    }
+
+    _thread = std::thread(task);
+
+    return osOK;
+}
+
+osStatus Thread::join()
+{
+    if (_thread.joinable())
+    {
+        _thread.join();
+    }
+
+    return osOK;
+}
+
+} // namespace rtos
+
+void SocketAddress::set_ip_address(const char* ip)
+{
+    snprintf(_ip, sizeof(_ip), "%s", ip);
+}
+
+NetworkInterface* NetworkInterface::get_default_instance()
+{
+    static NetworkInterface hostNetwork;
+
+    return &hostNetwork;
+}
+
+nsapi_error_t NetworkInterface::connect()
+{
+    if (_status == NSAPI_STATUS_GLOBAL_UP)
+    {
+        return NSAPI_ERROR_IS_CONNECTED;
+    }
+
+    SetStatus(NSAPI_STATUS_GLOBAL_UP);
+
+    return NSAPI_ERROR_OK;
+}
+
+nsapi_error_t NetworkInterface::disconnect()
+{
+    SetStatus(NSAPI_STATUS_DISCONNECTED);
+
+    return NSAPI_ERROR_OK;
+}
+
+const char* NetworkInterface::get_mac_address()
+{
+    if (_mac[0] == '\0')
+    {
+        // MAC address of the simulated device, overridable so that simulated devices differ
+        snprintf(_mac, sizeof(_mac), "%s", HostConfig_GetString("PNP_HOST_MAC_ADDRESS", "02:00:00:00:04:87"));
+    }
+
+    return _mac;
+}
+
+nsapi_error_t NetworkInterface::gethostbyname(const char* host, SocketAddress* address)
+{
+    struct addrinfo hints;
+    struct addrinfo* result = NULL;
+    char ip[INET6_ADDRSTRLEN];
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if ((getaddrinfo(host, NULL, &hints, &result) != 0) || (result == NULL))
+    {
+        return NSAPI_ERROR_DNS_FAILURE;
+    }
+
+    const void* addr = (result->ai_family == AF_INET6) ? (const void*)&((struct sockaddr_in6*)result->ai_addr)->sin6_addr
+                                                       : (const void*)&((struct sockaddr_in*)result->ai_addr)->sin_addr;
+    inet_ntop(result->ai_family, addr, ip, sizeof(ip));
+    address->set_ip_address(ip);
+
+    freeaddrinfo(result);
+
+    return NSAPI_ERROR_OK;
+}
+
+void NetworkInterface::add_event_listener(mbed::Callback<void(nsapi_event_t, intptr_t)> statusCallback)
+{
+    _listeners.push_back(statusCallback);
+}
+
+void NetworkInterface::SetStatus(nsapi_connection_status_t status)
+{
+    _status = status;
+
+    for (size_t i = 0; i < _listeners.size(); i++)
+    {
+        _listeners[i](NSAPI_EVENT_CONNECTION_STATUS_CHANGE, (intptr_t)status);
+    }
+}
+
+//
+// KvPath returns the file backing the KVStore key, e.g. kvstore/pnp_dps_assignment for "/kv/pnp_dps_assignment"
+//
+static std::string KvPath(const char* key)
+{
+    const char* name = strrchr(key, '/');
+    std::string directory = HostConfig_GetString("PNP_HOST_KV_DIR", "kvstore");
+
+    mkdir(directory.c_str(), 0700);
+
+    return directory + "/" + ((name != NULL) ? (name + 1) : key);
+}
+
+int kv_set(const char* full_name_key, const void* buffer, size_t size, uint32_t create_flags)
+{
+    (void)create_flags;
+
+    std::string path = KvPath(full_name_key);
+    FILE* file = fopen(path.c_str(), "wb");
+    int result;
+
+    if (file == NULL)
+    {
+        result = MBED_ERROR_WRITE_FAILED;
+    }
+    else
+    {
+        result = (fwrite(buffer, 1, size, file) == size) ? MBED_SUCCESS : MBED_ERROR_WRITE_FAILED;
+        fclose(file);
+    }
+
+    return result;
+}
+
+int kv_get(const char* full_name_key, void* buffer, size_t buffer_size, size_t* actual_size)
+{
+    std::string path = KvPath(full_name_key);
+    FILE* file = fopen(path.c_str(), "rb");
+
+    if (file == NULL)
+    {
+        return MBED_ERROR_ITEM_NOT_FOUND;
+    }
+
+    *actual_size = fread(buffer, 1, buffer_size, file);
+    fclose(file);
+
+    return MBED_SUCCESS;
+}
+
+int kv_remove(const char* full_name_key)
+{
+    std::string path = KvPath(full_name_key);
+
+    return (remove(path.c_str()) == 0) ? MBED_SUCCESS : MBED_ERROR_ITEM_NOT_FOUND;
+}
+
+// Peak of heap in use, as the C library does not track it
+static uint32_t g_heapPeak = 0;
+
+void mbed_stats_heap_get(mbed_stats_heap_t* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ >= 33)))
+    struct mallinfo2 info = mallinfo2();
+#else
+    struct mallinfo info = mallinfo();
+#endif
+
+    stats->current_size = (uint32_t)(info.uordblks + info.hblkhd);
+    stats->reserved_size = (uint32_t)(info.arena + info.hblkhd);
+    if (stats->current_size > g_heapPeak)
+    {
+        g_heapPeak = stats->current_size;
+    }
+    stats->max_size = g_heapPeak;
+}
+
+size_t mbed_stats_stack_get_each(mbed_stats_stack_t* stats, size_t count)
+{
+    (void)stats;
+    (void)count;
+
+    return 0;
+}
+
+void mbed_stats_cpu_get(mbed_stats_cpu_t* stats)
+{
+    struct timespec cpuTime;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->uptime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - g_hostStartTime).count();
+
+    // Time the process was not on a CPU counts as idle
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuTime) == 0)
+    {
+        uint64_t busy = (uint64_t)cpuTime.tv_sec * 1000000 + cpuTime.tv_nsec / 1000;
+
+        stats->idle_time = (stats->uptime > busy) ? (stats->uptime - busy) : 0;
+    }
+}
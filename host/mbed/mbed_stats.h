@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header stands in for Mbed OS runtime statistics in the host build.  Heap statistics come from the C library,
+// CPU statistics from process times.  Thread stacks are not measured on the host.
+
+#ifndef MBED_HOST_MBED_STATS_H
+#define MBED_HOST_MBED_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    uint32_t current_size;
+    uint32_t max_size;
+    uint32_t total_size;
+    uint32_t reserved_size;
+    uint32_t alloc_cnt;
+    uint32_t alloc_fail_cnt;
+    uint32_t overhead_size;
+} mbed_stats_heap_t;
+
+typedef struct
+{
+    // uint32_t in Mbed OS, where it holds a 32-bit osThreadId_t.  Pointer-sized here, not to truncate those of the host.
+    uintptr_t thread_id;
+    uint32_t max_size;
+    uint32_t reserved_size;
+    uint32_t stack_cnt;
+} mbed_stats_stack_t;
+
+typedef struct
+{
+    uint64_t uptime;
+    uint64_t idle_time;
+    uint64_t sleep_time;
+    uint64_t deep_sleep_time;
+} mbed_stats_cpu_t;
+
+void mbed_stats_heap_get(mbed_stats_heap_t* stats);
+size_t mbed_stats_stack_get_each(mbed_stats_stack_t* stats, size_t count);
+void mbed_stats_cpu_get(mbed_stats_cpu_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBED_HOST_MBED_STATS_H */
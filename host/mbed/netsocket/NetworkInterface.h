@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header stands in for the Mbed OS network interface in the host build.  The host network is always up; the Azure IoT
+// C SDK connects through its own Linux platform layer, so this only serves the application's DNS lookups and status events.
+
+#ifndef MBED_HOST_NETWORK_INTERFACE_H
+#define MBED_HOST_NETWORK_INTERFACE_H
+
+#include <stdint.h>
+
+#include <vector>
+
+typedef int nsapi_error_t;
+
+enum
+{
+    NSAPI_ERROR_OK = 0,
+    NSAPI_ERROR_WOULD_BLOCK = -3001,
+    NSAPI_ERROR_UNSUPPORTED = -3002,
+    NSAPI_ERROR_PARAMETER = -3003,
+    NSAPI_ERROR_NO_CONNECTION = -3004,
+    NSAPI_ERROR_NO_SOCKET = -3005,
+    NSAPI_ERROR_NO_ADDRESS = -3006,
+    NSAPI_ERROR_NO_MEMORY = -3007,
+    NSAPI_ERROR_NO_SSID = -3008,
+    NSAPI_ERROR_DNS_FAILURE = -3009,
+    NSAPI_ERROR_DHCP_FAILURE = -3010,
+    NSAPI_ERROR_AUTH_FAILURE = -3011,
+    NSAPI_ERROR_DEVICE_ERROR = -3012,
+    NSAPI_ERROR_IN_PROGRESS = -3013,
+    NSAPI_ERROR_ALREADY = -3014,
+    NSAPI_ERROR_IS_CONNECTED = -3015,
+    NSAPI_ERROR_CONNECTION_LOST = -3016,
+    NSAPI_ERROR_CONNECTION_TIMEOUT = -3017,
+    NSAPI_ERROR_ADDRESS_IN_USE = -3018,
+    NSAPI_ERROR_TIMEOUT = -3019,
+    NSAPI_ERROR_BUSY = -3020
+};
+
+typedef enum
+{
+    NSAPI_EVENT_CONNECTION_STATUS_CHANGE = 0
+} nsapi_event_t;
+
+typedef enum
+{
+    NSAPI_STATUS_LOCAL_UP = 0,
+    NSAPI_STATUS_GLOBAL_UP = 1,
+    NSAPI_STATUS_DISCONNECTED = 2,
+    NSAPI_STATUS_CONNECTING = 3
+} nsapi_connection_status_t;
+
+//
+// SocketAddress holds a resolved IP address in text form
+//
+class SocketAddress
+{
+public:
+    SocketAddress() { _ip[0] = '\0'; }
+    void set_ip_address(const char* ip);
+    const char* get_ip_address() const { return _ip; }
+
+private:
+    char _ip[64];
+};
+
+//
+// NetworkInterface of the host
+//
+class NetworkInterface
+{
+public:
+    static NetworkInterface* get_default_instance();
+
+    nsapi_error_t connect();
+    nsapi_error_t disconnect();
+    const char* get_mac_address();
+    nsapi_error_t gethostbyname(const char* host, SocketAddress* address);
+    nsapi_connection_status_t get_connection_status() const { return _status; }
+    void add_event_listener(mbed::Callback<void(nsapi_event_t, intptr_t)> statusCallback);
+
+private:
+    void SetStatus(nsapi_connection_status_t status);
+
+    nsapi_connection_status_t _status = NSAPI_STATUS_DISCONNECTED;
+    char _mac[18] = "";
+    std::vector<mbed::Callback<void(nsapi_event_t, intptr_t)>> _listeners;
+};
+
+#endif /* MBED_HOST_NETWORK_INTERFACE_H */
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header stands in for the Mbed OS critical sections in the host build.  They serialize against each other and
+// against CriticalSectionLock, as interrupts are not masked on the host.
+
+#ifndef MBED_HOST_MBED_CRITICAL_H
+#define MBED_HOST_MBED_CRITICAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void core_util_critical_section_enter(void);
+void core_util_critical_section_exit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MBED_HOST_MBED_CRITICAL_H */
@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header stands in for the Mbed OS error codes in the host build.
+
+#ifndef MBED_HOST_MBED_ERROR_H
+#define MBED_HOST_MBED_ERROR_H
+
+#define MBED_SUCCESS                0
+#define MBED_ERROR_ITEM_NOT_FOUND   (-0x80FF0107)
+#define MBED_ERROR_WRITE_FAILED     (-0x80FF010F)
+#define MBED_ERROR_READ_FAILED      (-0x80FF0110)
+#define MBED_ERROR_INVALID_SIZE     (-0x80FF0106)
+
+#endif /* MBED_HOST_MBED_ERROR_H */
@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Simulated Bosch BMX055 on the host I2C bus: the accelerometer (BMA2x2), gyroscope (BMG160) and magnetometer (BMM050) dies
+// at their default addresses, with the register layouts of the data sheet (BST-BMX055-DS000).  Samples are synthesized when
+// their data registers or FIFOs are read: gravity along Z, a slow sway, and some noise.
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mbed.h"
+#include "BMX055.h"
+#include "sim_i2c.h"
+
+// Sway of the simulated board
+static const double g_swayHz = 0.5;
+static const double g_swayAccelG = 0.02;
+static const double g_swayGyroDps = 2.0;
+
+// Zero-g offset of the accelerometer in g and zero-rate offset of the gyroscope in deg/s, which offset compensation removes
+static const double g_accelOffsetG[3] = { 0.03, -0.02, 0.05 };
+static const double g_gyroOffsetDps[3] = { 0.6, -0.4, 0.3 };
+
+// LSB of the offset compensation registers
+static const double g_accelOffsetLsbG = 0.0078125;
+static const double g_gyroOffsetLsbDps = 0.061;
+
+// Earth magnetic field at the simulated board, in uT
+static const double g_earthFieldUt[3] = { 20.0, 5.0, -40.0 };
+
+// Magnetometer trim registers of a sample part
+static const int8_t g_magDigX2 = 26;
+static const int16_t g_magDigZ1 = 24747;
+static const int16_t g_magDigZ2 = 763;
+static const uint16_t g_magDigXyz1 = 7053;
+
+//
+// SimSeconds returns the simulation time in seconds
+//
+static double SimSeconds(void)
+{
+    return (double)Kernel::Clock::now().time_since_epoch().count() / 1000.0;
+}
+
+//
+// SimNoise returns uniform noise in [-amplitude, amplitude]
+//
+static double SimNoise(double amplitude)
+{
+    return amplitude * (2.0 * ((double)rand() / RAND_MAX) - 1.0);
+}
+
+//
+// SimClamp converts value to a signed integer of bits bits, saturating
+//
+static int32_t SimClamp(double value, int bits)
+{
+    double max = (double)((1 << (bits - 1)) - 1);
+    double min = -(double)(1 << (bits - 1));
+
+    return (int32_t)((value > max) ? max : ((value < min) ? min : value));
+}
+
+//
+// SimFifoDie is a die sampled at a data rate, whose frames of X, Y and Z data collect in a FIFO of depth frames while
+// FIFO_CONFIG_1 (0x3E) selects stream mode.  FIFO_STATUS (0x0E) holds the frame count, and bursts from FIFO_DATA (0x3F),
+// which does not auto-increment, pop the oldest frames.  Frames are synthesized at their sample time as they are read.
+//
+class SimFifoDie : public SimRegisterDevice
+{
+public:
+    explicit SimFifoDie(int depth) : _depth(depth), _frames(0), _newestSeconds(0.0) {}
+
+    int Read(uint8_t* data, int length) override
+    {
+        if (_pointer != 0x3F)
+        {
+            return SimRegisterDevice::Read(data, length);
+        }
+
+        Fill();
+        double period = 1.0 / DataRateHz();
+        for (int i = 0; i < length; i += 6)
+        {
+            uint8_t frame[6] = { 0 };
+
+            // An empty FIFO reads as zeros
+            if (_frames > 0)
+            {
+                Synthesize(_newestSeconds - (_frames - 1) * period, frame);
+                _frames--;
+            }
+            memcpy(&data[i], frame, (length - i < 6) ? length - i : 6);
+        }
+
+        return 0;
+    }
+
+protected:
+    // Synthesize fills frame with the sample taken at t seconds, laid out like the data registers
+    virtual void Synthesize(double t, uint8_t* frame) = 0;
+
+    // DataRateHz returns the output data rate of the bandwidth selected
+    virtual double DataRateHz(void) = 0;
+
+    void OnRead(uint8_t reg, int length) override
+    {
+        if ((reg <= 0x0E) && ((reg + length) > 0x0E))
+        {
+            Fill();
+            _regs[0x0E] = (uint8_t)_frames;
+        }
+        if ((reg <= 0x07) && ((reg + length) > 0x02))
+        {
+            Synthesize(SimSeconds(), &_regs[0x02]);
+        }
+    }
+
+    void OnWrite(uint8_t reg, uint8_t value) override
+    {
+        (void)value;
+
+        // Writing FIFO_CONFIG_1 clears FIFO
+        if (reg == 0x3E)
+        {
+            _frames = 0;
+            _newestSeconds = SimSeconds();
+        }
+    }
+
+private:
+    // Fill adds the frames sampled since the newest one, dropping the oldest on overflow like stream mode
+    void Fill(void)
+    {
+        double now = SimSeconds();
+        double rate = DataRateHz();
+
+        if ((_regs[0x3E] & 0xC0) != 0x80)
+        {
+            _frames = 0;
+            _newestSeconds = now;
+            return;
+        }
+
+        int added = (int)((now - _newestSeconds) * rate);
+        if (added > 0)
+        {
+            _newestSeconds += added / rate;
+            _frames = (_frames + added > _depth) ? _depth : _frames + added;
+        }
+    }
+
+    int _depth;
+    int _frames;
+    double _newestSeconds;
+};
+
+//
+// SimAccel simulates the accelerometer die
+//
+class SimAccel : public SimFifoDie
+{
+public:
+    SimAccel() : SimFifoDie(BMX055_ACC_FIFO_FRAMES)
+    {
+        _regs[0x00] = I_AM_BMX055_ACC;
+        _regs[0x0F] = ACC_2G;
+        _regs[0x10] = ACC_BW7R81Hz;
+        // cal_rdy
+        _regs[0x36] = 0x10;
+    }
+
+protected:
+    void OnWrite(uint8_t reg, uint8_t value) override
+    {
+        SimFifoDie::OnWrite(reg, value);
+        if (reg != 0x36)
+        {
+            return;
+        }
+
+        if ((value & 0x80) != 0)
+        {
+            // offset_reset
+            _regs[0x38] = _regs[0x39] = _regs[0x3A] = 0;
+        }
+
+        // Fast offset compensation of the axis of cal_trigger, to the target of OFC_SETTING, done at once
+        int axis = ((value >> 5) & 0x03) - 1;
+        if (axis >= 0)
+        {
+            static const double targets[4] = { 0.0, 1.0, -1.0, 0.0 };
+            double target = targets[(_regs[0x37] >> (1 + axis * 2)) & 0x03];
+            double still = g_accelOffsetG[axis] + ((axis == 2) ? 1.0 : 0.0);
+
+            _regs[0x38 + axis] = (uint8_t)(int8_t)SimClamp(round((target - still) / g_accelOffsetLsbG), 8);
+        }
+
+        _regs[0x36] = (uint8_t)((value & 0x07) | 0x10);
+    }
+
+    void OnRead(uint8_t reg, int length) override
+    {
+        SimFifoDie::OnRead(reg, length);
+        if ((reg <= 0x08) && ((reg + length) > 0x08))
+        {
+            // 0.5 K/LSB, centered at 23 degC
+            _regs[0x08] = (uint8_t)(int8_t)SimClamp((25.0 + SimNoise(0.5) - 23.0) * 2.0, 8);
+        }
+    }
+
+    void Synthesize(double t, uint8_t* frame) override
+    {
+        double g[3] =
+        {
+            g_swayAccelG * sin(2 * M_PI * g_swayHz * t) + SimNoise(0.004),
+            g_swayAccelG * cos(2 * M_PI * g_swayHz * t) + SimNoise(0.004),
+            1.0 + SimNoise(0.004)
+        };
+        // 12-bit samples over +/- range
+        double lsbPerG = 2048.0 / RangeG();
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            g[axis] += g_accelOffsetG[axis] + (int8_t)_regs[0x38 + axis] * g_accelOffsetLsbG;
+
+            int32_t sample = SimClamp(g[axis] * lsbPerG, 12);
+
+            // LSB register: data bits 3:0 in 7:4, new_data in bit 0
+            frame[axis * 2] = (uint8_t)(((sample & 0x0F) << 4) | 0x01);
+            frame[axis * 2 + 1] = (uint8_t)((sample >> 4) & 0xFF);
+        }
+    }
+
+    // Twice the bandwidth, which doubles from 7.81 Hz at ACC_BW7R81Hz up to 1000 Hz
+    double DataRateHz(void) override
+    {
+        int bw = _regs[0x10] & 0x1F;
+
+        bw = (bw < ACC_BW7R81Hz) ? ACC_BW7R81Hz : ((bw > 15) ? 15 : bw);
+        return 2.0 * 7.8125 * (1 << (bw - ACC_BW7R81Hz));
+    }
+
+private:
+    double RangeG(void)
+    {
+        switch (_regs[0x0F])
+        {
+        case ACC_4G:
+            return 4.0;
+        case ACC_8G:
+            return 8.0;
+        case ACC_16G:
+            return 16.0;
+        default:
+            return 2.0;
+        }
+    }
+};
+
+//
+// SimGyro simulates the gyroscope die
+//
+class SimGyro : public SimFifoDie
+{
+public:
+    SimGyro() : SimFifoDie(BMX055_GYR_FIFO_FRAMES)
+    {
+        _regs[0x00] = I_AM_BMX055_GYR;
+        _regs[0x0F] = GYR_2000DPS;
+    }
+
+protected:
+    void OnWrite(uint8_t reg, uint8_t value) override
+    {
+        SimFifoDie::OnWrite(reg, value);
+        if ((reg != 0x32) || ((value & 0x08) == 0))
+        {
+            return;
+        }
+
+        // Fast offset compensation of the axes enabled in bits 2:0, done at once
+        int32_t offsets[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            offsets[axis] = ((value & (1 << axis)) != 0) ? SimClamp(round(-g_gyroOffsetDps[axis] / g_gyroOffsetLsbDps), 12) : Offset(axis);
+        }
+
+        _regs[0x36] = (uint8_t)((((offsets[0] >> 10) & 0x03) << 6) | (((offsets[1] >> 9) & 0x07) << 3) | ((offsets[2] >> 9) & 0x07));
+        _regs[0x37] = (uint8_t)(offsets[0] >> 2);
+        _regs[0x38] = (uint8_t)(offsets[1] >> 1);
+        _regs[0x39] = (uint8_t)(offsets[2] >> 1);
+        _regs[0x3A] = (uint8_t)((_regs[0x3A] & 0xF0) | ((offsets[0] & 0x03) << 2) | ((offsets[1] & 0x01) << 1) | (offsets[2] & 0x01));
+        // fast_offset_en self-clears
+        _regs[0x32] = value & ~0x08;
+    }
+
+    void Synthesize(double t, uint8_t* frame) override
+    {
+        double dps[3] =
+        {
+            g_swayGyroDps * cos(2 * M_PI * g_swayHz * t) + SimNoise(0.1),
+            -g_swayGyroDps * sin(2 * M_PI * g_swayHz * t) + SimNoise(0.1),
+            SimNoise(0.1)
+        };
+        // 16-bit samples over +/- full scale
+        double lsbPerDps = 32768.0 / FullScaleDps();
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            dps[axis] += g_gyroOffsetDps[axis] + Offset(axis) * g_gyroOffsetLsbDps;
+
+            int32_t sample = SimClamp(dps[axis] * lsbPerDps, 16);
+
+            frame[axis * 2] = (uint8_t)(sample & 0xFF);
+            frame[axis * 2 + 1] = (uint8_t)((sample >> 8) & 0xFF);
+        }
+    }
+
+    double DataRateHz(void) override
+    {
+        static const double dataRates[] = { 2000.0, 2000.0, 1000.0, 400.0, 200.0, 100.0, 200.0, 100.0 };
+
+        return dataRates[_regs[0x10] & 0x07];
+    }
+
+private:
+    double FullScaleDps(void)
+    {
+        static const double fullScales[] = { 2000.0, 1000.0, 500.0, 250.0, 125.0 };
+        uint8_t range = _regs[0x0F] & 0x07;
+
+        return (range < 5) ? fullScales[range] : 2000.0;
+    }
+
+    // 12-bit offset of axis, split over OFC1 (0x36), OFC2..4 (0x37..0x39) and trim_gp0 (0x3A)
+    int32_t Offset(int axis)
+    {
+        uint32_t offset;
+
+        if (axis == 0)
+        {
+            offset = ((_regs[0x36] >> 6) & 0x03) << 10 | _regs[0x37] << 2 | ((_regs[0x3A] >> 2) & 0x03);
+        }
+        else if (axis == 1)
+        {
+            offset = ((_regs[0x36] >> 3) & 0x07) << 9 | _regs[0x38] << 1 | ((_regs[0x3A] >> 1) & 0x01);
+        }
+        else
+        {
+            offset = (_regs[0x36] & 0x07) << 9 | _regs[0x39] << 1 | (_regs[0x3A] & 0x01);
+        }
+
+        return (int32_t)(offset << 20) >> 20;
+    }
+};
+
+//
+// SimMagnet simulates the magnetometer die.  Until powered on through register 0x4B, only that register responds.
+//
+class SimMagnet : public SimRegisterDevice
+{
+public:
+    SimMagnet()
+    {
+        // dig_x2 and dig_y2, dig_z1, dig_z2 and dig_xyz1, the others zero
+        _regs[0x64] = (uint8_t)g_magDigX2;
+        _regs[0x65] = (uint8_t)g_magDigX2;
+        _regs[0x68] = (uint8_t)(g_magDigZ2 & 0xFF);
+        _regs[0x69] = (uint8_t)(g_magDigZ2 >> 8);
+        _regs[0x6A] = (uint8_t)(g_magDigZ1 & 0xFF);
+        _regs[0x6B] = (uint8_t)(g_magDigZ1 >> 8);
+        _regs[0x6C] = (uint8_t)(g_magDigXyz1 & 0xFF);
+        _regs[0x6D] = (uint8_t)(g_magDigXyz1 >> 8);
+    }
+
+protected:
+    void OnWrite(uint8_t reg, uint8_t value) override
+    {
+        if (reg == 0x4B)
+        {
+            // Soft reset bits (7 and 1) self-clear
+            _regs[0x4B] = value & 0x01;
+        }
+    }
+
+    void OnRead(uint8_t reg, int length) override
+    {
+        (void)length;
+
+        bool powered = (_regs[0x4B] & 0x01) != 0;
+
+        _regs[0x40] = powered ? I_AM_BMX055_MAG : 0x00;
+
+        if (powered && (reg >= 0x42) && (reg <= 0x49))
+        {
+            // 13-bit X/Y and 15-bit Z samples.  With RHALL equal to dig_xyz1 the trim compensation is a plain scale,
+            // (dig_x2 + 160) / 32 for X/Y, and 32768 / (dig_z2 + dig_z1 * 2 * RHALL / 65536) for Z, in 1/16 uT/LSB.
+            int32_t rhall = g_magDigXyz1;
+            double xyUtPerLsb = (g_magDigX2 + 160) / 32.0 / 16.0;
+            double zUtPerLsb = 32768.0 / (g_magDigZ2 + (((int32_t)g_magDigZ1 * (rhall << 1) + (1 << 15)) >> 16)) / 16.0;
+            int32_t x = SimClamp((g_earthFieldUt[0] + SimNoise(0.3)) / xyUtPerLsb, 13);
+            int32_t y = SimClamp((g_earthFieldUt[1] + SimNoise(0.3)) / xyUtPerLsb, 13);
+            int32_t z = SimClamp((g_earthFieldUt[2] + SimNoise(0.3)) / zUtPerLsb, 15);
+
+            _regs[0x42] = (uint8_t)(((x & 0x1F) << 3) | 0x01);
+            _regs[0x43] = (uint8_t)((x >> 5) & 0xFF);
+            _regs[0x44] = (uint8_t)((y & 0x1F) << 3);
+            _regs[0x45] = (uint8_t)((y >> 5) & 0xFF);
+            _regs[0x46] = (uint8_t)((z & 0x7F) << 1);
+            _regs[0x47] = (uint8_t)((z >> 7) & 0xFF);
+            // RHALL bits 5:0 in 7:2, data ready in bit 0
+            _regs[0x48] = (uint8_t)(((rhall & 0x3F) << 2) | 0x01);
+            _regs[0x49] = (uint8_t)((rhall >> 6) & 0xFF);
+        }
+    }
+};
+
+//
+// SimBmx055 attaches the three dies to the simulated bus at boot
+//
+static class SimBmx055
+{
+public:
+    SimBmx055()
+    {
+        SimI2C_Attach(BMX055_ACC_CHIP_ADDR, &_accel);
+        SimI2C_Attach(BMX055_GYR_CHIP_ADDR, &_gyro);
+        SimI2C_Attach(BMX055_MAG_CHIP_ADDR, &_magnet);
+    }
+
+private:
+    SimAccel _accel;
+    SimGyro _gyro;
+    SimMagnet _magnet;
+} g_simBmx055;
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+
+#include <map>
+#include <mutex>
+
+#include "mbed.h"
+#include "sim_i2c.h"
+
+// Transfers are serialized like on a real bus
+static std::mutex g_simI2CMutex;
+
+//
+// SimI2CDevices returns the devices attached, by 8-bit address.  Function local, so that devices may attach from static constructors.
+//
+static std::map<int, SimI2CDevice*>& SimI2CDevices(void)
+{
+    static std::map<int, SimI2CDevice*> devices;
+
+    return devices;
+}
+
+void SimI2C_Attach(int address, SimI2CDevice* device)
+{
+    SimI2CDevices()[address & 0xFE] = device;
+}
+
+SimI2CDevice* SimI2C_Find(int address)
+{
+    std::map<int, SimI2CDevice*>::iterator it = SimI2CDevices().find(address & 0xFE);
+
+    return (it != SimI2CDevices().end()) ? it->second : NULL;
+}
+
+SimRegisterDevice::SimRegisterDevice() : _pointer(0)
+{
+    memset(_regs, 0, sizeof(_regs));
+}
+
+int SimRegisterDevice::Write(const uint8_t* data, int length)
+{
+    if (length < 1)
+    {
+        return 0;
+    }
+
+    _pointer = data[0];
+    for (int i = 1; i < length; i++)
+    {
+        uint8_t reg = _pointer++;
+        _regs[reg] = data[i];
+        OnWrite(reg, data[i]);
+    }
+
+    return 0;
+}
+
+int SimRegisterDevice::Read(uint8_t* data, int length)
+{
+    OnRead(_pointer, length);
+
+    for (int i = 0; i < length; i++)
+    {
+        data[i] = _regs[_pointer++];
+    }
+
+    return 0;
+}
+
+namespace mbed {
+
+int I2C::write(int address, const char* data, int length, bool repeated)
+{
+    (void)repeated;
+
+    std::lock_guard<std::mutex> lock(g_simI2CMutex);
+    SimI2CDevice* device = SimI2C_Find(address);
+
+    return (device != NULL) ? device->Write((const uint8_t*)data, length) : -1;
+}
+
+int I2C::read(int address, char* data, int length, bool repeated)
+{
+    (void)repeated;
+
+    std::lock_guard<std::mutex> lock(g_simI2CMutex);
+    SimI2CDevice* device = SimI2C_Find(address);
+
+    if (device == NULL)
+    {
+        // Nobody drives the bus
+        memset(data, 0xFF, length);
+        return -1;
+    }
+
+    return device->Read((uint8_t*)data, length);
+}
+
+} // namespace mbed
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header implements the simulated I2C bus of the host build.  Simulated devices attach to it at their (8-bit) address,
+// and the I2C class of host/mbed routes transfers to them.
+
+#ifndef SIM_I2C_H
+#define SIM_I2C_H
+
+#include <stdint.h>
+
+//
+// SimI2CDevice is a device on the simulated I2C bus
+//
+class SimI2CDevice
+{
+public:
+    virtual ~SimI2CDevice() {}
+
+    // Write receives a write transfer of length bytes.  Returns 0 to ACK.
+    virtual int Write(const uint8_t* data, int length) = 0;
+
+    // Read fills a read transfer of length bytes.  Returns 0 to ACK.
+    virtual int Read(uint8_t* data, int length) = 0;
+};
+
+//
+// SimI2C_Attach attaches device to the simulated bus at the 8-bit address.
+//
+void SimI2C_Attach(int address, SimI2CDevice* device);
+
+//
+// SimI2C_Find returns the device attached at the 8-bit address, or NULL, which NACKs.
+//
+SimI2CDevice* SimI2C_Find(int address);
+
+//
+// SimRegisterDevice is a device with a 256-byte register file, accessed the usual way: a write transfer starts with the
+// register address, followed by data to write; a read transfer reads from the last register address on.  The address
+// auto-increments.
+//
+class SimRegisterDevice : public SimI2CDevice
+{
+public:
+    SimRegisterDevice();
+
+    int Write(const uint8_t* data, int length) override;
+    int Read(uint8_t* data, int length) override;
+
+protected:
+    // OnRead is called before a read transfer starting at reg, to refresh the registers it covers.
+    virtual void OnRead(uint8_t reg, int length) { (void)reg; (void)length; }
+
+    // OnWrite is called after value has been written to reg.
+    virtual void OnWrite(uint8_t reg, uint8_t value) { (void)reg; (void)value; }
+
+    uint8_t _regs[256];
+    uint8_t _pointer;
+};
+
+#endif /* SIM_I2C_H */
@@ -8,6 +8,8 @@
 #include "azure_macro_utils/macro_utils.h"
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/crt_abstractions.h"
+// Frees strings from mallocAndStrcpy_s, which the SDK allocates with GB_USE_CUSTOM_HEAP, with the same free()
+#include "azure_c_shared_utility/gballoc.h"
 
 // This sample is provided for development
 // For more information please see the devdoc using_custom_hsm.md
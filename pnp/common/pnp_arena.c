@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include "parson.h"
+
+#include "pnp_arena.h"
+
+// Bytes of the arena.  It must hold the largest twin payload expected, plus its JSON tree; larger ones spill to the heap.
+#ifdef MBED_CONF_APP_PNP_ARENA_SIZE
+#define PNP_ARENA_SIZE  MBED_CONF_APP_PNP_ARENA_SIZE
+#else
+#define PNP_ARENA_SIZE  4096
+#endif
+
+// Alignment of blocks handed out, enough for double and 64-bit integers
+#define PNP_ARENA_ALIGNMENT 8
+
+static uint64_t g_arena[(PNP_ARENA_SIZE + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+
+// Bytes in use, and the offset of the most recent block, which alone can be freed before the scope ends
+static size_t g_arenaUsed = 0;
+static size_t g_arenaLastBlock = 0;
+
+// Depth of nested scopes; allocation from the arena only happens within one
+static unsigned int g_arenaDepth = 0;
+
+static PNP_ARENA_STATS g_arenaStats = { 0, 0, 0, 0, sizeof(g_arena) };
+
+void PnP_Arena_Init(void)
+{
+    json_set_allocation_functions(PnP_Arena_Malloc, PnP_Arena_Free);
+}
+
+void PnP_Arena_Begin(void)
+{
+    g_arenaDepth++;
+}
+
+void PnP_Arena_End(void)
+{
+    if ((g_arenaDepth > 0) && (--g_arenaDepth == 0))
+    {
+        g_arenaStats.scopes++;
+        g_arenaUsed = 0;
+        g_arenaLastBlock = 0;
+    }
+}
+
+void* PnP_Arena_Malloc(size_t size)
+{
+    size_t alignedSize = (size + PNP_ARENA_ALIGNMENT - 1) & ~(size_t)(PNP_ARENA_ALIGNMENT - 1);
+    void* ptr;
+
+    if (g_arenaDepth == 0)
+    {
+        ptr = malloc(size);
+    }
+    else if ((alignedSize == 0) || (alignedSize > sizeof(g_arena) - g_arenaUsed))
+    {
+        g_arenaStats.fallbacks++;
+        ptr = malloc(size);
+    }
+    else
+    {
+        ptr = (uint8_t*)g_arena + g_arenaUsed;
+        g_arenaLastBlock = g_arenaUsed;
+        g_arenaUsed += alignedSize;
+
+        g_arenaStats.allocations++;
+        if (g_arenaUsed > g_arenaStats.highWater)
+        {
+            g_arenaStats.highWater = (uint32_t)g_arenaUsed;
+        }
+    }
+
+    return ptr;
+}
+
+void PnP_Arena_Free(void* ptr)
+{
+    uint8_t* block = (uint8_t*)ptr;
+    uint8_t* arena = (uint8_t*)g_arena;
+
+    if ((block < arena) || (block >= arena + sizeof(g_arena)))
+    {
+        free(ptr);
+    }
+    // Freeing the most recent block returns it to the arena, as parson does with temporary buffers
+    else if ((size_t)(block - arena) == g_arenaLastBlock)
+    {
+        g_arenaUsed = g_arenaLastBlock;
+    }
+}
+
+void PnP_Arena_GetStats(PNP_ARENA_STATS* stats)
+{
+    *stats = g_arenaStats;
+}
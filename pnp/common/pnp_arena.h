@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Bump arena for the transient allocations of one IoT Hub callback: the payload copy, parson's JSON tree and its
+// serialized strings.  An arena scope is opened at the start of a twin or command callback and closed at its end, which
+// releases everything allocated in it at once rather than with dozens of free() calls, and keeps these short-lived blocks
+// off the general heap, where they would fragment it over time.
+//
+// parson allocates from the arena via json_set_allocation_functions once PnP_Arena_Init has run.  Outside a scope, and for
+// requests that do not fit, the arena forwards to malloc, and PnP_Arena_Free forwards blocks it did not hand out to free.
+// So nothing allocated in a scope may outlive it: copy to malloc'ed memory whatever is kept or handed over to the SDK,
+// e.g. command responses.
+//
+// Scopes are opened only on the thread that runs IoTHubDeviceClient_LL_DoWork.  Other threads must not use parson while
+// a scope is open.
+
+#ifndef PNP_ARENA_H
+#define PNP_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//
+// PNP_ARENA_STATS counts arena use since boot
+//
+typedef struct PNP_ARENA_STATS_TAG
+{
+    // Scopes closed
+    uint32_t scopes;
+    // Allocations served from the arena, and those forwarded to malloc because the arena was full
+    uint32_t allocations;
+    uint32_t fallbacks;
+    // Most bytes of the arena in use in a scope, and its size
+    uint32_t highWater;
+    uint32_t size;
+} PNP_ARENA_STATS;
+
+//
+// PnP_Arena_Init makes parson allocate through the arena.  Call it once, before any JSON is parsed or built.
+//
+void PnP_Arena_Init(void);
+
+//
+// PnP_Arena_Begin opens an arena scope.  Scopes nest; only the outermost PnP_Arena_End resets the arena.
+//
+void PnP_Arena_Begin(void);
+
+//
+// PnP_Arena_End closes the arena scope, releasing all the arena handed out in it.
+//
+void PnP_Arena_End(void);
+
+//
+// PnP_Arena_Malloc allocates size bytes from the arena in a scope, otherwise from the heap.
+//
+void* PnP_Arena_Malloc(size_t size);
+
+//
+// PnP_Arena_Free frees memory from PnP_Arena_Malloc or malloc.  Arena memory is only reclaimed by PnP_Arena_End, except
+// for the most recent allocation.
+//
+void PnP_Arena_Free(void* ptr);
+
+//
+// PnP_Arena_GetStats returns the statistics of the arena.
+//
+void PnP_Arena_GetStats(PNP_ARENA_STATS* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PNP_ARENA_H */
@@ -10,6 +10,7 @@
 #include "iothub_client_options.h"
 #include "iothubtransportmqtt.h"
 #include "pnp_device_client_ll.h"
+#include "pnp_tlsio.h"
 #ifdef USE_PROV_MODULE_FULL
 // DPS functionality using symmetric keys is only available if the cmake 
 // flags <-Duse_prov_client=ON -Dhsm_type_symm_key=ON -Drun_e2e_tests=OFF> are enabled when building the Azure IoT C SDK.
@@ -21,10 +22,18 @@
 #include "azure_c_shared_utility/xlogging.h"
 
 // For devices that do not have (or want) an OS level trusted certificate store,
-// but instead bring in default trusted certificates from the Azure IoT C SDK.
+// but instead bring in trusted certificates, by default those of the Azure IoT C SDK.
 #include "azure_c_shared_utility/shared_util_options.h"
 #include "certs.h"
 
+//
+// PnP_GetTrustedCertificates returns the configured trusted certificates, falling back to the SDK's full bundle.
+//
+const char* PnP_GetTrustedCertificates(const PNP_DEVICE_CONFIGURATION* pnpDeviceConfiguration)
+{
+    return (pnpDeviceConfiguration->trustedCertificates != NULL) ? pnpDeviceConfiguration->trustedCertificates : certificates;
+}
+
 //
 // AllocateDeviceClientHandle does the actual createHandle call, depending on the security type
 //
@@ -34,7 +43,7 @@ static IOTHUB_DEVICE_CLIENT_LL_HANDLE AllocateDeviceClientHandle(const PNP_DEVIC
 
     if (pnpDeviceConfiguration->securityType == PNP_CONNECTION_SECURITY_TYPE_CONNECTION_STRING)
     {
-        if ((deviceHandle = IoTHubDeviceClient_LL_CreateFromConnectionString(pnpDeviceConfiguration->u.connectionString, MQTT_Protocol)) == NULL)
+        if ((deviceHandle = IoTHubDeviceClient_LL_CreateFromConnectionString(pnpDeviceConfiguration->u.connectionString, PnP_MQTT_Protocol)) == NULL)
         {
             LogError("Failure creating IotHub client.  Hint: Check your connection string");
         }
@@ -95,6 +104,19 @@ IOTHUB_DEVICE_CLIENT_LL_HANDLE PnP_CreateDeviceClientLLHandle(const PNP_DEVICE_C
         LogError("Unable to set device twin callback, error=%d", iothubResult);
         result = false;
     }
+    // Optionally, set the callback function that gets notified of connection status changes with IoTHub.
+    else if ((pnpDeviceConfiguration->connectionStatusCallback != NULL) && (iothubResult = IoTHubDeviceClient_LL_SetConnectionStatusCallback(deviceHandle, pnpDeviceConfiguration->connectionStatusCallback, NULL)) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Unable to set connection status callback, error=%d", iothubResult);
+        result = false;
+    }
+    // Optionally, sets how the client reconnects to IoTHub on connection loss.  Left unset, the SDK's default policy applies.
+    else if ((pnpDeviceConfiguration->setRetryPolicy == true) &&
+             (iothubResult = IoTHubDeviceClient_LL_SetRetryPolicy(deviceHandle, pnpDeviceConfiguration->retryPolicy, pnpDeviceConfiguration->retryTimeoutLimitSecs)) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Unable to set retry policy, error=%d", iothubResult);
+        result = false;
+    }
     // Enabling auto url encode will have the underlying SDK perform URL encoding operations automatically.
     else if ((iothubResult = IoTHubDeviceClient_LL_SetOption(deviceHandle, OPTION_AUTO_URL_ENCODE_DECODE, &urlAutoEncodeDecode)) != IOTHUB_CLIENT_OK)
     {
@@ -102,7 +124,7 @@ IOTHUB_DEVICE_CLIENT_LL_HANDLE PnP_CreateDeviceClientLLHandle(const PNP_DEVICE_C
         result = false;
     }
     // Setting the Trusted Certificate.  This is only necessary on systems without built in certificate stores.
-    else if ((iothubResult = IoTHubDeviceClient_LL_SetOption(deviceHandle, OPTION_TRUSTED_CERT, certificates)) != IOTHUB_CLIENT_OK)
+    else if ((iothubResult = IoTHubDeviceClient_LL_SetOption(deviceHandle, OPTION_TRUSTED_CERT, PnP_GetTrustedCertificates(pnpDeviceConfiguration))) != IOTHUB_CLIENT_OK)
     {
         LogError("Unable to set the trusted cert, error=%d", iothubResult);
         result = false;
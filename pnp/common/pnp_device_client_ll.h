@@ -56,6 +56,17 @@ typedef struct PNP_DEVICE_CONFIGURATION_TAG
     // Callback for IoT Hub device twin notifications, which is the mechanism PnP properties from service use.
     // If PnP properties are not configured by the server, this should be NULL to conserve memory and bandwidth.
     IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK deviceTwinCallback;
+    // Callback for changes of the connection status with IoT Hub.  This is optional and may be NULL.
+    IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback;
+    // Whether to set the policy the IoT Hub client reconnects with after losing the connection.  If false, what a zero-initialized
+    // configuration holds, the SDK's default policy applies.
+    bool setRetryPolicy;
+    // The policy, and how long, in seconds, the client keeps retrying (0 for ever).  Used only if setRetryPolicy is true.
+    IOTHUB_CLIENT_RETRY_POLICY retryPolicy;
+    size_t retryTimeoutLimitSecs;
+    // PEM root certificates to trust for TLS with DPS and IoT Hub, or NULL for the full "certificates" bundle of the SDK.
+    // mbedTLS parses the bundle for every connection, so trimming it to the roots actually needed saves time and heap.
+    const char* trustedCertificates;
 } PNP_DEVICE_CONFIGURATION;
 
 //
@@ -68,6 +79,11 @@ typedef struct PNP_DEVICE_CONFIGURATION_TAG
 //
 IOTHUB_DEVICE_CLIENT_LL_HANDLE PnP_CreateDeviceClientLLHandle(const PNP_DEVICE_CONFIGURATION* pnpDeviceConfiguration);
 
+//
+// PnP_GetTrustedCertificates returns the PEM root certificates to set as OPTION_TRUSTED_CERT for the configuration.
+//
+const char* PnP_GetTrustedCertificates(const PNP_DEVICE_CONFIGURATION* pnpDeviceConfiguration);
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,15 +10,17 @@
 #include "iothub_device_client_ll.h"
 #include "iothubtransportmqtt.h"
 #include "pnp_device_client_ll.h"
+#include "pnp_tlsio.h"
 
+#include "azure_c_shared_utility/gballoc.h"
 #include "azure_c_shared_utility/strings.h"
 #include "azure_c_shared_utility/threadapi.h"
+#include "azure_c_shared_utility/tickcounter.h"
 #include "azure_c_shared_utility/xlogging.h"
 
 // For devices that do not have (or want) an OS level trusted certificate store,
-// but instead bring in default trusted certificates from the Azure IoT C SDK.
+// but instead bring in trusted certificates, by default those of the Azure IoT C SDK.
 #include "azure_c_shared_utility/shared_util_options.h"
-#include "certs.h"
 
 // DPS related header files
 #include "azure_prov_client/iothub_security_factory.h"
@@ -26,6 +28,12 @@
 #include "azure_prov_client/prov_transport_mqtt_client.h"
 #include "azure_prov_client/prov_security_factory.h"
 
+#ifdef USE_DPS_CACHE
+// Mbed OS KVStore, which persists the IoT Hub assignment across reboots
+#include "kvstore_global_api.h"
+#include "platform/mbed_error.h"
+#endif
+
 // Format of custom DPS payload sent when registering a PnP device.
 static const char g_dps_PayloadFormatForModelId[] = "{\"modelId\":\"%s\"}";
 
@@ -39,17 +47,198 @@ typedef enum PNP_DPS_REGISTRATION_STATUS_TAG
 
 PNP_DPS_REGISTRATION_STATUS g_pnpDpsRegistrationStatus;
 
-// Maximum amount of times we'll poll for DPS registration being ready.  Note that even though DPS works off of callbacks,
+// Maximum amount of time, in milliseconds, we'll poll for DPS registration being ready.  Note that even though DPS works off of callbacks,
 // the main() loop itself blocks 
-static const int g_dpsRegistrationMaxPolls = 60;
-// Amount to sleep between querying state from DPS registration loop
-static const int g_dpsRegistrationPollSleep = 1000;
+static const tickcounter_ms_t g_dpsRegistrationTimeoutMs = 60000;
+// Amount to sleep between querying state from DPS registration loop while a protocol exchange (TLS handshake, MQTT connect,
+// subscribe, register request) is in flight.  Each step completes within DoWork as soon as the response arrives, so keep this short.
+static const unsigned int g_dpsRegistrationPollSleepMinMs = 10;
+// Upper bound of the sleep between polls once the service has told us the registration is still being assigned.  The DPS client
+// then idles until the service's retry-after has elapsed, so there is nothing to gain from polling fast.
+static const unsigned int g_dpsRegistrationPollSleepMaxMs = 500;
+
+// Registration status last reported by the DPS client.  Only PROV_DEVICE_REG_STATUS_ASSIGNING lets the poll loop back off.
+static PROV_DEVICE_REG_STATUS g_pnpDpsRegistrationStep;
+// Set whenever the DPS client reports progress, so that the poll loop can return to short sleeps.
+static bool g_pnpDpsRegistrationStepChanged;
+
+// Wall time, in milliseconds, spent by the last DPS registration.  0 if it was skipped or not run yet.
+static uint32_t g_dpsLastRegistrationTimeMs;
 
 // IoT Hub for this device as determined by the DPS client runtime
 static char* g_dpsIothubUri;
 // DeviceId for this device as determined by the DPS client runtime
 static char* g_dpsDeviceId;
 
+//
+// FreeAssignment frees g_dpsIothubUri and g_dpsDeviceId, so that they can be set again
+//
+static void FreeAssignment(void)
+{
+    free(g_dpsIothubUri);
+    free(g_dpsDeviceId);
+    g_dpsIothubUri = NULL;
+    g_dpsDeviceId = NULL;
+}
+
+#ifdef USE_DPS_CACHE
+// KVStore key under which the IoT Hub assignment from the last successful DPS registration is kept.
+static const char g_dpsCacheKey[] = "/kv/pnp_dps_assignment";
+
+// Marks a valid cache record.  Bump it whenever PNP_DPS_CACHE_RECORD changes layout so stale records are ignored.
+#define PNP_DPS_CACHE_MAGIC 0x50445031
+
+// Maximum lengths of the strings stored in the cache record.  IoT Hub host names and device IDs are both limited to 128 characters.
+#define PNP_DPS_CACHE_MAX_ID_SCOPE_LENGTH 64
+#define PNP_DPS_CACHE_MAX_ID_LENGTH 128
+
+//
+// PNP_DPS_CACHE_RECORD is the layout of the IoT Hub assignment persisted in KVStore.  The DPS ID scope and registration ID
+// it was obtained with are kept alongside, so that re-configuring the device for another enrollment does not reuse a stale assignment.
+//
+typedef struct PNP_DPS_CACHE_RECORD_TAG
+{
+    uint32_t magic;
+    char idScope[PNP_DPS_CACHE_MAX_ID_SCOPE_LENGTH + 1];
+    char registrationId[PNP_DPS_CACHE_MAX_ID_LENGTH + 1];
+    char iothubUri[PNP_DPS_CACHE_MAX_ID_LENGTH + 1];
+    char deviceId[PNP_DPS_CACHE_MAX_ID_LENGTH + 1];
+} PNP_DPS_CACHE_RECORD;
+
+// Whether the device client handle most recently created came from the cached assignment rather than a fresh DPS registration.
+static bool g_dpsUsedCachedAssignment;
+// Whether g_dpsIothubUri and g_dpsDeviceId already hold the cached assignment, read ahead by PnP_DpsCache_Preload.
+static bool g_dpsCachePreloaded;
+
+//
+// LoadCachedAssignment reads the IoT Hub assignment persisted by a previous DPS registration into g_dpsIothubUri and g_dpsDeviceId.
+// It returns false if there is no cache record or it does not belong to the DPS enrollment currently configured.
+//
+static bool LoadCachedAssignment(const PNP_DEVICE_CONFIGURATION* pnpDeviceConfiguration)
+{
+    PNP_DPS_CACHE_RECORD* cacheRecord;
+    size_t actualSize = 0;
+    int kvResult;
+    bool result;
+
+    // Whatever an earlier load or registration left is replaced, or cleared if there is no cached assignment
+    FreeAssignment();
+
+    if ((cacheRecord = (PNP_DPS_CACHE_RECORD*)malloc(sizeof(PNP_DPS_CACHE_RECORD))) == NULL)
+    {
+        LogError("Unable to allocate DPS cache record");
+        result = false;
+    }
+    else if ((kvResult = kv_get(g_dpsCacheKey, cacheRecord, sizeof(PNP_DPS_CACHE_RECORD), &actualSize)) != 0)
+    {
+        // No assignment cached yet (typically first boot); not an error.
+        result = false;
+    }
+    else if ((actualSize != sizeof(PNP_DPS_CACHE_RECORD)) || (cacheRecord->magic != PNP_DPS_CACHE_MAGIC))
+    {
+        LogInfo("Ignoring DPS cache record of unknown format");
+        result = false;
+    }
+    else if ((strncmp(cacheRecord->idScope, pnpDeviceConfiguration->u.dpsConnectionAuth.idScope, sizeof(cacheRecord->idScope)) != 0) ||
+             (strncmp(cacheRecord->registrationId, pnpDeviceConfiguration->u.dpsConnectionAuth.deviceId, sizeof(cacheRecord->registrationId)) != 0))
+    {
+        LogInfo("Ignoring DPS cache record for another enrollment");
+        result = false;
+    }
+    else
+    {
+        // Defend against a truncated record before treating its fields as strings.
+        cacheRecord->iothubUri[PNP_DPS_CACHE_MAX_ID_LENGTH] = '\0';
+        cacheRecord->deviceId[PNP_DPS_CACHE_MAX_ID_LENGTH] = '\0';
+
+        if ((mallocAndStrcpy_s(&g_dpsIothubUri, cacheRecord->iothubUri) != 0) ||
+            (mallocAndStrcpy_s(&g_dpsDeviceId, cacheRecord->deviceId) != 0))
+        {
+            LogError("Unable to copy cached provisioning information");
+            FreeAssignment();
+            result = false;
+        }
+        else
+        {
+            LogInfo("Using IoT Hub assignment cached from previous DPS registration.  iothubUri=%s, deviceId=%s", g_dpsIothubUri, g_dpsDeviceId);
+            result = true;
+        }
+    }
+
+    free(cacheRecord);
+
+    return result;
+}
+
+//
+// StoreCachedAssignment persists the IoT Hub assignment just returned by DPS, so that following boots can skip registration.
+//
+static void StoreCachedAssignment(const PNP_DEVICE_CONFIGURATION* pnpDeviceConfiguration)
+{
+    PNP_DPS_CACHE_RECORD* cacheRecord;
+    int kvResult;
+
+    if ((strlen(pnpDeviceConfiguration->u.dpsConnectionAuth.idScope) > PNP_DPS_CACHE_MAX_ID_SCOPE_LENGTH) ||
+        (strlen(pnpDeviceConfiguration->u.dpsConnectionAuth.deviceId) > PNP_DPS_CACHE_MAX_ID_LENGTH) ||
+        (strlen(g_dpsIothubUri) > PNP_DPS_CACHE_MAX_ID_LENGTH) ||
+        (strlen(g_dpsDeviceId) > PNP_DPS_CACHE_MAX_ID_LENGTH))
+    {
+        LogError("DPS assignment too long to be cached");
+    }
+    else if ((cacheRecord = (PNP_DPS_CACHE_RECORD*)calloc(1, sizeof(PNP_DPS_CACHE_RECORD))) == NULL)
+    {
+        LogError("Unable to allocate DPS cache record");
+    }
+    else
+    {
+        cacheRecord->magic = PNP_DPS_CACHE_MAGIC;
+        strcpy(cacheRecord->idScope, pnpDeviceConfiguration->u.dpsConnectionAuth.idScope);
+        strcpy(cacheRecord->registrationId, pnpDeviceConfiguration->u.dpsConnectionAuth.deviceId);
+        strcpy(cacheRecord->iothubUri, g_dpsIothubUri);
+        strcpy(cacheRecord->deviceId, g_dpsDeviceId);
+
+        if ((kvResult = kv_set(g_dpsCacheKey, cacheRecord, sizeof(PNP_DPS_CACHE_RECORD), 0)) != 0)
+        {
+            LogError("Unable to cache DPS assignment, error=%d", kvResult);
+        }
+
+        free(cacheRecord);
+    }
+}
+
+void PnP_DpsCache_Invalidate(void)
+{
+    int kvResult;
+
+    if (((kvResult = kv_remove(g_dpsCacheKey)) != 0) && (kvResult != MBED_ERROR_ITEM_NOT_FOUND))
+    {
+        LogError("Unable to remove cached DPS assignment, error=%d", kvResult);
+    }
+
+    g_dpsUsedCachedAssignment = false;
+}
+
+bool PnP_DpsCache_Preload(const PNP_DEVICE_CONFIGURATION* pnpDeviceConfiguration)
+{
+    if (g_dpsCachePreloaded == false)
+    {
+        g_dpsCachePreloaded = LoadCachedAssignment(pnpDeviceConfiguration);
+    }
+
+    return g_dpsCachePreloaded;
+}
+
+const char* PnP_DpsCache_GetPreloadedIothubUri(void)
+{
+    return g_dpsCachePreloaded ? g_dpsIothubUri : NULL;
+}
+
+bool PnP_DpsCache_IsAssignmentCached(void)
+{
+    return g_dpsUsedCachedAssignment;
+}
+#endif /* USE_DPS_CACHE */
+
 //
 // provisioningRegisterCallback is called back by the DPS client when the DPS server has either succeeded or failed our request.
 //
@@ -64,10 +253,13 @@ static void provisioningRegisterCallback(PROV_DEVICE_RESULT registerResult, cons
     }
     else
     {
+        FreeAssignment();
+
         if ((mallocAndStrcpy_s(&g_dpsIothubUri, iothubUri) != 0) ||
             (mallocAndStrcpy_s(&g_dpsDeviceId, deviceId) != 0))
         {
             LogError("Unable to copy provisioning information");
+            FreeAssignment();
             g_pnpDpsRegistrationStatus = PNP_DPS_REGISTRATION_FAILED;
         }
         else
@@ -78,19 +270,88 @@ static void provisioningRegisterCallback(PROV_DEVICE_RESULT registerResult, cons
     }
 }
 
-IOTHUB_DEVICE_CLIENT_LL_HANDLE PnP_CreateDeviceClientLLHandle_ViaDps(const PNP_DEVICE_CONFIGURATION* pnpDeviceConfiguration)
+//
+// provisioningStatusCallback is called back by the DPS client as the registration progresses through its protocol steps.
+//
+static void provisioningStatusCallback(PROV_DEVICE_REG_STATUS regStatus, void* userContext)
+{
+    (void)userContext;
+
+    g_pnpDpsRegistrationStep = regStatus;
+    g_pnpDpsRegistrationStepChanged = true;
+}
+
+//
+// PollDpsRegistration drives the DPS client until provisioningRegisterCallback reports an outcome or the registration times out.
+// Sleeps between polls are kept short while the client is exchanging messages with the service, and only back off exponentially
+// while the service is assigning the device and the client waits for the service's retry-after.
+//
+static void PollDpsRegistration(PROV_DEVICE_LL_HANDLE provDeviceHandle, TICK_COUNTER_HANDLE tickCounter)
+{
+    tickcounter_ms_t startMs;
+    tickcounter_ms_t nowMs;
+    unsigned int pollSleepMs = g_dpsRegistrationPollSleepMinMs;
+
+    (void)tickcounter_get_current_ms(tickCounter, &startMs);
+    nowMs = startMs;
+
+    while ((g_pnpDpsRegistrationStatus == PNP_DPS_REGISTRATION_NOT_COMPLETE) && ((nowMs - startMs) < g_dpsRegistrationTimeoutMs))
+    {
+        g_pnpDpsRegistrationStepChanged = false;
+
+        Prov_Device_LL_DoWork(provDeviceHandle);
+
+        if (g_pnpDpsRegistrationStatus != PNP_DPS_REGISTRATION_NOT_COMPLETE)
+        {
+            break;
+        }
+
+        if (g_pnpDpsRegistrationStepChanged || (g_pnpDpsRegistrationStep != PROV_DEVICE_REG_STATUS_ASSIGNING))
+        {
+            pollSleepMs = g_dpsRegistrationPollSleepMinMs;
+        }
+        else if (pollSleepMs < g_dpsRegistrationPollSleepMaxMs)
+        {
+            pollSleepMs = (pollSleepMs * 2 < g_dpsRegistrationPollSleepMaxMs) ? (pollSleepMs * 2) : g_dpsRegistrationPollSleepMaxMs;
+        }
+
+        ThreadAPI_Sleep(pollSleepMs);
+        (void)tickcounter_get_current_ms(tickCounter, &nowMs);
+    }
+
+    (void)tickcounter_get_current_ms(tickCounter, &nowMs);
+    g_dpsLastRegistrationTimeMs = (uint32_t)(nowMs - startMs);
+    LogInfo("DPS registration wall time=%lu ms", (unsigned long)g_dpsLastRegistrationTimeMs);
+}
+
+uint32_t PnP_Dps_GetLastRegistrationTimeMs(void)
+{
+    return g_dpsLastRegistrationTimeMs;
+}
+
+//
+// RegisterWithDps runs the DPS registration and, on success, leaves the assigned IoT Hub in g_dpsIothubUri and g_dpsDeviceId.
+//
+static bool RegisterWithDps(const PNP_DEVICE_CONFIGURATION* pnpDeviceConfiguration)
 {
-    IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceHandle = NULL;
     bool result;
 
     PROV_DEVICE_RESULT provDeviceResult;
     PROV_DEVICE_LL_HANDLE provDeviceHandle = NULL;
     STRING_HANDLE modelIdPayload = NULL;
+    TICK_COUNTER_HANDLE tickCounter = NULL;
 
     LogInfo("Initiating DPS client to retrieve IoT Hub connection information");
     g_pnpDpsRegistrationStatus = PNP_DPS_REGISTRATION_NOT_COMPLETE;
+    g_pnpDpsRegistrationStep = PROV_DEVICE_REG_STATUS_CONNECTED;
+    g_dpsLastRegistrationTimeMs = 0;
 
-    if ((modelIdPayload = STRING_construct_sprintf(g_dps_PayloadFormatForModelId, pnpDeviceConfiguration->modelId)) == NULL)
+    if ((tickCounter = tickcounter_create()) == NULL)
+    {
+        LogError("Cannot create tick counter for DPS registration.");
+        result = false;
+    }
+    else if ((modelIdPayload = STRING_construct_sprintf(g_dps_PayloadFormatForModelId, pnpDeviceConfiguration->modelId)) == NULL)
     {
         LogError("Cannot allocate DPS payload for modelId.");
         result = false;
@@ -116,7 +377,7 @@ IOTHUB_DEVICE_CLIENT_LL_HANDLE PnP_CreateDeviceClientLLHandle_ViaDps(const PNP_D
         result = false;
     }
     // Setting the Trusted Certificate.  This is only necessary on systems without built in certificate stores.
-    else if ((provDeviceResult = Prov_Device_LL_SetOption(provDeviceHandle, OPTION_TRUSTED_CERT, certificates)) != PROV_DEVICE_RESULT_OK)
+    else if ((provDeviceResult = Prov_Device_LL_SetOption(provDeviceHandle, OPTION_TRUSTED_CERT, PnP_GetTrustedCertificates(pnpDeviceConfiguration))) != PROV_DEVICE_RESULT_OK)
     {
         LogError("Unable to set the trusted cert, error=%d", provDeviceResult);
         result = false;
@@ -128,18 +389,14 @@ IOTHUB_DEVICE_CLIENT_LL_HANDLE PnP_CreateDeviceClientLLHandle_ViaDps(const PNP_D
         LogError("Failed setting provisioning data, error=%d", provDeviceResult);
         result = false;
     }
-    else if ((provDeviceResult = Prov_Device_LL_Register_Device(provDeviceHandle, provisioningRegisterCallback, NULL, NULL, NULL)) != PROV_DEVICE_RESULT_OK)
+    else if ((provDeviceResult = Prov_Device_LL_Register_Device(provDeviceHandle, provisioningRegisterCallback, NULL, provisioningStatusCallback, NULL)) != PROV_DEVICE_RESULT_OK)
     {
         LogError("Prov_Device_LL_Register_Device failed, error=%d", provDeviceResult);
         result = false;
     }
     else
     {
-        for (int i = 0; (i < g_dpsRegistrationMaxPolls) && (g_pnpDpsRegistrationStatus == PNP_DPS_REGISTRATION_NOT_COMPLETE); i++)
-        {
-            Prov_Device_LL_DoWork(provDeviceHandle);
-            ThreadAPI_Sleep(g_dpsRegistrationPollSleep);
-        }
+        PollDpsRegistration(provDeviceHandle, tickCounter);
 
         if (g_pnpDpsRegistrationStatus == PNP_DPS_REGISTRATION_SUCCEEDED)
         {
@@ -166,6 +423,55 @@ IOTHUB_DEVICE_CLIENT_LL_HANDLE PnP_CreateDeviceClientLLHandle_ViaDps(const PNP_D
         Prov_Device_LL_Destroy(provDeviceHandle);
     }
 
+    STRING_delete(modelIdPayload);
+    if (tickCounter != NULL)
+    {
+        tickcounter_destroy(tickCounter);
+    }
+
+    return result;
+}
+
+IOTHUB_DEVICE_CLIENT_LL_HANDLE PnP_CreateDeviceClientLLHandle_ViaDps(const PNP_DEVICE_CONFIGURATION* pnpDeviceConfiguration)
+{
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceHandle = NULL;
+    bool result;
+
+#ifdef USE_DPS_CACHE
+    // Reuse the IoT Hub assignment from a previous registration when there is one, possibly read in advance by
+    // PnP_DpsCache_Preload.  The application is expected to call PnP_DpsCache_Invalidate() if IoT Hub then rejects
+    // the device, so that the next attempt goes through DPS again.
+    if (g_dpsCachePreloaded)
+    {
+        g_dpsCachePreloaded = false;
+        g_dpsUsedCachedAssignment = true;
+    }
+    else
+    {
+        g_dpsUsedCachedAssignment = LoadCachedAssignment(pnpDeviceConfiguration);
+    }
+
+    if (g_dpsUsedCachedAssignment)
+    {
+        // The symmetric key is otherwise handed to the HSM as part of DPS registration, and IoT Hub authentication needs it too.
+        if (prov_dev_set_symmetric_key_info(pnpDeviceConfiguration->u.dpsConnectionAuth.deviceId, pnpDeviceConfiguration->u.dpsConnectionAuth.deviceKey) != 0)
+        {
+            LogError("prov_dev_set_symmetric_key_info failed.");
+            result = false;
+        }
+        else
+        {
+            result = true;
+        }
+    }
+    else if ((result = RegisterWithDps(pnpDeviceConfiguration)) == true)
+    {
+        StoreCachedAssignment(pnpDeviceConfiguration);
+    }
+#else
+    result = RegisterWithDps(pnpDeviceConfiguration);
+#endif
+
     if (result == true)
     {
         if (iothub_security_init(IOTHUB_SECURITY_TYPE_SYMMETRIC_KEY) != 0)
@@ -173,16 +479,14 @@ IOTHUB_DEVICE_CLIENT_LL_HANDLE PnP_CreateDeviceClientLLHandle_ViaDps(const PNP_D
             LogError("iothub_security_init failed");
             result = false;
         }
-        else if ((deviceHandle = IoTHubDeviceClient_LL_CreateFromDeviceAuth(g_dpsIothubUri, g_dpsDeviceId, MQTT_Protocol)) == NULL)
+        else if ((deviceHandle = IoTHubDeviceClient_LL_CreateFromDeviceAuth(g_dpsIothubUri, g_dpsDeviceId, PnP_MQTT_Protocol)) == NULL)
         {
             LogError("IoTHubDeviceClient_LL_CreateFromDeviceAuth failed");
             result = true;
         }
     }
 
-    free(g_dpsIothubUri);
-    free(g_dpsDeviceId);
-    STRING_delete(modelIdPayload);
+    FreeAssignment();
 
     return deviceHandle;
 }
@@ -21,6 +21,38 @@ extern "C" {
 //
 IOTHUB_DEVICE_CLIENT_LL_HANDLE PnP_CreateDeviceClientLLHandle_ViaDps(const PNP_DEVICE_CONFIGURATION* pnpDeviceConfiguration);
 
+//
+// PnP_Dps_GetLastRegistrationTimeMs returns the wall time, in milliseconds, the last DPS registration took, for startup metrics.
+// It returns 0 if no registration has been run (e.g. the IoT Hub assignment was taken from cache).
+//
+uint32_t PnP_Dps_GetLastRegistrationTimeMs(void);
+
+#ifdef USE_DPS_CACHE
+//
+// PnP_DpsCache_Preload reads the cached IoT Hub assignment ahead of PnP_CreateDeviceClientLLHandle_ViaDps, so that
+// the KVStore access can overlap with other boot work such as network bring-up.  It returns whether an assignment was found.
+//
+bool PnP_DpsCache_Preload(const PNP_DEVICE_CONFIGURATION* pnpDeviceConfiguration);
+
+//
+// PnP_DpsCache_GetPreloadedIothubUri returns the IoT Hub host name found by PnP_DpsCache_Preload, or NULL if there is none.
+// The string remains valid until PnP_CreateDeviceClientLLHandle_ViaDps is called.
+//
+const char* PnP_DpsCache_GetPreloadedIothubUri(void);
+
+//
+// PnP_DpsCache_IsAssignmentCached returns whether the handle most recently created by PnP_CreateDeviceClientLLHandle_ViaDps
+// connects to an IoT Hub assignment cached in KVStore, instead of one freshly returned by DPS.
+//
+bool PnP_DpsCache_IsAssignmentCached(void);
+
+//
+// PnP_DpsCache_Invalidate erases the cached IoT Hub assignment.  Call it when IoT Hub rejects the cached assignment
+// (e.g. the device was deleted or moved to another hub), so that the next PnP_CreateDeviceClientLLHandle_ViaDps registers with DPS again.
+//
+void PnP_DpsCache_Invalidate(void);
+#endif /* USE_DPS_CACHE */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Not azure_c_shared_utility/gballoc.h: it would redirect the malloc and free of this file to this file
+#include "platform/mbed_critical.h"
+
+#include "pnp_mempool.h"
+
+// Blocks of each size class.  The defaults cover the messages, strings and buffers the IoT SDK keeps for one telemetry
+// message and one reported property in flight, besides those it holds for the whole connection.
+#ifndef MBED_CONF_APP_PNP_MEMPOOL_BLOCKS
+#define MBED_CONF_APP_PNP_MEMPOOL_BLOCKS 8
+#endif
+
+#define PNP_MEMPOOL_TINY_SIZE   32
+#define PNP_MEMPOOL_SMALL_SIZE  64
+#define PNP_MEMPOOL_MEDIUM_SIZE 128
+#define PNP_MEMPOOL_LARGE_SIZE  256
+#define PNP_MEMPOOL_HUGE_SIZE   768
+
+#define PNP_MEMPOOL_BLOCKS  MBED_CONF_APP_PNP_MEMPOOL_BLOCKS
+
+//
+// PNP_MEMPOOL_BLOCK is a free block, linked into the free list of its class
+//
+typedef struct PNP_MEMPOOL_BLOCK_TAG
+{
+    struct PNP_MEMPOOL_BLOCK_TAG* next;
+} PNP_MEMPOOL_BLOCK;
+
+//
+// PNP_MEMPOOL_CLASS is one size class, over storage of blocks * blockSize bytes
+//
+typedef struct PNP_MEMPOOL_CLASS_TAG
+{
+    uint8_t* storage;
+    PNP_MEMPOOL_BLOCK* freeList;
+    PNP_MEMPOOL_STATS stats;
+} PNP_MEMPOOL_CLASS;
+
+// Storage of the classes, as 64-bit words for alignment
+static uint64_t g_tinyStorage[PNP_MEMPOOL_BLOCKS * PNP_MEMPOOL_TINY_SIZE / sizeof(uint64_t)];
+static uint64_t g_smallStorage[PNP_MEMPOOL_BLOCKS * PNP_MEMPOOL_SMALL_SIZE / sizeof(uint64_t)];
+static uint64_t g_mediumStorage[PNP_MEMPOOL_BLOCKS * PNP_MEMPOOL_MEDIUM_SIZE / sizeof(uint64_t)];
+static uint64_t g_largeStorage[PNP_MEMPOOL_BLOCKS * PNP_MEMPOOL_LARGE_SIZE / sizeof(uint64_t)];
+static uint64_t g_hugeStorage[PNP_MEMPOOL_BLOCKS * PNP_MEMPOOL_HUGE_SIZE / sizeof(uint64_t)];
+
+// Size classes, from the smallest.  Free lists are built on first use.
+static PNP_MEMPOOL_CLASS g_classes[PNP_MEMPOOL_NUM_CLASSES] =
+{
+    { (uint8_t*)g_tinyStorage, NULL, { PNP_MEMPOOL_TINY_SIZE, PNP_MEMPOOL_BLOCKS, 0, 0, 0, 0 } },
+    { (uint8_t*)g_smallStorage, NULL, { PNP_MEMPOOL_SMALL_SIZE, PNP_MEMPOOL_BLOCKS, 0, 0, 0, 0 } },
+    { (uint8_t*)g_mediumStorage, NULL, { PNP_MEMPOOL_MEDIUM_SIZE, PNP_MEMPOOL_BLOCKS, 0, 0, 0, 0 } },
+    { (uint8_t*)g_largeStorage, NULL, { PNP_MEMPOOL_LARGE_SIZE, PNP_MEMPOOL_BLOCKS, 0, 0, 0, 0 } },
+    { (uint8_t*)g_hugeStorage, NULL, { PNP_MEMPOOL_HUGE_SIZE, PNP_MEMPOOL_BLOCKS, 0, 0, 0, 0 } },
+};
+
+static bool g_poolsInitialized = false;
+static uint32_t g_oversized = 0;
+
+//
+// InitPools links the blocks of each class into its free list
+//
+static void InitPools(void)
+{
+    for (size_t i = 0; i < PNP_MEMPOOL_NUM_CLASSES; i++)
+    {
+        PNP_MEMPOOL_CLASS* poolClass = &g_classes[i];
+
+        poolClass->freeList = NULL;
+        for (uint32_t block = poolClass->stats.blocks; block > 0; block--)
+        {
+            PNP_MEMPOOL_BLOCK* freeBlock = (PNP_MEMPOOL_BLOCK*)(poolClass->storage + (block - 1) * poolClass->stats.blockSize);
+
+            freeBlock->next = poolClass->freeList;
+            poolClass->freeList = freeBlock;
+        }
+    }
+
+    g_poolsInitialized = true;
+}
+
+//
+// FindOwningClass returns the class whose storage ptr lies in, or NULL if it came from malloc
+//
+static PNP_MEMPOOL_CLASS* FindOwningClass(const void* ptr)
+{
+    const uint8_t* block = (const uint8_t*)ptr;
+
+    for (size_t i = 0; i < PNP_MEMPOOL_NUM_CLASSES; i++)
+    {
+        PNP_MEMPOOL_CLASS* poolClass = &g_classes[i];
+
+        if ((block >= poolClass->storage) && (block < poolClass->storage + poolClass->stats.blocks * poolClass->stats.blockSize))
+        {
+            return poolClass;
+        }
+    }
+
+    return NULL;
+}
+
+void* PnP_MemPool_Alloc(size_t size)
+{
+    core_util_critical_section_enter();
+
+    if (g_poolsInitialized == false)
+    {
+        InitPools();
+    }
+
+    for (size_t i = 0; i < PNP_MEMPOOL_NUM_CLASSES; i++)
+    {
+        PNP_MEMPOOL_CLASS* poolClass = &g_classes[i];
+
+        if (size <= poolClass->stats.blockSize)
+        {
+            PNP_MEMPOOL_BLOCK* block = poolClass->freeList;
+
+            if (block == NULL)
+            {
+                poolClass->stats.misses++;
+                break;
+            }
+
+            poolClass->freeList = block->next;
+            poolClass->stats.hits++;
+            poolClass->stats.inUse++;
+            if (poolClass->stats.inUse > poolClass->stats.highWater)
+            {
+                poolClass->stats.highWater = poolClass->stats.inUse;
+            }
+
+            core_util_critical_section_exit();
+            return block;
+        }
+        else if (i == PNP_MEMPOOL_NUM_CLASSES - 1)
+        {
+            g_oversized++;
+        }
+    }
+
+    core_util_critical_section_exit();
+
+    // Outside the critical section, as malloc locks a mutex
+    return malloc(size);
+}
+
+void PnP_MemPool_Free(void* ptr)
+{
+    PNP_MEMPOOL_CLASS* poolClass;
+
+    if (ptr == NULL)
+    {
+        return;
+    }
+    else if ((poolClass = FindOwningClass(ptr)) == NULL)
+    {
+        free(ptr);
+    }
+    else
+    {
+        PNP_MEMPOOL_BLOCK* block = (PNP_MEMPOOL_BLOCK*)ptr;
+
+        core_util_critical_section_enter();
+        block->next = poolClass->freeList;
+        poolClass->freeList = block;
+        poolClass->stats.inUse--;
+        core_util_critical_section_exit();
+    }
+}
+
+void* PnP_MemPool_Realloc(void* ptr, size_t size)
+{
+    PNP_MEMPOOL_CLASS* poolClass;
+    void* newPtr;
+
+    if (ptr == NULL)
+    {
+        return PnP_MemPool_Alloc(size);
+    }
+    else if ((poolClass = FindOwningClass(ptr)) == NULL)
+    {
+        return realloc(ptr, size);
+    }
+    else if (size <= poolClass->stats.blockSize)
+    {
+        // The block still fits, e.g. a string the IoT SDK appends to
+        return ptr;
+    }
+    else if ((newPtr = PnP_MemPool_Alloc(size)) != NULL)
+    {
+        memcpy(newPtr, ptr, poolClass->stats.blockSize);
+        PnP_MemPool_Free(ptr);
+    }
+
+    return newPtr;
+}
+
+void PnP_MemPool_GetStats(PNP_MEMPOOL_STATS stats[PNP_MEMPOOL_NUM_CLASSES], uint32_t* oversized)
+{
+    core_util_critical_section_enter();
+
+    for (size_t i = 0; i < PNP_MEMPOOL_NUM_CLASSES; i++)
+    {
+        stats[i] = g_classes[i].stats;
+    }
+
+    *oversized = g_oversized;
+
+    core_util_critical_section_exit();
+}
+
+#ifdef GB_USE_CUSTOM_HEAP
+//
+// With GB_USE_CUSTOM_HEAP, c-utility's gballoc.h turns malloc, calloc, realloc and free of every source file of the IoT
+// SDK into the functions below, so that its message handles, property maps, body copies, strings and MQTT packets come
+// from the pools as well.  Blocks the application allocated with plain malloc and hands over to the SDK to free, e.g.
+// command responses, are not in the pools and go back to the heap.
+//
+void* mallocToUse(size_t size)
+{
+    return PnP_MemPool_Alloc(size);
+}
+
+void* callocToUse(size_t nmemb, size_t size)
+{
+    void* ptr;
+
+    if ((size != 0) && (nmemb > SIZE_MAX / size))
+    {
+        ptr = NULL;
+    }
+    else if ((ptr = PnP_MemPool_Alloc(nmemb * size)) != NULL)
+    {
+        memset(ptr, 0, nmemb * size);
+    }
+
+    return ptr;
+}
+
+void* reallocToUse(void* ptr, size_t size)
+{
+    return PnP_MemPool_Realloc(ptr, size);
+}
+
+void freeToUse(void* ptr)
+{
+    PnP_MemPool_Free(ptr);
+}
+#endif
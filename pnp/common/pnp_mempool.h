@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Fixed-block memory pools for the buffers allocated over and over for the device's whole lifetime: reported properties
+// built by the PnP layer and, built with GB_USE_CUSTOM_HEAP, every allocation of the IoT SDK.  Blocks come in a few size
+// classes, each a free list over static storage, so allocation takes constant time and these recurring allocations stay
+// off the general heap.  Requests larger than the largest class, or made while their class is exhausted, are served by
+// malloc and counted as misses.
+//
+// The pools are thread-safe, but must not be used from interrupts, as they fall back to malloc.
+
+#ifndef PNP_MEMPOOL_H
+#define PNP_MEMPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Number of size classes
+#define PNP_MEMPOOL_NUM_CLASSES 5
+
+//
+// PNP_MEMPOOL_STATS counts the use of one size class since boot
+//
+typedef struct PNP_MEMPOOL_STATS_TAG
+{
+    // Size of the blocks and their number
+    uint32_t blockSize;
+    uint32_t blocks;
+    // Allocations served by the class, and those that fell back to malloc because it was exhausted
+    uint32_t hits;
+    uint32_t misses;
+    // Blocks in use now, and the most ever in use at once
+    uint32_t inUse;
+    uint32_t highWater;
+} PNP_MEMPOOL_STATS;
+
+//
+// PnP_MemPool_Alloc returns a block of at least size bytes from the smallest class that fits, or from malloc.
+//
+void* PnP_MemPool_Alloc(size_t size);
+
+//
+// PnP_MemPool_Free returns a block from PnP_MemPool_Alloc.
+//
+void PnP_MemPool_Free(void* ptr);
+
+//
+// PnP_MemPool_Realloc resizes a block from PnP_MemPool_Alloc like realloc, keeping it in place while it fits its class.
+//
+void* PnP_MemPool_Realloc(void* ptr, size_t size);
+
+//
+// PnP_MemPool_GetStats returns the statistics of each size class, from the smallest.  Allocations larger than every class
+// are counted in oversized.
+//
+void PnP_MemPool_GetStats(PNP_MEMPOOL_STATS stats[PNP_MEMPOOL_NUM_CLASSES], uint32_t* oversized);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PNP_MEMPOOL_H */
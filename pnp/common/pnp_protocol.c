@@ -1,12 +1,21 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
+#include <stdarg.h>
+#include <stdio.h>
+
 // Header associated with this .c file
 #include "pnp_protocol.h"
 
 // JSON parsing library
 #include "parson.h"
 
+// Arena for the transient allocations of parsing
+#include "pnp_arena.h"
+
+// Fixed-block pools for reported properties
+#include "pnp_mempool.h"
+
 // IoT core utility related header files
 #include "azure_c_shared_utility/xlogging.h"
 #include "azure_c_shared_utility/strings.h"
@@ -78,6 +87,62 @@ STRING_HANDLE PnP_CreateReportedPropertyWithStatus(const char* componentName, co
     return jsonToSend;    
 }
 
+//
+// FormatToPool formats JSON into a block of the pools just large enough
+//
+static char* FormatToPool(const char* format, ...)
+{
+    va_list args;
+    int length;
+    char* jsonToSend;
+
+    va_start(args, format);
+    length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    if (length < 0)
+    {
+        LogError("Unable to format JSON");
+        jsonToSend = NULL;
+    }
+    else if ((jsonToSend = (char*)PnP_MemPool_Alloc((size_t)length + 1)) == NULL)
+    {
+        LogError("Unable to allocate JSON buffer");
+    }
+    else
+    {
+        va_start(args, format);
+        (void)vsnprintf(jsonToSend, (size_t)length + 1, format, args);
+        va_end(args);
+    }
+
+    return jsonToSend;
+}
+
+char* PnP_FormatReportedProperty(const char* componentName, const char* propertyName, const char* propertyValue)
+{
+    if (componentName == NULL)
+    {
+        return FormatToPool(g_propertyWithoutResponseSchemaWithoutComponent, propertyName, propertyValue);
+    }
+    else
+    {
+        return FormatToPool(g_propertyWithoutResponseSchemaWithComponent, componentName, propertyName, propertyValue);
+    }
+}
+
+char* PnP_FormatReportedPropertyWithStatus(const char* componentName, const char* propertyName, const char* propertyValue, int result, const char* description, int ackVersion)
+{
+    if (componentName == NULL)
+    {
+        return FormatToPool(g_propertyWithResponseSchemaWithoutComponent, propertyName, propertyValue, result, description, ackVersion);
+    }
+    else
+    {
+        return FormatToPool(g_propertyWithResponseSchemaWithComponent, componentName, propertyName, propertyValue, result, description, ackVersion);
+    }
+}
+
 void PnP_ParseCommandName(const char* deviceMethodName, unsigned const char** componentName, size_t* componentNameSize, const char** pnpCommandName)
 {
     const char* separator;
@@ -282,6 +347,9 @@ bool PnP_ProcessTwinData(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned ch
     JSON_Object* desiredObject;
     bool result;
 
+    // The payload copy and its JSON tree only live for this call.  Nested in the caller's scope, if any.
+    PnP_Arena_Begin();
+
     if ((jsonStr = PnP_CopyPayloadToString(payload, size)) == NULL)
     {
         LogError("Unable to allocate twin buffer");
@@ -304,7 +372,9 @@ bool PnP_ProcessTwinData(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned ch
     }
 
     json_value_free(rootValue);
-    free(jsonStr);
+    PnP_Arena_Free(jsonStr);
+
+    PnP_Arena_End();
 
     return result;
 }
@@ -314,7 +384,7 @@ char* PnP_CopyPayloadToString(const unsigned char* payload, size_t size)
     char* jsonStr;
     size_t sizeToAllocate = size + 1;
 
-    if ((jsonStr = (char*)malloc(sizeToAllocate)) == NULL)
+    if ((jsonStr = (char*)PnP_Arena_Malloc(sizeToAllocate)) == NULL)
     {
         LogError("Unable to allocate %lu size buffer", (unsigned long)(sizeToAllocate));
     }
@@ -25,6 +25,7 @@ extern "C" {
 #define PNP_STATUS_SUCCESS 200
 #define PNP_STATUS_BAD_FORMAT 400
 #define PNP_STATUS_NOT_FOUND  404
+#define PNP_STATUS_CONFLICT 409
 #define PNP_STATUS_INTERNAL_ERROR 500
 
 //
@@ -57,6 +58,14 @@ STRING_HANDLE PnP_CreateReportedProperty(const char* componentName, const char*
 //
 STRING_HANDLE PnP_CreateReportedPropertyWithStatus(const char* componentName, const char* propertyName, const char* propertyValue, int result, const char* description, int ackVersion);
 
+//
+// PnP_FormatReportedProperty and PnP_FormatReportedPropertyWithStatus return the same JSON as PnP_CreateReportedProperty and
+// PnP_CreateReportedPropertyWithStatus, but in a block of the fixed-block pools of pnp_mempool.h rather than a STRING_HANDLE
+// on the heap.  Free it with PnP_MemPool_Free, typically right after IoTHubDeviceClient_LL_SendReportedState copied it.
+//
+char* PnP_FormatReportedProperty(const char* componentName, const char* propertyName, const char* propertyValue);
+char* PnP_FormatReportedPropertyWithStatus(const char* componentName, const char* propertyName, const char* propertyValue, int result, const char* description, int ackVersion);
+
 // 
 // PnP_ParseCommandName is invoked by the application when an incoming device method arrives.  This function
 // parses the device method name into the targeted (optional) component and PnP specific command.  Note that 
@@ -83,6 +92,7 @@ bool PnP_ProcessTwinData(DEVICE_TWIN_UPDATE_STATE updateState, const unsigned ch
 //
 // PnP_CopyTwinPayloadToString takes the payload data, which arrives as a potentially non-NULL terminated string from the IoTHub SDK, and creates
 // a new copy of the data with a NULL terminator.  The JSON parser this sample uses, parson, only operates over NULL terminated strings.
+// The copy comes from the arena of pnp_arena.h within a scope, so free it with PnP_Arena_Free.
 //
 char* PnP_CopyPayloadToString(const unsigned char* payload, size_t size);
 
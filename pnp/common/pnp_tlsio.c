@@ -0,0 +1,1032 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef USE_TLS_SESSION_RESUMPTION
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+
+#include "iothubtransportmqtt.h"
+// The MQTT transport's own create function, to build it over this TLS I/O rather than the platform's default
+#include "internal/iothub_transport_ll_private.h"
+#include "internal/iothubtransport_mqtt_common.h"
+
+#include "azure_macro_utils/macro_utils.h"
+#include "azure_c_shared_utility/gballoc.h"
+#include "azure_c_shared_utility/crt_abstractions.h"
+#include "azure_c_shared_utility/optionhandler.h"
+#include "azure_c_shared_utility/shared_util_options.h"
+#include "azure_c_shared_utility/socketio.h"
+#include "azure_c_shared_utility/tickcounter.h"
+#include "azure_c_shared_utility/tlsio.h"
+#include "azure_c_shared_utility/xlogging.h"
+
+#ifdef USE_TLS_SESSION_CACHE
+// Mbed OS KVStore, which persists the session across reboots
+#include "kvstore_global_api.h"
+#include "mbedtls/platform_util.h"
+#include "platform/mbed_error.h"
+#endif
+
+#include "pnp_tlsio.h"
+
+// Port IoT Hub serves MQTT on
+#define PNP_TLSIO_MQTT_PORT 8883
+
+// Bytes decrypted at a time and passed to the layer above
+#define PNP_TLSIO_READ_CHUNK_SIZE 256
+
+typedef enum PNP_TLSIO_STATE_TAG
+{
+    PNP_TLSIO_STATE_NOT_OPEN,
+    PNP_TLSIO_STATE_OPENING_UNDERLYING_IO,
+    PNP_TLSIO_STATE_IN_HANDSHAKE,
+    PNP_TLSIO_STATE_OPEN,
+    PNP_TLSIO_STATE_CLOSING,
+    PNP_TLSIO_STATE_ERROR
+} PNP_TLSIO_STATE;
+
+//
+// PNP_TLSIO_INSTANCE is one TLS connection, over a socket I/O of the SDK's platform
+//
+typedef struct PNP_TLSIO_INSTANCE_TAG
+{
+    XIO_HANDLE underlyingIo;
+    char* hostname;
+    PNP_TLSIO_STATE state;
+
+    ON_IO_OPEN_COMPLETE onIoOpenComplete;
+    void* onIoOpenCompleteContext;
+    ON_BYTES_RECEIVED onBytesReceived;
+    void* onBytesReceivedContext;
+    ON_IO_ERROR onIoError;
+    void* onIoErrorContext;
+    ON_IO_CLOSE_COMPLETE onIoCloseComplete;
+    void* onIoCloseCompleteContext;
+
+    // Bytes received from the underlying I/O that mbedTLS has not consumed yet
+    unsigned char* receivedBytes;
+    size_t receivedByteCount;
+
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctrDrbg;
+    mbedtls_ssl_config config;
+    mbedtls_ssl_context ssl;
+    mbedtls_x509_crt trustedCertificates;
+    mbedtls_x509_crt ownCertificate;
+    mbedtls_pk_context ownPrivateKey;
+
+    // Options as set, handed back by TlsIo_RetrieveOptions when the transport re-creates the TLS I/O to reconnect
+    char* trustedCertificatesPem;
+    char* x509Certificate;
+    char* x509PrivateKey;
+
+    // Handshake in progress: when it started, the bytes it has cost so far, and whether the cached session was offered
+    TICK_COUNTER_HANDLE tickCounter;
+    tickcounter_ms_t handshakeStartMs;
+    uint32_t handshakeBytesSent;
+    uint32_t handshakeBytesReceived;
+    bool sessionOffered;
+} PNP_TLSIO_INSTANCE;
+
+// Session of the last handshake, and the host it was with, or NULL if there is none.  Only one host is kept: the device
+// talks to one IoT Hub, and DPS only on the rare boots its assignment is not cached.
+static mbedtls_ssl_session g_cachedSession;
+static char* g_cachedSessionHostname = NULL;
+
+static PNP_TLSIO_STATS g_tlsioStats;
+
+//
+// ForgetCachedSession drops the session in RAM
+//
+static void ForgetCachedSession(void)
+{
+    mbedtls_ssl_session_free(&g_cachedSession);
+    mbedtls_ssl_session_init(&g_cachedSession);
+    free(g_cachedSessionHostname);
+    g_cachedSessionHostname = NULL;
+}
+
+#ifdef USE_TLS_SESSION_CACHE
+// KVStore key under which the session of the last full handshake is kept.
+static const char g_tlsioCacheKey[] = "/kv/pnp_tls_session";
+
+// Marks a valid cache record.  Bump it whenever PNP_TLSIO_CACHE_RECORD changes layout so stale records are ignored.
+#define PNP_TLSIO_CACHE_MAGIC 0x544C5331
+
+// IoT Hub host names are limited to 128 characters.  A serialized session holds the ticket and the server's certificate.
+#define PNP_TLSIO_CACHE_MAX_HOSTNAME_LENGTH 128
+#define PNP_TLSIO_CACHE_MAX_SESSION_SIZE 3072
+
+//
+// PNP_TLSIO_CACHE_RECORD is the layout of the session persisted in KVStore, of which only sessionSize bytes of session
+// are stored.
+//
+typedef struct PNP_TLSIO_CACHE_RECORD_TAG
+{
+    uint32_t magic;
+    char hostname[PNP_TLSIO_CACHE_MAX_HOSTNAME_LENGTH + 1];
+    uint32_t sessionSize;
+    unsigned char session[PNP_TLSIO_CACHE_MAX_SESSION_SIZE];
+} PNP_TLSIO_CACHE_RECORD;
+
+// Whether the session persisted by an earlier boot has been looked up.
+static bool g_cachedSessionLoaded = false;
+
+//
+// LoadCachedSession reads the session persisted by an earlier boot into g_cachedSession
+//
+static void LoadCachedSession(void)
+{
+    PNP_TLSIO_CACHE_RECORD* cacheRecord;
+    size_t actualSize = 0;
+    int result;
+
+    if ((cacheRecord = (PNP_TLSIO_CACHE_RECORD*)malloc(sizeof(PNP_TLSIO_CACHE_RECORD))) == NULL)
+    {
+        LogError("Unable to allocate TLS session cache record");
+    }
+    else if (kv_get(g_tlsioCacheKey, cacheRecord, sizeof(PNP_TLSIO_CACHE_RECORD), &actualSize) != 0)
+    {
+        // No session cached yet (typically first boot); not an error.
+        free(cacheRecord);
+    }
+    else
+    {
+        if ((actualSize < offsetof(PNP_TLSIO_CACHE_RECORD, session)) || (cacheRecord->magic != PNP_TLSIO_CACHE_MAGIC) ||
+            (actualSize != offsetof(PNP_TLSIO_CACHE_RECORD, session) + cacheRecord->sessionSize))
+        {
+            LogInfo("Ignoring TLS session cache record of unknown format");
+        }
+        else
+        {
+            cacheRecord->hostname[PNP_TLSIO_CACHE_MAX_HOSTNAME_LENGTH] = '\0';
+
+            ForgetCachedSession();
+            if ((result = mbedtls_ssl_session_load(&g_cachedSession, cacheRecord->session, cacheRecord->sessionSize)) != 0)
+            {
+                LogInfo("Ignoring TLS session cache record of another mbedTLS version or configuration, error=-0x%x", -result);
+                ForgetCachedSession();
+            }
+            else if (mallocAndStrcpy_s(&g_cachedSessionHostname, cacheRecord->hostname) != 0)
+            {
+                LogError("Unable to copy cached TLS session host name");
+                ForgetCachedSession();
+            }
+        }
+
+        mbedtls_platform_zeroize(cacheRecord, sizeof(PNP_TLSIO_CACHE_RECORD));
+        free(cacheRecord);
+    }
+}
+
+//
+// StoreCachedSession persists g_cachedSession, so that the first connection after a reboot can resume it too
+//
+static void StoreCachedSession(void)
+{
+    PNP_TLSIO_CACHE_RECORD* cacheRecord;
+    size_t sessionSize = 0;
+    int result;
+
+    if (strlen(g_cachedSessionHostname) > PNP_TLSIO_CACHE_MAX_HOSTNAME_LENGTH)
+    {
+        LogError("TLS host name too long to be cached");
+    }
+    else if ((cacheRecord = (PNP_TLSIO_CACHE_RECORD*)calloc(1, sizeof(PNP_TLSIO_CACHE_RECORD))) == NULL)
+    {
+        LogError("Unable to allocate TLS session cache record");
+    }
+    else
+    {
+        if ((result = mbedtls_ssl_session_save(&g_cachedSession, cacheRecord->session, sizeof(cacheRecord->session), &sessionSize)) != 0)
+        {
+            LogError("TLS session too large to be cached, error=-0x%x", -result);
+        }
+        else
+        {
+            cacheRecord->magic = PNP_TLSIO_CACHE_MAGIC;
+            strcpy(cacheRecord->hostname, g_cachedSessionHostname);
+            cacheRecord->sessionSize = (uint32_t)sessionSize;
+
+            if ((result = kv_set(g_tlsioCacheKey, cacheRecord, offsetof(PNP_TLSIO_CACHE_RECORD, session) + sessionSize, 0)) != 0)
+            {
+                LogError("Unable to cache TLS session, error=%d", result);
+            }
+        }
+
+        // The record holds the session's master secret
+        mbedtls_platform_zeroize(cacheRecord, sizeof(PNP_TLSIO_CACHE_RECORD));
+        free(cacheRecord);
+    }
+}
+#endif /* USE_TLS_SESSION_CACHE */
+
+//
+// OfferCachedSession sets up the next handshake of instance to resume the cached session, if it is with the same host
+//
+static void OfferCachedSession(PNP_TLSIO_INSTANCE* instance)
+{
+    int result;
+
+#ifdef USE_TLS_SESSION_CACHE
+    if (g_cachedSessionLoaded == false)
+    {
+        LoadCachedSession();
+        g_cachedSessionLoaded = true;
+    }
+#endif
+
+    instance->sessionOffered = false;
+
+    if ((g_cachedSessionHostname != NULL) && (strcmp(g_cachedSessionHostname, instance->hostname) == 0))
+    {
+        if ((result = mbedtls_ssl_set_session(&instance->ssl, &g_cachedSession)) != 0)
+        {
+            LogError("Unable to offer cached TLS session, error=-0x%x", -result);
+        }
+        else
+        {
+            instance->sessionOffered = true;
+        }
+    }
+}
+
+//
+// CacheSession keeps the session instance has just established, to be offered on the next connection
+//
+static void CacheSession(PNP_TLSIO_INSTANCE* instance, bool persist)
+{
+    int result;
+
+    ForgetCachedSession();
+
+    if (mallocAndStrcpy_s(&g_cachedSessionHostname, instance->hostname) != 0)
+    {
+        LogError("Unable to copy TLS host name");
+    }
+    else if ((result = mbedtls_ssl_get_session(&instance->ssl, &g_cachedSession)) != 0)
+    {
+        LogError("Unable to get TLS session, error=-0x%x", -result);
+        ForgetCachedSession();
+    }
+#ifdef USE_TLS_SESSION_CACHE
+    else if (persist == true)
+    {
+        StoreCachedSession();
+    }
+#endif
+
+    (void)persist;
+}
+
+//
+// IndicateError reports a failure of the connection, as a failed open while it is being opened
+//
+static void IndicateError(PNP_TLSIO_INSTANCE* instance)
+{
+    PNP_TLSIO_STATE previousState = instance->state;
+
+    instance->state = PNP_TLSIO_STATE_ERROR;
+
+    if ((previousState == PNP_TLSIO_STATE_OPENING_UNDERLYING_IO) || (previousState == PNP_TLSIO_STATE_IN_HANDSHAKE))
+    {
+        instance->onIoOpenComplete(instance->onIoOpenCompleteContext, IO_OPEN_ERROR);
+    }
+    else if (previousState == PNP_TLSIO_STATE_OPEN)
+    {
+        instance->onIoError(instance->onIoErrorContext);
+    }
+}
+
+//
+// ContinueHandshake takes the handshake as far as the bytes received so far allow, and completes the open once it is done
+//
+static void ContinueHandshake(PNP_TLSIO_INSTANCE* instance)
+{
+    tickcounter_ms_t nowMs = instance->handshakeStartMs;
+    bool resumed;
+    int result = mbedtls_ssl_handshake(&instance->ssl);
+
+    if ((result == MBEDTLS_ERR_SSL_WANT_READ) || (result == MBEDTLS_ERR_SSL_WANT_WRITE))
+    {
+        return;
+    }
+    else if (result != 0)
+    {
+        LogError("TLS handshake with %s failed, error=-0x%x", instance->hostname, -result);
+        g_tlsioStats.failedHandshakes++;
+
+        // The server may have refused the session itself, so the next attempt starts afresh
+        if (instance->sessionOffered == true)
+        {
+            ForgetCachedSession();
+        }
+
+        IndicateError(instance);
+        return;
+    }
+
+    // A resumed session keeps the master secret of the one offered; a full handshake derives a new one
+    resumed = (instance->sessionOffered == true) &&
+              (memcmp(instance->ssl.session->master, g_cachedSession.master, sizeof(g_cachedSession.master)) == 0);
+
+    (void)tickcounter_get_current_ms(instance->tickCounter, &nowMs);
+
+    if (resumed == true)
+    {
+        g_tlsioStats.resumedHandshakes++;
+    }
+    else
+    {
+        g_tlsioStats.fullHandshakes++;
+    }
+    g_tlsioStats.lastHandshakeMs = (uint32_t)(nowMs - instance->handshakeStartMs);
+    g_tlsioStats.lastHandshakeBytesSent = instance->handshakeBytesSent;
+    g_tlsioStats.lastHandshakeBytesReceived = instance->handshakeBytesReceived;
+    g_tlsioStats.lastHandshakeResumed = resumed;
+
+    LogInfo("TLS handshake with %s %s in %lu ms, bytes sent=%lu, received=%lu", instance->hostname, resumed ? "resumed" : "full",
+            (unsigned long)g_tlsioStats.lastHandshakeMs, (unsigned long)instance->handshakeBytesSent, (unsigned long)instance->handshakeBytesReceived);
+
+    // The server may have sent a new ticket with a resumed session.  Only a new session is worth a write to flash.
+    CacheSession(instance, resumed == false);
+
+    instance->state = PNP_TLSIO_STATE_OPEN;
+    instance->onIoOpenComplete(instance->onIoOpenCompleteContext, IO_OPEN_OK);
+}
+
+//
+// DecryptReceivedBytes passes all application data in the bytes received so far to the layer above
+//
+static void DecryptReceivedBytes(PNP_TLSIO_INSTANCE* instance)
+{
+    unsigned char buffer[PNP_TLSIO_READ_CHUNK_SIZE];
+    int result;
+
+    // The layer above may close the connection from its callback
+    while (instance->state == PNP_TLSIO_STATE_OPEN)
+    {
+        if ((result = mbedtls_ssl_read(&instance->ssl, buffer, sizeof(buffer))) > 0)
+        {
+            instance->onBytesReceived(instance->onBytesReceivedContext, buffer, (size_t)result);
+        }
+        else if ((result == MBEDTLS_ERR_SSL_WANT_READ) || (result == MBEDTLS_ERR_SSL_WANT_WRITE))
+        {
+            break;
+        }
+        else
+        {
+            if ((result == 0) || (result == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY))
+            {
+                LogInfo("TLS connection closed by %s", instance->hostname);
+            }
+            else
+            {
+                LogError("mbedtls_ssl_read failed, error=-0x%x", -result);
+            }
+
+            IndicateError(instance);
+        }
+    }
+}
+
+//
+// OnSslSend is mbedTLS's output: bytes are queued on the underlying I/O, which sends them in its dowork
+//
+static int OnSslSend(void* context, const unsigned char* buffer, size_t size)
+{
+    PNP_TLSIO_INSTANCE* instance = (PNP_TLSIO_INSTANCE*)context;
+
+    if (xio_send(instance->underlyingIo, buffer, size, NULL, NULL) != 0)
+    {
+        LogError("Unable to send TLS record");
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+
+    if (instance->state == PNP_TLSIO_STATE_IN_HANDSHAKE)
+    {
+        instance->handshakeBytesSent += (uint32_t)size;
+    }
+
+    return (int)size;
+}
+
+//
+// OnSslRecv is mbedTLS's input, from the bytes the underlying I/O has received so far
+//
+static int OnSslRecv(void* context, unsigned char* buffer, size_t size)
+{
+    PNP_TLSIO_INSTANCE* instance = (PNP_TLSIO_INSTANCE*)context;
+
+    if (instance->receivedByteCount == 0)
+    {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+
+    if (size > instance->receivedByteCount)
+    {
+        size = instance->receivedByteCount;
+    }
+
+    memcpy(buffer, instance->receivedBytes, size);
+    instance->receivedByteCount -= size;
+    memmove(instance->receivedBytes, instance->receivedBytes + size, instance->receivedByteCount);
+
+    if (instance->state == PNP_TLSIO_STATE_IN_HANDSHAKE)
+    {
+        instance->handshakeBytesReceived += (uint32_t)size;
+    }
+
+    return (int)size;
+}
+
+static void OnUnderlyingIoOpenComplete(void* context, IO_OPEN_RESULT openResult)
+{
+    PNP_TLSIO_INSTANCE* instance = (PNP_TLSIO_INSTANCE*)context;
+
+    if (instance->state != PNP_TLSIO_STATE_OPENING_UNDERLYING_IO)
+    {
+        return;
+    }
+    else if (openResult != IO_OPEN_OK)
+    {
+        LogError("Unable to connect with %s", instance->hostname);
+        IndicateError(instance);
+    }
+    else
+    {
+        instance->state = PNP_TLSIO_STATE_IN_HANDSHAKE;
+        instance->handshakeBytesSent = 0;
+        instance->handshakeBytesReceived = 0;
+        if (tickcounter_get_current_ms(instance->tickCounter, &instance->handshakeStartMs) != 0)
+        {
+            instance->handshakeStartMs = 0;
+        }
+
+        // Sends the ClientHello right away
+        ContinueHandshake(instance);
+    }
+}
+
+static void OnUnderlyingIoBytesReceived(void* context, const unsigned char* buffer, size_t size)
+{
+    PNP_TLSIO_INSTANCE* instance = (PNP_TLSIO_INSTANCE*)context;
+    unsigned char* receivedBytes;
+
+    if ((receivedBytes = (unsigned char*)realloc(instance->receivedBytes, instance->receivedByteCount + size)) == NULL)
+    {
+        LogError("Unable to allocate %lu bytes received", (unsigned long)(instance->receivedByteCount + size));
+        IndicateError(instance);
+    }
+    else
+    {
+        memcpy(receivedBytes + instance->receivedByteCount, buffer, size);
+        instance->receivedBytes = receivedBytes;
+        instance->receivedByteCount += size;
+    }
+}
+
+static void OnUnderlyingIoError(void* context)
+{
+    PNP_TLSIO_INSTANCE* instance = (PNP_TLSIO_INSTANCE*)context;
+
+    LogError("Connection with %s failed", instance->hostname);
+    IndicateError(instance);
+}
+
+static void OnUnderlyingIoCloseComplete(void* context)
+{
+    PNP_TLSIO_INSTANCE* instance = (PNP_TLSIO_INSTANCE*)context;
+
+    instance->state = PNP_TLSIO_STATE_NOT_OPEN;
+
+    if (instance->onIoCloseComplete != NULL)
+    {
+        instance->onIoCloseComplete(instance->onIoCloseCompleteContext);
+    }
+}
+
+//
+// ConfigureOwnCertificate presents the client certificate and key set as options, once both are
+//
+static int ConfigureOwnCertificate(PNP_TLSIO_INSTANCE* instance)
+{
+    int result;
+
+    mbedtls_x509_crt_free(&instance->ownCertificate);
+    mbedtls_x509_crt_init(&instance->ownCertificate);
+    mbedtls_pk_free(&instance->ownPrivateKey);
+    mbedtls_pk_init(&instance->ownPrivateKey);
+
+    if ((instance->x509Certificate == NULL) || (instance->x509PrivateKey == NULL))
+    {
+        result = 0;
+    }
+    else if ((result = mbedtls_x509_crt_parse(&instance->ownCertificate, (const unsigned char*)instance->x509Certificate, strlen(instance->x509Certificate) + 1)) != 0)
+    {
+        LogError("Unable to parse x509 certificate, error=-0x%x", -result);
+        result = MU_FAILURE;
+    }
+    else if ((result = mbedtls_pk_parse_key(&instance->ownPrivateKey, (const unsigned char*)instance->x509PrivateKey, strlen(instance->x509PrivateKey) + 1, NULL, 0)) != 0)
+    {
+        LogError("Unable to parse x509 private key, error=-0x%x", -result);
+        result = MU_FAILURE;
+    }
+    else if ((result = mbedtls_ssl_conf_own_cert(&instance->config, &instance->ownCertificate, &instance->ownPrivateKey)) != 0)
+    {
+        LogError("Unable to set x509 certificate, error=-0x%x", -result);
+        result = MU_FAILURE;
+    }
+
+    return result;
+}
+
+static int TlsIo_SetOption(CONCRETE_IO_HANDLE tlsIo, const char* optionName, const void* value)
+{
+    PNP_TLSIO_INSTANCE* instance = (PNP_TLSIO_INSTANCE*)tlsIo;
+    int result;
+
+    if ((instance == NULL) || (optionName == NULL))
+    {
+        LogError("Invalid argument to set TLS option");
+        result = MU_FAILURE;
+    }
+    else if (strcmp(optionName, OPTION_TRUSTED_CERT) == 0)
+    {
+        mbedtls_x509_crt_free(&instance->trustedCertificates);
+        mbedtls_x509_crt_init(&instance->trustedCertificates);
+        free(instance->trustedCertificatesPem);
+        instance->trustedCertificatesPem = NULL;
+
+        if (mallocAndStrcpy_s(&instance->trustedCertificatesPem, (const char*)value) != 0)
+        {
+            LogError("Unable to copy trusted certificates");
+            result = MU_FAILURE;
+        }
+        // A positive result counts certificates of the bundle mbedTLS does not support, which are skipped
+        else if ((result = mbedtls_x509_crt_parse(&instance->trustedCertificates, (const unsigned char*)instance->trustedCertificatesPem, strlen(instance->trustedCertificatesPem) + 1)) < 0)
+        {
+            LogError("Unable to parse trusted certificates, error=-0x%x", -result);
+            result = MU_FAILURE;
+        }
+        else
+        {
+            mbedtls_ssl_conf_ca_chain(&instance->config, &instance->trustedCertificates, NULL);
+            result = 0;
+        }
+    }
+    else if ((strcmp(optionName, SU_OPTION_X509_CERT) == 0) || (strcmp(optionName, SU_OPTION_X509_PRIVATE_KEY) == 0))
+    {
+        char** option = (strcmp(optionName, SU_OPTION_X509_CERT) == 0) ? &instance->x509Certificate : &instance->x509PrivateKey;
+
+        free(*option);
+        *option = NULL;
+
+        if (mallocAndStrcpy_s(option, (const char*)value) != 0)
+        {
+            LogError("Unable to copy option %s", optionName);
+            result = MU_FAILURE;
+        }
+        else
+        {
+            result = ConfigureOwnCertificate(instance);
+        }
+    }
+    else
+    {
+        // Socket options, e.g. keep-alive, belong to the underlying I/O
+        result = xio_setoption(instance->underlyingIo, optionName, value);
+    }
+
+    return result;
+}
+
+static void* CloneOption(const char* name, const void* value)
+{
+    char* result;
+
+    if (mallocAndStrcpy_s(&result, (const char*)value) != 0)
+    {
+        LogError("Unable to clone option %s", name);
+        result = NULL;
+    }
+
+    return result;
+}
+
+static void DestroyOption(const char* name, const void* value)
+{
+    (void)name;
+    free((void*)value);
+}
+
+static OPTIONHANDLER_HANDLE TlsIo_RetrieveOptions(CONCRETE_IO_HANDLE tlsIo)
+{
+    PNP_TLSIO_INSTANCE* instance = (PNP_TLSIO_INSTANCE*)tlsIo;
+    OPTIONHANDLER_HANDLE result;
+
+    if (instance == NULL)
+    {
+        LogError("Invalid argument to retrieve TLS options");
+        result = NULL;
+    }
+    else if ((result = OptionHandler_Create(CloneOption, DestroyOption, TlsIo_SetOption)) == NULL)
+    {
+        LogError("Unable to create option handler");
+    }
+    else if (((instance->trustedCertificatesPem != NULL) && (OptionHandler_AddOption(result, OPTION_TRUSTED_CERT, instance->trustedCertificatesPem) != OPTIONHANDLER_OK)) ||
+             ((instance->x509Certificate != NULL) && (OptionHandler_AddOption(result, SU_OPTION_X509_CERT, instance->x509Certificate) != OPTIONHANDLER_OK)) ||
+             ((instance->x509PrivateKey != NULL) && (OptionHandler_AddOption(result, SU_OPTION_X509_PRIVATE_KEY, instance->x509PrivateKey) != OPTIONHANDLER_OK)))
+    {
+        LogError("Unable to save TLS options");
+        OptionHandler_Destroy(result);
+        result = NULL;
+    }
+
+    return result;
+}
+
+static void TlsIo_Destroy(CONCRETE_IO_HANDLE tlsIo)
+{
+    PNP_TLSIO_INSTANCE* instance = (PNP_TLSIO_INSTANCE*)tlsIo;
+
+    if (instance != NULL)
+    {
+        if (instance->underlyingIo != NULL)
+        {
+            xio_destroy(instance->underlyingIo);
+        }
+        if (instance->tickCounter != NULL)
+        {
+            tickcounter_destroy(instance->tickCounter);
+        }
+
+        mbedtls_ssl_free(&instance->ssl);
+        mbedtls_ssl_config_free(&instance->config);
+        mbedtls_x509_crt_free(&instance->trustedCertificates);
+        mbedtls_x509_crt_free(&instance->ownCertificate);
+        mbedtls_pk_free(&instance->ownPrivateKey);
+        mbedtls_ctr_drbg_free(&instance->ctrDrbg);
+        mbedtls_entropy_free(&instance->entropy);
+
+        free(instance->receivedBytes);
+        free(instance->trustedCertificatesPem);
+        free(instance->x509Certificate);
+        free(instance->x509PrivateKey);
+        free(instance->hostname);
+        free(instance);
+    }
+}
+
+static CONCRETE_IO_HANDLE TlsIo_Create(void* ioCreateParameters)
+{
+    static const char personalization[] = "pnp_tlsio";
+    const TLSIO_CONFIG* tlsioConfig = (const TLSIO_CONFIG*)ioCreateParameters;
+    PNP_TLSIO_INSTANCE* instance;
+    SOCKETIO_CONFIG socketioConfig;
+    const IO_INTERFACE_DESCRIPTION* underlyingIoInterface;
+    void* underlyingIoParameters;
+    int result;
+
+    if ((tlsioConfig == NULL) || (tlsioConfig->hostname == NULL))
+    {
+        LogError("Invalid TLS I/O configuration");
+        return NULL;
+    }
+    else if ((instance = (PNP_TLSIO_INSTANCE*)calloc(1, sizeof(PNP_TLSIO_INSTANCE))) == NULL)
+    {
+        LogError("Unable to allocate TLS I/O");
+        return NULL;
+    }
+
+    // Everything is initialized first, so that TlsIo_Destroy can clean up after a failure at any step below
+    mbedtls_entropy_init(&instance->entropy);
+    mbedtls_ctr_drbg_init(&instance->ctrDrbg);
+    mbedtls_ssl_config_init(&instance->config);
+    mbedtls_ssl_init(&instance->ssl);
+    mbedtls_x509_crt_init(&instance->trustedCertificates);
+    mbedtls_x509_crt_init(&instance->ownCertificate);
+    mbedtls_pk_init(&instance->ownPrivateKey);
+    instance->state = PNP_TLSIO_STATE_NOT_OPEN;
+
+    // A proxy, when there is one, comes as the underlying I/O.  Otherwise, connect straight.
+    if (tlsioConfig->underlying_io_interface != NULL)
+    {
+        underlyingIoInterface = tlsioConfig->underlying_io_interface;
+        underlyingIoParameters = tlsioConfig->underlying_io_parameters;
+    }
+    else
+    {
+        socketioConfig.hostname = tlsioConfig->hostname;
+        socketioConfig.port = tlsioConfig->port;
+        socketioConfig.accepted_socket = NULL;
+        underlyingIoInterface = socketio_get_interface_description();
+        underlyingIoParameters = &socketioConfig;
+    }
+
+    if (mallocAndStrcpy_s(&instance->hostname, tlsioConfig->hostname) != 0)
+    {
+        LogError("Unable to copy TLS host name");
+    }
+    else if ((instance->tickCounter = tickcounter_create()) == NULL)
+    {
+        LogError("Unable to create tick counter for TLS I/O");
+    }
+    else if ((instance->underlyingIo = xio_create(underlyingIoInterface, underlyingIoParameters)) == NULL)
+    {
+        LogError("Unable to create underlying I/O for TLS");
+    }
+    else if ((result = mbedtls_ctr_drbg_seed(&instance->ctrDrbg, mbedtls_entropy_func, &instance->entropy,
+                                             (const unsigned char*)personalization, sizeof(personalization) - 1)) != 0)
+    {
+        LogError("mbedtls_ctr_drbg_seed failed, error=-0x%x", -result);
+    }
+    else if ((result = mbedtls_ssl_config_defaults(&instance->config, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT)) != 0)
+    {
+        LogError("mbedtls_ssl_config_defaults failed, error=-0x%x", -result);
+    }
+    else
+    {
+        mbedtls_ssl_conf_rng(&instance->config, mbedtls_ctr_drbg_random, &instance->ctrDrbg);
+        mbedtls_ssl_conf_authmode(&instance->config, MBEDTLS_SSL_VERIFY_REQUIRED);
+        // IoT Hub requires TLS 1.2
+        mbedtls_ssl_conf_min_version(&instance->config, MBEDTLS_SSL_MAJOR_VERSION_3, MBEDTLS_SSL_MINOR_VERSION_3);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        // Tickets let the server resume the session without keeping it in a cache of its own
+        mbedtls_ssl_conf_session_tickets(&instance->config, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+
+        if ((result = mbedtls_ssl_setup(&instance->ssl, &instance->config)) != 0)
+        {
+            LogError("mbedtls_ssl_setup failed, error=-0x%x", -result);
+        }
+        else if ((result = mbedtls_ssl_set_hostname(&instance->ssl, instance->hostname)) != 0)
+        {
+            LogError("mbedtls_ssl_set_hostname failed, error=-0x%x", -result);
+        }
+        else
+        {
+            mbedtls_ssl_set_bio(&instance->ssl, instance, OnSslSend, OnSslRecv, NULL);
+            return instance;
+        }
+    }
+
+    TlsIo_Destroy(instance);
+
+    return NULL;
+}
+
+static int TlsIo_Open(CONCRETE_IO_HANDLE tlsIo, ON_IO_OPEN_COMPLETE onIoOpenComplete, void* onIoOpenCompleteContext,
+                      ON_BYTES_RECEIVED onBytesReceived, void* onBytesReceivedContext, ON_IO_ERROR onIoError, void* onIoErrorContext)
+{
+    PNP_TLSIO_INSTANCE* instance = (PNP_TLSIO_INSTANCE*)tlsIo;
+    int result;
+
+    if ((instance == NULL) || (onIoOpenComplete == NULL) || (onBytesReceived == NULL) || (onIoError == NULL))
+    {
+        LogError("Invalid argument to open TLS I/O");
+        result = MU_FAILURE;
+    }
+    else if (instance->state != PNP_TLSIO_STATE_NOT_OPEN)
+    {
+        LogError("TLS I/O already open");
+        result = MU_FAILURE;
+    }
+    else if ((result = mbedtls_ssl_session_reset(&instance->ssl)) != 0)
+    {
+        LogError("mbedtls_ssl_session_reset failed, error=-0x%x", -result);
+        result = MU_FAILURE;
+    }
+    else
+    {
+        instance->onIoOpenComplete = onIoOpenComplete;
+        instance->onIoOpenCompleteContext = onIoOpenCompleteContext;
+        instance->onBytesReceived = onBytesReceived;
+        instance->onBytesReceivedContext = onBytesReceivedContext;
+        instance->onIoError = onIoError;
+        instance->onIoErrorContext = onIoErrorContext;
+        instance->receivedByteCount = 0;
+
+        OfferCachedSession(instance);
+
+        instance->state = PNP_TLSIO_STATE_OPENING_UNDERLYING_IO;
+        if (xio_open(instance->underlyingIo, OnUnderlyingIoOpenComplete, instance, OnUnderlyingIoBytesReceived, instance, OnUnderlyingIoError, instance) != 0)
+        {
+            LogError("Unable to open underlying I/O for TLS");
+            instance->state = PNP_TLSIO_STATE_NOT_OPEN;
+            result = MU_FAILURE;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+static int TlsIo_Close(CONCRETE_IO_HANDLE tlsIo, ON_IO_CLOSE_COMPLETE onIoCloseComplete, void* callbackContext)
+{
+    PNP_TLSIO_INSTANCE* instance = (PNP_TLSIO_INSTANCE*)tlsIo;
+    int result;
+
+    if (instance == NULL)
+    {
+        LogError("Invalid argument to close TLS I/O");
+        result = MU_FAILURE;
+    }
+    else if ((instance->state == PNP_TLSIO_STATE_NOT_OPEN) || (instance->state == PNP_TLSIO_STATE_CLOSING))
+    {
+        LogError("TLS I/O not open");
+        result = MU_FAILURE;
+    }
+    else
+    {
+        if (instance->state == PNP_TLSIO_STATE_OPEN)
+        {
+            (void)mbedtls_ssl_close_notify(&instance->ssl);
+        }
+        else if ((instance->state == PNP_TLSIO_STATE_OPENING_UNDERLYING_IO) || (instance->state == PNP_TLSIO_STATE_IN_HANDSHAKE))
+        {
+            instance->onIoOpenComplete(instance->onIoOpenCompleteContext, IO_OPEN_CANCELLED);
+        }
+
+        instance->state = PNP_TLSIO_STATE_CLOSING;
+        instance->onIoCloseComplete = onIoCloseComplete;
+        instance->onIoCloseCompleteContext = callbackContext;
+
+        if (xio_close(instance->underlyingIo, OnUnderlyingIoCloseComplete, instance) != 0)
+        {
+            LogError("Unable to close underlying I/O for TLS");
+            instance->state = PNP_TLSIO_STATE_NOT_OPEN;
+            result = MU_FAILURE;
+        }
+        else
+        {
+            result = 0;
+        }
+    }
+
+    return result;
+}
+
+static int TlsIo_Send(CONCRETE_IO_HANDLE tlsIo, const void* buffer, size_t size, ON_SEND_COMPLETE onSendComplete, void* callbackContext)
+{
+    PNP_TLSIO_INSTANCE* instance = (PNP_TLSIO_INSTANCE*)tlsIo;
+    const unsigned char* bytes = (const unsigned char*)buffer;
+    int result;
+
+    if ((instance == NULL) || (buffer == NULL) || (size == 0))
+    {
+        LogError("Invalid argument to send over TLS");
+        return MU_FAILURE;
+    }
+    else if (instance->state != PNP_TLSIO_STATE_OPEN)
+    {
+        LogError("TLS I/O not open");
+        return MU_FAILURE;
+    }
+
+    // OnSslSend never blocks, so every write takes at least part of the buffer or fails
+    while (size > 0)
+    {
+        if ((result = mbedtls_ssl_write(&instance->ssl, bytes, size)) <= 0)
+        {
+            LogError("mbedtls_ssl_write failed, error=-0x%x", -result);
+            return MU_FAILURE;
+        }
+
+        bytes += result;
+        size -= (size_t)result;
+    }
+
+    if (onSendComplete != NULL)
+    {
+        onSendComplete(callbackContext, IO_SEND_OK);
+    }
+
+    return 0;
+}
+
+static void TlsIo_DoWork(CONCRETE_IO_HANDLE tlsIo)
+{
+    PNP_TLSIO_INSTANCE* instance = (PNP_TLSIO_INSTANCE*)tlsIo;
+
+    if ((instance != NULL) && (instance->state != PNP_TLSIO_STATE_NOT_OPEN))
+    {
+        xio_dowork(instance->underlyingIo);
+
+        if (instance->state == PNP_TLSIO_STATE_IN_HANDSHAKE)
+        {
+            ContinueHandshake(instance);
+        }
+        else if (instance->state == PNP_TLSIO_STATE_OPEN)
+        {
+            DecryptReceivedBytes(instance);
+        }
+    }
+}
+
+static const IO_INTERFACE_DESCRIPTION g_tlsioInterfaceDescription =
+{
+    TlsIo_RetrieveOptions,
+    TlsIo_Create,
+    TlsIo_Destroy,
+    TlsIo_Open,
+    TlsIo_Close,
+    TlsIo_Send,
+    TlsIo_DoWork,
+    TlsIo_SetOption
+};
+
+const IO_INTERFACE_DESCRIPTION* PnP_TlsIo_GetInterfaceDescription(void)
+{
+    return &g_tlsioInterfaceDescription;
+}
+
+//
+// GetIoTransport creates the TLS I/O of the MQTT transport, as the SDK's own does with the platform's default
+//
+static XIO_HANDLE GetIoTransport(const char* fullyQualifiedName, const MQTT_TRANSPORT_PROXY_OPTIONS* mqttTransportProxyOptions)
+{
+    TLSIO_CONFIG tlsioConfig;
+
+    // HTTP proxies apply to MQTT over WebSockets only
+    (void)mqttTransportProxyOptions;
+
+    tlsioConfig.hostname = fullyQualifiedName;
+    tlsioConfig.port = PNP_TLSIO_MQTT_PORT;
+    tlsioConfig.underlying_io_interface = NULL;
+    tlsioConfig.underlying_io_parameters = NULL;
+
+    return xio_create(PnP_TlsIo_GetInterfaceDescription(), &tlsioConfig);
+}
+
+static TRANSPORT_LL_HANDLE CreateTransport(const IOTHUBTRANSPORT_CONFIG* config, TRANSPORT_CALLBACKS_INFO* cb_info, void* ctx)
+{
+    return IoTHubTransport_MQTT_Common_Create(config, GetIoTransport, cb_info, ctx);
+}
+
+const TRANSPORT_PROVIDER* PnP_TlsIo_MQTT_Protocol(void)
+{
+    static TRANSPORT_PROVIDER transportProvider;
+    static bool transportProviderInitialized = false;
+
+    // The SDK's MQTT transport as it is, but for how it creates its TLS I/O
+    if (transportProviderInitialized == false)
+    {
+        transportProvider = *MQTT_Protocol();
+        transportProvider.IoTHubTransport_Create = CreateTransport;
+        transportProviderInitialized = true;
+    }
+
+    return &transportProvider;
+}
+
+void PnP_TlsIo_ForgetSession(void)
+{
+#ifdef USE_TLS_SESSION_CACHE
+    int result;
+#endif
+
+    ForgetCachedSession();
+
+#ifdef USE_TLS_SESSION_CACHE
+    if (((result = kv_remove(g_tlsioCacheKey)) != 0) && (result != MBED_ERROR_ITEM_NOT_FOUND))
+    {
+        LogError("Unable to remove cached TLS session, error=%d", result);
+    }
+
+    g_cachedSessionLoaded = true;
+#endif
+}
+
+void PnP_TlsIo_GetStats(PNP_TLSIO_STATS* stats)
+{
+    *stats = g_tlsioStats;
+}
+
+#endif /* USE_TLS_SESSION_RESUMPTION */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// TLS I/O over mbedTLS for the IoT Hub connection, in place of the SDK's default TLS I/O, which starts every connection
+// with a full handshake.  This one keeps the session (session ID or ticket) of the last handshake with the hub and offers
+// it on the next connection, so that reconnects and SAS token renewals take an abbreviated handshake: no certificate chain
+// to send and verify, and no public key operations.  With USE_TLS_SESSION_CACHE, the session is also kept in KVStore
+// across reboots.
+//
+// The TLS I/O is plugged into the SDK's MQTT transport by PnP_MQTT_Protocol, which stands for MQTT_Protocol when
+// USE_TLS_SESSION_RESUMPTION is defined.  Use it from the thread that runs IoTHubDeviceClient_LL_DoWork only.
+
+#ifndef PNP_TLSIO_H
+#define PNP_TLSIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "iothubtransportmqtt.h"
+#include "azure_c_shared_utility/xio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef USE_TLS_SESSION_RESUMPTION
+
+//
+// PNP_TLSIO_STATS counts the TLS handshakes since boot
+//
+typedef struct PNP_TLSIO_STATS_TAG
+{
+    uint32_t fullHandshakes;
+    uint32_t resumedHandshakes;
+    uint32_t failedHandshakes;
+    // Time and bytes over the network of the last handshake that succeeded, from TCP connection established to
+    // handshake done
+    uint32_t lastHandshakeMs;
+    uint32_t lastHandshakeBytesSent;
+    uint32_t lastHandshakeBytesReceived;
+    bool lastHandshakeResumed;
+} PNP_TLSIO_STATS;
+
+//
+// PnP_TlsIo_GetInterfaceDescription returns the TLS I/O, created with a TLSIO_CONFIG like the SDK's.
+//
+const IO_INTERFACE_DESCRIPTION* PnP_TlsIo_GetInterfaceDescription(void);
+
+//
+// PnP_TlsIo_MQTT_Protocol is the SDK's MQTT transport, over this TLS I/O.
+//
+const TRANSPORT_PROVIDER* PnP_TlsIo_MQTT_Protocol(void);
+
+//
+// PnP_TlsIo_ForgetSession drops the cached session, so that the next connection takes a full handshake.
+//
+void PnP_TlsIo_ForgetSession(void);
+
+//
+// PnP_TlsIo_GetStats returns the handshake counts and the cost of the last handshake.
+//
+void PnP_TlsIo_GetStats(PNP_TLSIO_STATS* stats);
+
+#define PnP_MQTT_Protocol PnP_TlsIo_MQTT_Protocol
+
+#else
+
+#define PnP_MQTT_Protocol MQTT_Protocol
+
+#endif /* USE_TLS_SESSION_RESUMPTION */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PNP_TLSIO_H */
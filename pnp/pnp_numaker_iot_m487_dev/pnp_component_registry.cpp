@@ -0,0 +1,281 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Standard C header files
+#include <stdio.h>
+#include <string.h>
+
+// PnP routines
+#include "pnp_protocol.h"
+#include "pnp_component_registry.h"
+#include "pnp_diagnostics_component.h"
+
+// Core IoT SDK utilities
+#include "azure_c_shared_utility/xlogging.h"
+
+// Hot path latency histograms
+#include "latency_probe.h"
+
+//
+// HashComponentName returns the FNV-1a hash of the componentNameSize characters at componentName
+//
+static uint32_t HashComponentName(const char* componentName, size_t componentNameSize)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < componentNameSize; i++)
+    {
+        hash ^= (uint8_t)componentName[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+bool PnP_ComponentRegistry_Initialize(const PNP_COMPONENT_REGISTRATION* registrations, size_t numComponents)
+{
+    bool result = true;
+
+    for (size_t i = 0; i < numComponents; i++)
+    {
+        const PNP_COMPONENT_INTERFACE* componentInterface = registrations[i].componentInterface;
+
+        if ((componentInterface->initialize != NULL) && (componentInterface->initialize() == false))
+        {
+            LogError("Component=%s is NOT available", registrations[i].componentName);
+            result = false;
+        }
+    }
+
+    return result;
+}
+
+bool PnP_ComponentRegistry_Create(PNP_COMPONENT_REGISTRY* registry, const PNP_COMPONENT_REGISTRATION* registrations, size_t numComponents)
+{
+    bool result = true;
+
+    memset(registry, 0, sizeof(*registry));
+
+    if (numComponents > PNP_COMPONENT_REGISTRY_MAX_COMPONENTS)
+    {
+        LogError("Too many components=%lu.  Maximum is=%d", (unsigned long)numComponents, PNP_COMPONENT_REGISTRY_MAX_COMPONENTS);
+        return false;
+    }
+
+    registry->registrations = registrations;
+
+    for (size_t i = 0; (i < numComponents) && result; i++)
+    {
+        const char* componentName = registrations[i].componentName;
+        size_t componentNameSize = strlen(componentName);
+        uint32_t bucket = HashComponentName(componentName, componentNameSize) & (PNP_COMPONENT_REGISTRY_NUM_BUCKETS - 1);
+
+        // Linear probing.  The table is never full, as it has more buckets than components.
+        while (registry->buckets[bucket] != 0)
+        {
+            bucket = (bucket + 1) & (PNP_COMPONENT_REGISTRY_NUM_BUCKETS - 1);
+        }
+
+        if (PnP_ComponentRegistry_Find(registry, componentName, componentNameSize) >= 0)
+        {
+            LogError("Component=%s is registered twice", componentName);
+            result = false;
+        }
+        else if ((registry->componentHandles[i] = registrations[i].componentInterface->create(componentName)) == NULL)
+        {
+            LogError("Unable to create component handle for %s", componentName);
+            result = false;
+        }
+        else
+        {
+            registry->componentNames[i] = componentName;
+            registry->componentNameSizes[i] = componentNameSize;
+            registry->buckets[bucket] = (uint8_t)(i + 1);
+            registry->numComponents = i + 1;
+        }
+    }
+
+    if (result == false)
+    {
+        PnP_ComponentRegistry_Destroy(registry);
+    }
+
+    return result;
+}
+
+void PnP_ComponentRegistry_Destroy(PNP_COMPONENT_REGISTRY* registry)
+{
+    for (size_t i = 0; i < registry->numComponents; i++)
+    {
+        const PNP_COMPONENT_INTERFACE* componentInterface = registry->registrations[i].componentInterface;
+
+        if (componentInterface->destroy != NULL)
+        {
+            componentInterface->destroy(registry->componentHandles[i]);
+        }
+    }
+
+    memset(registry, 0, sizeof(*registry));
+}
+
+int PnP_ComponentRegistry_Find(const PNP_COMPONENT_REGISTRY* registry, const char* componentName, size_t componentNameSize)
+{
+    uint32_t bucket = HashComponentName(componentName, componentNameSize) & (PNP_COMPONENT_REGISTRY_NUM_BUCKETS - 1);
+    uint8_t entry;
+
+    while ((entry = registry->buckets[bucket]) != 0)
+    {
+        size_t index = entry - 1;
+
+        if ((registry->componentNameSizes[index] == componentNameSize) && (memcmp(registry->componentNames[index], componentName, componentNameSize) == 0))
+        {
+            return (int)index;
+        }
+
+        bucket = (bucket + 1) & (PNP_COMPONENT_REGISTRY_NUM_BUCKETS - 1);
+    }
+
+    return -1;
+}
+
+void PnP_ComponentRegistry_ReportProperties(const PNP_COMPONENT_REGISTRY* registry, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL)
+{
+    for (size_t i = 0; i < registry->numComponents; i++)
+    {
+        const PNP_COMPONENT_INTERFACE* componentInterface = registry->registrations[i].componentInterface;
+
+        if (componentInterface->reportProperties != NULL)
+        {
+            componentInterface->reportProperties(registry->componentHandles[i], deviceClientLL);
+        }
+    }
+}
+
+//
+// SendTelemetryMessage sends length characters of JSON at telemetryStringBuffer as a telemetry message of component componentName
+//
+static void SendTelemetryMessage(IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL, const char* componentName, const char* telemetryStringBuffer, int length, size_t bufferSize)
+{
+    IOTHUB_MESSAGE_HANDLE messageHandle = NULL;
+    IOTHUB_CLIENT_RESULT iothubResult;
+
+    if ((length < 0) || ((size_t)length >= bufferSize))
+    {
+        LogError("Unable to serialize telemetry of component=%s", componentName);
+    }
+    else if ((messageHandle = PnP_CreateTelemetryMessageHandle(componentName, telemetryStringBuffer)) == NULL)
+    {
+        LogError("Unable to create telemetry message");
+    }
+    else if ((iothubResult = PnP_DiagnosticsComponent_SendEventAsync(deviceClientLL, messageHandle)) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Unable to send telemetry message, error=%d", iothubResult);
+    }
+
+    IoTHubMessage_Destroy(messageHandle);
+}
+
+void PnP_ComponentRegistry_SendTelemetry(const PNP_COMPONENT_REGISTRY* registry, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL, unsigned int pollIteration)
+{
+    char telemetryStringBuffer[PNP_COMPONENT_REGISTRY_MAX_TELEMETRY_SIZE];
+
+    for (size_t i = 0; i < registry->numComponents; i++)
+    {
+        const PNP_COMPONENT_REGISTRATION* registration = &registry->registrations[i];
+        const PNP_COMPONENT_INTERFACE* componentInterface = registration->componentInterface;
+        PNP_COMPONENT_HANDLE componentHandle = registry->componentHandles[i];
+
+        // Events go out on every pass, whatever the telemetry interval
+        for (int n = 0; (componentInterface->serializeEvent != NULL) && (n < PNP_COMPONENT_REGISTRY_MAX_EVENTS_PER_PASS); n++)
+        {
+            int length = componentInterface->serializeEvent(componentHandle, telemetryStringBuffer, sizeof(telemetryStringBuffer));
+            if (length == 0)
+            {
+                break;
+            }
+
+            uint32_t probeStart = LatencyProbe_Start();
+            SendTelemetryMessage(deviceClientLL, registration->componentName, telemetryStringBuffer, length, sizeof(telemetryStringBuffer));
+            LatencyProbe_Stop(LATENCY_PROBE_TELEMETRY, probeStart);
+        }
+
+        if ((componentInterface->serializeTelemetry == NULL) || (registration->telemetryPollInterval == 0) ||
+            ((pollIteration % registration->telemetryPollInterval) != 0))
+        {
+            continue;
+        }
+
+        if ((componentInterface->sample != NULL) && (componentInterface->sample(componentHandle) == false))
+        {
+            continue;
+        }
+
+        uint32_t probeStart = LatencyProbe_Start();
+
+        int length = componentInterface->serializeTelemetry(componentHandle, telemetryStringBuffer, sizeof(telemetryStringBuffer));
+        SendTelemetryMessage(deviceClientLL, registration->componentName, telemetryStringBuffer, length, sizeof(telemetryStringBuffer));
+
+        LatencyProbe_Stop(LATENCY_PROBE_TELEMETRY, probeStart);
+    }
+}
+
+bool PnP_ComponentRegistry_ProcessPropertyUpdate(const PNP_COMPONENT_REGISTRY* registry, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL, const char* componentName, const char* propertyName, JSON_Value* propertyValue, int version)
+{
+    int index = PnP_ComponentRegistry_Find(registry, componentName, strlen(componentName));
+
+    if (index < 0)
+    {
+        return false;
+    }
+
+    const PNP_COMPONENT_INTERFACE* componentInterface = registry->registrations[index].componentInterface;
+
+    if (componentInterface->processPropertyUpdate == NULL)
+    {
+        LogError("Property=%s was requested to be changed but component=%s has no writable properties", propertyName, componentName);
+    }
+    else
+    {
+        componentInterface->processPropertyUpdate(registry->componentHandles[index], deviceClientLL, propertyName, propertyValue, version);
+    }
+
+    return true;
+}
+
+int PnP_ComponentRegistry_ProcessCommand(const PNP_COMPONENT_REGISTRY* registry, const char* componentName, size_t componentNameSize, const char* pnpCommandName, JSON_Value* commandJsonValue, unsigned char** response, size_t* responseSize)
+{
+    int index = PnP_ComponentRegistry_Find(registry, componentName, componentNameSize);
+    int result;
+
+    if (index < 0)
+    {
+        LogError("PnP component=%.*s is not supported", (int)componentNameSize, componentName);
+        result = PNP_STATUS_NOT_FOUND;
+    }
+    else if (registry->registrations[index].componentInterface->processCommand == NULL)
+    {
+        LogError("PnP command=%s is not supported on %s component", pnpCommandName, registry->componentNames[index]);
+        result = PNP_STATUS_NOT_FOUND;
+    }
+    else
+    {
+        result = registry->registrations[index].componentInterface->processCommand(registry->componentHandles[index], pnpCommandName, commandJsonValue, response, responseSize);
+    }
+
+    return result;
+}
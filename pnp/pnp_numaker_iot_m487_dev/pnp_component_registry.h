@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header implements the registry of the subcomponents of the device.  Each component implements PNP_COMPONENT_INTERFACE,
+// and the application lists its components, with their names in the model, in a static table of PNP_COMPONENT_REGISTRATION.
+// The registry creates the components and dispatches twin properties, commands and telemetry to them by component name,
+// through a hash table, so another sensor only costs another table entry.
+//
+// The root component, i.e. properties and commands with no component name, is left to the application.
+
+#ifndef PNP_COMPONENT_REGISTRY_H
+#define PNP_COMPONENT_REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "parson.h"
+#include "iothub_device_client_ll.h"
+
+//
+// Handle representing a component's state, as returned by its create function
+//
+typedef void* PNP_COMPONENT_HANDLE;
+
+//
+// PNP_COMPONENT_INTERFACE is implemented by each component.  Functions marked optional may be NULL.
+//
+typedef struct PNP_COMPONENT_INTERFACE_TAG
+{
+    // Probes and configures the hardware of the component, and returns whether it is available.  It may take long, so the
+    // application may run it in parallel with network bring-up.  Optional.
+    bool (*initialize)(void);
+
+    // Allocates the state of a component named componentName.  Returns NULL on failure.
+    PNP_COMPONENT_HANDLE (*create)(const char* componentName);
+
+    // Frees the state of the component.  Optional.
+    void (*destroy)(PNP_COMPONENT_HANDLE componentHandle);
+
+    // Sends the read-only properties of the component, once the device client is created.  Optional.
+    void (*reportProperties)(PNP_COMPONENT_HANDLE componentHandle, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL);
+
+    // Takes a sample of the component's telemetry into its state.  Returns false if there is nothing to send.  Optional.
+    bool (*sample)(PNP_COMPONENT_HANDLE componentHandle);
+
+    // Serializes the last sample, or the current state if the component has no sample function, as the JSON body of a
+    // telemetry message into buffer.  Returns the length, or a negative number on failure.  Optional, for components with
+    // no telemetry.
+    int (*serializeTelemetry)(PNP_COMPONENT_HANDLE componentHandle, char* buffer, size_t bufferSize);
+
+    // Serializes one pending event of the component, telemetry sent as soon as it happens rather than on an interval, as the
+    // JSON body of a telemetry message into buffer.  Returns the length, 0 if no event is pending, or a negative number on
+    // failure.  Optional.
+    int (*serializeEvent)(PNP_COMPONENT_HANDLE componentHandle, char* buffer, size_t bufferSize);
+
+    // Processes a writable property update of the component, and reports it back.  Optional.
+    void (*processPropertyUpdate)(PNP_COMPONENT_HANDLE componentHandle, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL, const char* propertyName, JSON_Value* propertyValue, int version);
+
+    // Processes a command of the component.  Returns an HTTP style status code.  Optional.
+    int (*processCommand)(PNP_COMPONENT_HANDLE componentHandle, const char* pnpCommandName, JSON_Value* commandJsonValue, unsigned char** response, size_t* responseSize);
+}
+PNP_COMPONENT_INTERFACE;
+
+//
+// PNP_COMPONENT_REGISTRATION is an entry of the application's table of components
+//
+typedef struct PNP_COMPONENT_REGISTRATION_TAG
+{
+    // Name of the component in the model
+    const char* componentName;
+
+    // Telemetry is sent on every telemetryPollInterval(th) pass of the main loop.  0 for no telemetry.
+    unsigned int telemetryPollInterval;
+
+    const PNP_COMPONENT_INTERFACE* componentInterface;
+}
+PNP_COMPONENT_REGISTRATION;
+
+// Maximum number of components in a registry
+#define PNP_COMPONENT_REGISTRY_MAX_COMPONENTS 8
+
+// Number of hash buckets.  A power of 2, at least twice the number of components to keep probe sequences short.
+#define PNP_COMPONENT_REGISTRY_NUM_BUCKETS 16
+
+// Maximum length of the JSON body of a telemetry message.  The largest is the motion sensor's, with the statistics of 6 axes.
+#define PNP_COMPONENT_REGISTRY_MAX_TELEMETRY_SIZE 768
+
+// Maximum number of events sent per component on one pass of the main loop
+#define PNP_COMPONENT_REGISTRY_MAX_EVENTS_PER_PASS 4
+
+//
+// PNP_COMPONENT_REGISTRY holds the components of one device client
+//
+typedef struct PNP_COMPONENT_REGISTRY_TAG
+{
+    const PNP_COMPONENT_REGISTRATION* registrations;
+    size_t numComponents;
+
+    // Names of the components, in the form PnP_ProcessTwinData takes
+    const char* componentNames[PNP_COMPONENT_REGISTRY_MAX_COMPONENTS];
+    size_t componentNameSizes[PNP_COMPONENT_REGISTRY_MAX_COMPONENTS];
+
+    PNP_COMPONENT_HANDLE componentHandles[PNP_COMPONENT_REGISTRY_MAX_COMPONENTS];
+
+    // Open-addressed hash table of component names.  Each bucket holds the component index plus 1, or 0 if empty.
+    uint8_t buckets[PNP_COMPONENT_REGISTRY_NUM_BUCKETS];
+}
+PNP_COMPONENT_REGISTRY;
+
+//
+// PnP_ComponentRegistry_Initialize runs the initialize function of every component in registrations, and returns whether
+// all of them are available.  It does not need a registry, so it may run before the device client is created.
+//
+bool PnP_ComponentRegistry_Initialize(const PNP_COMPONENT_REGISTRATION* registrations, size_t numComponents);
+
+//
+// PnP_ComponentRegistry_Create creates every component in registrations into registry.  registrations must outlive registry.
+// On failure, the components created so far are destroyed.
+//
+bool PnP_ComponentRegistry_Create(PNP_COMPONENT_REGISTRY* registry, const PNP_COMPONENT_REGISTRATION* registrations, size_t numComponents);
+
+//
+// PnP_ComponentRegistry_Destroy destroys the components of registry.
+//
+void PnP_ComponentRegistry_Destroy(PNP_COMPONENT_REGISTRY* registry);
+
+//
+// PnP_ComponentRegistry_Find returns the index of the component whose name is the componentNameSize characters at componentName,
+// or -1 if there is none.
+//
+int PnP_ComponentRegistry_Find(const PNP_COMPONENT_REGISTRY* registry, const char* componentName, size_t componentNameSize);
+
+//
+// PnP_ComponentRegistry_ReportProperties sends the read-only properties of every component.
+//
+void PnP_ComponentRegistry_ReportProperties(const PNP_COMPONENT_REGISTRY* registry, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL);
+
+//
+// PnP_ComponentRegistry_SendTelemetry sends pending events of the components, then samples and sends telemetry of the components
+// due on pass pollIteration of the main loop.
+//
+void PnP_ComponentRegistry_SendTelemetry(const PNP_COMPONENT_REGISTRY* registry, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL, unsigned int pollIteration);
+
+//
+// PnP_ComponentRegistry_ProcessPropertyUpdate hands a property update to the component componentName.  Returns false if
+// the registry has no such component.
+//
+bool PnP_ComponentRegistry_ProcessPropertyUpdate(const PNP_COMPONENT_REGISTRY* registry, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL, const char* componentName, const char* propertyName, JSON_Value* propertyValue, int version);
+
+//
+// PnP_ComponentRegistry_ProcessCommand hands a command to the component whose name is the componentNameSize characters at
+// componentName, as PnP_ParseCommandName returns it.  Returns an HTTP style status code, PNP_STATUS_NOT_FOUND if the
+// registry has no such component.
+//
+int PnP_ComponentRegistry_ProcessCommand(const PNP_COMPONENT_REGISTRY* registry, const char* componentName, size_t componentNameSize, const char* pnpCommandName, JSON_Value* commandJsonValue, unsigned char** response, size_t* responseSize);
+
+#endif /* PNP_COMPONENT_REGISTRY_H */
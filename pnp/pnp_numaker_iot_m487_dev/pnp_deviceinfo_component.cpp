@@ -22,6 +22,7 @@
 // PnP routines
 #include "pnp_deviceinfo_component.h"
 #include "pnp_protocol.h"
+#include "pnp_mempool.h"
 
 // Core IoT SDK utilities
 #include "azure_c_shared_utility/xlogging.h"
@@ -62,18 +63,15 @@ static const char PnPDeviceInfo_TotalMemoryPropertyValue[] = "160";
 static void SendReportedPropertyForDeviceInformation(IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL, const char* componentName, const char* propertyName, const char* propertyValue)
 {
     IOTHUB_CLIENT_RESULT iothubClientResult;
-    STRING_HANDLE jsonToSend = NULL;
+    char* jsonToSend = NULL;
 
-    if ((jsonToSend = PnP_CreateReportedProperty(componentName, propertyName, propertyValue)) == NULL)
+    if ((jsonToSend = PnP_FormatReportedProperty(componentName, propertyName, propertyValue)) == NULL)
     {
         LogError("Unable to build reported property response for propertyName=%s, propertyValue=%s", propertyName, propertyValue);
     }
     else
     {
-        const char* jsonToSendStr = STRING_c_str(jsonToSend);
-        size_t jsonToSendStrLen = strlen(jsonToSendStr);
-
-        if ((iothubClientResult = IoTHubDeviceClient_LL_SendReportedState(deviceClientLL, (const unsigned char*)jsonToSendStr, jsonToSendStrLen, NULL, NULL)) != IOTHUB_CLIENT_OK)
+        if ((iothubClientResult = IoTHubDeviceClient_LL_SendReportedState(deviceClientLL, (const unsigned char*)jsonToSend, strlen(jsonToSend), NULL, NULL)) != IOTHUB_CLIENT_OK)
         {
             LogError("Unable to send reported state for property=%s, error=%d", propertyName, iothubClientResult);
         }
@@ -83,7 +81,7 @@ static void SendReportedPropertyForDeviceInformation(IOTHUB_DEVICE_CLIENT_LL_HAN
         }
     }
 
-    STRING_delete(jsonToSend);
+    PnP_MemPool_Free(jsonToSend);
 }
 
 void PnP_DeviceInfoComponent_Report_All_Properties(const char* componentName, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL)
@@ -100,3 +98,29 @@ void PnP_DeviceInfoComponent_Report_All_Properties(const char* componentName, IO
     SendReportedPropertyForDeviceInformation(deviceClientLL, componentName, PnPDeviceInfo_TotalStoragePropertyName, PnPDeviceInfo_TotalStoragePropertyValue);
     SendReportedPropertyForDeviceInformation(deviceClientLL, componentName, PnPDeviceInfo_TotalMemoryPropertyName, PnPDeviceInfo_TotalMemoryPropertyValue);
 }
+
+//
+// Component interface.  DeviceInfo has no state of its own: its handle is its name.
+//
+static PNP_COMPONENT_HANDLE DeviceInfoComponent_Create(const char* componentName)
+{
+    return (PNP_COMPONENT_HANDLE)componentName;
+}
+
+static void DeviceInfoComponent_ReportProperties(PNP_COMPONENT_HANDLE componentHandle, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL)
+{
+    PnP_DeviceInfoComponent_Report_All_Properties((const char*)componentHandle, deviceClientLL);
+}
+
+const PNP_COMPONENT_INTERFACE g_deviceInfoComponentInterface =
+{
+    NULL,
+    DeviceInfoComponent_Create,
+    NULL,
+    DeviceInfoComponent_ReportProperties,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
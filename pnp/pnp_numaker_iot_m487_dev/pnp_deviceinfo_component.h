@@ -26,10 +26,16 @@
 #define PNP_DEVICEINFO_COMPONENT_H
 
 #include "iothub_device_client_ll.h"
+#include "pnp_component_registry.h"
 
 //
 // PnP_DeviceInfoComponent_Report_All_Properties sends properties corresponding to the DeviceInfo interface to the cloud.
 //
 void PnP_DeviceInfoComponent_Report_All_Properties(const char* componentName, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL);
 
+//
+// g_deviceInfoComponentInterface registers the component with the component registry.
+//
+extern const PNP_COMPONENT_INTERFACE g_deviceInfoComponentInterface;
+
 #endif /* PNP_DEVICEINFO_COMPONENT_H */
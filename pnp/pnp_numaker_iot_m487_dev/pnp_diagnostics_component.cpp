@@ -0,0 +1,481 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Standard C header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Mbed port header files
+#include "mbed.h"
+#include "mbed_stats.h"
+
+// PnP routines
+#include "pnp_protocol.h"
+#include "pnp_arena.h"
+#include "pnp_mempool.h"
+#include "pnp_tlsio.h"
+#include "pnp_diagnostics_component.h"
+
+// Core IoT SDK utilities
+#include "azure_c_shared_utility/xlogging.h"
+
+// Hot path latency histograms
+#include "latency_probe.h"
+
+// Shared I2C bus accounting
+#include "I2CBus.h"
+
+// Command to dump full statistics
+static const char g_dumpStatsCommand[] = "dumpStats";
+
+// Command to dump latency histograms.  A payload of true resets them afterwards.
+static const char g_dumpLatencyCommand[] = "dumpLatency";
+
+// Maximum number of threads whose stacks are reported.  Further ones are not.
+#define DIAGNOSTICS_MAX_THREADS 16
+
+// Format string for sending diagnostics telemetry
+static const char g_diagnosticsTelemetryBodyFormat[] =
+    "{\"heapCurrent\":%lu,\"heapPeak\":%lu,\"heapFree\":%lu,\"heapAllocFail\":%lu,\"stackMinFree\":%lu,\"stackMinFreeThread\":\"%s\","
+    "\"cpuIdle\":%u,\"doWorkAvgUs\":%lu,\"doWorkMaxUs\":%lu,\"sendQueueDepth\":%lu,\"sendFailures\":%lu}";
+
+//
+// DIAGNOSTICS_DOWORK_STATS accounts IoTHubDeviceClient_LL_DoWork calls
+//
+typedef struct DIAGNOSTICS_DOWORK_STATS_TAG
+{
+    uint32_t count;
+    uint64_t totalUs;
+    uint32_t maxUs;
+}
+DIAGNOSTICS_DOWORK_STATS;
+
+// DoWork calls since the last telemetry, and since boot
+static DIAGNOSTICS_DOWORK_STATS g_doWorkInterval;
+static DIAGNOSTICS_DOWORK_STATS g_doWorkTotal;
+
+// Telemetry messages queued but not confirmed yet, those IoT Hub confirmed as delivered and those it did not.  Confirmations arrive from
+// within IoTHubDeviceClient_LL_DoWork, i.e. on the same thread as the sends.
+static uint32_t g_sendQueueDepth = 0;
+static uint32_t g_sendQueueDepthPeak = 0;
+static uint32_t g_sendDelivered = 0;
+static uint32_t g_sendFailures = 0;
+
+// CPU statistics at the last telemetry, to compute the idle percentage over the interval
+static mbed_stats_cpu_t g_lastCpuStats;
+
+//
+// HeapFree returns the heap not allocated, including what fragmentation makes unusable for large blocks
+//
+static uint32_t HeapFree(const mbed_stats_heap_t* heapStats)
+{
+    uint32_t used = heapStats->current_size + heapStats->overhead_size;
+
+    return (heapStats->reserved_size > used) ? (heapStats->reserved_size - used) : 0;
+}
+
+//
+// ThreadName returns the name of the thread threadId, or "?" if it has none.  The thread id of the stack statistics is the
+// osThreadId_t as an integer.
+//
+static const char* ThreadName(uintptr_t threadId)
+{
+    const char* name = osThreadGetName((osThreadId_t)threadId);
+
+    return (name != NULL) ? name : "?";
+}
+
+//
+// SendConfirmationCallback is invoked by IoT SDK when a telemetry message is delivered, or given up on.
+//
+static void SendConfirmationCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void* userContextCallback)
+{
+    (void)userContextCallback;
+
+    if (g_sendQueueDepth > 0)
+    {
+        g_sendQueueDepth--;
+    }
+
+    if (result != IOTHUB_CLIENT_CONFIRMATION_OK)
+    {
+        g_sendFailures++;
+    }
+    else
+    {
+        g_sendDelivered++;
+    }
+}
+
+void PnP_DiagnosticsComponent_RecordDoWork(uint32_t durationUs)
+{
+    g_doWorkInterval.count++;
+    g_doWorkInterval.totalUs += durationUs;
+    if (durationUs > g_doWorkInterval.maxUs)
+    {
+        g_doWorkInterval.maxUs = durationUs;
+    }
+
+    g_doWorkTotal.count++;
+    g_doWorkTotal.totalUs += durationUs;
+    if (durationUs > g_doWorkTotal.maxUs)
+    {
+        g_doWorkTotal.maxUs = durationUs;
+    }
+}
+
+IOTHUB_CLIENT_RESULT PnP_DiagnosticsComponent_SendEventAsync(IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL, IOTHUB_MESSAGE_HANDLE messageHandle)
+{
+    IOTHUB_CLIENT_RESULT iothubResult;
+
+    if ((iothubResult = IoTHubDeviceClient_LL_SendEventAsync(deviceClientLL, messageHandle, SendConfirmationCallback, NULL)) == IOTHUB_CLIENT_OK)
+    {
+        g_sendQueueDepth++;
+        if (g_sendQueueDepth > g_sendQueueDepthPeak)
+        {
+            g_sendQueueDepthPeak = g_sendQueueDepth;
+        }
+    }
+
+    return iothubResult;
+}
+
+void PnP_DiagnosticsComponent_GetSendCounts(uint32_t* delivered, uint32_t* failed)
+{
+    *delivered = g_sendDelivered;
+    *failed = g_sendFailures;
+}
+
+int PnP_DiagnosticsComponent_SerializeTelemetry(char* buffer, size_t bufferSize)
+{
+    mbed_stats_heap_t heapStats;
+    mbed_stats_cpu_t cpuStats;
+    mbed_stats_stack_t stackStats[DIAGNOSTICS_MAX_THREADS];
+    size_t numThreads;
+
+    mbed_stats_heap_get(&heapStats);
+    mbed_stats_cpu_get(&cpuStats);
+    numThreads = mbed_stats_stack_get_each(stackStats, DIAGNOSTICS_MAX_THREADS);
+
+    // The thread closest to overflowing its stack
+    uint32_t stackMinFree = 0;
+    const char* stackMinFreeThread = "";
+    for (size_t i = 0; i < numThreads; i++)
+    {
+        uint32_t stackFree = stackStats[i].reserved_size - stackStats[i].max_size;
+
+        if ((i == 0) || (stackFree < stackMinFree))
+        {
+            stackMinFree = stackFree;
+            stackMinFreeThread = ThreadName(stackStats[i].thread_id);
+        }
+    }
+
+    // Idle percentage over the interval
+    unsigned int cpuIdle = 0;
+    uint64_t uptimeDelta = cpuStats.uptime - g_lastCpuStats.uptime;
+    if (uptimeDelta != 0)
+    {
+        cpuIdle = (unsigned int)(((cpuStats.idle_time - g_lastCpuStats.idle_time) * 100) / uptimeDelta);
+    }
+    g_lastCpuStats = cpuStats;
+
+    uint32_t doWorkAvgUs = (g_doWorkInterval.count != 0) ? (uint32_t)(g_doWorkInterval.totalUs / g_doWorkInterval.count) : 0;
+
+    int result = snprintf(buffer, bufferSize, g_diagnosticsTelemetryBodyFormat,
+                          (unsigned long)heapStats.current_size, (unsigned long)heapStats.max_size, (unsigned long)HeapFree(&heapStats),
+                          (unsigned long)heapStats.alloc_fail_cnt, (unsigned long)stackMinFree, stackMinFreeThread,
+                          cpuIdle, (unsigned long)doWorkAvgUs, (unsigned long)g_doWorkInterval.maxUs,
+                          (unsigned long)g_sendQueueDepth, (unsigned long)g_sendFailures);
+
+    memset(&g_doWorkInterval, 0, sizeof(g_doWorkInterval));
+
+    return result;
+}
+
+//
+// DumpStats builds the JSON of full statistics, logs it over serial and returns it as the command response.
+//
+static int DumpStats(unsigned char** response, size_t* responseSize)
+{
+    int result;
+
+    mbed_stats_heap_t heapStats;
+    mbed_stats_cpu_t cpuStats;
+    mbed_stats_stack_t stackStats[DIAGNOSTICS_MAX_THREADS];
+    size_t numThreads;
+
+    mbed_stats_heap_get(&heapStats);
+    mbed_stats_cpu_get(&cpuStats);
+    numThreads = mbed_stats_stack_get_each(stackStats, DIAGNOSTICS_MAX_THREADS);
+
+    JSON_Value* rootValue = json_value_init_object();
+    JSON_Value* threadsValue = json_value_init_array();
+    JSON_Object* rootObject = json_value_get_object(rootValue);
+    JSON_Array* threadsArray = json_value_get_array(threadsValue);
+    char* serialized = NULL;
+
+    if ((rootObject == NULL) || (threadsArray == NULL))
+    {
+        LogError("Unable to allocate diagnostics JSON");
+        json_value_free(threadsValue);
+        result = PNP_STATUS_INTERNAL_ERROR;
+    }
+    else
+    {
+        json_object_dotset_number(rootObject, "heap.current", heapStats.current_size);
+        json_object_dotset_number(rootObject, "heap.peak", heapStats.max_size);
+        json_object_dotset_number(rootObject, "heap.reserved", heapStats.reserved_size);
+        json_object_dotset_number(rootObject, "heap.overhead", heapStats.overhead_size);
+        json_object_dotset_number(rootObject, "heap.free", HeapFree(&heapStats));
+        json_object_dotset_number(rootObject, "heap.totalAllocated", heapStats.total_size);
+        json_object_dotset_number(rootObject, "heap.allocCount", heapStats.alloc_cnt);
+        json_object_dotset_number(rootObject, "heap.allocFailCount", heapStats.alloc_fail_cnt);
+
+        for (size_t i = 0; i < numThreads; i++)
+        {
+            JSON_Value* threadValue = json_value_init_object();
+            JSON_Object* threadObject = json_value_get_object(threadValue);
+
+            if (threadObject != NULL)
+            {
+                json_object_set_string(threadObject, "name", ThreadName(stackStats[i].thread_id));
+                json_object_set_number(threadObject, "stackSize", stackStats[i].reserved_size);
+                json_object_set_number(threadObject, "stackPeak", stackStats[i].max_size);
+                json_array_append_value(threadsArray, threadValue);
+            }
+        }
+        json_object_set_value(rootObject, "threads", threadsValue);
+
+        json_object_dotset_number(rootObject, "cpu.uptimeUs", (double)cpuStats.uptime);
+        json_object_dotset_number(rootObject, "cpu.idleUs", (double)cpuStats.idle_time);
+        json_object_dotset_number(rootObject, "cpu.sleepUs", (double)cpuStats.sleep_time);
+        json_object_dotset_number(rootObject, "cpu.deepSleepUs", (double)cpuStats.deep_sleep_time);
+
+        json_object_dotset_number(rootObject, "doWork.count", g_doWorkTotal.count);
+        json_object_dotset_number(rootObject, "doWork.avgUs", (g_doWorkTotal.count != 0) ? (double)(g_doWorkTotal.totalUs / g_doWorkTotal.count) : 0);
+        json_object_dotset_number(rootObject, "doWork.maxUs", g_doWorkTotal.maxUs);
+
+        json_object_dotset_number(rootObject, "send.queueDepth", g_sendQueueDepth);
+        json_object_dotset_number(rootObject, "send.queueDepthPeak", g_sendQueueDepthPeak);
+        json_object_dotset_number(rootObject, "send.delivered", g_sendDelivered);
+        json_object_dotset_number(rootObject, "send.failures", g_sendFailures);
+
+        PNP_ARENA_STATS arenaStats;
+        PnP_Arena_GetStats(&arenaStats);
+        json_object_dotset_number(rootObject, "arena.size", arenaStats.size);
+        json_object_dotset_number(rootObject, "arena.highWater", arenaStats.highWater);
+        json_object_dotset_number(rootObject, "arena.allocations", arenaStats.allocations);
+        json_object_dotset_number(rootObject, "arena.fallbacks", arenaStats.fallbacks);
+
+        PNP_MEMPOOL_STATS poolStats[PNP_MEMPOOL_NUM_CLASSES];
+        uint32_t poolOversized;
+        JSON_Value* poolsValue = json_value_init_array();
+        JSON_Array* poolsArray = json_value_get_array(poolsValue);
+        PnP_MemPool_GetStats(poolStats, &poolOversized);
+        for (size_t i = 0; i < PNP_MEMPOOL_NUM_CLASSES; i++)
+        {
+            JSON_Value* poolValue = json_value_init_object();
+            JSON_Object* poolObject = json_value_get_object(poolValue);
+
+            if (poolObject != NULL)
+            {
+                json_object_set_number(poolObject, "blockSize", poolStats[i].blockSize);
+                json_object_set_number(poolObject, "blocks", poolStats[i].blocks);
+                json_object_set_number(poolObject, "hits", poolStats[i].hits);
+                json_object_set_number(poolObject, "misses", poolStats[i].misses);
+                json_object_set_number(poolObject, "highWater", poolStats[i].highWater);
+                json_array_append_value(poolsArray, poolValue);
+            }
+        }
+        json_object_dotset_value(rootObject, "pools.classes", poolsValue);
+        json_object_dotset_number(rootObject, "pools.oversized", poolOversized);
+
+#ifdef USE_TLS_SESSION_RESUMPTION
+        PNP_TLSIO_STATS tlsStats;
+        PnP_TlsIo_GetStats(&tlsStats);
+        json_object_dotset_number(rootObject, "tls.fullHandshakes", tlsStats.fullHandshakes);
+        json_object_dotset_number(rootObject, "tls.resumedHandshakes", tlsStats.resumedHandshakes);
+        json_object_dotset_number(rootObject, "tls.failedHandshakes", tlsStats.failedHandshakes);
+        json_object_dotset_number(rootObject, "tls.lastHandshakeMs", tlsStats.lastHandshakeMs);
+        json_object_dotset_number(rootObject, "tls.lastHandshakeBytesSent", tlsStats.lastHandshakeBytesSent);
+        json_object_dotset_number(rootObject, "tls.lastHandshakeBytesReceived", tlsStats.lastHandshakeBytesReceived);
+        json_object_dotset_boolean(rootObject, "tls.lastHandshakeResumed", tlsStats.lastHandshakeResumed);
+#endif
+
+        I2CBus_DeviceStats i2cStats[I2CBUS_MAX_DEVICES];
+        size_t numI2CDevices = I2CBus::get_stats_each(i2cStats, I2CBUS_MAX_DEVICES);
+        JSON_Value* i2cValue = json_value_init_array();
+        JSON_Array* i2cArray = json_value_get_array(i2cValue);
+        for (size_t i = 0; i < numI2CDevices; i++)
+        {
+            JSON_Value* deviceValue = json_value_init_object();
+            JSON_Object* deviceObject = json_value_get_object(deviceValue);
+
+            if (deviceObject != NULL)
+            {
+                json_object_set_string(deviceObject, "name", i2cStats[i].name);
+                json_object_set_number(deviceObject, "transactions", i2cStats[i].transactions);
+                json_object_set_number(deviceObject, "errors", i2cStats[i].errors);
+                json_object_set_number(deviceObject, "bytes", i2cStats[i].bytes);
+                json_object_set_number(deviceObject, "busyUs", (double)i2cStats[i].busy_us);
+                // Share of the time since the device was attached that the bus was busy with it, in percent
+                json_object_set_number(deviceObject, "utilization", (i2cStats[i].elapsed_us != 0) ? (double)i2cStats[i].busy_us * 100 / i2cStats[i].elapsed_us : 0);
+                json_object_set_number(deviceObject, "avgWaitUs", (i2cStats[i].transactions != 0) ? (double)(i2cStats[i].wait_us / i2cStats[i].transactions) : 0);
+                json_object_set_number(deviceObject, "maxWaitUs", i2cStats[i].max_wait_us);
+                json_array_append_value(i2cArray, deviceValue);
+            }
+        }
+        json_object_set_value(rootObject, "i2c", i2cValue);
+
+        if ((serialized = json_serialize_to_string(rootValue)) == NULL)
+        {
+            LogError("Unable to serialize diagnostics JSON");
+            result = PNP_STATUS_INTERNAL_ERROR;
+        }
+        else
+        {
+            LogInfo("Diagnostics: %s", serialized);
+
+            // The IoT SDK frees the response with free()
+            size_t serializedSize = strlen(serialized);
+            if ((*response = (unsigned char*)malloc(serializedSize)) == NULL)
+            {
+                LogError("Unable to allocate diagnostics response");
+                result = PNP_STATUS_INTERNAL_ERROR;
+            }
+            else
+            {
+                memcpy(*response, serialized, serializedSize);
+                *responseSize = serializedSize;
+                result = PNP_STATUS_SUCCESS;
+            }
+        }
+    }
+
+    json_free_serialized_string(serialized);
+    json_value_free(rootValue);
+
+    return result;
+}
+
+//
+// DumpLatency logs the latency histograms over serial and returns them as the command response.  If reset is set, they are cleared afterwards.
+//
+static int DumpLatency(bool reset, unsigned char** response, size_t* responseSize)
+{
+    int result;
+    JSON_Value* rootValue = NULL;
+    char* serialized = NULL;
+
+    LatencyProbe_Report();
+
+    if ((rootValue = LatencyProbe_ToJson()) == NULL)
+    {
+        LogError("Unable to allocate latency JSON");
+        result = PNP_STATUS_INTERNAL_ERROR;
+    }
+    else if ((serialized = json_serialize_to_string(rootValue)) == NULL)
+    {
+        LogError("Unable to serialize latency JSON");
+        result = PNP_STATUS_INTERNAL_ERROR;
+    }
+    else
+    {
+        // The IoT SDK frees the response with free()
+        size_t serializedSize = strlen(serialized);
+        if ((*response = (unsigned char*)malloc(serializedSize)) == NULL)
+        {
+            LogError("Unable to allocate latency response");
+            result = PNP_STATUS_INTERNAL_ERROR;
+        }
+        else
+        {
+            memcpy(*response, serialized, serializedSize);
+            *responseSize = serializedSize;
+            result = PNP_STATUS_SUCCESS;
+        }
+    }
+
+    if (reset && (result == PNP_STATUS_SUCCESS))
+    {
+        LatencyProbe_Reset();
+    }
+
+    json_free_serialized_string(serialized);
+    json_value_free(rootValue);
+
+    return result;
+}
+
+int PnP_DiagnosticsComponent_ProcessCommand(const char* componentName, const char *pnpCommandName, JSON_Value* commandJsonValue, unsigned char** response, size_t* responseSize)
+{
+    int result;
+
+    if (strcmp(pnpCommandName, g_dumpStatsCommand) == 0)
+    {
+        result = DumpStats(response, responseSize);
+    }
+    else if (strcmp(pnpCommandName, g_dumpLatencyCommand) == 0)
+    {
+        bool reset = (json_value_get_type(commandJsonValue) == JSONBoolean) && json_value_get_boolean(commandJsonValue);
+
+        result = DumpLatency(reset, response, responseSize);
+    }
+    else
+    {
+        LogError("PnP command=%s is not supported on %s component", pnpCommandName, componentName);
+        result = PNP_STATUS_NOT_FOUND;
+    }
+
+    return result;
+}
+
+//
+// Component interface.  The diagnostics are of the whole device, so the component has no state of its own: its handle is its name.
+//
+static PNP_COMPONENT_HANDLE DiagnosticsComponent_Create(const char* componentName)
+{
+    return (PNP_COMPONENT_HANDLE)componentName;
+}
+
+static int DiagnosticsComponent_SerializeTelemetry(PNP_COMPONENT_HANDLE componentHandle, char* buffer, size_t bufferSize)
+{
+    (void)componentHandle;
+
+    return PnP_DiagnosticsComponent_SerializeTelemetry(buffer, bufferSize);
+}
+
+static int DiagnosticsComponent_ProcessCommand(PNP_COMPONENT_HANDLE componentHandle, const char* pnpCommandName, JSON_Value* commandJsonValue, unsigned char** response, size_t* responseSize)
+{
+    return PnP_DiagnosticsComponent_ProcessCommand((const char*)componentHandle, pnpCommandName, commandJsonValue, response, responseSize);
+}
+
+const PNP_COMPONENT_INTERFACE g_diagnosticsComponentInterface =
+{
+    NULL,
+    DiagnosticsComponent_Create,
+    NULL,
+    NULL,
+    NULL,
+    DiagnosticsComponent_SerializeTelemetry,
+    NULL,
+    NULL,
+    DiagnosticsComponent_ProcessCommand
+};
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header implements a diagnostics component, which tells how close the device is to running out of memory or CPU.
+// It reports heap and stack usage, CPU idle time, IoTHubDeviceClient_LL_DoWork duration and the depth of the telemetry queue,
+// periodically as telemetry and in full on the dumpStats command.  The dumpLatency command returns the hot path latency
+// histograms of latency_probe.h.
+//
+// Heap, stack and CPU statistics need "platform.heap-stats-enabled", "platform.stack-stats-enabled" and
+// "platform.cpu-stats-enabled" in mbed_app.json; otherwise they read zero.
+
+#ifndef PNP_DIAGNOSTICS_COMPONENT_H
+#define PNP_DIAGNOSTICS_COMPONENT_H
+
+#include "parson.h"
+#include "iothub_device_client_ll.h"
+#include "pnp_component_registry.h"
+
+//
+// PnP_DiagnosticsComponent_RecordDoWork accounts one IoTHubDeviceClient_LL_DoWork call, which took durationUs microseconds.
+//
+void PnP_DiagnosticsComponent_RecordDoWork(uint32_t durationUs);
+
+//
+// PnP_DiagnosticsComponent_SendEventAsync queues messageHandle like IoTHubDeviceClient_LL_SendEventAsync, counting it as
+// outstanding until IoT Hub confirms it.  Use it for all telemetry so that the queue depth is accurate.
+//
+IOTHUB_CLIENT_RESULT PnP_DiagnosticsComponent_SendEventAsync(IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL, IOTHUB_MESSAGE_HANDLE messageHandle);
+
+//
+// PnP_DiagnosticsComponent_GetSendCounts returns the telemetry messages IoT Hub confirmed as delivered, and those it did not, since boot.
+//
+void PnP_DiagnosticsComponent_GetSendCounts(uint32_t* delivered, uint32_t* failed);
+
+//
+// PnP_DiagnosticsComponent_SerializeTelemetry formats a summary of the statistics since the previous call as the body of a telemetry message.
+//
+int PnP_DiagnosticsComponent_SerializeTelemetry(char* buffer, size_t bufferSize);
+
+//
+// PnP_DiagnosticsComponent_ProcessCommand is used to process any incoming PnP Commands to the diagnostics component.
+// The function returns an HTTP style return code to indicate success or failure.
+//
+int PnP_DiagnosticsComponent_ProcessCommand(const char* componentName, const char *pnpCommandName, JSON_Value* commandJsonValue, unsigned char** response, size_t* responseSize);
+
+//
+// g_diagnosticsComponentInterface registers the component with the component registry.
+//
+extern const PNP_COMPONENT_INTERFACE g_diagnosticsComponentInterface;
+
+#endif /* PNP_DIAGNOSTICS_COMPONENT_H */
@@ -17,6 +17,8 @@
  */
 
 // Standard C header files
+#include <math.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,6 +26,7 @@
 
 // PnP routines
 #include "pnp_protocol.h"
+#include "pnp_mempool.h"
 #include "pnp_motion_sensor_bmx055_component.h"
 
 // Core IoT SDK utilities
@@ -32,19 +35,167 @@
 // Motion sensor BMX055 driver
 #include "BMX055.h"
 
-// Format string for sending 9-axis telemetry
-static const char g_accelXTelemetryBodyFormat[] = "{\"accelX\":%.02f}";
-static const char g_accelYTelemetryBodyFormat[] = "{\"accelY\":%.02f}";
-static const char g_accelZTelemetryBodyFormat[] = "{\"accelZ\":%.02f}";
-static const char g_gyroXTelemetryBodyFormat[] = "{\"gyroX\":%.02f}";
-static const char g_gyroYTelemetryBodyFormat[] = "{\"gyroY\":%.02f}";
-static const char g_gyroZTelemetryBodyFormat[] = "{\"gyroZ\":%.02f}";
-static const char g_magnetXTelemetryBodyFormat[] = "{\"magnetX\":%.02f}";
-static const char g_magnetYTelemetryBodyFormat[] = "{\"magnetY\":%.02f}";
-static const char g_magnetZTelemetryBodyFormat[] = "{\"magnetZ\":%.02f}";
+// Cache of the addresses BMX055 was found at
+#include "kvstore_global_api.h"
 
-// Format string for sending chip temperature telemetry
-static const char g_tempTelemetryBodyFormat[] = "{\"temperature\":%.02f}";
+// Hot path latency histograms
+#include "latency_probe.h"
+
+// Hard-iron and soft-iron calibration of the magnetometer
+#include "mag_calibration.h"
+
+// Bias estimation of the gyroscope
+#include "gyro_bias.h"
+
+// Statistics of the samples of each telemetry interval
+#include "stream_stats.h"
+
+// Anomaly detection over the statistics of each telemetry interval
+#include "anomaly_detector.h"
+
+// Format string of the statistics of one axis over a telemetry interval: its mean under the name of the axis, then its minimum, maximum
+// and standard deviation
+#define MOTION_AXIS_STATS_FORMAT(axis, precision) \
+    "\"" axis "\":%." precision "f,\"" axis "Min\":%." precision "f,\"" axis "Max\":%." precision "f,\"" axis "Std\":%." precision "f,"
+
+// Format string for sending the statistics of acceleration and angular rate with the bias removed over the telemetry interval, with the
+// number of samples they are of, calibrated magnetic field, chip temperature and anomaly score telemetry.  All fields go in one message,
+// as every message costs a message handle, its property map and a clone in the IoT SDK, plus an MQTT publish.
+static const char g_motionTelemetryBodyFormat[] = "{\"accelSamples\":%lu,"
+                                                  MOTION_AXIS_STATS_FORMAT("accelX", "03")
+                                                  MOTION_AXIS_STATS_FORMAT("accelY", "03")
+                                                  MOTION_AXIS_STATS_FORMAT("accelZ", "03")
+                                                  "\"gyroSamples\":%lu,"
+                                                  MOTION_AXIS_STATS_FORMAT("gyroX", "02")
+                                                  MOTION_AXIS_STATS_FORMAT("gyroY", "02")
+                                                  MOTION_AXIS_STATS_FORMAT("gyroZ", "02")
+                                                  "\"magnetX\":%.02f,\"magnetY\":%.02f,\"magnetZ\":%.02f,\"temperature\":%.02f,"
+                                                  "\"anomalyScore\":%.02f}";
+
+// Format string for sending an event of the on-sensor engines: the axis and sign that triggered it first, and how many times it
+// happened since the last one was sent
+static const char g_motionEventBodyFormat[] = "{\"%s\":{\"axis\":\"%c\",\"sign\":%d,\"count\":%lu}}";
+
+// Format strings for sending the outcome of a magnetometer calibration
+static const char g_magnetCalibrationSuccessFormat[] = "{\"magnetCalibration\":{\"status\":\"success\",\"samples\":%lu,"
+                                                       "\"offsetX\":%.02f,\"offsetY\":%.02f,\"offsetZ\":%.02f,\"fieldStrength\":%.02f}}";
+static const char g_magnetCalibrationFailureFormat[] = "{\"magnetCalibration\":{\"status\":\"failed\",\"samples\":%lu,\"reason\":\"%s\"}}";
+
+// Format string for sending an anomaly alert: its score, and the feature it is of with its value and baseline
+static const char g_anomalyEventBodyFormat[] = "{\"anomaly\":{\"score\":%.02f,\"feature\":\"%s\",\"value\":%.04f,\"baseline\":%.04f}}";
+
+// Features of each telemetry interval the anomaly detector scores, the variation of every axis, which vibration shows in
+#define BMX055_NUM_ANOMALY_FEATURES 6
+
+static const char* const g_anomalyFeatureNames[BMX055_NUM_ANOMALY_FEATURES] =
+{
+    "accelXStd", "accelYStd", "accelZStd", "gyroXStd", "gyroYStd", "gyroZStd"
+};
+
+// Noise of each feature, in g and deg/s, under which the detector does not tell its variation from the baseline
+static const float g_anomalyFeatureMinSigma[BMX055_NUM_ANOMALY_FEATURES] =
+{
+    0.001f, 0.001f, 0.001f, 0.05f, 0.05f, 0.05f
+};
+
+// Score over which an interval is anomalous
+static const float g_anomalyThreshold = MBED_CONF_APP_MOTION_ANOMALY_THRESHOLD;
+
+// Command which forgets the anomaly baseline and learns it again, after the normal condition changed for good
+static const char g_resetBaselineCommandName[] = "resetBaseline";
+
+// Command which calibrates the magnetometer while the device is turned around, for the seconds given in its payload
+static const char g_calibrateCommandName[] = "calibrate";
+static const uint32_t g_defaultCalibrationSeconds = 30;
+static const uint32_t g_minCalibrationSeconds = 5;
+static const uint32_t g_maxCalibrationSeconds = 300;
+
+// Command which runs the fast offset compensation of the accelerometer and gyroscope, while the device lies still with the axis in its
+// payload pointing up ("+z" if null)
+static const char g_compensateOffsetsCommandName[] = "compensateOffsets";
+
+// Format string for the response of compensateOffsets: the offset compensation registers of the accelerometer and gyroscope
+static const char g_compensateOffsetsResponseFormat[] = "{\"status\":\"success\",\"accelOffsetRegs\":[%d,%d,%d],\"gyroOffsetRegs\":[%d,%d,%d]}";
+
+// Writable properties of the thresholds of the on-sensor engines in g.  0 disables the engine.
+static const char g_motionThresholdPropertyName[] = "motionThreshold";
+static const char g_tapThresholdPropertyName[] = "tapThreshold";
+static const char g_highGThresholdPropertyName[] = "highGThreshold";
+
+// Largest threshold, the widest range of the accelerometer
+static const float g_maxThresholdG = 16.0f;
+
+//
+// BMX055_SETTING maps a value of a sensor setting property, in its physical unit, to the setting of BMX055
+//
+typedef struct BMX055_SETTING_TAG
+{
+    float value;
+    uint8_t setting;
+    // Output data rate the setting fills the FIFO at, for bandwidth settings
+    float dataRateHz;
+}
+BMX055_SETTING;
+
+// Accelerometer range in g
+static const BMX055_SETTING g_accelRangeSettings[] =
+{
+    { 2.0f, ACC_2G, 0.0f }, { 4.0f, ACC_4G, 0.0f }, { 8.0f, ACC_8G, 0.0f }, { 16.0f, ACC_16G, 0.0f }
+};
+
+// Accelerometer filter bandwidth in Hz.  The output data rate is twice of it.
+static const BMX055_SETTING g_accelBandwidthSettings[] =
+{
+    { 7.81f, ACC_BW7R81Hz, 15.63f }, { 15.63f, ACC_BW15R63Hz, 31.25f }, { 31.25f, ACC_BW31R25Hz, 62.5f }, { 62.5f, ACC_BW62R5Hz, 125.0f },
+    { 125.0f, ACC_BW125Hz, 250.0f }, { 250.0f, ACC_BW250Hz, 500.0f }, { 500.0f, ACC_BW500Hz, 1000.0f }, { 1000.0f, ACC_BW1kHz, 2000.0f }
+};
+
+// Gyroscope range in deg/s
+static const BMX055_SETTING g_gyroRangeSettings[] =
+{
+    { 125.0f, GYR_125DPS, 0.0f }, { 250.0f, GYR_250DPS, 0.0f }, { 500.0f, GYR_500DPS, 0.0f }, { 1000.0f, GYR_1000DPS, 0.0f }, { 2000.0f, GYR_2000DPS, 0.0f }
+};
+
+// Gyroscope filter bandwidth in Hz.  Each comes with its own output data rate, see BMX055.h.
+static const BMX055_SETTING g_gyroBandwidthSettings[] =
+{
+    { 12.0f, GYR_100Hz12Hz, 100.0f }, { 23.0f, GYR_200Hz23Hz, 200.0f }, { 32.0f, GYR_100Hz32Hz, 100.0f }, { 47.0f, GYR_400Hz47Hz, 400.0f },
+    { 64.0f, GYR_200Hz64Hz, 200.0f }, { 116.0f, GYR_1000Hz116Hz, 1000.0f }, { 230.0f, GYR_2000Hz230Hz, 2000.0f }, { 523.0f, GYR_2000Hz523Hz, 2000.0f }
+};
+
+// Magnetometer output data rate in Hz
+static const BMX055_SETTING g_magnetOdrSettings[] =
+{
+    { 2.0f, MAG_ODR2Hz, 0.0f }, { 6.0f, MAG_ODR6Hz, 0.0f }, { 8.0f, MAG_ODR8Hz, 0.0f }, { 10.0f, MAG_ODR10Hz, 0.0f },
+    { 15.0f, MAG_ODR15Hz, 0.0f }, { 20.0f, MAG_ODR20Hz, 0.0f }, { 25.0f, MAG_ODR25Hz, 0.0f }, { 30.0f, MAG_ODR30Hz, 0.0f }
+};
+
+//
+// BMX055_SETTING_PROPERTY is a writable property of a field of BMX055_TypeDef
+//
+typedef struct BMX055_SETTING_PROPERTY_TAG
+{
+    const char* propertyName;
+    size_t fieldOffset;
+    const BMX055_SETTING* settings;
+    size_t numSettings;
+    // Depth of the FIFO the settings' data rate fills, 0 if they don't set a data rate
+    int fifoFrames;
+}
+BMX055_SETTING_PROPERTY;
+
+#define BMX055_SETTING_PROPERTY_ENTRY(name, field, settings, fifoFrames) { name, offsetof(BMX055_TypeDef, field), settings, sizeof(settings) / sizeof(settings[0]), fifoFrames }
+
+static const BMX055_SETTING_PROPERTY g_settingProperties[] =
+{
+    BMX055_SETTING_PROPERTY_ENTRY("accelRange", acc_fs, g_accelRangeSettings, 0),
+    BMX055_SETTING_PROPERTY_ENTRY("accelBandwidth", acc_bw, g_accelBandwidthSettings, BMX055_ACC_FIFO_FRAMES),
+    BMX055_SETTING_PROPERTY_ENTRY("gyroRange", gyr_fs, g_gyroRangeSettings, 0),
+    BMX055_SETTING_PROPERTY_ENTRY("gyroBandwidth", gyr_bw, g_gyroBandwidthSettings, BMX055_GYR_FIFO_FRAMES),
+    BMX055_SETTING_PROPERTY_ENTRY("magnetOdr", mag_odr, g_magnetOdrSettings, 0)
+};
+
+static const size_t g_numSettingProperties = sizeof(g_settingProperties) / sizeof(g_settingProperties[0]);
 
 //
 // PNP_MOTIONSENSORBMX055_COMPONENT represents motion sensor BMX055 component
@@ -54,89 +205,488 @@ typedef struct PNP_MOTIONSENSORBMX055_COMPONENT_TAG
     // Name of this component
     char componentName[PNP_MAXIMUM_COMPONENT_LENGTH + 1];
 
-    // 9-axis motion sensor data
-    BMX055_ACCEL_TypeDef  accel;
-    BMX055_GYRO_TypeDef   gyro;
+    // Statistics per axis of acceleration in g and of angular rate in deg/s with the bias removed, of the interval in progress, which
+    // the sampler adds every sample to, guarded by g_bmx055SampleMutex
+    STREAM_STATS accelInterval[3];
+    STREAM_STATS gyroInterval[3];
+
+    // Statistics of the last interval, which are sent
+    STREAM_STATS accelStats[3];
+    STREAM_STATS gyroStats[3];
+
+    // Calibrated magnetic field
     BMX055_MAGNET_TypeDef magnet;
     
     // Chip temperature
     float temp;
+
+    // Anomaly detector over the statistics of each interval, with the score of the last one and whether it was anomalous
+    ANOMALY_DETECTOR anomalyDetector;
+    float anomalyScore;
+    bool anomalous;
+
+    // Anomaly alert not sent yet: its score, the feature the score is of, and its value and baseline
+    bool anomalyPending;
+    float anomalyAlertScore;
+    size_t anomalyFeature;
+    float anomalyValue;
+    float anomalyBaseline;
+
+    // Next component in g_bmx055Components
+    struct PNP_MOTIONSENSORBMX055_COMPONENT_TAG* next;
 }
 PNP_MOTIONSENSORBMX055_COMPONENT;
 
-// Instance of motion sensor BMX055
-BMX055 g_bmx055(PD_0, PD_1);
+// Instance of motion sensor BMX055.  It is constructed by PnP_MotionSensorBMX055Component_InitSensor rather than
+// as a global object, because probing and configuring the chip sleeps for tens of milliseconds and would delay main().
+static BMX055 *g_bmx055 = NULL;
+
+// KVStore key of the addresses BMX055 was found at.  Probing them first on the following boots saves walking the others.
+static const char g_bmx055AddrCacheKey[] = "/kv/bmx055_addr";
+
+// Magic number of BMX055_ADDR_CACHE_RECORD, changed whenever its layout changes
+#define BMX055_ADDR_CACHE_MAGIC 0x424D5831
 
-// Send telemetry: one axis
-static void SendTelemetry_OneAxisOrTemp(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL, const char *telemetryBodyFormat, float telemetryData)
+typedef struct BMX055_ADDR_CACHE_RECORD_TAG
 {
-    PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component = (PNP_MOTIONSENSORBMX055_COMPONENT*)pnpMotionSensorBMX055ComponentHandle;
-    IOTHUB_MESSAGE_HANDLE messageHandle = NULL;
-    IOTHUB_CLIENT_RESULT iothubResult;
+    uint32_t magic;
+    BMX055_ADDR_INF_TypeDef addr;
+}
+BMX055_ADDR_CACHE_RECORD;
+
+// KVStore key of the magnetometer calibration, which is of the board the sensor is soldered on and so kept across boots
+static const char g_bmx055MagCalKey[] = "/kv/bmx055_magcal";
+
+// Magic number of BMX055_MAG_CAL_RECORD, changed whenever its layout changes
+#define BMX055_MAG_CAL_MAGIC 0x424D4331
+
+typedef struct BMX055_MAG_CAL_RECORD_TAG
+{
+    uint32_t magic;
+    MAG_CALIBRATION calibration;
+}
+BMX055_MAG_CAL_RECORD;
+
+// KVStore key of the offset compensation registers, which the chip forgets on power-off
+static const char g_bmx055OffsetKey[] = "/kv/bmx055_offset";
+
+// Magic number of BMX055_OFFSET_RECORD, changed whenever its layout changes
+#define BMX055_OFFSET_MAGIC 0x424D4F31
+
+typedef struct BMX055_OFFSET_RECORD_TAG
+{
+    uint32_t magic;
+    BMX055_OFFSET_TypeDef offset;
+}
+BMX055_OFFSET_RECORD;
+
+// Interrupt pins of BMX055.  With INT1 wired, a sampler thread reads the sensor on its data-ready or FIFO watermark interrupts,
+// and the MCU sleeps in between.  Otherwise the sampler polls the sensor, whose FIFOs keep the samples taken since.
+static const BMX055_INT_TypeDef g_bmx055Interrupts =
+{
+    MBED_CONF_APP_BMX055_INT1_PIN,
+    MBED_CONF_APP_BMX055_INT3_PIN,
+    MBED_CONF_APP_BMX055_FIFO_WATERMARK
+};
+
+// With INT1 wired, the sampler reads the FIFOs anyway if no interrupt comes in a second, in case an edge was missed.
+// Otherwise it drains them every bmx055_poll_period.
+static const uint32_t g_bmx055SamplerTimeoutMs = (g_bmx055Interrupts.acc_int1 != NC) ? 1000 : MBED_CONF_APP_BMX055_POLL_PERIOD;
+
+static Thread g_bmx055SamplerThread(osPriorityAboveNormal, 2048, nullptr, "bmx055Sampler");
+
+// Latest acceleration from the sampler, which gyroscope samples are paired with, and the components it adds samples to,
+// guarded by g_bmx055SampleMutex
+static Mutex g_bmx055SampleMutex;
+static BMX055_ACCEL_TypeDef g_bmx055LatestAccel;
+static PNP_MOTIONSENSORBMX055_COMPONENT* g_bmx055Components = NULL;
+
+// Bias of the gyroscope, learned from the samples whenever the device is still, guarded by g_bmx055SampleMutex
+static GYRO_BIAS g_bmx055GyroBias;
+
+// Calibration applied to the magnetometer, guarded by g_bmx055SampleMutex
+static MAG_CALIBRATION g_bmx055MagCalibration;
+
+// A calibration thread, started on the first calibrate command, takes g_bmx055CalibrationReads reads of the magnetometer, one per
+// g_bmx055CalibrationPeriodMs, whenever BMX055_CALIBRATION_START is set.  These are written only while no calibration is running.
+#define BMX055_CALIBRATION_START 0x01
+
+// Solving the fit takes about 1 KB of stack
+static Thread g_bmx055CalibrationThread(osPriorityBelowNormal, 3072, nullptr, "bmx055Calib");
+static bool g_bmx055CalibrationThreadStarted = false;
+static EventFlags g_bmx055CalibrationFlags;
+static uint32_t g_bmx055CalibrationReads;
+static uint32_t g_bmx055CalibrationPeriodMs;
+static MAG_CALIBRATION_FIT g_bmx055CalibrationFit;
+
+// State of the calibration, and its outcome not sent yet, guarded by g_bmx055SampleMutex
+static bool g_bmx055Calibrating = false;
+static bool g_bmx055CalibrationResultPending = false;
+static MAG_CALIBRATION_RESULT g_bmx055CalibrationResult;
+static uint32_t g_bmx055CalibrationSamples;
+
+// Settings of BMX055, set through the writable properties
+static BMX055_TypeDef g_bmx055Parameters = bmx055_std_paramtr;
+
+// Thresholds of the on-sensor engines, set through the writable properties
+static BMX055_ENGINE_TypeDef g_bmx055Engine = { 0.0f, 0.0f, 0.0f };
+
+//
+// BMX055_PENDING_EVENT is an event of an on-sensor engine not sent yet.  Repeats are coalesced until it is sent.
+//
+typedef struct BMX055_PENDING_EVENT_TAG
+{
+    const char* telemetryName;
+    uint8_t event;
+    uint32_t count;
+    char axis;
+    int sign;
+}
+BMX055_PENDING_EVENT;
+
+// Guarded by g_bmx055SampleMutex
+static BMX055_PENDING_EVENT g_bmx055PendingEvents[] =
+{
+    { "motionDetected", BMX055_EVT_MOTION, 0, 'x', 1 },
+    { "tap", BMX055_EVT_TAP, 0, 'x', 1 },
+    { "highG", BMX055_EVT_HIGH_G, 0, 'x', 1 }
+};
+
+static const size_t g_bmx055NumPendingEvents = sizeof(g_bmx055PendingEvents) / sizeof(g_bmx055PendingEvents[0]);
+
+//
+// BMX055_PollEvents reads the events the on-sensor engines latched, and queues them to be sent
+//
+static void BMX055_PollEvents(void)
+{
+    BMX055_EVENT_TypeDef evt;
+
+    if ((g_bmx055->engine_enabled() == false) || (g_bmx055->get_events(&evt) == 0))
+    {
+        return;
+    }
+
+    g_bmx055SampleMutex.lock();
+    for (size_t i = 0; i < g_bmx055NumPendingEvents; i++)
+    {
+        BMX055_PENDING_EVENT* pendingEvent = &g_bmx055PendingEvents[i];
+
+        if ((evt.events & pendingEvent->event) == 0)
+        {
+            continue;
+        }
 
-    char axisStringBuffer[32];
+        pendingEvent->count++;
+        if (pendingEvent->event == BMX055_EVT_MOTION)
+        {
+            pendingEvent->axis = evt.motion_axis;
+            pendingEvent->sign = evt.motion_sign;
+        }
+        else if (pendingEvent->event == BMX055_EVT_TAP)
+        {
+            pendingEvent->axis = evt.tap_axis;
+            pendingEvent->sign = evt.tap_sign;
+        }
+        else
+        {
+            pendingEvent->axis = evt.high_g_axis;
+            pendingEvent->sign = evt.high_g_sign;
+        }
+    }
+    g_bmx055SampleMutex.unlock();
+}
 
-    if (snprintf(axisStringBuffer, sizeof(axisStringBuffer), telemetryBodyFormat, telemetryData) < 0)
+//
+// BMX055_TrackAccel adds accelerometer samples to the interval of every component, and keeps the last one
+//
+static void BMX055_TrackAccel(const BMX055_ACCEL_TypeDef* accel, int frames)
+{
+    g_bmx055SampleMutex.lock();
+    for (PNP_MOTIONSENSORBMX055_COMPONENT* component = g_bmx055Components; component != NULL; component = component->next)
     {
-        LogError("snprintf of current 9-axis telemetry failed");
+        for (int i = 0; i < frames; i++)
+        {
+            StreamStats_Add(&component->accelInterval[0], accel[i].x);
+            StreamStats_Add(&component->accelInterval[1], accel[i].y);
+            StreamStats_Add(&component->accelInterval[2], accel[i].z);
+        }
     }
-    else if ((messageHandle = PnP_CreateTelemetryMessageHandle(pnpMotionSensorBMX055Component->componentName, axisStringBuffer)) == NULL)
+    g_bmx055LatestAccel = accel[frames - 1];
+    g_bmx055SampleMutex.unlock();
+}
+
+//
+// BMX055_TrackGyro feeds gyroscope samples to the bias estimator, paired with the latest acceleration, and adds them with the bias
+// removed to the interval of every component
+//
+static void BMX055_TrackGyro(const BMX055_GYRO_TypeDef* gyro, int frames)
+{
+    g_bmx055SampleMutex.lock();
+    for (int i = 0; i < frames; i++)
     {
-        LogError("Unable to create telemetry message");
+        float rate[3] = { gyro[i].x, gyro[i].y, gyro[i].z };
+        const float accel[3] = { g_bmx055LatestAccel.x, g_bmx055LatestAccel.y, g_bmx055LatestAccel.z };
+
+        GyroBias_Add(&g_bmx055GyroBias, rate, accel);
+        GyroBias_Apply(&g_bmx055GyroBias, rate, rate);
+
+        for (PNP_MOTIONSENSORBMX055_COMPONENT* component = g_bmx055Components; component != NULL; component = component->next)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                StreamStats_Add(&component->gyroInterval[axis], rate[axis]);
+            }
+        }
     }
-    else if ((iothubResult = IoTHubDeviceClient_LL_SendEventAsync(deviceClientLL, messageHandle, NULL, NULL)) != IOTHUB_CLIENT_OK)
+    g_bmx055SampleMutex.unlock();
+}
+
+//
+// BMX055_SamplerThread drains the accelerometer and gyroscope FIFOs of BMX055 whenever they interrupt, or on every poll without
+// interrupt pins
+//
+static void BMX055_SamplerThread(void)
+{
+    BMX055_ACCEL_TypeDef accel[BMX055_ACC_FIFO_FRAMES];
+    // Gyroscope FIFO is read in chunks of the accelerometer FIFO depth
+    BMX055_GYRO_TypeDef gyro[BMX055_ACC_FIFO_FRAMES];
+
+    while (true)
     {
-        LogError("Unable to send telemetry message, error=%d", iothubResult);
+        uint32_t sources = g_bmx055->wait_for_data(g_bmx055SamplerTimeoutMs);
+        if (sources == 0)
+        {
+            sources = BMX055_INT_ACC | BMX055_INT_GYR;
+        }
+
+        if ((sources & BMX055_INT_ACC) != 0)
+        {
+            // Engines share INT1 with data-ready or FIFO watermark
+            BMX055_PollEvents();
+
+            int frames;
+            do
+            {
+                uint32_t probeStart = LatencyProbe_Start();
+                frames = g_bmx055->get_accel_fifo(accel, BMX055_ACC_FIFO_FRAMES);
+                LatencyProbe_Stop(LATENCY_PROBE_I2C_READ, probeStart);
+
+                if (frames > 0)
+                {
+                    BMX055_TrackAccel(accel, frames);
+                }
+            }
+            while (frames == BMX055_ACC_FIFO_FRAMES);
+
+            // Without INT3, the gyroscope FIFO is drained along with the accelerometer's
+            if (g_bmx055Interrupts.gyr_int3 == NC)
+            {
+                sources |= BMX055_INT_GYR;
+            }
+        }
+
+        if ((sources & BMX055_INT_GYR) != 0)
+        {
+            int frames;
+            do
+            {
+                frames = g_bmx055->get_gyro_fifo(gyro, BMX055_ACC_FIFO_FRAMES);
+
+                if (frames > 0)
+                {
+                    BMX055_TrackGyro(gyro, frames);
+                }
+            }
+            while (frames == BMX055_ACC_FIFO_FRAMES);
+        }
     }
+}
+
+//
+// ReadMagnet reads the magnetic field into the component, calibrated.  It is left unchanged on overflow.
+//
+static void ReadMagnet(PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component)
+{
+    BMX055_MAGNET_TypeDef magnet;
+
+    uint32_t probeStart = LatencyProbe_Start();
+    bool valid = g_bmx055->get_magnet(&magnet);
+    LatencyProbe_Stop(LATENCY_PROBE_I2C_READ, probeStart);
+
+    if (valid)
+    {
+        float field[3] = { magnet.x, magnet.y, magnet.z };
 
-    IoTHubMessage_Destroy(messageHandle);
+        g_bmx055SampleMutex.lock();
+        MagCalibration_Apply(&g_bmx055MagCalibration, field, field);
+        g_bmx055SampleMutex.unlock();
+
+        pnpMotionSensorBMX055Component->magnet.x = field[0];
+        pnpMotionSensorBMX055Component->magnet.y = field[1];
+        pnpMotionSensorBMX055Component->magnet.z = field[2];
+    }
 }
 
-// Send telemetry: acceleration x/y/z
-static void SendTelemetry_Accel(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL)
+//
+// BMX055_LoadOffset writes the offset compensation registers of the last compensation, kept in KVStore, into the chip
+//
+static void BMX055_LoadOffset(void)
 {
-    PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component = (PNP_MOTIONSENSORBMX055_COMPONENT*)pnpMotionSensorBMX055ComponentHandle;
+    BMX055_OFFSET_RECORD record;
+    size_t actualSize = 0;
 
-    g_bmx055.get_accel(&pnpMotionSensorBMX055Component->accel);
-    SendTelemetry_OneAxisOrTemp(pnpMotionSensorBMX055ComponentHandle, deviceClientLL, g_accelXTelemetryBodyFormat, pnpMotionSensorBMX055Component->accel.x);
-    SendTelemetry_OneAxisOrTemp(pnpMotionSensorBMX055ComponentHandle, deviceClientLL, g_accelYTelemetryBodyFormat, pnpMotionSensorBMX055Component->accel.y);
-    SendTelemetry_OneAxisOrTemp(pnpMotionSensorBMX055ComponentHandle, deviceClientLL, g_accelZTelemetryBodyFormat, pnpMotionSensorBMX055Component->accel.z);
+    if ((kv_get(g_bmx055OffsetKey, &record, sizeof(record), &actualSize) == 0) &&
+        (actualSize == sizeof(record)) &&
+        (record.magic == BMX055_OFFSET_MAGIC))
+    {
+        g_bmx055->set_offset(&record.offset);
+    }
 }
 
-// Send telemetry: gyroscope x/y/z
-static void SendTelemetry_Gyro(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL)
+//
+// BMX055_LoadMagCalibration reads the magnetometer calibration from KVStore, or leaves the magnetometer uncalibrated if there is none
+//
+static void BMX055_LoadMagCalibration(void)
 {
-    PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component = (PNP_MOTIONSENSORBMX055_COMPONENT*)pnpMotionSensorBMX055ComponentHandle;
+    BMX055_MAG_CAL_RECORD record;
+    size_t actualSize = 0;
+
+    if ((kv_get(g_bmx055MagCalKey, &record, sizeof(record), &actualSize) == 0) &&
+        (actualSize == sizeof(record)) &&
+        (record.magic == BMX055_MAG_CAL_MAGIC))
+    {
+        g_bmx055MagCalibration = record.calibration;
+        LogInfo("BMX055 magnetometer calibrated, field strength %.02f uT", record.calibration.fieldStrength);
+    }
+    else
+    {
+        MagCalibration_Identity(&g_bmx055MagCalibration);
+    }
+}
 
-    g_bmx055.get_gyro(&pnpMotionSensorBMX055Component->gyro);
-    SendTelemetry_OneAxisOrTemp(pnpMotionSensorBMX055ComponentHandle, deviceClientLL, g_gyroXTelemetryBodyFormat, pnpMotionSensorBMX055Component->gyro.x);
-    SendTelemetry_OneAxisOrTemp(pnpMotionSensorBMX055ComponentHandle, deviceClientLL, g_gyroYTelemetryBodyFormat, pnpMotionSensorBMX055Component->gyro.y);
-    SendTelemetry_OneAxisOrTemp(pnpMotionSensorBMX055ComponentHandle, deviceClientLL, g_gyroZTelemetryBodyFormat, pnpMotionSensorBMX055Component->gyro.z);
+//
+// BMX055_StoreMagCalibration writes calibration to KVStore
+//
+static void BMX055_StoreMagCalibration(const MAG_CALIBRATION* calibration)
+{
+    BMX055_MAG_CAL_RECORD record;
+    int kvResult;
+
+    record.magic = BMX055_MAG_CAL_MAGIC;
+    record.calibration = *calibration;
+    if ((kvResult = kv_set(g_bmx055MagCalKey, &record, sizeof(record), 0)) != 0)
+    {
+        LogError("Unable to store BMX055 magnetometer calibration, error=%d", kvResult);
+    }
 }
 
-// Send telemetry: magnetometer x/y/z
-static void SendTelemetry_Magnet(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL)
+//
+// BMX055_CalibrationThread fits the magnetometer samples of each calibration, and applies and stores the calibration if it fits
+//
+static void BMX055_CalibrationThread(void)
 {
-    PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component = (PNP_MOTIONSENSORBMX055_COMPONENT*)pnpMotionSensorBMX055ComponentHandle;
+    while (true)
+    {
+        g_bmx055CalibrationFlags.wait_any(BMX055_CALIBRATION_START);
+
+        MagCalibration_FitReset(&g_bmx055CalibrationFit);
+        for (uint32_t i = 0; i < g_bmx055CalibrationReads; i++)
+        {
+            BMX055_MAGNET_TypeDef magnet;
+
+            if (g_bmx055->get_magnet(&magnet) == true)
+            {
+                float field[3] = { magnet.x, magnet.y, magnet.z };
+
+                MagCalibration_FitAdd(&g_bmx055CalibrationFit, field);
+            }
+            ThisThread::sleep_for(std::chrono::milliseconds(g_bmx055CalibrationPeriodMs));
+        }
+
+        MAG_CALIBRATION calibration;
+        MAG_CALIBRATION_RESULT result = MagCalibration_FitSolve(&g_bmx055CalibrationFit, &calibration);
+
+        if (result == MAG_CALIBRATION_OK)
+        {
+            LogInfo("BMX055 magnetometer calibrated from %lu samples, offset %.02f %.02f %.02f uT, field strength %.02f uT",
+                    (unsigned long)g_bmx055CalibrationFit.numSamples, calibration.offset[0], calibration.offset[1], calibration.offset[2],
+                    calibration.fieldStrength);
+            BMX055_StoreMagCalibration(&calibration);
+        }
+        else
+        {
+            LogError("BMX055 magnetometer calibration failed from %lu samples: %s", (unsigned long)g_bmx055CalibrationFit.numSamples,
+                     MagCalibration_ResultString(result));
+        }
+
+        g_bmx055SampleMutex.lock();
+        if (result == MAG_CALIBRATION_OK)
+        {
+            g_bmx055MagCalibration = calibration;
+        }
+        g_bmx055CalibrationResult = result;
+        g_bmx055CalibrationSamples = g_bmx055CalibrationFit.numSamples;
+        g_bmx055CalibrationResultPending = true;
+        g_bmx055Calibrating = false;
+        g_bmx055SampleMutex.unlock();
+    }
+}
+
+//
+// BMX055_CreateWithAddrCache constructs g_bmx055, probing the addresses cached in KVStore first, and updates the cache
+//
+static void BMX055_CreateWithAddrCache(void)
+{
+    BMX055_ADDR_CACHE_RECORD record;
+    size_t actualSize = 0;
+    bool cached = (kv_get(g_bmx055AddrCacheKey, &record, sizeof(record), &actualSize) == 0) &&
+                  (actualSize == sizeof(record)) &&
+                  (record.magic == BMX055_ADDR_CACHE_MAGIC);
+
+    g_bmx055 = new BMX055(PD_0, PD_1, cached ? &record.addr : NULL);
 
-    g_bmx055.get_magnet(&pnpMotionSensorBMX055Component->magnet);
-    SendTelemetry_OneAxisOrTemp(pnpMotionSensorBMX055ComponentHandle, deviceClientLL, g_magnetXTelemetryBodyFormat, pnpMotionSensorBMX055Component->magnet.x);
-    SendTelemetry_OneAxisOrTemp(pnpMotionSensorBMX055ComponentHandle, deviceClientLL, g_magnetYTelemetryBodyFormat, pnpMotionSensorBMX055Component->magnet.y);
-    SendTelemetry_OneAxisOrTemp(pnpMotionSensorBMX055ComponentHandle, deviceClientLL, g_magnetZTelemetryBodyFormat, pnpMotionSensorBMX055Component->magnet.z);
+    BMX055_ADDR_INF_TypeDef found;
+    g_bmx055->read_addr_inf(&found);
+
+    if ((g_bmx055->chip_ready() == true) &&
+        ((cached == false) || (memcmp(&found, &record.addr, sizeof(found)) != 0)))
+    {
+        int kvResult;
+
+        record.magic = BMX055_ADDR_CACHE_MAGIC;
+        record.addr = found;
+        if ((kvResult = kv_set(g_bmx055AddrCacheKey, &record, sizeof(record), 0)) != 0)
+        {
+            LogError("Unable to cache BMX055 addresses, error=%d", kvResult);
+        }
+    }
 }
 
-// Send telemetry: temperature
-static void SendTelemetry_Temp(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL)
+bool PnP_MotionSensorBMX055Component_InitSensor(void)
 {
-    PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component = (PNP_MOTIONSENSORBMX055_COMPONENT*)pnpMotionSensorBMX055ComponentHandle;
+    if (g_bmx055 == NULL)
+    {
+        BMX055_CreateWithAddrCache();
+        BMX055_LoadOffset();
+        BMX055_LoadMagCalibration();
+        GyroBias_Init(&g_bmx055GyroBias);
 
-    pnpMotionSensorBMX055Component->temp = g_bmx055.get_chip_temperature();
-    SendTelemetry_OneAxisOrTemp(pnpMotionSensorBMX055ComponentHandle, deviceClientLL, g_tempTelemetryBodyFormat, pnpMotionSensorBMX055Component->temp);
+        if (g_bmx055->chip_ready() == true)
+        {
+            if (g_bmx055Interrupts.acc_int1 != NC)
+            {
+                g_bmx055->set_interrupt(&g_bmx055Interrupts);
+            }
+            g_bmx055SamplerThread.start(BMX055_SamplerThread);
+        }
+    }
+
+    return g_bmx055->chip_ready();
 }
 
 PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE PnP_MotionSensorBMX055Component_CreateHandle(const char* componentName)
 {
-    if (g_bmx055.chip_ready() == 0)
+    if (PnP_MotionSensorBMX055Component_InitSensor() == false)
     {
         LogError("Bosch BMX055 is NOT available!!\r\n");
         return NULL;
@@ -158,18 +708,27 @@ PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE PnP_MotionSensorBMX055Component_CreateHa
         strcpy(motionSensorBMX055Component->componentName, componentName);
 
         // Default 9-axis motion sensor data
-        motionSensorBMX055Component->accel.x = 0.0f;
-        motionSensorBMX055Component->accel.y = 0.0f;
-        motionSensorBMX055Component->accel.z = 0.0f;
-        motionSensorBMX055Component->gyro.x = 0.0f;
-        motionSensorBMX055Component->gyro.y = 0.0f;
-        motionSensorBMX055Component->gyro.z = 0.0f;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            StreamStats_Reset(&motionSensorBMX055Component->accelInterval[axis]);
+            StreamStats_Reset(&motionSensorBMX055Component->gyroInterval[axis]);
+            StreamStats_Reset(&motionSensorBMX055Component->accelStats[axis]);
+            StreamStats_Reset(&motionSensorBMX055Component->gyroStats[axis]);
+        }
         motionSensorBMX055Component->magnet.x = 0.0f;
         motionSensorBMX055Component->magnet.y = 0.0f;
         motionSensorBMX055Component->magnet.z = 0.0f;
 
         // Default chip temperature
         motionSensorBMX055Component->temp = 0.0f;
+
+        AnomalyDetector_Init(&motionSensorBMX055Component->anomalyDetector, BMX055_NUM_ANOMALY_FEATURES, g_anomalyFeatureMinSigma);
+
+        // Samples go to the component from now on
+        g_bmx055SampleMutex.lock();
+        motionSensorBMX055Component->next = g_bmx055Components;
+        g_bmx055Components = motionSensorBMX055Component;
+        g_bmx055SampleMutex.unlock();
     }
 
     return (PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE)motionSensorBMX055Component;
@@ -179,8 +738,169 @@ void PnP_MotionSensorBMX055Component_Destroy(PNP_MOTIONSENSORBMX055_COMPONENT_HA
 {
     if (pnpMotionSensorBMX055ComponentHandle != NULL)
     {
-        free(pnpMotionSensorBMX055ComponentHandle);
+        PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component = (PNP_MOTIONSENSORBMX055_COMPONENT*)pnpMotionSensorBMX055ComponentHandle;
+
+        g_bmx055SampleMutex.lock();
+        for (PNP_MOTIONSENSORBMX055_COMPONENT** link = &g_bmx055Components; *link != NULL; link = &(*link)->next)
+        {
+            if (*link == pnpMotionSensorBMX055Component)
+            {
+                *link = pnpMotionSensorBMX055Component->next;
+                break;
+            }
+        }
+        g_bmx055SampleMutex.unlock();
+
+        free(pnpMotionSensorBMX055Component);
+    }
+}
+
+//
+// SetCommandResponse copies the JSON body into a response of a command, which the IoT SDK frees with free()
+//
+static int SetCommandResponse(const char* body, int result, unsigned char** response, size_t* responseSize)
+{
+    size_t bodySize = strlen(body);
+
+    if ((*response = (unsigned char*)malloc(bodySize)) == NULL)
+    {
+        LogError("Unable to allocate command response");
+        return PNP_STATUS_INTERNAL_ERROR;
+    }
+
+    memcpy(*response, body, bodySize);
+    *responseSize = bodySize;
+    return result;
+}
+
+//
+// StartCalibration starts a magnetometer calibration of the seconds in commandJsonValue, or of g_defaultCalibrationSeconds if it is null.
+// The outcome is sent as the magnetCalibration event when done.
+//
+static int StartCalibration(JSON_Value* commandJsonValue, unsigned char** response, size_t* responseSize)
+{
+    uint32_t seconds = g_defaultCalibrationSeconds;
+    char body[64];
+
+    if (json_value_get_type(commandJsonValue) == JSONNumber)
+    {
+        double requested = json_value_get_number(commandJsonValue);
+
+        if ((requested < g_minCalibrationSeconds) || (requested > g_maxCalibrationSeconds))
+        {
+            LogError("Calibration of %f seconds is out of range [%lu, %lu]", requested, (unsigned long)g_minCalibrationSeconds, (unsigned long)g_maxCalibrationSeconds);
+            return SetCommandResponse("{\"status\":\"duration out of range\"}", PNP_STATUS_BAD_FORMAT, response, responseSize);
+        }
+        seconds = (uint32_t)requested;
+    }
+    else if (json_value_get_type(commandJsonValue) != JSONNull)
+    {
+        LogError("Calibration duration is not a number");
+        return SetCommandResponse("{\"status\":\"duration not a number\"}", PNP_STATUS_BAD_FORMAT, response, responseSize);
+    }
+
+    g_bmx055SampleMutex.lock();
+    bool calibrating = g_bmx055Calibrating;
+    g_bmx055Calibrating = true;
+    g_bmx055SampleMutex.unlock();
+
+    if (calibrating)
+    {
+        return SetCommandResponse("{\"status\":\"already calibrating\"}", PNP_STATUS_CONFLICT, response, responseSize);
+    }
+
+    // One read per sample at the data rate of the magnetometer
+    float odrHz = g_magnetOdrSettings[0].value;
+    for (size_t i = 0; i < sizeof(g_magnetOdrSettings) / sizeof(g_magnetOdrSettings[0]); i++)
+    {
+        if (g_magnetOdrSettings[i].setting == g_bmx055Parameters.mag_odr)
+        {
+            odrHz = g_magnetOdrSettings[i].value;
+        }
+    }
+    g_bmx055CalibrationPeriodMs = (uint32_t)(1000.0f / odrHz);
+    g_bmx055CalibrationReads = seconds * 1000 / g_bmx055CalibrationPeriodMs;
+
+    if (g_bmx055CalibrationThreadStarted == false)
+    {
+        g_bmx055CalibrationThread.start(BMX055_CalibrationThread);
+        g_bmx055CalibrationThreadStarted = true;
+    }
+    g_bmx055CalibrationFlags.set(BMX055_CALIBRATION_START);
+
+    LogInfo("Calibrating BMX055 magnetometer for %lu seconds, turn the device around all axes", (unsigned long)seconds);
+
+    snprintf(body, sizeof(body), "{\"status\":\"started\",\"durationSeconds\":%lu}", (unsigned long)seconds);
+    return SetCommandResponse(body, PNP_STATUS_SUCCESS, response, responseSize);
+}
+
+//
+// CompensateOffsets runs the fast offset compensation with the axis in commandJsonValue pointing up, "+z" if it is null, and stores
+// the offsets in KVStore.  This blocks for the 64 samples the gyroscope averages, well under a second.
+//
+static int CompensateOffsets(JSON_Value* commandJsonValue, unsigned char** response, size_t* responseSize)
+{
+    const char* upAxis = "+z";
+    uint8_t accelTarget[3] = { BMX055_FOC_0G, BMX055_FOC_0G, BMX055_FOC_0G };
+    char body[128];
+
+    if (json_value_get_type(commandJsonValue) == JSONString)
+    {
+        upAxis = json_value_get_string(commandJsonValue);
+    }
+    else if (json_value_get_type(commandJsonValue) != JSONNull)
+    {
+        upAxis = "";
+    }
+
+    if ((strlen(upAxis) != 2) || ((upAxis[0] != '+') && (upAxis[0] != '-')) || (upAxis[1] < 'x') || (upAxis[1] > 'z'))
+    {
+        LogError("Axis pointing up is not one of +x, -x, +y, -y, +z and -z");
+        return SetCommandResponse("{\"status\":\"axis not one of +x, -x, +y, -y, +z and -z\"}", PNP_STATUS_BAD_FORMAT, response, responseSize);
+    }
+    accelTarget[upAxis[1] - 'x'] = (upAxis[0] == '+') ? BMX055_FOC_PLUS_1G : BMX055_FOC_MINUS_1G;
+
+    if (g_bmx055->fast_offset_compensation(accelTarget) == false)
+    {
+        LogError("BMX055 fast offset compensation timed out");
+        return SetCommandResponse("{\"status\":\"timed out\"}", PNP_STATUS_INTERNAL_ERROR, response, responseSize);
+    }
+
+    BMX055_OFFSET_RECORD record;
+    int kvResult;
+
+    record.magic = BMX055_OFFSET_MAGIC;
+    g_bmx055->get_offset(&record.offset);
+    if ((kvResult = kv_set(g_bmx055OffsetKey, &record, sizeof(record), 0)) != 0)
+    {
+        LogError("Unable to store BMX055 offsets, error=%d", kvResult);
     }
+
+    // The chip removes the bias now, so whatever was learned is stale
+    g_bmx055SampleMutex.lock();
+    GyroBias_Init(&g_bmx055GyroBias);
+    g_bmx055SampleMutex.unlock();
+
+    LogInfo("BMX055 offsets compensated with %s up", upAxis);
+
+    snprintf(body, sizeof(body), g_compensateOffsetsResponseFormat,
+             record.offset.acc[0], record.offset.acc[1], record.offset.acc[2], record.offset.gyr[0], record.offset.gyr[1], record.offset.gyr[2]);
+    return SetCommandResponse(body, PNP_STATUS_SUCCESS, response, responseSize);
+}
+
+//
+// ResetBaseline forgets the anomaly baseline of the component, which is learned again from the following intervals
+//
+static int ResetBaseline(PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component, unsigned char** response, size_t* responseSize)
+{
+    AnomalyDetector_Reset(&pnpMotionSensorBMX055Component->anomalyDetector);
+    pnpMotionSensorBMX055Component->anomalyScore = 0.0f;
+    pnpMotionSensorBMX055Component->anomalous = false;
+    pnpMotionSensorBMX055Component->anomalyPending = false;
+
+    LogInfo("Learning anomaly baseline of %s again", pnpMotionSensorBMX055Component->componentName);
+
+    return SetCommandResponse("{\"status\":\"success\"}", PNP_STATUS_SUCCESS, response, responseSize);
 }
 
 int PnP_MotionSensorBMX055Component_ProcessCommand(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, const char *pnpCommandName, JSON_Value* commandJsonValue, unsigned char** response, size_t* responseSize)
@@ -188,23 +908,329 @@ int PnP_MotionSensorBMX055Component_ProcessCommand(PNP_MOTIONSENSORBMX055_COMPON
     PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component = (PNP_MOTIONSENSORBMX055_COMPONENT*)pnpMotionSensorBMX055ComponentHandle;
     int result;
 
-    LogError("PnP command=%s is not supported on %s component", pnpCommandName, pnpMotionSensorBMX055Component->componentName);
-    result = PNP_STATUS_NOT_FOUND;
+    if (strcmp(pnpCommandName, g_calibrateCommandName) == 0)
+    {
+        result = StartCalibration(commandJsonValue, response, responseSize);
+    }
+    else if (strcmp(pnpCommandName, g_compensateOffsetsCommandName) == 0)
+    {
+        result = CompensateOffsets(commandJsonValue, response, responseSize);
+    }
+    else if (strcmp(pnpCommandName, g_resetBaselineCommandName) == 0)
+    {
+        result = ResetBaseline(pnpMotionSensorBMX055Component, response, responseSize);
+    }
+    else
+    {
+        LogError("PnP command=%s is not supported on %s component", pnpCommandName, pnpMotionSensorBMX055Component->componentName);
+        result = PNP_STATUS_NOT_FOUND;
+    }
 
     return result;
 }
 
+//
+// ReportWritableProperty sends a reported property acknowledging an update of a writable property
+//
+static void ReportWritableProperty(PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL, const char* propertyName, float value, int result, const char* description, int version)
+{
+    IOTHUB_CLIENT_RESULT iothubClientResult;
+    char valueString[16];
+    char* jsonToSend = NULL;
+
+    snprintf(valueString, sizeof(valueString), "%g", value);
+
+    if ((jsonToSend = PnP_FormatReportedPropertyWithStatus(pnpMotionSensorBMX055Component->componentName, propertyName, valueString, result, description, version)) == NULL)
+    {
+        LogError("Unable to build reported property response for propertyName=%s", propertyName);
+    }
+    else if ((iothubClientResult = IoTHubDeviceClient_LL_SendReportedState(deviceClientLL, (const unsigned char*)jsonToSend, strlen(jsonToSend), NULL, NULL)) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Unable to send reported state for property=%s, error=%d", propertyName, iothubClientResult);
+    }
+    else
+    {
+        LogInfo("Sending %s property to IoTHub", propertyName);
+    }
+
+    PnP_MemPool_Free(jsonToSend);
+}
+
+//
+// IsSettingDrainedInTime returns whether the sampler drains the FIFO settingProperty fills before it overflows with setting,
+// with half a poll period to spare.  Without INT1, the FIFOs are drained every poll, whatever their data rate; with it,
+// they are drained on their own watermark or data-ready interrupts.
+//
+static bool IsSettingDrainedInTime(const BMX055_SETTING_PROPERTY* settingProperty, const BMX055_SETTING* setting)
+{
+    if ((settingProperty->fifoFrames == 0) || (g_bmx055Interrupts.acc_int1 != NC))
+    {
+        return true;
+    }
+
+    float fillMs = (float)settingProperty->fifoFrames * 1000.0f / setting->dataRateHz;
+
+    return fillMs >= (float)g_bmx055SamplerTimeoutMs * 1.5f;
+}
+
+//
+// ProcessSettingUpdate applies the supported setting nearest to the value requested for settingProperty, live through BMX055::set_parameter,
+// and reports the value applied.  Data rates whose FIFO would overflow between polls are not supported.
+//
+static void ProcessSettingUpdate(PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL, const BMX055_SETTING_PROPERTY* settingProperty, JSON_Value* propertyValue, int version)
+{
+    uint8_t* field = (uint8_t*)&g_bmx055Parameters + settingProperty->fieldOffset;
+    const BMX055_SETTING* current = &settingProperty->settings[0];
+    const BMX055_SETTING* nearest = NULL;
+    const BMX055_SETTING* nearestAny = &settingProperty->settings[0];
+
+    for (size_t i = 0; i < settingProperty->numSettings; i++)
+    {
+        if (settingProperty->settings[i].setting == *field)
+        {
+            current = &settingProperty->settings[i];
+        }
+    }
+
+    if (json_value_get_type(propertyValue) != JSONNumber)
+    {
+        LogError("JSON field %s is not a number", settingProperty->propertyName);
+        ReportWritableProperty(pnpMotionSensorBMX055Component, deviceClientLL, settingProperty->propertyName, current->value, PNP_STATUS_BAD_FORMAT, "not a number", version);
+        return;
+    }
+
+    float requested = (float)json_value_get_number(propertyValue);
+
+    for (size_t i = 0; i < settingProperty->numSettings; i++)
+    {
+        const BMX055_SETTING* setting = &settingProperty->settings[i];
+
+        if (fabsf(setting->value - requested) < fabsf(nearestAny->value - requested))
+        {
+            nearestAny = setting;
+        }
+        if (IsSettingDrainedInTime(settingProperty, setting) &&
+            ((nearest == NULL) || (fabsf(setting->value - requested) < fabsf(nearest->value - requested))))
+        {
+            nearest = setting;
+        }
+    }
+
+    // Should bmx055_poll_period be too long for any data rate, the lowest, listed first, loses the fewest samples
+    if (nearest == NULL)
+    {
+        nearest = &settingProperty->settings[0];
+    }
+
+    LogInfo("Received %s=%g for component=%s, applying %g", settingProperty->propertyName, requested, pnpMotionSensorBMX055Component->componentName, nearest->value);
+
+    if (nearest->setting != *field)
+    {
+        *field = nearest->setting;
+        g_bmx055->set_parameter(&g_bmx055Parameters);
+    }
+
+    ReportWritableProperty(pnpMotionSensorBMX055Component, deviceClientLL, settingProperty->propertyName, nearest->value, PNP_STATUS_SUCCESS,
+                           (nearest->value == requested) ? "success" :
+                           ((nearest != nearestAny) ? "limited to the data rate bmx055_poll_period drains" : "nearest supported value"), version);
+}
+
 void PnP_MotionSensorBMX055Component_ProcessPropertyUpdate(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL, const char* propertyName, JSON_Value* propertyValue, int version)
 {
     PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component = (PNP_MOTIONSENSORBMX055_COMPONENT*)pnpMotionSensorBMX055ComponentHandle;
+    float* threshold;
+
+    for (size_t i = 0; i < g_numSettingProperties; i++)
+    {
+        if (strcmp(propertyName, g_settingProperties[i].propertyName) == 0)
+        {
+            ProcessSettingUpdate(pnpMotionSensorBMX055Component, deviceClientLL, &g_settingProperties[i], propertyValue, version);
+            return;
+        }
+    }
+
+    if (strcmp(propertyName, g_motionThresholdPropertyName) == 0)
+    {
+        threshold = &g_bmx055Engine.motion_th;
+    }
+    else if (strcmp(propertyName, g_tapThresholdPropertyName) == 0)
+    {
+        threshold = &g_bmx055Engine.tap_th;
+    }
+    else if (strcmp(propertyName, g_highGThresholdPropertyName) == 0)
+    {
+        threshold = &g_bmx055Engine.high_g_th;
+    }
+    else
+    {
+        LogError("Property=%s was requested to be changed but is not part of the %s interface definition", propertyName, pnpMotionSensorBMX055Component->componentName);
+        return;
+    }
+
+    if (json_value_get_type(propertyValue) != JSONNumber)
+    {
+        LogError("JSON field %s is not a number", propertyName);
+        ReportWritableProperty(pnpMotionSensorBMX055Component, deviceClientLL, propertyName, *threshold, PNP_STATUS_BAD_FORMAT, "not a number", version);
+    }
+    else if ((json_value_get_number(propertyValue) < 0.0) || (json_value_get_number(propertyValue) > g_maxThresholdG))
+    {
+        LogError("%s=%f is out of range [0, %.0f]", propertyName, json_value_get_number(propertyValue), g_maxThresholdG);
+        ReportWritableProperty(pnpMotionSensorBMX055Component, deviceClientLL, propertyName, *threshold, PNP_STATUS_BAD_FORMAT, "out of range", version);
+    }
+    else
+    {
+        *threshold = (float)json_value_get_number(propertyValue);
+
+        LogInfo("Received %s=%.03f g for component=%s", propertyName, *threshold, pnpMotionSensorBMX055Component->componentName);
+
+        g_bmx055->set_engine(&g_bmx055Engine);
+        ReportWritableProperty(pnpMotionSensorBMX055Component, deviceClientLL, propertyName, *threshold, PNP_STATUS_SUCCESS, "success", version);
+    }
+}
+
+//
+// ScoreAnomaly scores the statistics of the last interval against the anomaly baseline, and raises an alert when they turn anomalous
+//
+static void ScoreAnomaly(PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component)
+{
+    float features[BMX055_NUM_ANOMALY_FEATURES];
+    size_t feature;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        features[axis] = StreamStats_StdDev(&pnpMotionSensorBMX055Component->accelStats[axis]);
+        features[3 + axis] = StreamStats_StdDev(&pnpMotionSensorBMX055Component->gyroStats[axis]);
+    }
+
+    float score = AnomalyDetector_Add(&pnpMotionSensorBMX055Component->anomalyDetector, features, g_anomalyThreshold, &feature);
+    bool anomalous = (score > g_anomalyThreshold);
+
+    // One alert per anomaly, however many intervals it lasts.  Anomalous intervals are not learned, so the baseline is as before it.
+    if (anomalous && (pnpMotionSensorBMX055Component->anomalous == false))
+    {
+        pnpMotionSensorBMX055Component->anomalyPending = true;
+        pnpMotionSensorBMX055Component->anomalyAlertScore = score;
+        pnpMotionSensorBMX055Component->anomalyFeature = feature;
+        pnpMotionSensorBMX055Component->anomalyValue = features[feature];
+        pnpMotionSensorBMX055Component->anomalyBaseline = pnpMotionSensorBMX055Component->anomalyDetector.mean[feature];
+
+        LogInfo("Anomaly on %s: %s=%.04f, baseline %.04f, score %.02f", pnpMotionSensorBMX055Component->componentName,
+                g_anomalyFeatureNames[feature], features[feature], pnpMotionSensorBMX055Component->anomalyDetector.mean[feature], score);
+    }
+
+    pnpMotionSensorBMX055Component->anomalyScore = score;
+    pnpMotionSensorBMX055Component->anomalous = anomalous;
+}
+
+bool PnP_MotionSensorBMX055Component_Sample(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle)
+{
+    PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component = (PNP_MOTIONSENSORBMX055_COMPONENT*)pnpMotionSensorBMX055ComponentHandle;
+
+    // Close the interval: take its statistics to send, and start the next one
+    g_bmx055SampleMutex.lock();
+    memcpy(pnpMotionSensorBMX055Component->accelStats, pnpMotionSensorBMX055Component->accelInterval, sizeof(pnpMotionSensorBMX055Component->accelStats));
+    memcpy(pnpMotionSensorBMX055Component->gyroStats, pnpMotionSensorBMX055Component->gyroInterval, sizeof(pnpMotionSensorBMX055Component->gyroStats));
+    for (int axis = 0; axis < 3; axis++)
+    {
+        StreamStats_Reset(&pnpMotionSensorBMX055Component->accelInterval[axis]);
+        StreamStats_Reset(&pnpMotionSensorBMX055Component->gyroInterval[axis]);
+    }
+    g_bmx055SampleMutex.unlock();
+
+    if (pnpMotionSensorBMX055Component->accelStats[0].count == 0)
+    {
+        return false;
+    }
+
+    ScoreAnomaly(pnpMotionSensorBMX055Component);
+
+    // The magnetometer has no FIFO, and its data rate is far below the rate telemetry is sent at
+    ReadMagnet(pnpMotionSensorBMX055Component);
+
+    uint32_t probeStart = LatencyProbe_Start();
+    pnpMotionSensorBMX055Component->temp = g_bmx055->get_chip_temperature();
+    LatencyProbe_Stop(LATENCY_PROBE_I2C_READ, probeStart);
+
+    return true;
+}
+
+int PnP_MotionSensorBMX055Component_SerializeTelemetry(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, char* buffer, size_t bufferSize)
+{
+    PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component = (PNP_MOTIONSENSORBMX055_COMPONENT*)pnpMotionSensorBMX055ComponentHandle;
+    const STREAM_STATS* accel = pnpMotionSensorBMX055Component->accelStats;
+    const STREAM_STATS* gyro = pnpMotionSensorBMX055Component->gyroStats;
 
-    LogError("Property=%s was requested to be changed but is not part of the %s interface definition", propertyName, pnpMotionSensorBMX055Component->componentName);
+    return snprintf(buffer, bufferSize, g_motionTelemetryBodyFormat,
+                    (unsigned long)accel[0].count,
+                    accel[0].mean, accel[0].min, accel[0].max, StreamStats_StdDev(&accel[0]),
+                    accel[1].mean, accel[1].min, accel[1].max, StreamStats_StdDev(&accel[1]),
+                    accel[2].mean, accel[2].min, accel[2].max, StreamStats_StdDev(&accel[2]),
+                    (unsigned long)gyro[0].count,
+                    gyro[0].mean, gyro[0].min, gyro[0].max, StreamStats_StdDev(&gyro[0]),
+                    gyro[1].mean, gyro[1].min, gyro[1].max, StreamStats_StdDev(&gyro[1]),
+                    gyro[2].mean, gyro[2].min, gyro[2].max, StreamStats_StdDev(&gyro[2]),
+                    pnpMotionSensorBMX055Component->magnet.x, pnpMotionSensorBMX055Component->magnet.y, pnpMotionSensorBMX055Component->magnet.z,
+                    pnpMotionSensorBMX055Component->temp, pnpMotionSensorBMX055Component->anomalyScore);
 }
 
-void PnP_MotionSensorBMX055Component_SendTelemetry(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL)
+int PnP_MotionSensorBMX055Component_SerializeEvent(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, char* buffer, size_t bufferSize)
 {
-    SendTelemetry_Accel(pnpMotionSensorBMX055ComponentHandle, deviceClientLL);
-    //SendTelemetry_Gyro(pnpMotionSensorBMX055ComponentHandle, deviceClientLL);
-    //SendTelemetry_Magnet(pnpMotionSensorBMX055ComponentHandle, deviceClientLL);
-    SendTelemetry_Temp(pnpMotionSensorBMX055ComponentHandle, deviceClientLL);
+    PNP_MOTIONSENSORBMX055_COMPONENT* pnpMotionSensorBMX055Component = (PNP_MOTIONSENSORBMX055_COMPONENT*)pnpMotionSensorBMX055ComponentHandle;
+    int length = 0;
+
+    if (pnpMotionSensorBMX055Component->anomalyPending)
+    {
+        pnpMotionSensorBMX055Component->anomalyPending = false;
+        return snprintf(buffer, bufferSize, g_anomalyEventBodyFormat, pnpMotionSensorBMX055Component->anomalyAlertScore,
+                        g_anomalyFeatureNames[pnpMotionSensorBMX055Component->anomalyFeature],
+                        pnpMotionSensorBMX055Component->anomalyValue, pnpMotionSensorBMX055Component->anomalyBaseline);
+    }
+
+    g_bmx055SampleMutex.lock();
+    if (g_bmx055CalibrationResultPending)
+    {
+        if (g_bmx055CalibrationResult == MAG_CALIBRATION_OK)
+        {
+            length = snprintf(buffer, bufferSize, g_magnetCalibrationSuccessFormat, (unsigned long)g_bmx055CalibrationSamples,
+                              g_bmx055MagCalibration.offset[0], g_bmx055MagCalibration.offset[1], g_bmx055MagCalibration.offset[2],
+                              g_bmx055MagCalibration.fieldStrength);
+        }
+        else
+        {
+            length = snprintf(buffer, bufferSize, g_magnetCalibrationFailureFormat, (unsigned long)g_bmx055CalibrationSamples,
+                              MagCalibration_ResultString(g_bmx055CalibrationResult));
+        }
+        g_bmx055CalibrationResultPending = false;
+        g_bmx055SampleMutex.unlock();
+        return length;
+    }
+
+    for (size_t i = 0; i < g_bmx055NumPendingEvents; i++)
+    {
+        BMX055_PENDING_EVENT* pendingEvent = &g_bmx055PendingEvents[i];
+
+        if (pendingEvent->count != 0)
+        {
+            length = snprintf(buffer, bufferSize, g_motionEventBodyFormat,
+                              pendingEvent->telemetryName, pendingEvent->axis, pendingEvent->sign, (unsigned long)pendingEvent->count);
+            pendingEvent->count = 0;
+            break;
+        }
+    }
+    g_bmx055SampleMutex.unlock();
+
+    return length;
 }
+
+const PNP_COMPONENT_INTERFACE g_motionSensorBMX055ComponentInterface =
+{
+    PnP_MotionSensorBMX055Component_InitSensor,
+    PnP_MotionSensorBMX055Component_CreateHandle,
+    PnP_MotionSensorBMX055Component_Destroy,
+    NULL,
+    PnP_MotionSensorBMX055Component_Sample,
+    PnP_MotionSensorBMX055Component_SerializeTelemetry,
+    PnP_MotionSensorBMX055Component_SerializeEvent,
+    PnP_MotionSensorBMX055Component_ProcessPropertyUpdate,
+    PnP_MotionSensorBMX055Component_ProcessCommand
+};
@@ -24,12 +24,20 @@
 
 #include "parson.h"
 #include "iothub_device_client_ll.h"
+#include "pnp_component_registry.h"
 
 //
 // Handle representing a thermostat component.
 //
 typedef void* PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE;
 
+//
+// PnP_MotionSensorBMX055Component_InitSensor probes and configures the BMX055 chip, and returns whether it is available.
+// This blocks on I2C transfers and chip start-up delays, so the application may run it on another thread in parallel with
+// network bring-up.  Otherwise it is run by PnP_MotionSensorBMX055Component_CreateHandle.
+//
+bool PnP_MotionSensorBMX055Component_InitSensor(void);
+
 //
 // PnP_MotionSensorBMX055Component_CreateHandle allocates a handle to correspond to the motion sensor BMX055.
 // This operation is only for allocation and does NOT invoke any I/O operations.
@@ -44,18 +52,44 @@ void PnP_MotionSensorBMX055Component_Destroy(PNP_MOTIONSENSORBMX055_COMPONENT_HA
 //
 // PnP_MotionSensorBMX055Component_ProcessCommand is used to process any incoming PnP Commands, transferred via the IoTHub device method channel,
 // to the given PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE.  The function returns an HTTP style return code to indicate success or failure.
+// The calibrate command fits the magnetometer samples taken while the device is turned around, for the seconds in its payload (30 if
+// null), and stores the hard-iron and soft-iron calibration in KVStore.  Its outcome is sent as the magnetCalibration event.
+// The compensateOffsets command runs the fast offset compensation of the accelerometer and gyroscope while the device lies still, with
+// the axis in its payload pointing up ("+z" if null), and stores the offsets in KVStore.
+// The resetBaseline command forgets the baseline of the anomaly detector, which is learned again from the following intervals.
 //
 int PnP_MotionSensorBMX055Component_ProcessCommand(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, const char *pnpCommandName, JSON_Value* commandJsonValue, unsigned char** response, size_t* responseSize);
 
 //
 // PnP_MotionSensorBMX055Component_ProcessPropertyUpdate processes an incoming property update and, if the property is in this model, will
-// send a reported property acknowledging receipt of the property request from IoTHub.
+// send a reported property acknowledging receipt of the property request from IoTHub.  The writable properties are the sensor settings
+// accelRange (g), accelBandwidth (Hz), gyroRange (deg/s), gyroBandwidth (Hz) and magnetOdr (Hz), which are set to the nearest supported
+// value, polling without INT1 included, and the thresholds of the on-sensor engines: motionThreshold, tapThreshold and highGThreshold in g.
 //
 void PnP_MotionSensorBMX055Component_ProcessPropertyUpdate(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL, const char* propertyName, JSON_Value* propertyValue, int version);
 
 //
-// PnP_MotionSensorBMX055Component_SendTelemetry sends telemetry indicating the current 9-axis motion sensor data.
+// PnP_MotionSensorBMX055Component_Sample closes the interval since the last call: it takes the statistics of all acceleration and angular
+// rate samples of the interval, and reads the calibrated magnetic field and chip temperature into the component.  The gyroscope bias,
+// learned whenever the device is still, is removed from the angular rate.  The statistics are scored by the anomaly detector.
+// Returns false if the interval had no samples.
+//
+bool PnP_MotionSensorBMX055Component_Sample(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle);
+
+//
+// PnP_MotionSensorBMX055Component_SerializeTelemetry formats the statistics of the last interval as the body of one telemetry message.
+//
+int PnP_MotionSensorBMX055Component_SerializeTelemetry(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, char* buffer, size_t bufferSize);
+
+//
+// PnP_MotionSensorBMX055Component_SerializeEvent formats one pending event of the on-sensor motion, tap and high-g engines as
+// the body of one telemetry message, or an anomaly alert, or the outcome of a magnetometer calibration.  Returns 0 if no event is pending.
+//
+int PnP_MotionSensorBMX055Component_SerializeEvent(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, char* buffer, size_t bufferSize);
+
+//
+// g_motionSensorBMX055ComponentInterface registers the component with the component registry.
 //
-void PnP_MotionSensorBMX055Component_SendTelemetry(PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE pnpMotionSensorBMX055ComponentHandle, IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClientLL);
+extern const PNP_COMPONENT_INTERFACE g_motionSensorBMX055ComponentInterface;
 
 #endif /* PNP_MOTION_SENSOR_BMX055_CONTROLLER_H */
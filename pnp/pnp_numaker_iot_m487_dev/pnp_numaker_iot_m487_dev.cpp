@@ -30,7 +30,6 @@
 
 // Mbed port header files
 #include "mbed.h"
-#include "NTPClient.h"
 
 // IoTHub Device Client and IoT core utility related header files
 #include "iothub.h"
@@ -44,40 +43,73 @@
 // PnP utilities.
 #include "pnp_device_client_ll.h"
 #include "pnp_protocol.h"
+#include "pnp_arena.h"
+#include "pnp_mempool.h"
+#ifdef USE_PROV_MODULE_FULL
+#include "pnp_dps_ll.h"
+#endif
+
+// Boot stage timing
+#include "boot_profiler.h"
+
+// Current time for TLS, from RTC or NTP
+#include "time_source.h"
+
+// Network re-association and outage tracking
+#include "reconnect_manager.h"
+
+// Hot path latency histograms
+#include "latency_probe.h"
+
+// Root CA certificates of DPS and IoT Hub
+#include "trusted_roots.h"
 
 // Headers that provide implementation for subcomponents
+#include "pnp_component_registry.h"
 #include "pnp_motion_sensor_bmx055_component.h"
 #include "pnp_deviceinfo_component.h"
+#include "pnp_diagnostics_component.h"
 
 
 // Values of connection / security settings read from environment variables and/or DPS runtime
 PNP_DEVICE_CONFIGURATION g_pnpDeviceConfiguration;
 
+// Global symbol referenced by the Azure SDK's port for Mbed OS, via "extern"
+NetworkInterface *_defaultSystemNetwork;
+
 // Amount of time to sleep between polling hub, in milliseconds.  Set to wake up every 100 milliseconds.
 static unsigned int g_sleepBetweenPollsMs = 100;
 
 // Every time the main loop wakes up, on the g_sendTelemetryPollInterval(th) pass will send a telemetry message.
 // So we will send telemetry every (g_sendTelemetryPollInterval * g_sleepBetweenPollsMs) milliseconds;
-static const int g_sendTelemetryPollInterval = 20;
+static const unsigned int g_sendTelemetryPollInterval = 20;
+
+// Motion sensor telemetry, the statistics of all samples since the last one, is sent on every g_sendMotionPollInterval(th) pass.
+static const unsigned int g_sendMotionPollInterval = (MBED_CONF_APP_MOTION_TELEMETRY_INTERVAL * 1000) / g_sleepBetweenPollsMs;
+
+// Diagnostics telemetry is sent on every g_sendDiagnosticsPollInterval(th) pass.
+static const unsigned int g_sendDiagnosticsPollInterval = (MBED_CONF_APP_DIAGNOSTICS_TELEMETRY_INTERVAL * 1000) / g_sleepBetweenPollsMs;
 
 // Whether tracing at the IoTHub client is enabled or not. 
 static bool g_hubClientTraceEnabled = MBED_CONF_APP_IOTHUB_CLIENT_TRACE;
 
+// How long the IoT Hub client keeps retrying to reconnect, in seconds.  0 to retry for ever.
+static const size_t g_hubRetryTimeoutLimitSecs = MBED_CONF_APP_IOTHUB_RETRY_TIMEOUT;
+
 // DTMI indicating this device's ModelId.
 static const char g_NuMakerIoTM487DevModelId[] = "dtmi:nuvoton:numaker_iot_m487_dev;1";
 
-// PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE represents the motion sensor BMX055 component that is sub-component of the NuMaker IoT M487 Dev.
-// Note that we do NOT have an analogous DeviceInfo component handle because there is only DeviceInfo subcomponent and its
-// implementation is straightforward.
-PNP_MOTIONSENSORBMX055_COMPONENT_HANDLE g_motionSensorBMX055Handle;
-
-// Name of subcomponents that NuMaker IoT M487 Dev implements.
-static const char g_motionSensorBMX055ComponentName[] = "motionSensorBMX055";
-static const size_t g_motionSensorBMX055ComponentSize = sizeof(g_motionSensorBMX055ComponentName) - 1;
-static const char g_deviceInfoComponentName[] = "deviceInformation";
+// Subcomponents that NuMaker IoT M487 Dev implements, by their names in the model.  Another sensor only needs another entry here.
+static const PNP_COMPONENT_REGISTRATION g_componentRegistrations[] =
+{
+    {"motionSensorBMX055", g_sendMotionPollInterval, &g_motionSensorBMX055ComponentInterface},
+    {"deviceInformation", 0, &g_deviceInfoComponentInterface},
+    {"diagnostics", g_sendDiagnosticsPollInterval, &g_diagnosticsComponentInterface}
+};
+static const size_t g_numComponentRegistrations = sizeof(g_componentRegistrations) / sizeof(g_componentRegistrations[0]);
 
-static const char* g_modeledComponents[] = {g_motionSensorBMX055ComponentName, g_deviceInfoComponentName};
-static const size_t g_numModeledComponents = sizeof(g_modeledComponents) / sizeof(g_modeledComponents[0]);
+// Instances of the subcomponents, which properties, commands and telemetry are dispatched to
+static PNP_COMPONENT_REGISTRY g_componentRegistry;
 
 // Command implemented by the NuMakerIoTM487Dev component itself to implement reboot.
 static const char g_rebootCommand[] = "reboot";
@@ -97,6 +129,9 @@ static const char g_button2PropertyName[] = "button2";
 static const char g_button1TelemetryBodyFormat[] = "{\"button1\":%s}";
 static const char g_button2TelemetryBodyFormat[] = "{\"button2\":%s}";
 
+// Format string for sending telemetry of the last outage of the IoT Hub connection
+static const char g_reconnectTelemetryBodyFormat[] = "{\"outageCount\":%lu,\"outageDurationMs\":%lu,\"networkDownMs\":%lu,\"reconnectLatencyMs\":%lu,\"networkReconnectAttempts\":%lu}";
+
 // led instance
 static DigitalOut g_led(LED3);
 
@@ -104,27 +139,36 @@ static DigitalOut g_led(LED3);
 InterruptIn g_button1(SW2);
 InterruptIn g_button2(SW3);
 
+#if defined(USE_PROV_MODULE_FULL) && defined(USE_DPS_CACHE)
+// Set when IoT Hub rejects the IoT Hub assignment cached from DPS.  The main loop then re-creates the device client,
+// which goes through a fresh DPS registration.
+static bool g_reprovisionRequested = false;
+
+// DPS registrations tried after IoT Hub rejected the cached assignment, with jittered exponential backoff in between, before
+// the device reboots instead.  Registration then runs again at boot, after the network is brought up anew.
+static const int g_reprovisionAttempts = 6;
+static const uint32_t g_reprovisionBackoffBaseMs = 5000;
+static const uint32_t g_reprovisionBackoffMaxMs = MBED_CONF_APP_NETWORK_RECONNECT_MAX_BACKOFF * 1000;
+#endif
+
 //
 // PnP_NuMakerIoTM487DevComponent_ReportProperty_Led sends the led property to IoTHub
 //
 static void PnP_NuMakerIoTM487DevComponent_ReportProperty_Led(IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClient, int version)
 {
     IOTHUB_CLIENT_RESULT iothubClientResult;
-    STRING_HANDLE jsonToSend = NULL;
+    char* jsonToSend = NULL;
 
     /* Reported led state (0/1 for On/Off) */
     int led_state = !g_led;
 
-    if ((jsonToSend = PnP_CreateReportedPropertyWithStatus(NULL, g_ledPropertyName, led_state ? "true" : "false", PNP_STATUS_SUCCESS, "success", version)) == NULL)
+    if ((jsonToSend = PnP_FormatReportedPropertyWithStatus(NULL, g_ledPropertyName, led_state ? "true" : "false", PNP_STATUS_SUCCESS, "success", version)) == NULL)
     {
         LogError("Unable to build %s property", g_ledPropertyName);
     }
     else
     {
-        const char* jsonToSendStr = STRING_c_str(jsonToSend);
-        size_t jsonToSendStrLen = strlen(jsonToSendStr);
-
-        if ((iothubClientResult = IoTHubDeviceClient_LL_SendReportedState(deviceClient, (const unsigned char*)jsonToSendStr, jsonToSendStrLen, NULL, NULL)) != IOTHUB_CLIENT_OK)
+        if ((iothubClientResult = IoTHubDeviceClient_LL_SendReportedState(deviceClient, (const unsigned char*)jsonToSend, strlen(jsonToSend), NULL, NULL)) != IOTHUB_CLIENT_OK)
         {
             LogError("Unable to send reported state, error=%d", iothubClientResult);
         }
@@ -134,7 +178,7 @@ static void PnP_NuMakerIoTM487DevComponent_ReportProperty_Led(IOTHUB_DEVICE_CLIE
         }
     }
 
-    STRING_delete(jsonToSend);
+    PnP_MemPool_Free(jsonToSend);
 }
 
 //
@@ -172,7 +216,7 @@ static void PnP_NuMakerIoTM487DevComponent_SendTelemetry_Button(IOTHUB_DEVICE_CL
     {
         LogError("Unable to create telemetry message");
     }
-    else if ((iothubResult = IoTHubDeviceClient_LL_SendEventAsync(deviceClient, messageHandle, NULL, NULL)) != IOTHUB_CLIENT_OK)
+    else if ((iothubResult = PnP_DiagnosticsComponent_SendEventAsync(deviceClient, messageHandle)) != IOTHUB_CLIENT_OK)
     {
         LogError("Unable to send telemetry message, error=%d", iothubResult);
     }
@@ -180,6 +224,38 @@ static void PnP_NuMakerIoTM487DevComponent_SendTelemetry_Button(IOTHUB_DEVICE_CL
     IoTHubMessage_Destroy(messageHandle);
 }
 
+//
+// PnP_NuMakerIoTM487DevComponent_SendTelemetry_Reconnect sends the report of the outage of the IoT Hub connection that has just ended
+//
+static void PnP_NuMakerIoTM487DevComponent_SendTelemetry_Reconnect(IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClient, const RECONNECT_REPORT* report)
+{
+    IOTHUB_MESSAGE_HANDLE messageHandle = NULL;
+    IOTHUB_CLIENT_RESULT iothubResult;
+
+    char reconnectStringBuffer[160];
+
+    if (snprintf(reconnectStringBuffer, sizeof(reconnectStringBuffer), g_reconnectTelemetryBodyFormat, (unsigned long)report->outageCount,
+                 (unsigned long)report->outageDurationMs, (unsigned long)report->networkDownMs, (unsigned long)report->reconnectLatencyMs,
+                 (unsigned long)report->networkReconnectAttempts) < 0)
+    {
+        LogError("snprintf of reconnect telemetry failed");
+    }
+    else if ((messageHandle = PnP_CreateTelemetryMessageHandle(NULL, reconnectStringBuffer)) == NULL)
+    {
+        LogError("Unable to create telemetry message");
+    }
+    else if ((iothubResult = PnP_DiagnosticsComponent_SendEventAsync(deviceClient, messageHandle)) != IOTHUB_CLIENT_OK)
+    {
+        LogError("Unable to send telemetry message, error=%d", iothubResult);
+    }
+    else
+    {
+        LogInfo("Sending reconnect telemetry %s", reconnectStringBuffer);
+    }
+
+    IoTHubMessage_Destroy(messageHandle);
+}
+
 //
 // PnP_NuMakerIoTM487DevComponent_ProcessPropertyUpdate processes an incoming property update and, if the property is in this model, will
 // send a reported property acknowledging receipt of the property request from IoTHub.
@@ -287,10 +363,14 @@ static int PnP_NuMakerIoTM487DevComponent_DeviceMethodCallback(const char* metho
     unsigned const char *componentName;
     size_t componentNameSize;
     const char *pnpCommandName;
+    uint32_t probeStart = LatencyProbe_Start();
 
     *response = NULL;
     *responseSize = 0;
 
+    // Transient allocations of the command come from the arena, up to PnP_Arena_End.  The response is malloc'ed, as the SDK frees it.
+    PnP_Arena_Begin();
+
     BlinkStatusLED(5);
 
     // Parse the methodName into its PnP (optional) componentName and pnpCommandName.
@@ -312,15 +392,7 @@ static int PnP_NuMakerIoTM487DevComponent_DeviceMethodCallback(const char* metho
         if (componentName != NULL)
         {
             LogInfo("Received PnP command for component=%.*s, command=%s", (int)componentNameSize, componentName, pnpCommandName);
-            if (strncmp((const char*)componentName, g_motionSensorBMX055ComponentName, g_motionSensorBMX055ComponentSize) == 0)
-            {
-                result = PnP_MotionSensorBMX055Component_ProcessCommand(g_motionSensorBMX055Handle, pnpCommandName, rootValue, response, responseSize);
-            }
-            else
-            {
-                LogError("PnP component=%.*s is not supported by NuMaker IoT M487 Dev", (int)componentNameSize, componentName);
-                result = PNP_STATUS_NOT_FOUND;
-            }
+            result = PnP_ComponentRegistry_ProcessCommand(&g_componentRegistry, (const char*)componentName, componentNameSize, pnpCommandName, rootValue, response, responseSize);
         }
         else
         {
@@ -343,7 +415,11 @@ static int PnP_NuMakerIoTM487DevComponent_DeviceMethodCallback(const char* metho
     }
 
     json_value_free(rootValue);
-    free(jsonStr);
+    PnP_Arena_Free(jsonStr);
+
+    PnP_Arena_End();
+
+    LatencyProbe_Stop(LATENCY_PROBE_COMMAND, probeStart);
 
     return result;
 }
@@ -369,11 +445,7 @@ static void PnP_NuMakerIoTM487DevComponent_ApplicationPropertyCallback(const cha
             LogError("Property=%s arrived for NuMaker IoT M487 Dev component itself.  This does not support writeable properties on it (all properties are on subcomponents)", propertyName);
         }
     }
-    else if (strcmp(componentName, g_motionSensorBMX055ComponentName) == 0)
-    {
-        PnP_MotionSensorBMX055Component_ProcessPropertyUpdate(g_motionSensorBMX055Handle, deviceClient, propertyName, propertyValue, version);
-    }
-    else
+    else if (PnP_ComponentRegistry_ProcessPropertyUpdate(&g_componentRegistry, deviceClient, componentName, propertyName, propertyValue, version) == false)
     {
         LogError("Component=%s is not implemented by the NuMaker IoT M487 Dev", componentName);
     }
@@ -386,12 +458,41 @@ static void PnP_NuMakerIoTM487DevComponent_DeviceTwinCallback(DEVICE_TWIN_UPDATE
 {
     // Invoke PnP_ProcessTwinData to actualy process the data.  PnP_ProcessTwinData uses a visitor pattern to parse
     // the JSON and then visit each property, invoking PnP_NuMakerIoTM487DevComponent_ApplicationPropertyCallback on each element.
-    if (PnP_ProcessTwinData(updateState, payload, size, g_modeledComponents, g_numModeledComponents, PnP_NuMakerIoTM487DevComponent_ApplicationPropertyCallback, userContextCallback) == false)
+    uint32_t probeStart = LatencyProbe_Start();
+
+    if (PnP_ProcessTwinData(updateState, payload, size, g_componentRegistry.componentNames, g_componentRegistry.numComponents, PnP_NuMakerIoTM487DevComponent_ApplicationPropertyCallback, userContextCallback) == false)
     {
         // If we're unable to parse the JSON for any reason (typically because the JSON is malformed or we ran out of memory)
         // there is no action we can take beyond logging.
         LogError("Unable to process twin json.  Ignoring any desired property update requests");
     }
+
+    LatencyProbe_Stop(LATENCY_PROBE_TWIN, probeStart);
+}
+
+//
+// PnP_NuMakerIoTM487DevComponent_ConnectionStatusCallback is invoked by IoT SDK when the connection status with IoT Hub changes.
+//
+static void PnP_NuMakerIoTM487DevComponent_ConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason, void* userContextCallback)
+{
+    (void)userContextCallback;
+
+    LogInfo("IoT Hub connection status=%d, reason=%d", (int)result, (int)reason);
+
+    ReconnectManager_OnHubConnectionStatus(result, reason);
+
+#if defined(USE_PROV_MODULE_FULL) && defined(USE_DPS_CACHE)
+    // Credentials refused or device disabled/deleted on the hub we were assigned earlier: the cached assignment is stale.
+    // Anything else (network loss, expired SAS token, ...) is left to the SDK's retry policy.
+    if ((result == IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED) &&
+        ((reason == IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL) || (reason == IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED)) &&
+        PnP_DpsCache_IsAssignmentCached())
+    {
+        LogInfo("IoT Hub rejected cached DPS assignment.  Falling back to DPS registration");
+        PnP_DpsCache_Invalidate();
+        g_reprovisionRequested = true;
+    }
+#endif
 }
 
 //
@@ -424,7 +525,17 @@ static IOTHUB_DEVICE_CLIENT_LL_HANDLE CreateDeviceClientAndAllocateComponents(vo
 
     g_pnpDeviceConfiguration.deviceMethodCallback = PnP_NuMakerIoTM487DevComponent_DeviceMethodCallback;
     g_pnpDeviceConfiguration.deviceTwinCallback = PnP_NuMakerIoTM487DevComponent_DeviceTwinCallback;
+    g_pnpDeviceConfiguration.connectionStatusCallback = PnP_NuMakerIoTM487DevComponent_ConnectionStatusCallback;
+    g_pnpDeviceConfiguration.setRetryPolicy = true;
+    g_pnpDeviceConfiguration.retryPolicy = IOTHUB_CLIENT_RETRY_EXPONENTIAL_BACKOFF_WITH_JITTER;
+    g_pnpDeviceConfiguration.retryTimeoutLimitSecs = g_hubRetryTimeoutLimitSecs;
     g_pnpDeviceConfiguration.enableTracing = g_hubClientTraceEnabled;
+#ifdef PNP_HOST_BUILD
+    // The host build may trust another CA instead, e.g. the test CA of the local IoT Hub stand-in
+    g_pnpDeviceConfiguration.trustedCertificates = HostConfig_GetTrustedCertificates(trusted_roots);
+#else
+    g_pnpDeviceConfiguration.trustedCertificates = trusted_roots;
+#endif
     g_pnpDeviceConfiguration.modelId = g_NuMakerIoTM487DevModelId;
 
     if (GetConnectionSettingsFromConfiguration() == false)
@@ -437,9 +548,9 @@ static IOTHUB_DEVICE_CLIENT_LL_HANDLE CreateDeviceClientAndAllocateComponents(vo
         LogError("Failure creating IotHub device client");
         result = false;
     }
-    else if ((g_motionSensorBMX055Handle = PnP_MotionSensorBMX055Component_CreateHandle(g_motionSensorBMX055ComponentName)) == NULL)
+    else if (PnP_ComponentRegistry_Create(&g_componentRegistry, g_componentRegistrations, g_numComponentRegistrations) == false)
     {
-        LogError("Unable to create component handle for %s", g_motionSensorBMX055ComponentName);
+        LogError("Unable to create components");
         result = false;
     }
     else
@@ -449,7 +560,6 @@ static IOTHUB_DEVICE_CLIENT_LL_HANDLE CreateDeviceClientAndAllocateComponents(vo
 
     if (result == false)
     {
-        PnP_MotionSensorBMX055Component_Destroy(g_motionSensorBMX055Handle);
         if (deviceClient != NULL)
         {
             IoTHubDeviceClient_LL_Destroy(deviceClient);
@@ -461,12 +571,188 @@ static IOTHUB_DEVICE_CLIENT_LL_HANDLE CreateDeviceClientAndAllocateComponents(vo
     return deviceClient;
 }
 
-// Global symbol referenced by the Azure SDK's port for Mbed OS, via "extern"
-NetworkInterface *_defaultSystemNetwork;
+#if defined(USE_PROV_MODULE_FULL) && defined(USE_DPS_CACHE)
+//
+// ReprovisionDeviceClient destroys deviceClient, which was created from a stale cached DPS assignment, and creates a new one
+// through a fresh DPS registration.  Transient DPS or network failures are retried; if none of the attempts succeeds,
+// the device reboots rather than be left without a client.
+//
+static IOTHUB_DEVICE_CLIENT_LL_HANDLE ReprovisionDeviceClient(IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClient)
+{
+    IoTHubDeviceClient_LL_Destroy(deviceClient);
+    IoTHub_Deinit();
+
+    for (int attempt = 0; attempt < g_reprovisionAttempts; attempt++)
+    {
+        if (attempt > 0)
+        {
+            // A random time between half and all of min(base * 2^(attempt - 1), max), so that a fleet doesn't retry in lockstep
+            uint32_t backoffMs = ((g_reprovisionBackoffBaseMs << (attempt - 1)) < g_reprovisionBackoffMaxMs) ? (g_reprovisionBackoffBaseMs << (attempt - 1)) : g_reprovisionBackoffMaxMs;
+            backoffMs = (backoffMs / 2) + ((uint32_t)rand() % ((backoffMs / 2) + 1));
+
+            LogInfo("Retrying DPS registration in %lu ms", (unsigned long)backoffMs);
+            ThisThread::sleep_for(std::chrono::milliseconds(backoffMs));
+        }
+
+        if ((deviceClient = PnP_CreateDeviceClientLLHandle(&g_pnpDeviceConfiguration)) == NULL)
+        {
+            LogError("Failure re-creating IotHub device client via DPS, attempt %d of %d", attempt + 1, g_reprovisionAttempts);
+        }
+        else
+        {
+            // The new hub has not seen our properties yet.
+            PnP_ComponentRegistry_ReportProperties(&g_componentRegistry, deviceClient);
+            PnP_NuMakerIoTM487DevComponent_ReportProperty_Led(deviceClient, 1);
+            return deviceClient;
+        }
+    }
+
+    LogError("DPS registration keeps failing.  Rebooting");
+    NVIC_SystemReset();
+
+    return deviceClient;
+}
+#endif
+
+// Stack size of threads running boot stages in parallel with main()
+static const uint32_t g_bootStageThreadStackSize = 4096;
+
+// Outcome of boot stages, read by main() once their threads are joined
+static bool g_bootSensorReady = false;
+static bool g_bootTimeTrusted = false;
+
+//
+// BootStage_InitSensor probes and configures the sensors of the components.  It only needs I2C, so it runs in parallel with network bring-up.
+//
+static void BootStage_InitSensor(void)
+{
+    BOOT_PROFILER_STAGE stage = BootProfiler_StageBegin("sensorInit");
+
+    g_bootSensorReady = PnP_ComponentRegistry_Initialize(g_componentRegistrations, g_numComponentRegistrations);
+
+    BootProfiler_StageEnd(stage);
+}
+
+//
+// BootStage_LoadSettings reads connection settings, the time source state and, with DPS, the IoT Hub assignment cached in KVStore.
+// It only needs flash, so it runs in parallel with network bring-up.
+//
+static void BootStage_LoadSettings(void)
+{
+    BOOT_PROFILER_STAGE stage = BootProfiler_StageBegin("settingsLoad");
+
+    g_bootTimeTrusted = TimeSource_RestoreFromRtc();
+    (void)GetConnectionSettingsFromConfiguration();
+#if defined(USE_PROV_MODULE_FULL) && defined(USE_DPS_CACHE)
+    (void)PnP_DpsCache_Preload(&g_pnpDeviceConfiguration);
+#endif
+
+    BootProfiler_StageEnd(stage);
+}
+
+//
+// ResolveHostName looks up hostName, the first hostNameLength characters of which are significant.  The result is
+// of no interest here; the lookup primes the DNS cache of the network stack for the connection made later.
+//
+static void ResolveHostName(const char* hostName, size_t hostNameLength)
+{
+    char hostNameBuffer[128 + 1];
+    SocketAddress address;
+    nsapi_error_t ret;
+
+    if (hostNameLength >= sizeof(hostNameBuffer))
+    {
+        LogError("Host name too long to resolve ahead");
+        return;
+    }
+
+    memcpy(hostNameBuffer, hostName, hostNameLength);
+    hostNameBuffer[hostNameLength] = '\0';
+
+    if ((ret = _defaultSystemNetwork->gethostbyname(hostNameBuffer, &address)) != NSAPI_ERROR_OK)
+    {
+        LogError("Unable to resolve %s ahead, error=%d", hostNameBuffer, ret);
+    }
+    else
+    {
+        LogInfo("Resolved %s to %s", hostNameBuffer, address.get_ip_address());
+    }
+}
+
+//
+// BootStage_ResolveEndpoints resolves the DPS and/or IoT Hub host names in parallel with NTP, which the TLS handshakes
+// to them have to wait for anyway.
+//
+static void BootStage_ResolveEndpoints(void)
+{
+    BOOT_PROFILER_STAGE stage = BootProfiler_StageBegin("dnsPrefetch");
+
+#ifdef USE_PROV_MODULE_FULL
+    const char* hostName = NULL;
+
+#ifdef USE_DPS_CACHE
+    // With an assignment cached, DPS is not contacted at all.
+    hostName = PnP_DpsCache_GetPreloadedIothubUri();
+#endif
+    if (hostName == NULL)
+    {
+        hostName = g_pnpDeviceConfiguration.u.dpsConnectionAuth.endpoint;
+    }
+    ResolveHostName(hostName, strlen(hostName));
+#else
+    static const char hostNameKey[] = "HostName=";
+    const char* hostName = strstr(g_pnpDeviceConfiguration.u.connectionString, hostNameKey);
+
+    if (hostName != NULL)
+    {
+        hostName += sizeof(hostNameKey) - 1;
+        ResolveHostName(hostName, strcspn(hostName, ";"));
+    }
+#endif
+
+    BootProfiler_StageEnd(stage);
+}
+
+//
+// BootStage_SyncTime gets the current time from the NTP server, unless the RTC could be trusted after a warm reset.
+// TLS needs it to check certificate validity.  On failure, we carry on with our best guess and let the background refresh retry.
+// The background refresh starts here, with the network up, rather than once connected to IoT Hub: with a wrong time, the device
+// could never authenticate to get there.
+//
+static void BootStage_SyncTime(void)
+{
+    if (g_bootTimeTrusted == false)
+    {
+        BOOT_PROFILER_STAGE stage = BootProfiler_StageBegin("ntp");
+
+        if (TimeSource_SyncFromNtp(_defaultSystemNetwork) == false)
+        {
+            LogError("Continuing without NTP time.  TLS may fail until time gets synced in background");
+        }
+
+        BootProfiler_StageEnd(stage);
+    }
+
+    TimeSource_StartBackgroundRefresh(_defaultSystemNetwork);
+}
 
 int main(void)
 {
+    BOOT_PROFILER_STAGE bootStage;
+
+    // Before any JSON is parsed or built
+    PnP_Arena_Init();
+
+    LatencyProbe_Init();
+
+    // Boot stages that do not need network run in parallel with network bring-up.
+    Thread sensorInitThread(osPriorityNormal, g_bootStageThreadStackSize, nullptr, "sensorInit");
+    Thread settingsLoadThread(osPriorityNormal, g_bootStageThreadStackSize, nullptr, "settingsLoad");
+    sensorInitThread.start(BootStage_InitSensor);
+    settingsLoadThread.start(BootStage_LoadSettings);
+
     LogInfo("Connecting to the network");
+    bootStage = BootProfiler_StageBegin("network");
 
     _defaultSystemNetwork = NetworkInterface::get_default_instance();
     if (_defaultSystemNetwork == nullptr) {
@@ -480,26 +766,29 @@ int main(void)
         return -1;
     }
     LogInfo("Connection success, MAC: %s", _defaultSystemNetwork->get_mac_address());
+    BootProfiler_StageEnd(bootStage);
 
-    LogInfo("Getting time from the NTP server");
+    // DNS lookups of the endpoints overlap with NTP, if needed at all.  They need the connection settings loaded.
+    Thread dnsPrefetchThread(osPriorityNormal, g_bootStageThreadStackSize, nullptr, "dnsPrefetch");
+    settingsLoadThread.join();
+    dnsPrefetchThread.start(BootStage_ResolveEndpoints);
 
-    NTPClient ntp(_defaultSystemNetwork);
-    ntp.set_server("time.google.com", 123);
-    time_t timestamp = ntp.get_timestamp();
-    if (timestamp < 0) {
-        LogError("Failed to get the current time, error: %ld", (long)timestamp);
-        return -1;
-    }
-    LogInfo("Time: %s", ctime(&timestamp));
+    BootStage_SyncTime();
 
-    rtc_init();
-    rtc_write(timestamp);
-    time_t rtc_timestamp = rtc_read(); // verify it's been successfully updated
-    LogInfo("RTC reports %s", ctime(&rtc_timestamp));
+    dnsPrefetchThread.join();
+    sensorInitThread.join();
+
+    if (g_bootSensorReady == false) {
+        LogError("Not all sensors are available!!");
+    }
 
     IOTHUB_DEVICE_CLIENT_LL_HANDLE deviceClient = NULL;
 
-    if ((deviceClient = CreateDeviceClientAndAllocateComponents()) == NULL)
+    bootStage = BootProfiler_StageBegin("iothubClient");
+    deviceClient = CreateDeviceClientAndAllocateComponents();
+    BootProfiler_StageEnd(bootStage);
+
+    if (deviceClient == NULL)
     {
         LogError("Failure creating IotHub device client");
     }
@@ -507,10 +796,13 @@ int main(void)
     {
         LogInfo("Successfully created device client.  Hit Control-C to exit program\n");
 
+        // The client connects to IoT Hub on its first DoWork.  From then on, the network link is watched for drops.
+        ReconnectManager_Start(_defaultSystemNetwork);
+
         int numberOfIterations = 0;
 
         // During startup, send the non-"writeable" properties.
-        PnP_DeviceInfoComponent_Report_All_Properties(g_deviceInfoComponentName, deviceClient);
+        PnP_ComponentRegistry_ReportProperties(&g_componentRegistry, deviceClient);
 
         // During startup, send the "writeable" properties once.
         PnP_NuMakerIoTM487DevComponent_ReportProperty_Led(deviceClient, 1);
@@ -519,20 +811,53 @@ int main(void)
         {
             // Wake up periodically to poll.  Even if we do not plan on sending telemetry, we still need to poll periodically in order to process
             // incoming requests from the server and to do connection keep alives.
-            if ((numberOfIterations % g_sendTelemetryPollInterval) == 0)
+            RECONNECT_REPORT reconnectReport;
+
+            if (ReconnectManager_TakeReport(&reconnectReport))
+            {
+                PnP_NuMakerIoTM487DevComponent_SendTelemetry_Reconnect(deviceClient, &reconnectReport);
+            }
+
+            // While reconnecting, the client would only pile up telemetry in memory.
+            if (ReconnectManager_IsInOutage() == false)
             {
-                PnP_NuMakerIoTM487DevComponent_SendTelemetry_Button(deviceClient, 1);
-                PnP_NuMakerIoTM487DevComponent_SendTelemetry_Button(deviceClient, 2);
-                PnP_MotionSensorBMX055Component_SendTelemetry(g_motionSensorBMX055Handle, deviceClient);
+                if ((numberOfIterations % g_sendTelemetryPollInterval) == 0)
+                {
+                    PnP_NuMakerIoTM487DevComponent_SendTelemetry_Button(deviceClient, 1);
+                    PnP_NuMakerIoTM487DevComponent_SendTelemetry_Button(deviceClient, 2);
+                }
+
+                PnP_ComponentRegistry_SendTelemetry(&g_componentRegistry, deviceClient, numberOfIterations);
             }
 
+            // The 64-bit microsecond ticker; the raw us_ticker_read() counts HAL ticks and wraps in seconds on M480
+            uint64_t doWorkStartUs = ticker_read_us(get_us_ticker_data());
+            uint32_t probeStart = LatencyProbe_Start();
             IoTHubDeviceClient_LL_DoWork(deviceClient);
+            LatencyProbe_Stop(LATENCY_PROBE_DOWORK, probeStart);
+            PnP_DiagnosticsComponent_RecordDoWork((uint32_t)(ticker_read_us(get_us_ticker_data()) - doWorkStartUs));
+
+            // Time to first telemetry ends with the first telemetry handed to the transport.
+            if (numberOfIterations == 0)
+            {
+                BootProfiler_Milestone("firstTelemetry");
+                BootProfiler_Report();
+            }
+
             ThreadAPI_Sleep(g_sleepBetweenPollsMs);
             numberOfIterations++;
+
+#if defined(USE_PROV_MODULE_FULL) && defined(USE_DPS_CACHE)
+            if (g_reprovisionRequested)
+            {
+                g_reprovisionRequested = false;
+                deviceClient = ReprovisionDeviceClient(deviceClient);
+            }
+#endif
         }
 
-        // Free the memory allocated with MotionSensorBMX055Component.
-        PnP_MotionSensorBMX055Component_Destroy(g_motionSensorBMX055Handle);
+        // Free the memory allocated with the components.
+        PnP_ComponentRegistry_Destroy(&g_componentRegistry);
 
         // Clean up the iothub sdk handle
         IoTHubDeviceClient_LL_Destroy(deviceClient);
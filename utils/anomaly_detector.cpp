@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Standard C header files
+#include <math.h>
+#include <string.h>
+
+#include "anomaly_detector.h"
+
+void AnomalyDetector_Init(ANOMALY_DETECTOR* detector, size_t numFeatures, const float minSigma[])
+{
+    memset(detector, 0, sizeof(*detector));
+    detector->numFeatures = (numFeatures < ANOMALY_DETECTOR_MAX_FEATURES) ? numFeatures : ANOMALY_DETECTOR_MAX_FEATURES;
+    memcpy(detector->minSigma, minSigma, detector->numFeatures * sizeof(minSigma[0]));
+}
+
+void AnomalyDetector_Reset(ANOMALY_DETECTOR* detector)
+{
+    memset(detector->mean, 0, sizeof(detector->mean));
+    memset(detector->variance, 0, sizeof(detector->variance));
+    detector->windows = 0;
+}
+
+bool AnomalyDetector_Ready(const ANOMALY_DETECTOR* detector)
+{
+    return (detector->windows >= ANOMALY_DETECTOR_BASELINE_WINDOWS);
+}
+
+float AnomalyDetector_Add(ANOMALY_DETECTOR* detector, const float features[], float threshold, size_t* feature)
+{
+    float score = 0.0f;
+    size_t scoreFeature = 0;
+
+    if (AnomalyDetector_Ready(detector))
+    {
+        for (size_t i = 0; i < detector->numFeatures; i++)
+        {
+            float sigma = sqrtf(detector->variance[i]);
+            float z = fabsf(features[i] - detector->mean[i]) / ((sigma > detector->minSigma[i]) ? sigma : detector->minSigma[i]);
+
+            if (z > score)
+            {
+                score = z;
+                scoreFeature = i;
+            }
+        }
+    }
+
+    if (feature != NULL)
+    {
+        *feature = scoreFeature;
+    }
+
+    if (score > threshold)
+    {
+        return score;
+    }
+
+    // A plain average while learning, which the weight of 1 / ANOMALY_DETECTOR_BASELINE_WINDOWS carries on from
+    if (detector->windows < ANOMALY_DETECTOR_BASELINE_WINDOWS)
+    {
+        detector->windows++;
+    }
+    float alpha = 1.0f / detector->windows;
+
+    for (size_t i = 0; i < detector->numFeatures; i++)
+    {
+        float delta = features[i] - detector->mean[i];
+
+        detector->mean[i] += alpha * delta;
+        detector->variance[i] = (1.0f - alpha) * (detector->variance[i] + alpha * delta * delta);
+    }
+
+    return score;
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header implements an anomaly detector over windows of features, such as the statistics of a sensor over each telemetry interval.
+//
+// The baseline of each feature is its exponentially weighted moving mean and variance.  Each window is scored by how many standard
+// deviations its features are off their baselines, the largest z-score among them.  The first ANOMALY_DETECTOR_BASELINE_WINDOWS windows
+// only learn the baseline, as plain averages, and score 0.  After that, windows scoring over the threshold are not learned, so an
+// anomaly is never absorbed into the baseline however long it lasts: once the normal condition changes for good, reset the baseline.
+
+#ifndef ANOMALY_DETECTOR_H
+#define ANOMALY_DETECTOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Most features of one window
+//
+#define ANOMALY_DETECTOR_MAX_FEATURES 8
+
+//
+// Windows the baseline is learned from before scoring starts.  Their inverse is the weight of each window afterwards.
+//
+#define ANOMALY_DETECTOR_BASELINE_WINDOWS 50
+
+//
+// ANOMALY_DETECTOR is the state of one detector
+//
+typedef struct ANOMALY_DETECTOR_TAG
+{
+    size_t numFeatures;
+    // Smallest standard deviation each feature is scored with, its noise, so a feature steadier than that does not score high on noise
+    float minSigma[ANOMALY_DETECTOR_MAX_FEATURES];
+
+    // Baseline of each feature, and the number of windows learned
+    float mean[ANOMALY_DETECTOR_MAX_FEATURES];
+    float variance[ANOMALY_DETECTOR_MAX_FEATURES];
+    uint32_t windows;
+}
+ANOMALY_DETECTOR;
+
+//
+// AnomalyDetector_Init starts a detector of numFeatures features, at most ANOMALY_DETECTOR_MAX_FEATURES, with no baseline
+//
+void AnomalyDetector_Init(ANOMALY_DETECTOR* detector, size_t numFeatures, const float minSigma[]);
+
+//
+// AnomalyDetector_Reset forgets the baseline, which is learned again from the following windows
+//
+void AnomalyDetector_Reset(ANOMALY_DETECTOR* detector);
+
+//
+// AnomalyDetector_Ready returns whether the baseline is learned, and windows are scored
+//
+bool AnomalyDetector_Ready(const ANOMALY_DETECTOR* detector);
+
+//
+// AnomalyDetector_Add scores the features of a window, and learns them unless the score is over threshold.
+// Returns the score, and the index of the feature it is of in feature if not NULL.
+//
+float AnomalyDetector_Add(ANOMALY_DETECTOR* detector, const float features[], float threshold, size_t* feature);
+
+#endif /* ANOMALY_DETECTOR_H */
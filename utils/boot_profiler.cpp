@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Standard C header files
+#include <string.h>
+
+// Mbed port header files
+#include "mbed.h"
+
+// Core IoT SDK utilities
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "boot_profiler.h"
+
+//
+// BOOT_PROFILER_RECORD represents one boot stage or milestone
+//
+typedef struct BOOT_PROFILER_RECORD_TAG
+{
+    const char* name;
+    // Milliseconds since kernel start
+    uint32_t startMs;
+    uint32_t endMs;
+    bool ended;
+}
+BOOT_PROFILER_RECORD;
+
+static BOOT_PROFILER_RECORD g_bootProfilerRecords[BOOT_PROFILER_MAX_STAGES];
+static int g_bootProfilerNumRecords = 0;
+
+// Stages begin and end on different threads
+static Mutex g_bootProfilerMutex;
+
+static uint32_t GetKernelMs(void)
+{
+    return (uint32_t)Kernel::Clock::now().time_since_epoch().count();
+}
+
+BOOT_PROFILER_STAGE BootProfiler_StageBegin(const char* stageName)
+{
+    BOOT_PROFILER_STAGE stage;
+
+    g_bootProfilerMutex.lock();
+    if (g_bootProfilerNumRecords >= BOOT_PROFILER_MAX_STAGES)
+    {
+        stage = -1;
+    }
+    else
+    {
+        stage = g_bootProfilerNumRecords++;
+        g_bootProfilerRecords[stage].name = stageName;
+        g_bootProfilerRecords[stage].startMs = GetKernelMs();
+        g_bootProfilerRecords[stage].endMs = 0;
+        g_bootProfilerRecords[stage].ended = false;
+    }
+    g_bootProfilerMutex.unlock();
+
+    return stage;
+}
+
+void BootProfiler_StageEnd(BOOT_PROFILER_STAGE stage)
+{
+    if ((stage >= 0) && (stage < BOOT_PROFILER_MAX_STAGES))
+    {
+        g_bootProfilerMutex.lock();
+        g_bootProfilerRecords[stage].endMs = GetKernelMs();
+        g_bootProfilerRecords[stage].ended = true;
+        g_bootProfilerMutex.unlock();
+    }
+}
+
+//
+// FindRecord returns the index of the record named name, or -1.  Called with g_bootProfilerMutex held.
+//
+static int FindRecord(const char* name)
+{
+    for (int i = 0; i < g_bootProfilerNumRecords; i++)
+    {
+        if (strcmp(g_bootProfilerRecords[i].name, name) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void BootProfiler_Milestone(const char* milestoneName)
+{
+    bool reached;
+
+    g_bootProfilerMutex.lock();
+    reached = (FindRecord(milestoneName) >= 0);
+    g_bootProfilerMutex.unlock();
+
+    if (reached == false)
+    {
+        BootProfiler_StageEnd(BootProfiler_StageBegin(milestoneName));
+    }
+}
+
+int32_t BootProfiler_GetElapsedMs(const char* milestoneName)
+{
+    int32_t elapsedMs = -1;
+    int index;
+
+    g_bootProfilerMutex.lock();
+    if (((index = FindRecord(milestoneName)) >= 0) && g_bootProfilerRecords[index].ended)
+    {
+        elapsedMs = (int32_t)g_bootProfilerRecords[index].endMs;
+    }
+    g_bootProfilerMutex.unlock();
+
+    return elapsedMs;
+}
+
+void BootProfiler_Report(void)
+{
+    g_bootProfilerMutex.lock();
+
+    LogInfo("Boot stage report (ms since kernel start):");
+    for (int i = 0; i < g_bootProfilerNumRecords; i++)
+    {
+        const BOOT_PROFILER_RECORD* record = &g_bootProfilerRecords[i];
+
+        if (record->ended)
+        {
+            LogInfo("  %-16s start=%6lu end=%6lu took=%6lu", record->name, (unsigned long)record->startMs, (unsigned long)record->endMs, (unsigned long)(record->endMs - record->startMs));
+        }
+        else
+        {
+            LogInfo("  %-16s start=%6lu (not finished)", record->name, (unsigned long)record->startMs);
+        }
+    }
+
+    g_bootProfilerMutex.unlock();
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header implements timing of boot stages, so that time-to-first-telemetry can be measured.
+// Stages may run on different threads and overlap.  Each records its start and end, relative to kernel start.
+
+#ifndef BOOT_PROFILER_H
+#define BOOT_PROFILER_H
+
+#include <stdint.h>
+
+//
+// Maximum number of stages and milestones that can be recorded in one boot.  Further ones are dropped.
+//
+#define BOOT_PROFILER_MAX_STAGES 16
+
+//
+// Handle of a recorded boot stage.  Negative if the stage could not be recorded.
+//
+typedef int BOOT_PROFILER_STAGE;
+
+//
+// BootProfiler_StageBegin records the start of the boot stage named stageName, which must be a string literal or otherwise outlive the report.
+//
+BOOT_PROFILER_STAGE BootProfiler_StageBegin(const char* stageName);
+
+//
+// BootProfiler_StageEnd records the end of the boot stage returned by BootProfiler_StageBegin.
+//
+void BootProfiler_StageEnd(BOOT_PROFILER_STAGE stage);
+
+//
+// BootProfiler_Milestone records a point in time, such as the first telemetry message, as a zero-length stage.
+// Only the first occurrence of a milestone name is recorded.
+//
+void BootProfiler_Milestone(const char* milestoneName);
+
+//
+// BootProfiler_GetElapsedMs returns the elapsed time, in milliseconds, from kernel start to the milestone milestoneName, or -1 if it has not been reached.
+//
+int32_t BootProfiler_GetElapsedMs(const char* milestoneName);
+
+//
+// BootProfiler_Report logs all recorded stages with their start, end and duration.
+//
+void BootProfiler_Report(void);
+
+#endif /* BOOT_PROFILER_H */
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Standard C header files
+#include <math.h>
+#include <string.h>
+
+#include "gyro_bias.h"
+
+// Standard deviations under which a window is still: some times the noise of BMX055 at its widest bandwidths
+#define GYRO_BIAS_STILL_GYRO_DPS 0.5f
+#define GYRO_BIAS_STILL_ACCEL_G 0.01f
+
+// Largest difference of the gyroscope means of consecutive still windows.  The noise of a mean is a fraction of it.
+#define GYRO_BIAS_AGREE_DPS 0.1f
+
+// Largest zero-rate offset learned.  A steady turn faster than this is never taken for the bias.
+#define GYRO_BIAS_MAX_DPS 5.0f
+
+// Weight of each still window after the first one
+#define GYRO_BIAS_ALPHA 0.2f
+
+//
+// Variance returns the variance of samples from the sum and sum of squares of their deviations from a reference
+//
+static float Variance(float sum, float sumSq, uint32_t numSamples)
+{
+    float mean = sum / numSamples;
+
+    return sumSq / numSamples - mean * mean;
+}
+
+void GyroBias_Init(GYRO_BIAS* gyroBias)
+{
+    memset(gyroBias, 0, sizeof(*gyroBias));
+}
+
+bool GyroBias_Add(GYRO_BIAS* gyroBias, const float gyro[3], const float accel[3])
+{
+    if (gyroBias->numSamples == 0)
+    {
+        memcpy(gyroBias->gyroFirst, gyro, sizeof(gyroBias->gyroFirst));
+        memcpy(gyroBias->accelFirst, accel, sizeof(gyroBias->accelFirst));
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        float gyroDeviation = gyro[i] - gyroBias->gyroFirst[i];
+        float accelDeviation = accel[i] - gyroBias->accelFirst[i];
+
+        gyroBias->gyroSum[i] += gyroDeviation;
+        gyroBias->gyroSumSq[i] += gyroDeviation * gyroDeviation;
+        gyroBias->accelSum[i] += accelDeviation;
+        gyroBias->accelSumSq[i] += accelDeviation * accelDeviation;
+    }
+
+    if (++gyroBias->numSamples < GYRO_BIAS_WINDOW_SAMPLES)
+    {
+        return false;
+    }
+
+    bool quiet = true;
+    float mean[3];
+
+    for (int i = 0; i < 3; i++)
+    {
+        mean[i] = gyroBias->gyroFirst[i] + gyroBias->gyroSum[i] / gyroBias->numSamples;
+
+        if ((Variance(gyroBias->gyroSum[i], gyroBias->gyroSumSq[i], gyroBias->numSamples) > GYRO_BIAS_STILL_GYRO_DPS * GYRO_BIAS_STILL_GYRO_DPS) ||
+            (Variance(gyroBias->accelSum[i], gyroBias->accelSumSq[i], gyroBias->numSamples) > GYRO_BIAS_STILL_ACCEL_G * GYRO_BIAS_STILL_ACCEL_G) ||
+            (fabsf(mean[i]) > GYRO_BIAS_MAX_DPS))
+        {
+            quiet = false;
+        }
+    }
+
+    bool still = quiet && gyroBias->lastQuiet;
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (fabsf(mean[i] - gyroBias->lastMean[i]) > GYRO_BIAS_AGREE_DPS)
+        {
+            still = false;
+        }
+    }
+
+    gyroBias->lastQuiet = quiet;
+    memcpy(gyroBias->lastMean, mean, sizeof(gyroBias->lastMean));
+
+    if (still)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            gyroBias->bias[i] = (gyroBias->stillWindows == 0) ? mean[i] : gyroBias->bias[i] + GYRO_BIAS_ALPHA * (mean[i] - gyroBias->bias[i]);
+        }
+        gyroBias->stillWindows++;
+    }
+
+    // Next window
+    gyroBias->numSamples = 0;
+    memset(gyroBias->gyroSum, 0, sizeof(gyroBias->gyroSum));
+    memset(gyroBias->gyroSumSq, 0, sizeof(gyroBias->gyroSumSq));
+    memset(gyroBias->accelSum, 0, sizeof(gyroBias->accelSum));
+    memset(gyroBias->accelSumSq, 0, sizeof(gyroBias->accelSumSq));
+
+    return still;
+}
+
+void GyroBias_Apply(const GYRO_BIAS* gyroBias, const float gyro[3], float compensated[3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        compensated[i] = gyro[i] - gyroBias->bias[i];
+    }
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header implements a gyroscope bias estimator, which learns the zero-rate offset of a gyroscope whenever the device is still.
+//
+// Samples of the gyroscope and accelerometer are grouped in windows of GYRO_BIAS_WINDOW_SAMPLES.  A window is still when neither sensor
+// varies more than its noise, the gyroscope mean is within the zero-rate offset a gyroscope may have, and it agrees with the mean of the
+// window before, which must have been still too: then the mean is the bias.  The last condition rejects slow turns, which look still
+// within one window.  Each still window refines the estimate by exponential smoothing, so it follows the bias as it drifts with temperature.
+
+#ifndef GYRO_BIAS_H
+#define GYRO_BIAS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Samples of one window
+//
+#define GYRO_BIAS_WINDOW_SAMPLES 32
+
+//
+// GYRO_BIAS is the state of one estimator
+//
+typedef struct GYRO_BIAS_TAG
+{
+    // Bias in deg/s, subtracted by GyroBias_Apply
+    float bias[3];
+    // Number of still windows the bias was learned from, 0 while it is unknown
+    uint32_t stillWindows;
+
+    // Whether the last window was quiet, and its gyroscope mean
+    bool lastQuiet;
+    float lastMean[3];
+
+    // Window in progress.  Sums are of the deviations from the first sample of the window, which keeps the variance exact in float.
+    uint32_t numSamples;
+    float gyroFirst[3];
+    float gyroSum[3];
+    float gyroSumSq[3];
+    float accelFirst[3];
+    float accelSum[3];
+    float accelSumSq[3];
+}
+GYRO_BIAS;
+
+//
+// GyroBias_Init starts an estimator with an unknown bias
+//
+void GyroBias_Init(GYRO_BIAS* gyroBias);
+
+//
+// GyroBias_Add adds a gyroscope sample in deg/s, with an accelerometer sample in g taken about the same time.
+// Returns true when it completes a still window, which updated the bias.
+//
+bool GyroBias_Add(GYRO_BIAS* gyroBias, const float gyro[3], const float accel[3]);
+
+//
+// GyroBias_Apply subtracts the bias from gyro into compensated.  They may be the same array.
+//
+void GyroBias_Apply(const GYRO_BIAS* gyroBias, const float gyro[3], float compensated[3]);
+
+#endif /* GYRO_BIAS_H */
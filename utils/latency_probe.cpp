@@ -0,0 +1,230 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Standard C header files
+#include <string.h>
+
+// Mbed port header files
+#include "mbed.h"
+
+// Core IoT SDK utilities
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "latency_probe.h"
+
+// Without DWT (e.g. Cortex-M0/M23), fall back to the microsecond ticker.  Units are then microseconds rather than cycles.
+#if defined(DWT_CTRL_CYCCNTENA_Msk)
+#define LATENCY_PROBE_USE_DWT 1
+#else
+#define LATENCY_PROBE_USE_DWT 0
+#endif
+
+//
+// LATENCY_HISTOGRAM aggregates the samples of one probe
+//
+typedef struct LATENCY_HISTOGRAM_TAG
+{
+    uint32_t count;
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint64_t totalCycles;
+    uint32_t buckets[LATENCY_PROBE_NUM_BUCKETS];
+}
+LATENCY_HISTOGRAM;
+
+static const char* const g_probeNames[LATENCY_PROBE_COUNT] =
+{
+    "telemetry",
+    "twin",
+    "command",
+    "i2cRead",
+    "doWork"
+};
+
+static LATENCY_HISTOGRAM g_histograms[LATENCY_PROBE_COUNT];
+
+//
+// CyclesPerUs returns the number of counter ticks per microsecond
+//
+static uint32_t CyclesPerUs(void)
+{
+#if LATENCY_PROBE_USE_DWT
+    return SystemCoreClock / 1000000;
+#else
+    return 1;
+#endif
+}
+
+//
+// Log2 returns the index of the highest bit set in value, or 0 if value is 0
+//
+static uint32_t Log2(uint32_t value)
+{
+    return (value != 0) ? (31 - __CLZ(value)) : 0;
+}
+
+void LatencyProbe_Init(void)
+{
+#if LATENCY_PROBE_USE_DWT
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+    LatencyProbe_Reset();
+}
+
+uint32_t LatencyProbe_Start(void)
+{
+#if LATENCY_PROBE_USE_DWT
+    return DWT->CYCCNT;
+#else
+    // Microseconds, truncated from the 64-bit ticker, so that buckets are right across a wrap of the HAL counter
+    return (uint32_t)ticker_read_us(get_us_ticker_data());
+#endif
+}
+
+void LatencyProbe_Stop(LATENCY_PROBE probe, uint32_t startCycles)
+{
+    // Unsigned subtraction is right across one counter wrap (~23 s of cycles at 192 MHz, ~71 min of microseconds).
+    // Sections are far shorter.
+    uint32_t cycles = LatencyProbe_Start() - startCycles;
+    LATENCY_HISTOGRAM* histogram = &g_histograms[probe];
+
+    // Probes may be hit from several threads, e.g. I2C reads
+    CriticalSectionLock lock;
+
+    histogram->count++;
+    histogram->totalCycles += cycles;
+    if (cycles < histogram->minCycles)
+    {
+        histogram->minCycles = cycles;
+    }
+    if (cycles > histogram->maxCycles)
+    {
+        histogram->maxCycles = cycles;
+    }
+    histogram->buckets[Log2(cycles)]++;
+}
+
+//
+// SnapshotHistogram copies the histogram of probe consistently
+//
+static void SnapshotHistogram(LATENCY_PROBE probe, LATENCY_HISTOGRAM* snapshot)
+{
+    CriticalSectionLock lock;
+
+    *snapshot = g_histograms[probe];
+}
+
+void LatencyProbe_Report(void)
+{
+    uint32_t cyclesPerUs = CyclesPerUs();
+
+    LogInfo("Latency histograms (%s, %lu per us):", LATENCY_PROBE_USE_DWT ? "cycles" : "us", (unsigned long)cyclesPerUs);
+
+    for (int probe = 0; probe < LATENCY_PROBE_COUNT; probe++)
+    {
+        LATENCY_HISTOGRAM histogram;
+
+        SnapshotHistogram((LATENCY_PROBE)probe, &histogram);
+
+        if (histogram.count == 0)
+        {
+            LogInfo("  %-10s no samples", g_probeNames[probe]);
+            continue;
+        }
+
+        LogInfo("  %-10s count=%lu min=%lu us avg=%lu us max=%lu us", g_probeNames[probe], (unsigned long)histogram.count,
+                (unsigned long)(histogram.minCycles / cyclesPerUs), (unsigned long)((histogram.totalCycles / histogram.count) / cyclesPerUs),
+                (unsigned long)(histogram.maxCycles / cyclesPerUs));
+
+        for (int bucket = 0; bucket < LATENCY_PROBE_NUM_BUCKETS; bucket++)
+        {
+            if (histogram.buckets[bucket] != 0)
+            {
+                LogInfo("    [2^%-2d, 2^%-2d) %lu", bucket, bucket + 1, (unsigned long)histogram.buckets[bucket]);
+            }
+        }
+    }
+}
+
+JSON_Value* LatencyProbe_ToJson(void)
+{
+    uint32_t cyclesPerUs = CyclesPerUs();
+    JSON_Value* rootValue = json_value_init_object();
+    JSON_Object* rootObject = json_value_get_object(rootValue);
+
+    if (rootObject == NULL)
+    {
+        return NULL;
+    }
+
+    json_object_set_number(rootObject, "cyclesPerUs", cyclesPerUs);
+
+    for (int probe = 0; probe < LATENCY_PROBE_COUNT; probe++)
+    {
+        LATENCY_HISTOGRAM histogram;
+        JSON_Value* probeValue = json_value_init_object();
+        JSON_Object* probeObject = json_value_get_object(probeValue);
+        JSON_Value* bucketsValue = json_value_init_array();
+        JSON_Array* bucketsArray = json_value_get_array(bucketsValue);
+
+        if ((probeObject == NULL) || (bucketsArray == NULL))
+        {
+            json_value_free(probeValue);
+            json_value_free(bucketsValue);
+            json_value_free(rootValue);
+            return NULL;
+        }
+
+        SnapshotHistogram((LATENCY_PROBE)probe, &histogram);
+
+        json_object_set_number(probeObject, "count", histogram.count);
+        json_object_set_number(probeObject, "minCycles", (histogram.count != 0) ? histogram.minCycles : 0);
+        json_object_set_number(probeObject, "maxCycles", histogram.maxCycles);
+        json_object_set_number(probeObject, "avgCycles", (histogram.count != 0) ? (double)(histogram.totalCycles / histogram.count) : 0);
+
+        // Bucket n counts samples of [2^n, 2^(n+1)) cycles.  Trailing empty buckets are left out.
+        int numBuckets = LATENCY_PROBE_NUM_BUCKETS;
+        while ((numBuckets > 0) && (histogram.buckets[numBuckets - 1] == 0))
+        {
+            numBuckets--;
+        }
+        for (int bucket = 0; bucket < numBuckets; bucket++)
+        {
+            json_array_append_number(bucketsArray, histogram.buckets[bucket]);
+        }
+
+        json_object_set_value(probeObject, "log2Buckets", bucketsValue);
+        json_object_set_value(rootObject, g_probeNames[probe], probeValue);
+    }
+
+    return rootValue;
+}
+
+void LatencyProbe_Reset(void)
+{
+    CriticalSectionLock lock;
+
+    memset(g_histograms, 0, sizeof(g_histograms));
+    for (int probe = 0; probe < LATENCY_PROBE_COUNT; probe++)
+    {
+        g_histograms[probe].minCycles = UINT32_MAX;
+    }
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header implements latency probes on the hot paths of the device, from a sensor read to a message handed to IoT Hub.
+//
+// Each probe times a code section with the DWT cycle counter and aggregates the samples into a histogram of power-of-two
+// buckets in RAM: bucket n counts samples of [2^n, 2^(n+1)) cycles.  Recording a sample is a few dozen cycles, so the
+// probes are left on in production, and comparing histograms across firmware builds reveals regressions.
+
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <stdint.h>
+
+#include "parson.h"
+
+//
+// Code sections timed by latency probes
+//
+typedef enum LATENCY_PROBE_TAG
+{
+    // Building and queueing one telemetry message
+    LATENCY_PROBE_TELEMETRY,
+    // Processing a device twin (PnP properties)
+    LATENCY_PROBE_TWIN,
+    // Processing a device method (PnP command)
+    LATENCY_PROBE_COMMAND,
+    // Reading a sample from the motion sensor over I2C
+    LATENCY_PROBE_I2C_READ,
+    // One IoTHubDeviceClient_LL_DoWork call
+    LATENCY_PROBE_DOWORK,
+    LATENCY_PROBE_COUNT
+} LATENCY_PROBE;
+
+//
+// Number of histogram buckets, enough for any 32-bit cycle count
+//
+#define LATENCY_PROBE_NUM_BUCKETS 32
+
+//
+// LatencyProbe_Init enables the cycle counter.  Call it once at boot, before any probe.
+//
+void LatencyProbe_Init(void);
+
+//
+// LatencyProbe_Start returns the current cycle count, to pass to LatencyProbe_Stop at the end of the timed section.
+//
+uint32_t LatencyProbe_Start(void);
+
+//
+// LatencyProbe_Stop records the cycles elapsed since startCycles as a sample of probe.
+//
+void LatencyProbe_Stop(LATENCY_PROBE probe, uint32_t startCycles);
+
+//
+// LatencyProbe_Report logs the histograms of all probes over serial.
+//
+void LatencyProbe_Report(void);
+
+//
+// LatencyProbe_ToJson returns the histograms of all probes as a JSON object, or NULL if out of memory.
+// The caller frees it with json_value_free.
+//
+JSON_Value* LatencyProbe_ToJson(void);
+
+//
+// LatencyProbe_Reset clears the histograms of all probes.
+//
+void LatencyProbe_Reset(void);
+
+#endif /* LATENCY_PROBE_H */
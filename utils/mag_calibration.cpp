@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Standard C header files
+#include <math.h>
+#include <string.h>
+
+#include "mag_calibration.h"
+
+// Samples are scaled to units of about the Earth field so that the normal equations, of up to 4th powers, stay well conditioned
+#define MAG_CALIBRATION_SCALE_UT 64.0
+
+// Plausible strength of the Earth field in uT, and ratio of the longest to the shortest axis of the ellipsoid
+#define MAG_CALIBRATION_MIN_FIELD_UT 15.0
+#define MAG_CALIBRATION_MAX_FIELD_UT 100.0
+#define MAG_CALIBRATION_MAX_AXIS_RATIO 2.0
+
+// Jacobi sweeps for the eigenvalues of a 3x3 matrix.  It converges in 4 to 6.
+#define MAG_CALIBRATION_MAX_SWEEPS 50
+
+//
+// SolveLinear solves a * x = b of n unknowns by Gaussian elimination with partial pivoting.  a and b are destroyed.
+// Returns false if a is singular.
+//
+static bool SolveLinear(double* a, double* b, double* x, int n)
+{
+    double scale = 0.0;
+
+    for (int i = 0; i < n * n; i++)
+    {
+        scale = fmax(scale, fabs(a[i]));
+    }
+
+    for (int col = 0; col < n; col++)
+    {
+        int pivot = col;
+
+        for (int row = col + 1; row < n; row++)
+        {
+            if (fabs(a[row * n + col]) > fabs(a[pivot * n + col]))
+            {
+                pivot = row;
+            }
+        }
+
+        if (fabs(a[pivot * n + col]) <= scale * 1e-12)
+        {
+            return false;
+        }
+
+        if (pivot != col)
+        {
+            for (int k = 0; k < n; k++)
+            {
+                double t = a[col * n + k];
+                a[col * n + k] = a[pivot * n + k];
+                a[pivot * n + k] = t;
+            }
+            double t = b[col];
+            b[col] = b[pivot];
+            b[pivot] = t;
+        }
+
+        for (int row = col + 1; row < n; row++)
+        {
+            double f = a[row * n + col] / a[col * n + col];
+
+            for (int k = col; k < n; k++)
+            {
+                a[row * n + k] -= f * a[col * n + k];
+            }
+            b[row] -= f * b[col];
+        }
+    }
+
+    for (int row = n - 1; row >= 0; row--)
+    {
+        double sum = b[row];
+
+        for (int k = row + 1; k < n; k++)
+        {
+            sum -= a[row * n + k] * x[k];
+        }
+        x[row] = sum / a[row * n + row];
+    }
+
+    return true;
+}
+
+//
+// Eigen3 diagonalizes the symmetric a by Jacobi rotations: a ends up with the eigenvalues on its diagonal, and v with the eigenvectors in its columns
+//
+static void Eigen3(double a[3][3], double v[3][3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            v[i][j] = (i == j) ? 1.0 : 0.0;
+        }
+    }
+
+    for (int sweep = 0; sweep < MAG_CALIBRATION_MAX_SWEEPS; sweep++)
+    {
+        double off = a[0][1] * a[0][1] + a[0][2] * a[0][2] + a[1][2] * a[1][2];
+        double diag = a[0][0] * a[0][0] + a[1][1] * a[1][1] + a[2][2] * a[2][2];
+
+        if (off <= diag * 1e-24)
+        {
+            break;
+        }
+
+        for (int p = 0; p < 2; p++)
+        {
+            for (int q = p + 1; q < 3; q++)
+            {
+                if (a[p][q] == 0.0)
+                {
+                    continue;
+                }
+
+                // Rotation which zeroes a[p][q]
+                double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                double t = ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0);
+                double s = t * c;
+
+                for (int k = 0; k < 3; k++)
+                {
+                    double akp = a[k][p];
+                    double akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    double apk = a[p][k];
+                    double aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < 3; k++)
+                {
+                    double vkp = v[k][p];
+                    double vkq = v[k][q];
+                    v[k][p] = c * vkp - s * vkq;
+                    v[k][q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+void MagCalibration_Identity(MAG_CALIBRATION* calibration)
+{
+    memset(calibration, 0, sizeof(*calibration));
+
+    for (int i = 0; i < 3; i++)
+    {
+        calibration->softIron[i][i] = 1.0f;
+    }
+}
+
+void MagCalibration_Apply(const MAG_CALIBRATION* calibration, const float raw[3], float calibrated[3])
+{
+    float centered[3];
+
+    for (int i = 0; i < 3; i++)
+    {
+        centered[i] = raw[i] - calibration->offset[i];
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        calibrated[i] = calibration->softIron[i][0] * centered[0] +
+                        calibration->softIron[i][1] * centered[1] +
+                        calibration->softIron[i][2] * centered[2];
+    }
+}
+
+void MagCalibration_FitReset(MAG_CALIBRATION_FIT* fit)
+{
+    memset(fit, 0, sizeof(*fit));
+}
+
+void MagCalibration_FitAdd(MAG_CALIBRATION_FIT* fit, const float raw[3])
+{
+    double x = raw[0] / MAG_CALIBRATION_SCALE_UT;
+    double y = raw[1] / MAG_CALIBRATION_SCALE_UT;
+    double z = raw[2] / MAG_CALIBRATION_SCALE_UT;
+
+    // Row of the design matrix, for the unknowns of x'Mx + 2v'x = 1: Mxx, Myy, Mzz, Mxy, Mxz, Myz, vx, vy, vz
+    const double d[9] = { x * x, y * y, z * z, 2.0 * x * y, 2.0 * x * z, 2.0 * y * z, 2.0 * x, 2.0 * y, 2.0 * z };
+
+    for (int i = 0; i < 9; i++)
+    {
+        for (int j = i; j < 9; j++)
+        {
+            fit->dtd[i][j] += d[i] * d[j];
+        }
+        fit->dt1[i] += d[i];
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        if ((fit->numSamples == 0) || (raw[i] < fit->min[i]))
+        {
+            fit->min[i] = raw[i];
+        }
+        if ((fit->numSamples == 0) || (raw[i] > fit->max[i]))
+        {
+            fit->max[i] = raw[i];
+        }
+    }
+
+    fit->numSamples++;
+}
+
+MAG_CALIBRATION_RESULT MagCalibration_FitSolve(const MAG_CALIBRATION_FIT* fit, MAG_CALIBRATION* calibration)
+{
+    double a[9 * 9];
+    double b[9];
+    double p[9];
+
+    if (fit->numSamples < MAG_CALIBRATION_MIN_SAMPLES)
+    {
+        return MAG_CALIBRATION_TOO_FEW_SAMPLES;
+    }
+
+    for (int i = 0; i < 9; i++)
+    {
+        for (int j = 0; j < 9; j++)
+        {
+            a[i * 9 + j] = (j >= i) ? fit->dtd[i][j] : fit->dtd[j][i];
+        }
+        b[i] = fit->dt1[i];
+    }
+
+    if (SolveLinear(a, b, p, 9) == false)
+    {
+        return MAG_CALIBRATION_NO_ELLIPSOID;
+    }
+
+    // Center of the quadric: c = -inv(M) * v
+    double m[3][3] = { { p[0], p[3], p[4] }, { p[3], p[1], p[5] }, { p[4], p[5], p[2] } };
+    double mc[3 * 3];
+    double minusV[3] = { -p[6], -p[7], -p[8] };
+    double center[3];
+
+    memcpy(mc, m, sizeof(mc));
+    if (SolveLinear(mc, minusV, center, 3) == false)
+    {
+        return MAG_CALIBRATION_NO_ELLIPSOID;
+    }
+
+    // Moved to the center, the quadric is y'My = 1 + c'Mc.  With the origin outside of the ellipsoid, as when the hard-iron offset
+    // exceeds the field, M and k are both negative.
+    double k = 1.0;
+
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            k += center[i] * m[i][j] * center[j];
+        }
+    }
+
+    if (fabs(k) < 1e-12)
+    {
+        return MAG_CALIBRATION_NO_ELLIPSOID;
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            m[i][j] /= k;
+        }
+    }
+
+    // An ellipsoid has all eigenvalues positive, each 1 / radius^2 along its eigenvector
+    double v[3][3];
+    double radius[3];
+
+    Eigen3(m, v);
+
+    for (int i = 0; i < 3; i++)
+    {
+        if (m[i][i] <= 0.0)
+        {
+            return MAG_CALIBRATION_NO_ELLIPSOID;
+        }
+        radius[i] = 1.0 / sqrt(m[i][i]);
+    }
+
+    double minRadius = fmin(radius[0], fmin(radius[1], radius[2]));
+    double maxRadius = fmax(radius[0], fmax(radius[1], radius[2]));
+    double fieldStrength = cbrt(radius[0] * radius[1] * radius[2]);
+
+    if ((fieldStrength * MAG_CALIBRATION_SCALE_UT < MAG_CALIBRATION_MIN_FIELD_UT) ||
+        (fieldStrength * MAG_CALIBRATION_SCALE_UT > MAG_CALIBRATION_MAX_FIELD_UT) ||
+        (maxRadius > minRadius * MAG_CALIBRATION_MAX_AXIS_RATIO))
+    {
+        return MAG_CALIBRATION_IMPLAUSIBLE;
+    }
+
+    // Turned around fully, samples span about the diameter on each axis.  Half of it is enough for a good fit.
+    for (int i = 0; i < 3; i++)
+    {
+        if (fit->max[i] - fit->min[i] < fieldStrength * MAG_CALIBRATION_SCALE_UT)
+        {
+            return MAG_CALIBRATION_TOO_LITTLE_ROTATION;
+        }
+    }
+
+    // Soft-iron correction maps the ellipsoid onto the sphere of the same volume: V * diag(fieldStrength / radius) * V'
+    for (int i = 0; i < 3; i++)
+    {
+        for (int j = 0; j < 3; j++)
+        {
+            double w = 0.0;
+
+            for (int e = 0; e < 3; e++)
+            {
+                w += v[i][e] * (fieldStrength / radius[e]) * v[j][e];
+            }
+            calibration->softIron[i][j] = (float)w;
+        }
+        calibration->offset[i] = (float)(center[i] * MAG_CALIBRATION_SCALE_UT);
+    }
+    calibration->fieldStrength = (float)(fieldStrength * MAG_CALIBRATION_SCALE_UT);
+
+    return MAG_CALIBRATION_OK;
+}
+
+const char* MagCalibration_ResultString(MAG_CALIBRATION_RESULT result)
+{
+    switch (result)
+    {
+        case MAG_CALIBRATION_OK:
+            return "success";
+        case MAG_CALIBRATION_TOO_FEW_SAMPLES:
+            return "too few samples";
+        case MAG_CALIBRATION_TOO_LITTLE_ROTATION:
+            return "turn the device around all axes";
+        case MAG_CALIBRATION_NO_ELLIPSOID:
+            return "samples fit no ellipsoid";
+        case MAG_CALIBRATION_IMPLAUSIBLE:
+            return "field implausible, keep away from magnets";
+        default:
+            return "unknown";
+    }
+}
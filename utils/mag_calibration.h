@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header implements hard-iron and soft-iron calibration of a 3-axis magnetometer by online ellipsoid fitting.
+//
+// With no distortion, magnetometer samples taken while the device is turned around lie on a sphere of the local field strength
+// about the origin.  Ferromagnetic parts on the board shift the sphere (hard iron) and stretch it into a rotated ellipsoid (soft iron).
+// Samples are fitted to the general quadric x'Mx + 2v'x = 1 by least squares.  Only the normal equations are accumulated per sample,
+// so the fit takes constant memory however long the device is turned.
+
+#ifndef MAG_CALIBRATION_H
+#define MAG_CALIBRATION_H
+
+#include <stdint.h>
+
+//
+// MAG_CALIBRATION maps a raw sample m to the calibrated one softIron * (m - offset), which lies on a sphere of fieldStrength
+//
+typedef struct MAG_CALIBRATION_TAG
+{
+    // Hard-iron offset in uT
+    float offset[3];
+    // Soft-iron correction, row major
+    float softIron[3][3];
+    // Radius of the fitted sphere in uT, 0 when not calibrated
+    float fieldStrength;
+}
+MAG_CALIBRATION;
+
+//
+// MAG_CALIBRATION_FIT accumulates samples of a fit in progress
+//
+typedef struct MAG_CALIBRATION_FIT_TAG
+{
+    // Normal equations of the least squares, upper triangle only
+    double dtd[9][9];
+    double dt1[9];
+    // Extent of the samples on each axis in uT, to tell whether the device was turned enough
+    float min[3];
+    float max[3];
+    uint32_t numSamples;
+}
+MAG_CALIBRATION_FIT;
+
+//
+// Outcome of MagCalibration_FitSolve
+//
+typedef enum MAG_CALIBRATION_RESULT_TAG
+{
+    MAG_CALIBRATION_OK,
+    // Fewer than MAG_CALIBRATION_MIN_SAMPLES samples
+    MAG_CALIBRATION_TOO_FEW_SAMPLES,
+    // Samples do not span the ellipsoid on every axis
+    MAG_CALIBRATION_TOO_LITTLE_ROTATION,
+    // Samples fit no ellipsoid, e.g. a plane when turned about one axis only
+    MAG_CALIBRATION_NO_ELLIPSOID,
+    // The ellipsoid is not of an Earth field, e.g. magnets nearby
+    MAG_CALIBRATION_IMPLAUSIBLE
+} MAG_CALIBRATION_RESULT;
+
+#define MAG_CALIBRATION_MIN_SAMPLES 50
+
+//
+// MagCalibration_Identity sets calibration to no correction
+//
+void MagCalibration_Identity(MAG_CALIBRATION* calibration);
+
+//
+// MagCalibration_Apply corrects raw, in uT, into calibrated.  They may be the same array.
+//
+void MagCalibration_Apply(const MAG_CALIBRATION* calibration, const float raw[3], float calibrated[3]);
+
+//
+// MagCalibration_FitReset starts a new fit
+//
+void MagCalibration_FitReset(MAG_CALIBRATION_FIT* fit);
+
+//
+// MagCalibration_FitAdd adds a raw sample in uT to the fit
+//
+void MagCalibration_FitAdd(MAG_CALIBRATION_FIT* fit, const float raw[3]);
+
+//
+// MagCalibration_FitSolve solves the fit for calibration, which is left unchanged unless MAG_CALIBRATION_OK is returned
+//
+MAG_CALIBRATION_RESULT MagCalibration_FitSolve(const MAG_CALIBRATION_FIT* fit, MAG_CALIBRATION* calibration);
+
+//
+// MagCalibration_ResultString describes result
+//
+const char* MagCalibration_ResultString(MAG_CALIBRATION_RESULT result);
+
+#endif /* MAG_CALIBRATION_H */
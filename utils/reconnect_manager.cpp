@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Standard C header files
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Mbed port header files
+#include "mbed.h"
+
+// Core IoT SDK utilities
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "reconnect_manager.h"
+
+// Backoff of network re-association attempts: the n-th waits a random time between half and all of min(base * 2^n, max).
+static const uint32_t g_reconnectBackoffBaseMs = 1000;
+static const uint32_t g_reconnectBackoffMaxMs = MBED_CONF_APP_NETWORK_RECONNECT_MAX_BACKOFF * 1000;
+
+// Set by the network status listener when the link drops
+#define RECONNECT_FLAG_LINK_DOWN    0x1
+
+static NetworkInterface* g_network = NULL;
+
+static EventFlags g_reconnectFlags;
+
+static Thread g_reconnectThread(osPriorityBelowNormal, 4096, nullptr, "reconnect");
+
+// Network link state, updated from the network status listener and read from the main thread.  Guarded by CriticalSectionLock,
+// as the listener runs in whatever context the network driver reports from.
+static bool g_linkDown = false;
+static uint32_t g_linkDownStartMs = 0;
+static uint32_t g_linkUpMs = 0;
+static uint32_t g_linkDownTotalMs = 0;
+static uint32_t g_networkReconnectAttempts = 0;
+
+// IoT Hub connection state, only accessed from the thread calling IoTHubDeviceClient_LL_DoWork
+static bool g_hubEverConnected = false;
+static bool g_hubConnected = false;
+static uint32_t g_hubConnectStartMs = 0;
+static RECONNECT_REPORT g_report;
+static bool g_reportPending = false;
+
+//
+// NowMs returns the kernel time in milliseconds
+//
+static uint32_t NowMs(void)
+{
+    return (uint32_t)Kernel::Clock::now().time_since_epoch().count();
+}
+
+//
+// SeedRandom seeds rand() differently on each device and boot.  Unseeded, every device would draw the same "random" jitter.
+//
+static void SeedRandom(NetworkInterface* network)
+{
+    const char* mac = network->get_mac_address();
+    // FNV-1a over the MAC address
+    uint32_t seed = 2166136261u;
+
+    for (; (mac != NULL) && (*mac != '\0'); mac++)
+    {
+        seed = (seed ^ (uint8_t)*mac) * 16777619u;
+    }
+
+    srand(seed ^ NowMs() ^ (uint32_t)time(NULL));
+}
+
+//
+// JitteredBackoffMs returns how long to wait before the re-association attempt numbered attempt, counting from 0
+//
+static uint32_t JitteredBackoffMs(uint32_t attempt)
+{
+    uint32_t backoffMs = g_reconnectBackoffMaxMs;
+
+    if ((attempt < 16) && ((g_reconnectBackoffBaseMs << attempt) < g_reconnectBackoffMaxMs))
+    {
+        backoffMs = g_reconnectBackoffBaseMs << attempt;
+    }
+
+    return (backoffMs / 2) + ((uint32_t)rand() % ((backoffMs / 2) + 1));
+}
+
+//
+// ReconnectManager_NetworkStatusListener tracks the network link from the status events of the network interface
+//
+static void ReconnectManager_NetworkStatusListener(nsapi_event_t event, intptr_t value)
+{
+    if (event != NSAPI_EVENT_CONNECTION_STATUS_CHANGE)
+    {
+        return;
+    }
+
+    CriticalSectionLock lock;
+
+    if ((value == NSAPI_STATUS_DISCONNECTED) && (g_linkDown == false))
+    {
+        g_linkDown = true;
+        g_linkDownStartMs = NowMs();
+        g_reconnectFlags.set(RECONNECT_FLAG_LINK_DOWN);
+    }
+    else if ((value == NSAPI_STATUS_GLOBAL_UP) && g_linkDown)
+    {
+        g_linkDown = false;
+        g_linkUpMs = NowMs();
+        g_linkDownTotalMs += g_linkUpMs - g_linkDownStartMs;
+    }
+}
+
+//
+// ReconnectManager_Thread re-associates with the network whenever the link drops, until it is up again
+//
+static void ReconnectManager_Thread(void)
+{
+    while (true)
+    {
+        g_reconnectFlags.wait_any(RECONNECT_FLAG_LINK_DOWN);
+
+        LogInfo("Network link down.  Re-associating");
+
+        for (uint32_t attempt = 0; ; attempt++)
+        {
+            ThisThread::sleep_for(std::chrono::milliseconds(JitteredBackoffMs(attempt)));
+
+            // Some interfaces (e.g. Ethernet on cable plug-in) bring the link back by themselves.
+            if (g_network->get_connection_status() == NSAPI_STATUS_GLOBAL_UP)
+            {
+                break;
+            }
+
+            core_util_atomic_incr_u32(&g_networkReconnectAttempts, 1);
+
+            nsapi_error_t ret = g_network->connect();
+            if (ret == NSAPI_ERROR_OK)
+            {
+                LogInfo("Network re-associated after %lu attempt(s)", (unsigned long)(attempt + 1));
+                break;
+            }
+            else if ((ret == NSAPI_ERROR_IS_CONNECTED) || (ret == NSAPI_ERROR_ALREADY) || (ret == NSAPI_ERROR_BUSY))
+            {
+                // The interface is already bringing the link back itself.  Keep waiting for it.
+                continue;
+            }
+            else
+            {
+                LogError("Network re-association failed, error=%d", ret);
+                // Start over clean on the next attempt
+                (void)g_network->disconnect();
+            }
+        }
+    }
+}
+
+void ReconnectManager_Start(NetworkInterface* network)
+{
+    static bool started = false;
+
+    if (started == false)
+    {
+        started = true;
+        g_network = network;
+        SeedRandom(network);
+        network->add_event_listener(mbed::callback(ReconnectManager_NetworkStatusListener));
+        g_reconnectThread.start(ReconnectManager_Thread);
+    }
+
+    // The IoT Hub client connects on its first DoWork
+    g_hubConnectStartMs = NowMs();
+}
+
+void ReconnectManager_OnHubConnectionStatus(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
+{
+    uint32_t nowMs = NowMs();
+
+    if (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED)
+    {
+        if (g_hubConnected)
+        {
+            return;
+        }
+
+        if (g_hubEverConnected == false)
+        {
+            LogInfo("Connected to IoT Hub in %lu ms", (unsigned long)(nowMs - g_hubConnectStartMs));
+        }
+        else
+        {
+            CriticalSectionLock lock;
+
+            // Count a link still down, e.g. reported up late by the driver, up to now
+            uint32_t networkDownMs = g_linkDownTotalMs + (g_linkDown ? (nowMs - g_linkDownStartMs) : 0);
+            uint32_t reconnectFromMs = ((networkDownMs != 0) && (g_linkDown == false)) ? g_linkUpMs : g_hubConnectStartMs;
+
+            g_report.outageCount++;
+            g_report.outageDurationMs = nowMs - g_hubConnectStartMs;
+            g_report.networkDownMs = networkDownMs;
+            g_report.reconnectLatencyMs = nowMs - reconnectFromMs;
+            g_report.networkReconnectAttempts = g_networkReconnectAttempts;
+            g_reportPending = true;
+        }
+
+        g_hubEverConnected = true;
+        g_hubConnected = true;
+    }
+    else if (g_hubConnected || (g_hubEverConnected == false))
+    {
+        // Start of an outage, or a failed first connection which the retry policy takes over from here
+        CriticalSectionLock lock;
+
+        g_hubConnected = false;
+        g_hubConnectStartMs = nowMs;
+        g_linkDownTotalMs = 0;
+        g_networkReconnectAttempts = 0;
+        if (g_linkDown)
+        {
+            // The link dropped before IoT Hub noticed.  Count it from here on.
+            g_linkDownStartMs = nowMs;
+        }
+
+        if (g_hubEverConnected)
+        {
+            LogInfo("Lost IoT Hub connection, reason=%d.  Retrying with jittered exponential backoff", (int)reason);
+        }
+    }
+}
+
+bool ReconnectManager_IsInOutage(void)
+{
+    return g_hubEverConnected && (g_hubConnected == false);
+}
+
+bool ReconnectManager_TakeReport(RECONNECT_REPORT* report)
+{
+    bool result = g_reportPending;
+
+    if (result)
+    {
+        *report = g_report;
+        g_reportPending = false;
+    }
+
+    return result;
+}
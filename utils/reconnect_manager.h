@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header implements the reconnection manager of the device.
+//
+// The IoT Hub client reconnects by itself, per its retry policy.  But it cannot bring back the network link under it, so when
+// Wi-Fi drops, the manager re-associates with the AP, with jittered exponential backoff so that a fleet losing the same AP
+// does not come back in lockstep.  It also measures each outage, to be reported as telemetry once connected again.
+
+#ifndef RECONNECT_MANAGER_H
+#define RECONNECT_MANAGER_H
+
+#include "mbed.h"
+#include "iothub_device_client_ll.h"
+
+//
+// RECONNECT_REPORT describes the last outage of the IoT Hub connection
+//
+typedef struct RECONNECT_REPORT_TAG
+{
+    // Number of outages since boot, this one included
+    uint32_t outageCount;
+    // Time, in milliseconds, from losing the IoT Hub connection to being authenticated again
+    uint32_t outageDurationMs;
+    // Time, in milliseconds, the network link was down during the outage.  0 if only IoT Hub was unreachable.
+    uint32_t networkDownMs;
+    // Time, in milliseconds, from the network link being back (or from losing IoT Hub if the link stayed up) to being authenticated again
+    uint32_t reconnectLatencyMs;
+    // Number of re-association attempts with the network during the outage
+    uint32_t networkReconnectAttempts;
+} RECONNECT_REPORT;
+
+//
+// ReconnectManager_Start starts watching the network link for drops, and a low priority thread re-associating it.
+// It also seeds rand() per device, which the IoT Hub client draws its retry jitter from too.  Call it once the network is connected
+// and the IoT Hub client is about to connect.
+//
+void ReconnectManager_Start(NetworkInterface* network);
+
+//
+// ReconnectManager_OnHubConnectionStatus tracks the IoT Hub connection.  Call it from the connection status callback of the IoT Hub client.
+//
+void ReconnectManager_OnHubConnectionStatus(IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason);
+
+//
+// ReconnectManager_IsInOutage returns whether the IoT Hub connection, once established, is currently lost.
+// Telemetry is not worth queueing meanwhile; the IoT Hub client would keep it all in memory until reconnected.
+//
+bool ReconnectManager_IsInOutage(void);
+
+//
+// ReconnectManager_TakeReport returns, once, the report of the outage that has just ended.  Returns false if there is none pending.
+//
+bool ReconnectManager_TakeReport(RECONNECT_REPORT* report);
+
+#endif /* RECONNECT_MANAGER_H */
@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Standard C header files
+#include <math.h>
+#include <string.h>
+
+#include "stream_stats.h"
+
+void StreamStats_Reset(STREAM_STATS* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void StreamStats_Add(STREAM_STATS* stats, float sample)
+{
+    if (stats->count == 0)
+    {
+        stats->min = sample;
+        stats->max = sample;
+    }
+    else if (sample < stats->min)
+    {
+        stats->min = sample;
+    }
+    else if (sample > stats->max)
+    {
+        stats->max = sample;
+    }
+
+    stats->count++;
+
+    float delta = sample - stats->mean;
+    stats->mean += delta / stats->count;
+    stats->m2 += delta * (sample - stats->mean);
+}
+
+float StreamStats_StdDev(const STREAM_STATS* stats)
+{
+    if (stats->count == 0)
+    {
+        return 0.0f;
+    }
+
+    return sqrtf(stats->m2 / stats->count);
+}
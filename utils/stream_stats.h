@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header implements streaming statistics of a signal: the count, minimum, maximum, mean and variance of its samples, updated in
+// constant time and memory as each sample comes.
+//
+// The mean and variance follow Welford's method, which updates the mean and the sum of squared deviations from it, rather than the sum
+// of squares of the samples.  The latter cancels catastrophically in float when the signal varies little around a large value, such as
+// an accelerometer axis reading 1 g.
+
+#ifndef STREAM_STATS_H
+#define STREAM_STATS_H
+
+#include <stdint.h>
+
+//
+// STREAM_STATS is the state of the statistics of one signal
+//
+typedef struct STREAM_STATS_TAG
+{
+    uint32_t count;
+    float min;
+    float max;
+    float mean;
+    // Sum of squared deviations from the mean
+    float m2;
+}
+STREAM_STATS;
+
+//
+// StreamStats_Reset empties stats
+//
+void StreamStats_Reset(STREAM_STATS* stats);
+
+//
+// StreamStats_Add adds a sample to stats
+//
+void StreamStats_Add(STREAM_STATS* stats, float sample);
+
+//
+// StreamStats_StdDev returns the population standard deviation of the samples, 0 if there are none
+//
+float StreamStats_StdDev(const STREAM_STATS* stats);
+
+#endif /* STREAM_STATS_H */
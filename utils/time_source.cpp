@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Standard C header files
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Mbed port header files
+#include "mbed.h"
+#include "NTPClient.h"
+#include "kvstore_global_api.h"
+
+// Core IoT SDK utilities
+#include "azure_c_shared_utility/xlogging.h"
+
+#include "time_source.h"
+
+// NTP server to sync time from
+static const char g_ntpServer[] = "time.google.com";
+static const int g_ntpPort = 123;
+
+// Interval of background NTP refresh once time has been synced, and of retries until then
+static const auto g_ntpRefreshInterval = 24h;
+static const auto g_ntpRetryInterval = 60s;
+
+// The RTC is not trusted without NTP if the last sync is older than this, as its drift may have accumulated beyond compensation.
+static const int64_t g_rtcMaxTrustedAgeSecs = 30 * 24 * 3600;
+
+// Minimum interval between two NTP syncs to take a drift measurement from.  Shorter ones are dominated by NTP's 1 s resolution.
+static const int64_t g_driftMinMeasureSecs = 3600;
+
+// KVStore key under which TIME_SOURCE_RECORD is kept
+static const char g_timeSourceKey[] = "/kv/time_source";
+
+// Marks a valid TIME_SOURCE_RECORD.  Bump it whenever the layout changes.
+#define TIME_SOURCE_MAGIC 0x54535231
+
+//
+// TIME_SOURCE_RECORD is the time source state persisted in KVStore
+//
+typedef struct TIME_SOURCE_RECORD_TAG
+{
+    uint32_t magic;
+    // RTC drift estimate in parts per million; positive if the RTC runs fast
+    int32_t driftPpm;
+    // Time of the last NTP sync, which the RTC was set to
+    int64_t lastSyncTime;
+    // Total seconds the RTC has been stepped by drift compensation since the last sync
+    int64_t rtcCorrection;
+}
+TIME_SOURCE_RECORD;
+
+static TIME_SOURCE_RECORD g_timeSourceRecord;
+static bool g_timeSourceRecordValid = false;
+static bool g_timeSourceSynced = false;
+
+// NTP syncs may come from main() and the background refresh thread
+static Mutex g_timeSourceMutex;
+
+static Thread g_timeSourceRefreshThread(osPriorityLow, 4096, nullptr, "timeRefresh");
+
+//
+// LoadRecord reads TIME_SOURCE_RECORD from KVStore into g_timeSourceRecord
+//
+static void LoadRecord(void)
+{
+    size_t actualSize = 0;
+
+    g_timeSourceRecordValid = (kv_get(g_timeSourceKey, &g_timeSourceRecord, sizeof(g_timeSourceRecord), &actualSize) == 0) &&
+                              (actualSize == sizeof(g_timeSourceRecord)) &&
+                              (g_timeSourceRecord.magic == TIME_SOURCE_MAGIC);
+}
+
+//
+// StoreRecord writes g_timeSourceRecord to KVStore
+//
+static void StoreRecord(void)
+{
+    int kvResult;
+
+    g_timeSourceRecord.magic = TIME_SOURCE_MAGIC;
+    if ((kvResult = kv_set(g_timeSourceKey, &g_timeSourceRecord, sizeof(g_timeSourceRecord), 0)) != 0)
+    {
+        LogError("Unable to persist time source state, error=%d", kvResult);
+    }
+    else
+    {
+        g_timeSourceRecordValid = true;
+    }
+}
+
+//
+// IsWarmReset returns whether the last reset kept the RTC domain running, i.e. it was not a power-on or brown-out reset.
+//
+static bool IsWarmReset(void)
+{
+#if DEVICE_RESET_REASON
+    reset_reason_t resetReason = ResetReason::get();
+
+    return (resetReason != RESET_REASON_POWER_ON) && (resetReason != RESET_REASON_BROWN_OUT);
+#else
+    return false;
+#endif
+}
+
+bool TimeSource_RestoreFromRtc(void)
+{
+    bool result;
+
+    rtc_init();
+
+    g_timeSourceMutex.lock();
+
+    LoadRecord();
+
+    int64_t rtcNow = (int64_t)rtc_read();
+
+    if (g_timeSourceRecordValid == false)
+    {
+        LogInfo("No time synced before.  Waiting for NTP");
+        result = false;
+    }
+    else if (IsWarmReset() == false)
+    {
+        LogInfo("Cold reset.  RTC is not trusted without NTP");
+        result = false;
+    }
+    else if ((rtcNow < g_timeSourceRecord.lastSyncTime) || ((rtcNow - g_timeSourceRecord.lastSyncTime) > g_rtcMaxTrustedAgeSecs))
+    {
+        LogInfo("RTC inconsistent with last NTP sync.  RTC is not trusted without NTP");
+        result = false;
+    }
+    else
+    {
+        // Compensate the drift accumulated since the last sync, minus what previous warm boots have compensated already.
+        int64_t rtcUncorrected = rtcNow - g_timeSourceRecord.rtcCorrection;
+        int64_t expectedCorrection = -((rtcUncorrected - g_timeSourceRecord.lastSyncTime) * g_timeSourceRecord.driftPpm) / 1000000;
+        int64_t delta = expectedCorrection - g_timeSourceRecord.rtcCorrection;
+
+        if ((delta >= 1) || (delta <= -1))
+        {
+            rtcNow += delta;
+            rtc_write((time_t)rtcNow);
+            g_timeSourceRecord.rtcCorrection += delta;
+            StoreRecord();
+        }
+
+        time_t timestamp = (time_t)rtcNow;
+        LogInfo("Warm reset.  Trusting RTC (drift=%ld ppm, compensated %ld s): %s", (long)g_timeSourceRecord.driftPpm, (long)delta, ctime(&timestamp));
+        result = true;
+    }
+
+    g_timeSourceMutex.unlock();
+
+    return result;
+}
+
+bool TimeSource_SyncFromNtp(NetworkInterface* network)
+{
+    bool result;
+
+    LogInfo("Getting time from the NTP server");
+
+    NTPClient ntp(network);
+    ntp.set_server(g_ntpServer, g_ntpPort);
+    time_t timestamp = ntp.get_timestamp();
+
+    g_timeSourceMutex.lock();
+
+    int64_t rtcNow = (int64_t)rtc_read();
+
+    if (timestamp < 0)
+    {
+        LogError("Failed to get the current time, error: %ld", (long)timestamp);
+
+        // Time must not go backwards for certificate checks; the last sync is a lower bound of the current time.
+        if (g_timeSourceRecordValid && (rtcNow < g_timeSourceRecord.lastSyncTime))
+        {
+            rtc_write((time_t)g_timeSourceRecord.lastSyncTime);
+            LogInfo("RTC moved forward to the time of the last NTP sync");
+        }
+        result = false;
+    }
+    else
+    {
+        int64_t ntpNow = (int64_t)timestamp;
+
+        // Refine the drift estimate if the RTC has been running undisturbed long enough since the last sync.
+        if (g_timeSourceRecordValid && ((ntpNow - g_timeSourceRecord.lastSyncTime) >= g_driftMinMeasureSecs) && (rtcNow >= g_timeSourceRecord.lastSyncTime))
+        {
+            int64_t rtcUncorrected = rtcNow - g_timeSourceRecord.rtcCorrection;
+            int32_t measuredPpm = (int32_t)(((rtcUncorrected - ntpNow) * 1000000) / (ntpNow - g_timeSourceRecord.lastSyncTime));
+
+            g_timeSourceRecord.driftPpm = (g_timeSourceRecord.driftPpm == 0) ? measuredPpm : ((g_timeSourceRecord.driftPpm * 3 + measuredPpm) / 4);
+        }
+        else if (g_timeSourceRecordValid == false)
+        {
+            g_timeSourceRecord.driftPpm = 0;
+        }
+
+        rtc_write(timestamp);
+        g_timeSourceRecord.lastSyncTime = ntpNow;
+        g_timeSourceRecord.rtcCorrection = 0;
+        StoreRecord();
+        g_timeSourceSynced = true;
+
+        LogInfo("Time: %s", ctime(&timestamp));
+        LogInfo("RTC drift estimate=%ld ppm", (long)g_timeSourceRecord.driftPpm);
+        result = true;
+    }
+
+    g_timeSourceMutex.unlock();
+
+    return result;
+}
+
+//
+// TimeSource_RefreshThread syncs time from NTP periodically
+//
+static void TimeSource_RefreshThread(NetworkInterface* network)
+{
+    // A boot trusting the RTC or failing NTP has not synced yet, so sync right away.
+    bool syncDue = (g_timeSourceSynced == false);
+
+    while (true)
+    {
+        if (syncDue == false)
+        {
+            ThisThread::sleep_for(g_ntpRefreshInterval);
+        }
+
+        if ((syncDue = (TimeSource_SyncFromNtp(network) == false)) == true)
+        {
+            ThisThread::sleep_for(g_ntpRetryInterval);
+        }
+    }
+}
+
+void TimeSource_StartBackgroundRefresh(NetworkInterface* network)
+{
+    static bool started = false;
+
+    if (started == false)
+    {
+        started = true;
+        g_timeSourceRefreshThread.start(callback(TimeSource_RefreshThread, network));
+    }
+}
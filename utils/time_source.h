@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2020, Nuvoton Technology Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// This header implements the time source of the device.  TLS needs the current time to check certificate validity.
+//
+// The time and RTC drift estimate of the last NTP sync are persisted in KVStore.  After a warm reset, the RTC has kept running
+// and is trusted (with drift compensated) so that boot does not block on NTP.  NTP is then refreshed in the background.
+
+#ifndef TIME_SOURCE_H
+#define TIME_SOURCE_H
+
+#include "mbed.h"
+
+//
+// TimeSource_RestoreFromRtc initializes the RTC and checks whether it can be trusted without NTP: the reset must be a warm one
+// and the RTC must not be earlier than the last NTP sync.  If so, the drift accumulated since the last sync is compensated.
+// This needs no network.  Returns whether the RTC is trusted.
+//
+bool TimeSource_RestoreFromRtc(void);
+
+//
+// TimeSource_SyncFromNtp gets the current time from the NTP server into the RTC, and refines the drift estimate.  This blocks.
+// If NTP fails and the RTC is earlier than the last sync, the RTC is moved forward to the time of the last sync as the best guess.
+// Returns whether the time was synced.
+//
+bool TimeSource_SyncFromNtp(NetworkInterface* network);
+
+//
+// TimeSource_StartBackgroundRefresh starts a low priority thread that syncs time from NTP periodically, or retries shortly
+// when the time has not been synced at all yet.  Call it once the network is up.
+//
+void TimeSource_StartBackgroundRefresh(NetworkInterface* network);
+
+#endif /* TIME_SOURCE_H */